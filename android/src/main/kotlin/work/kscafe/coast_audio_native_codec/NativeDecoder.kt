@@ -49,7 +49,7 @@ private val MediaFormat.lengthInFrames: Long?
   }
 
 public class NativeDecoder constructor(private val pClientData: Long) : MediaDataSource() {
-  private val extractor = MediaExtractor().also { it.setDataSource(this) }
+  private var extractor = MediaExtractor().also { it.setDataSource(this) }
 
   private lateinit var codec: MediaCodec
   private lateinit var trackFormat: MediaFormat
@@ -58,6 +58,9 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
 
   private val bufferInfo = MediaCodec.BufferInfo()
 
+  // Holds the frames of the last decode call until the native side copies them. Grown when a larger output buffer arrives.
+  private var decodedBuffer: ByteBuffer = ByteBuffer.allocateDirect(0)
+
   private var endOfFile = false
   private var bytesToCutAfterSeek = 0
 
@@ -74,7 +77,64 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
     return true
   }
 
+  // Reads a new source through the same data source. The codec is reconfigured instead of created when the new track has the same MIME type.
+  private fun reopen(): Boolean {
+    extractor.release()
+    extractor = MediaExtractor().also { it.setDataSource(this) }
+    endOfFile = false
+    bytesToCutAfterSeek = 0
+
+    if (!prepared) {
+      return prepare()
+    }
+
+    val trackIndex = findAudioTrack()
+    if (trackIndex == null) {
+      codec.release()
+      prepared = false
+      return false
+    }
+
+    val format = extractor.getTrackFormat(trackIndex)
+    try {
+      if (format.getString(MediaFormat.KEY_MIME) == trackFormat.getString(MediaFormat.KEY_MIME)) {
+        codec.stop()
+        codec.configure(format, null, null, 0)
+        codec.start()
+      } else {
+        codec.release()
+        codec = MediaCodec.createDecoderByType(format.getString(MediaFormat.KEY_MIME)!!)
+        codec.configure(format, null, null, 0)
+        codec.start()
+      }
+    } catch (e: Exception) {
+      codec.release()
+      prepared = false
+      return false
+    }
+
+    extractor.selectTrack(trackIndex)
+    trackFormat = format
+    outputFormat = codec.outputFormat
+    return true
+  }
+
   private fun createCodec(): Pair<MediaCodec, Int>? {
+    val trackIndex = findAudioTrack() ?: return null
+    val format = extractor.getTrackFormat(trackIndex)
+    val mime = format.getString(MediaFormat.KEY_MIME)!!
+    extractor.selectTrack(trackIndex)
+    try {
+      val codec = MediaCodec.createDecoderByType(mime)
+      codec.configure(format, null, null, 0)
+      codec.start()
+      return Pair(codec, trackIndex)
+    } catch (e: Exception) {
+      return null
+    }
+  }
+
+  private fun findAudioTrack(): Int? {
     // Check the source for valid audio content.
     val trackCount = extractor.trackCount
     if (trackCount <= 0) {
@@ -84,16 +144,7 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
     for (trackIndex in 0 until trackCount) {
       val format = extractor.getTrackFormat(trackIndex)
       if (format.containsKey(MediaFormat.KEY_MIME) && format.containsKey(MediaFormat.KEY_SAMPLE_RATE) && format.containsKey(MediaFormat.KEY_CHANNEL_COUNT)) {
-        val mime = format.getString(MediaFormat.KEY_MIME)!!
-        extractor.selectTrack(trackIndex)
-        try {
-          val codec = MediaCodec.createDecoderByType(mime)
-          codec.configure(format, null, null, 0)
-          codec.start()
-          return Pair(codec, trackIndex)
-        } catch (e: Exception) {
-          return null
-        }
+        return trackIndex
       }
     }
 
@@ -116,6 +167,21 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
     endOfFile = false
   }
 
+  // Seeks to the sync sample before the frame without cutting up to it. Returns the first frame decoded next.
+  private fun seekToSync(frameIndex: Long): Long {
+    val sampleRate = outputFormat.sampleRate
+
+    val timeUs = frameIndex.toDouble() / sampleRate.toDouble() * 1000000.0
+    extractor.seekTo(timeUs.toLong(), MediaExtractor.SEEK_TO_PREVIOUS_SYNC)
+
+    bytesToCutAfterSeek = 0
+    codec.flush()
+    endOfFile = false
+
+    val syncTimeUs = extractor.sampleTime
+    return if (syncTimeUs <= 0) 0 else (syncTimeUs.toDouble() / 1000000.0 * sampleRate).toLong()
+  }
+
   private fun extractNextSample(): Int? {
     val inputBufferIndex = codec.dequeueInputBuffer(0)
     if (inputBufferIndex < 0) {
@@ -157,12 +223,12 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
       } else { // Finish cutting.
         outputBuffer.position(bytesToCutAfterSeek)
 
-        copiedBuffer = ByteBuffer.allocateDirect(bytesRead)
+        copiedBuffer = takeDecodedBuffer(bytesRead)
         copiedBuffer.put(outputBuffer.slice())
         bytesToCutAfterSeek = 0
       }
     } else {
-      copiedBuffer = ByteBuffer.allocateDirect(bytesRead)
+      copiedBuffer = takeDecodedBuffer(bytesRead)
       copiedBuffer.put(outputBuffer)
     }
 
@@ -172,6 +238,14 @@ public class NativeDecoder constructor(private val pClientData: Long) : MediaDat
     return AudioBuffer(copiedBuffer, bytesRead / outputFormat.bytesPerFrame, isEOF)
   }
 
+  private fun takeDecodedBuffer(size: Int): ByteBuffer {
+    if (decodedBuffer.capacity() < size) {
+      decodedBuffer = ByteBuffer.allocateDirect(size)
+    }
+    decodedBuffer.clear()
+    return decodedBuffer
+  }
+
   private fun decodeNext(): AudioBuffer? {
     extractNextSample()
 
@@ -1,7 +1,59 @@
 // Relative import to be able to reuse the C sources.
 // See the comment in ../{projectName}}.podspec for more information.
 #include "../../src/darwin/audio_file_stream.h"
+#include "../../src/ca_arena.h"
+#include "../../src/ca_budget.h"
+#include "../../src/ca_channel_mixer.h"
+#include "../../src/ca_checkpoint.h"
+#include "../../src/ca_convert.h"
+#include "../../src/ca_cpu.h"
 #include "../../src/ca_decoder.h"
+#include "../../src/ca_decoder_async.h"
+#include "../../src/ca_decoder_pool.h"
+#include "../../src/ca_decoder_reverse.h"
+#include "../../src/ca_flac_decoder.h"
+#include "../../src/ca_frame_scan.h"
+#include "../../src/ca_io.h"
+#include "../../src/ca_metadata.h"
+#include "../../src/ca_mp3_decoder.h"
+#include "../../src/ca_mp4_index.h"
+#include "../../src/ca_pcm_cache.h"
+#include "../../src/ca_pcm_chunk.h"
+#include "../../src/ca_pcm_decoder.h"
+#include "../../src/ca_pcm_ring.h"
+#include "../../src/ca_playlist.h"
+#include "../../src/ca_resampler.h"
+#include "../../src/ca_segmented_decode.h"
+#include "../../src/ca_thread_pool.h"
+#include "../../src/ca_time.h"
+#include "../../src/ca_transcode.h"
 
 #include "../../src/darwin/audio_file_stream.c"
+#include "../../src/ca_arena.c"
+#include "../../src/ca_budget.c"
+#include "../../src/ca_channel_mixer.c"
+#include "../../src/ca_checkpoint.c"
+#include "../../src/ca_convert.c"
+#include "../../src/ca_cpu.c"
 #include "../../src/ca_decoder.c"
+#include "../../src/ca_decoder_async.c"
+#include "../../src/ca_decoder_output.c"
+#include "../../src/ca_decoder_pool.c"
+#include "../../src/ca_decoder_reverse.c"
+#include "../../src/ca_flac_decoder.c"
+#include "../../src/ca_frame_scan.c"
+#include "../../src/ca_io.c"
+#include "../../src/ca_metadata.c"
+#include "../../src/ca_miniaudio.c"
+#include "../../src/ca_mp3_decoder.c"
+#include "../../src/ca_mp4_index.c"
+#include "../../src/ca_pcm_cache.c"
+#include "../../src/ca_pcm_chunk.c"
+#include "../../src/ca_pcm_decoder.c"
+#include "../../src/ca_pcm_ring.c"
+#include "../../src/ca_playlist.c"
+#include "../../src/ca_resampler.c"
+#include "../../src/ca_segmented_decode.c"
+#include "../../src/ca_thread_pool.c"
+#include "../../src/ca_time.c"
+#include "../../src/ca_transcode.c"
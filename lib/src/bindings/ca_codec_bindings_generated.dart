@@ -27,6 +27,100 @@ class CaCodecBindings {
           lookup)
       : _lookup = lookup;
 
+  int ca_pcm_chunk_pool_init(
+    ffi.Pointer<ca_pcm_chunk_pool> pPool,
+    int idleCapacity,
+  ) {
+    return _ca_pcm_chunk_pool_init(
+      pPool,
+      idleCapacity,
+    );
+  }
+
+  late final _ca_pcm_chunk_pool_initPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_pcm_chunk_pool>,
+              ca_uint32)>>('ca_pcm_chunk_pool_init');
+  late final _ca_pcm_chunk_pool_init = _ca_pcm_chunk_pool_initPtr
+      .asFunction<int Function(ffi.Pointer<ca_pcm_chunk_pool>, int)>();
+
+  ffi.Pointer<ca_pcm_chunk> ca_pcm_chunk_pool_acquire(
+    ffi.Pointer<ca_pcm_chunk_pool> pPool,
+    int sizeInBytes,
+  ) {
+    return _ca_pcm_chunk_pool_acquire(
+      pPool,
+      sizeInBytes,
+    );
+  }
+
+  late final _ca_pcm_chunk_pool_acquirePtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Pointer<ca_pcm_chunk> Function(ffi.Pointer<ca_pcm_chunk_pool>,
+              ca_uint32)>>('ca_pcm_chunk_pool_acquire');
+  late final _ca_pcm_chunk_pool_acquire =
+      _ca_pcm_chunk_pool_acquirePtr.asFunction<
+          ffi.Pointer<ca_pcm_chunk> Function(
+              ffi.Pointer<ca_pcm_chunk_pool>, int)>();
+
+  int ca_pcm_chunk_pool_get_size_in_bytes(
+    ffi.Pointer<ca_pcm_chunk_pool> pPool,
+  ) {
+    return _ca_pcm_chunk_pool_get_size_in_bytes(
+      pPool,
+    );
+  }
+
+  late final _ca_pcm_chunk_pool_get_size_in_bytesPtr = _lookup<
+          ffi
+          .NativeFunction<ca_uint64 Function(ffi.Pointer<ca_pcm_chunk_pool>)>>(
+      'ca_pcm_chunk_pool_get_size_in_bytes');
+  late final _ca_pcm_chunk_pool_get_size_in_bytes =
+      _ca_pcm_chunk_pool_get_size_in_bytesPtr
+          .asFunction<int Function(ffi.Pointer<ca_pcm_chunk_pool>)>();
+
+  void ca_pcm_chunk_pool_uninit(
+    ffi.Pointer<ca_pcm_chunk_pool> pPool,
+  ) {
+    return _ca_pcm_chunk_pool_uninit(
+      pPool,
+    );
+  }
+
+  late final _ca_pcm_chunk_pool_uninitPtr = _lookup<
+          ffi.NativeFunction<ffi.Void Function(ffi.Pointer<ca_pcm_chunk_pool>)>>(
+      'ca_pcm_chunk_pool_uninit');
+  late final _ca_pcm_chunk_pool_uninit = _ca_pcm_chunk_pool_uninitPtr
+      .asFunction<void Function(ffi.Pointer<ca_pcm_chunk_pool>)>();
+
+  void ca_pcm_chunk_retain(
+    ffi.Pointer<ca_pcm_chunk> pChunk,
+  ) {
+    return _ca_pcm_chunk_retain(
+      pChunk,
+    );
+  }
+
+  late final _ca_pcm_chunk_retainPtr =
+      _lookup<ffi.NativeFunction<ffi.Void Function(ffi.Pointer<ca_pcm_chunk>)>>(
+          'ca_pcm_chunk_retain');
+  late final _ca_pcm_chunk_retain = _ca_pcm_chunk_retainPtr
+      .asFunction<void Function(ffi.Pointer<ca_pcm_chunk>)>();
+
+  void ca_pcm_chunk_release(
+    ffi.Pointer<ca_pcm_chunk> pChunk,
+  ) {
+    return _ca_pcm_chunk_release(
+      pChunk,
+    );
+  }
+
+  late final _ca_pcm_chunk_releasePtr =
+      _lookup<ffi.NativeFunction<ffi.Void Function(ffi.Pointer<ca_pcm_chunk>)>>(
+          'ca_pcm_chunk_release');
+  late final _ca_pcm_chunk_release = _ca_pcm_chunk_releasePtr
+      .asFunction<void Function(ffi.Pointer<ca_pcm_chunk>)>();
+
   ca_decoder_config ca_decoder_config_init() {
     return _ca_decoder_config_init();
   }
@@ -77,6 +171,34 @@ class CaCodecBindings {
           ca_decoder_decoded_proc,
           ffi.Pointer<ffi.Void>)>();
 
+  int ca_decoder_reinit(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ca_decoder_read_proc pReadProc,
+    ca_decoder_seek_proc pSeekProc,
+    ca_decoder_tell_proc pTellProc,
+    ffi.Pointer<ffi.Void> pUserData,
+  ) {
+    return _ca_decoder_reinit(
+      pDecoder,
+      pReadProc,
+      pSeekProc,
+      pTellProc,
+      pUserData,
+    );
+  }
+
+  late final _ca_decoder_reinitPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(
+              ffi.Pointer<ca_decoder>,
+              ca_decoder_read_proc,
+              ca_decoder_seek_proc,
+              ca_decoder_tell_proc,
+              ffi.Pointer<ffi.Void>)>>('ca_decoder_reinit');
+  late final _ca_decoder_reinit = _ca_decoder_reinitPtr.asFunction<
+      int Function(ffi.Pointer<ca_decoder>, ca_decoder_read_proc,
+          ca_decoder_seek_proc, ca_decoder_tell_proc, ffi.Pointer<ffi.Void>)>();
+
   int ca_decoder_decode_next(
     ffi.Pointer<ca_decoder> pDecoder,
   ) {
@@ -91,6 +213,25 @@ class CaCodecBindings {
   late final _ca_decoder_decode_next = _ca_decoder_decode_nextPtr
       .asFunction<int Function(ffi.Pointer<ca_decoder>)>();
 
+  int ca_decoder_decode_budget(
+    ffi.Pointer<ca_decoder> pDecoder,
+    int maxFrames,
+    int maxMicros,
+  ) {
+    return _ca_decoder_decode_budget(
+      pDecoder,
+      maxFrames,
+      maxMicros,
+    );
+  }
+
+  late final _ca_decoder_decode_budgetPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>, ca_uint32,
+              ca_uint64)>>('ca_decoder_decode_budget');
+  late final _ca_decoder_decode_budget = _ca_decoder_decode_budgetPtr
+      .asFunction<int Function(ffi.Pointer<ca_decoder>, int, int)>();
+
   int ca_decoder_seek(
     ffi.Pointer<ca_decoder> pDecoder,
     int frameIndex,
@@ -108,6 +249,136 @@ class CaCodecBindings {
   late final _ca_decoder_seek = _ca_decoder_seekPtr
       .asFunction<int Function(ffi.Pointer<ca_decoder>, int)>();
 
+  int ca_decoder_seek_with_flags(
+    ffi.Pointer<ca_decoder> pDecoder,
+    int frameIndex,
+    int flags,
+  ) {
+    return _ca_decoder_seek_with_flags(
+      pDecoder,
+      frameIndex,
+      flags,
+    );
+  }
+
+  late final _ca_decoder_seek_with_flagsPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>, ca_uint64,
+              ffi.Int32)>>('ca_decoder_seek_with_flags');
+  late final _ca_decoder_seek_with_flags = _ca_decoder_seek_with_flagsPtr
+      .asFunction<int Function(ffi.Pointer<ca_decoder>, int, int)>();
+
+  int ca_decoder_request_seek(
+    ffi.Pointer<ca_decoder> pDecoder,
+    int frameIndex,
+    int flags,
+    ffi.Pointer<ca_uint64> pGeneration,
+  ) {
+    return _ca_decoder_request_seek(
+      pDecoder,
+      frameIndex,
+      flags,
+      pGeneration,
+    );
+  }
+
+  late final _ca_decoder_request_seekPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>, ca_uint64, ffi.Int32,
+              ffi.Pointer<ca_uint64>)>>('ca_decoder_request_seek');
+  late final _ca_decoder_request_seek = _ca_decoder_request_seekPtr.asFunction<
+      int Function(
+          ffi.Pointer<ca_decoder>, int, int, ffi.Pointer<ca_uint64>)>();
+
+  int ca_decoder_refine_seek(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ffi.Pointer<ca_uint64> pGeneration,
+  ) {
+    return _ca_decoder_refine_seek(
+      pDecoder,
+      pGeneration,
+    );
+  }
+
+  late final _ca_decoder_refine_seekPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>,
+              ffi.Pointer<ca_uint64>)>>('ca_decoder_refine_seek');
+  late final _ca_decoder_refine_seek = _ca_decoder_refine_seekPtr.asFunction<
+      int Function(ffi.Pointer<ca_decoder>, ffi.Pointer<ca_uint64>)>();
+
+  int ca_decoder_get_scrub_stats(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ffi.Pointer<ca_decoder_scrub_stats> pStats,
+  ) {
+    return _ca_decoder_get_scrub_stats(
+      pDecoder,
+      pStats,
+    );
+  }
+
+  late final _ca_decoder_get_scrub_statsPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>,
+              ffi.Pointer<ca_decoder_scrub_stats>)>>('ca_decoder_get_scrub_stats');
+  late final _ca_decoder_get_scrub_stats =
+      _ca_decoder_get_scrub_statsPtr.asFunction<
+          int Function(
+              ffi.Pointer<ca_decoder>, ffi.Pointer<ca_decoder_scrub_stats>)>();
+
+  int ca_decoder_get_pcm_cache_stats(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ffi.Pointer<ca_decoder_pcm_cache_stats> pStats,
+  ) {
+    return _ca_decoder_get_pcm_cache_stats(
+      pDecoder,
+      pStats,
+    );
+  }
+
+  late final _ca_decoder_get_pcm_cache_statsPtr = _lookup<
+          ffi.NativeFunction<
+              ffi.Int32 Function(ffi.Pointer<ca_decoder>,
+                  ffi.Pointer<ca_decoder_pcm_cache_stats>)>>(
+      'ca_decoder_get_pcm_cache_stats');
+  late final _ca_decoder_get_pcm_cache_stats =
+      _ca_decoder_get_pcm_cache_statsPtr.asFunction<
+          int Function(ffi.Pointer<ca_decoder>,
+              ffi.Pointer<ca_decoder_pcm_cache_stats>)>();
+
+  int ca_decoder_get_memory_usage(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ffi.Pointer<ca_uint64> pSizeInBytes,
+  ) {
+    return _ca_decoder_get_memory_usage(
+      pDecoder,
+      pSizeInBytes,
+    );
+  }
+
+  late final _ca_decoder_get_memory_usagePtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>,
+              ffi.Pointer<ca_uint64>)>>('ca_decoder_get_memory_usage');
+  late final _ca_decoder_get_memory_usage =
+      _ca_decoder_get_memory_usagePtr.asFunction<
+          int Function(ffi.Pointer<ca_decoder>, ffi.Pointer<ca_uint64>)>();
+
+  int ca_decoder_get_seek_generation(
+    ffi.Pointer<ca_decoder> pDecoder,
+  ) {
+    return _ca_decoder_get_seek_generation(
+      pDecoder,
+    );
+  }
+
+  late final _ca_decoder_get_seek_generationPtr = _lookup<
+          ffi.NativeFunction<ca_uint64 Function(ffi.Pointer<ca_decoder>)>>(
+      'ca_decoder_get_seek_generation');
+  late final _ca_decoder_get_seek_generation =
+      _ca_decoder_get_seek_generationPtr
+          .asFunction<int Function(ffi.Pointer<ca_decoder>)>();
+
   int ca_decoder_get_eof(
     ffi.Pointer<ca_decoder> pDecoder,
     ffi.Pointer<ca_bool> pIsEOF,
@@ -142,6 +413,26 @@ class CaCodecBindings {
   late final _ca_decoder_get_format = _ca_decoder_get_formatPtr.asFunction<
       int Function(ffi.Pointer<ca_decoder>, ffi.Pointer<ca_audio_format>)>();
 
+  /// Sets pIsSampleExact when exact seeks land on the target frame and decode the same samples as a sequential decode, which holds for the streams read natively.
+  /// Platform codecs can start a few frames off and depend on the packets decoded before the seek.
+  int ca_decoder_get_is_sample_exact(
+    ffi.Pointer<ca_decoder> pDecoder,
+    ffi.Pointer<ca_bool> pIsSampleExact,
+  ) {
+    return _ca_decoder_get_is_sample_exact(
+      pDecoder,
+      pIsSampleExact,
+    );
+  }
+
+  late final _ca_decoder_get_is_sample_exactPtr = _lookup<
+      ffi.NativeFunction<
+          ffi.Int32 Function(ffi.Pointer<ca_decoder>,
+              ffi.Pointer<ca_bool>)>>('ca_decoder_get_is_sample_exact');
+  late final _ca_decoder_get_is_sample_exact =
+      _ca_decoder_get_is_sample_exactPtr.asFunction<
+          int Function(ffi.Pointer<ca_decoder>, ffi.Pointer<ca_bool>)>();
+
   int ca_decoder_uninit(
     ffi.Pointer<ca_decoder> pDecoder,
   ) {
@@ -157,6 +448,31 @@ class CaCodecBindings {
       _ca_decoder_uninitPtr.asFunction<int Function(ffi.Pointer<ca_decoder>)>();
 }
 
+final class ca_pcm_chunk_pool extends ffi.Struct {
+  external ffi.Pointer<ffi.Void> pData;
+}
+
+final class ca_pcm_chunk extends ffi.Struct {
+  @ffi.Int32()
+  external int sampleFormat;
+
+  @ca_uint32()
+  external int channels;
+
+  @ca_uint32()
+  external int sampleRate;
+
+  @ca_uint64()
+  external int frameIndex;
+
+  @ca_uint32()
+  external int frameCount;
+
+  external ffi.Pointer<ffi.Void> pFrames;
+
+  external ffi.Pointer<ffi.Void> pData;
+}
+
 abstract class ca_result {
   static const int ca_result_success = 0;
   static const int ca_result_invalid_args = -1;
@@ -165,6 +481,9 @@ abstract class ca_result {
   static const int ca_result_tell_failed = -4;
   static const int ca_result_not_initialized = -5;
   static const int ca_result_unsupported_format = -6;
+  static const int ca_result_write_failed = -7;
+  static const int ca_result_out_of_memory = -8;
+  static const int ca_result_budget_exceeded = -9;
   static const int ca_result_unknown_failed = -1000;
 }
 
@@ -195,6 +514,23 @@ abstract class ca_sample_format {
   static const int ca_sample_format_f32 = 5;
 }
 
+abstract class ca_resampler_quality {
+  static const int ca_resampler_quality_low = 0;
+  static const int ca_resampler_quality_medium = 1;
+  static const int ca_resampler_quality_high = 2;
+  static const int ca_resampler_quality_best = 3;
+}
+
+abstract class ca_dither_mode {
+  static const int ca_dither_mode_none = 0;
+  static const int ca_dither_mode_triangle = 1;
+}
+
+abstract class ca_channel_mix_mode {
+  static const int ca_channel_mix_mode_itu = 0;
+  static const int ca_channel_mix_mode_custom = 1;
+}
+
 final class ca_audio_format extends ffi.Struct {
   @ca_uint32()
   external int channels;
@@ -227,8 +563,67 @@ abstract class ca_seek_origin {
 final class ca_decoder_config extends ffi.Struct {
   @ffi.Int()
   external int appleFileTypeHint;
+
+  @ffi.Int32()
+  external int outputSampleFormat;
+
+  @ffi.Int32()
+  external int ditherMode;
+
+  @ca_uint32()
+  external int outputSampleRate;
+
+  @ffi.Int32()
+  external int resamplerQuality;
+
+  external ca_decoder_decoded_planar_proc pDecodedPlanarProc;
+
+  @ca_uint32()
+  external int planarAlignment;
+
+  external ca_decoder_decoded_chunk_proc pDecodedChunkProc;
+
+  @ca_uint32()
+  external int outputChannels;
+
+  @ffi.Int32()
+  external int channelMixMode;
+
+  external ffi.Pointer<ffi.Float> pChannelMixMatrix;
+
+  @ca_uint32()
+  external int channelMixMatrixChannelsIn;
+
+  @ca_bool()
+  external int isPortableBackendDisabled;
+
+  @ca_bool()
+  external int isSeekTableDisabled;
+
+  @ca_uint32()
+  external int decodeThreadCount;
+
+  @ca_uint32()
+  external int checkpointCount;
+
+  @ca_uint32()
+  external int checkpointIntervalMillis;
+
+  @ca_uint64()
+  external int pcmCacheSizeInBytes;
 }
 
+typedef ca_decoder_decoded_planar_proc = ffi.Pointer<
+    ffi.NativeFunction<
+        ffi.Void Function(
+            ca_uint32 frameCount,
+            ffi.Pointer<ffi.Pointer<ffi.Void>> ppChannels,
+            ffi.Pointer<ffi.Void> pUserData)>>;
+typedef ca_decoder_decoded_chunk_proc = ffi.Pointer<
+    ffi.NativeFunction<
+        ffi.Void Function(
+            ffi.Pointer<ca_pcm_chunk> pChunk, ffi.Pointer<ffi.Void> pUserData)>>;
+
 final class ca_decoder extends ffi.Struct {
   external ffi.Pointer<ffi.Void> pDecoder;
 
@@ -257,6 +652,45 @@ typedef ca_decoder_decoded_proc = ffi.Pointer<
             ffi.Pointer<ffi.Void> pUserData)>>;
 typedef ca_bool = ffi.Int;
 
+abstract class ca_decoder_seek_flags {
+  static const int ca_decoder_seek_flag_none = 0;
+  static const int ca_decoder_seek_flag_scrub = 1;
+}
+
+final class ca_decoder_scrub_stats extends ffi.Struct {
+  @ca_uint64()
+  external int targetFrame;
+
+  @ca_uint64()
+  external int startFrame;
+
+  @ca_uint64()
+  external int lastLatencyMicros;
+
+  @ca_uint64()
+  external int maxLatencyMicros;
+
+  @ca_uint64()
+  external int scrubCount;
+}
+
+final class ca_decoder_pcm_cache_stats extends ffi.Struct {
+  @ca_uint64()
+  external int hitCount;
+
+  @ca_uint64()
+  external int missCount;
+
+  @ca_uint64()
+  external int servedFrameCount;
+
+  @ca_uint64()
+  external int cachedFrameCount;
+
+  @ca_uint64()
+  external int sizeInBytes;
+}
+
 const int CA_TRUE = 1;
 
 const int CA_FALSE = 0;
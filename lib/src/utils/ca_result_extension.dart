@@ -25,6 +25,12 @@ extension CaResultExtenson on int {
         return 'ca_result_not_initialized';
       case ca_result.ca_result_unsupported_format:
         return 'ca_result_unsupported_format';
+      case ca_result.ca_result_write_failed:
+        return 'ca_result_write_failed';
+      case ca_result.ca_result_out_of_memory:
+        return 'ca_result_out_of_memory';
+      case ca_result.ca_result_budget_exceeded:
+        return 'ca_result_budget_exceeded';
       case ca_result.ca_result_unknown_failed:
         return 'ca_result_unknown_failed';
       default:
@@ -3,7 +3,9 @@
 //
 #include "native_decoder.h"
 #include "../ca_decoder.h"
+#include "../ca_time.h"
 #include <jni.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,6 +16,24 @@ JavaVM *jvm = NULL;
 jobject classLoader;
 jmethodID loadClassMethod;
 
+// Set on threads attached by get_jni_env, so they detach when they exit. ART aborts when an attached native thread exits.
+static pthread_key_t attachedThreadKey;
+static pthread_once_t attachedThreadKeyOnce = PTHREAD_ONCE_INIT;
+
+static void detach_thread(void *pValue)
+{
+  (void)pValue;
+  if (jvm != NULL)
+  {
+    (*jvm)->DetachCurrentThread(jvm);
+  }
+}
+
+static void create_attached_thread_key()
+{
+  pthread_key_create(&attachedThreadKey, detach_thread);
+}
+
 ca_result get_jni_env(JNIEnv **env)
 {
   if (jvm == NULL)
@@ -23,7 +43,13 @@ ca_result get_jni_env(JNIEnv **env)
 
   if ((*jvm)->GetEnv(jvm, env, JNI_VERSION_1_6) == JNI_EDETACHED)
   {
-    return (*jvm)->AttachCurrentThread(jvm, env, NULL) == JNI_OK ? ca_result_success : ca_result_unknown_failed;
+    if ((*jvm)->AttachCurrentThread(jvm, env, NULL) != JNI_OK)
+    {
+      return ca_result_unknown_failed;
+    }
+
+    pthread_once(&attachedThreadKeyOnce, create_attached_thread_key);
+    pthread_setspecific(attachedThreadKey, *env);
   }
 
   return ca_result_success;
@@ -192,6 +218,33 @@ ca_result native_decoder_init(native_decoder *pDecoder, ca_decoder_config config
   return ca_result_success;
 }
 
+ca_result native_decoder_reopen(native_decoder *pDecoder, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc)
+{
+  JNIEnv *env;
+  ca_result result = get_jni_env(&env);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  native_decoder_data *pData = (native_decoder_data *)pDecoder->pData;
+  pData->readFunc = pReadProc;
+  pData->seekFunc = pSeekProc;
+  pData->tellFunc = pTellProc;
+
+  jclass decoderClass = load_class(env, DECODER_CLASS_NAME);
+  jmethodID reopenMethod = (*env)->GetMethodID(env, decoderClass, "reopen", "()Z");
+  jboolean reopened = (*env)->CallBooleanMethod(env, pData->decoder, reopenMethod);
+
+  if ((*env)->ExceptionCheck(env))
+  {
+    (*env)->ExceptionClear(env);
+    return ca_result_unknown_failed;
+  }
+
+  return reopened ? ca_result_success : ca_result_unsupported_format;
+}
+
 ca_result native_decoder_get_format(native_decoder *pDecoder, ca_audio_format *pFormat)
 {
   JNIEnv *env;
@@ -204,8 +257,8 @@ ca_result native_decoder_get_format(native_decoder *pDecoder, ca_audio_format *p
   native_decoder_data *pData = (native_decoder_data *)pDecoder->pData;
   jclass decoderClass = load_class(env, DECODER_CLASS_NAME);
 
-  native_audio_format *pNativeFormat = (native_audio_format *)malloc(sizeof(native_audio_format));
-  jobject byteBuffer = (*env)->NewDirectByteBuffer(env, pNativeFormat, sizeof(native_audio_format));
+  native_audio_format nativeFormat;
+  jobject byteBuffer = (*env)->NewDirectByteBuffer(env, &nativeFormat, sizeof(native_audio_format));
   jmethodID getFormatMethod = (*env)->GetMethodID(env, decoderClass, "getOutputNativeAudioFormat", "(Ljava/nio/ByteBuffer;)V");
   (*env)->CallVoidMethod(env, pData->decoder, getFormatMethod, byteBuffer);
 
@@ -215,17 +268,15 @@ ca_result native_decoder_get_format(native_decoder *pDecoder, ca_audio_format *p
     return ca_result_unknown_failed;
   }
 
-  pFormat->channels = pNativeFormat->channels;
-  pFormat->sample_rate = pNativeFormat->sample_rate;
-  pFormat->sample_foramt = pNativeFormat->sample_format;
-  pFormat->length = (ca_uint64)pNativeFormat->length;
-
-  free(pNativeFormat);
+  pFormat->channels = nativeFormat.channels;
+  pFormat->sample_rate = nativeFormat.sample_rate;
+  pFormat->sample_foramt = nativeFormat.sample_format;
+  pFormat->length = (ca_uint64)nativeFormat.length;
 
   return ca_result_success;
 }
 
-ca_result native_decoder_decode_next(native_decoder *pDecoder)
+ca_result native_decoder_decode_next(native_decoder *pDecoder, ca_uint64 deadlineMicros)
 {
   JNIEnv *env;
   ca_result result = get_jni_env(&env);
@@ -240,11 +291,17 @@ ca_result native_decoder_decode_next(native_decoder *pDecoder)
 
   jmethodID decodeNextMethod = (*env)->GetMethodID(env, decoderClass, "decodeNext", "()Lwork/kscafe/coast_audio_native_codec/AudioBuffer;");
   jobject audioBuffer = (*env)->CallObjectMethod(env, pData->decoder, decodeNextMethod);
-  while (audioBuffer == NULL)
+  while (audioBuffer == NULL && ca_get_time_micros() < deadlineMicros)
   {
     audioBuffer = (*env)->CallObjectMethod(env, pData->decoder, decodeNextMethod);
   }
 
+  // The codec keeps the queued input, so the next call continues where this one stopped.
+  if (audioBuffer == NULL)
+  {
+    return ca_result_success;
+  }
+
   jfieldID bufferField = (*env)->GetFieldID(env, audioBufferClass, "buffer", "Ljava/nio/ByteBuffer;");
   jobject buffer = (*env)->GetObjectField(env, audioBuffer, bufferField);
 
@@ -280,6 +337,30 @@ ca_result native_decoder_seek(native_decoder *pDecoder, ca_uint64 frameIndex)
   return ca_result_success;
 }
 
+ca_result native_decoder_seek_sync(native_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex)
+{
+  JNIEnv *env;
+  ca_result result = get_jni_env(&env);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  native_decoder_data *pData = (native_decoder_data *)pDecoder->pData;
+  jclass decoderClass = load_class(env, DECODER_CLASS_NAME);
+  jmethodID seekMethod = (*env)->GetMethodID(env, decoderClass, "seekToSync", "(J)J");
+  jlong syncFrameIndex = (*env)->CallLongMethod(env, pData->decoder, seekMethod, frameIndex);
+
+  if ((*env)->ExceptionCheck(env))
+  {
+    (*env)->ExceptionClear(env);
+    return ca_result_unknown_failed;
+  }
+
+  *pFrameIndex = (ca_uint64)syncFrameIndex;
+  return ca_result_success;
+}
+
 ca_result native_decoder_get_eof(native_decoder *pDecoder, ca_bool *pIsEOF)
 {
   JNIEnv *env;
@@ -15,12 +15,19 @@ JNIEXPORT void JNI_OnUnload(JavaVM *vm, void *reserved);
 
 ca_result native_decoder_init(native_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
 
+// Switches the decoder to a new source read with the given procs. The codec is kept when the new track has the same MIME type.
+ca_result native_decoder_reopen(native_decoder *pDecoder, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc);
+
 ca_result native_decoder_get_format(native_decoder *pDecoder, ca_audio_format *pFormat);
 
-ca_result native_decoder_decode_next(native_decoder *pDecoder);
+// Returns without delivering frames when the codec has no output before deadlineMicros of ca_get_time_micros.
+ca_result native_decoder_decode_next(native_decoder *pDecoder, ca_uint64 deadlineMicros);
 
 ca_result native_decoder_seek(native_decoder *pDecoder, ca_uint64 frameIndex);
 
+// Seeks the extractor to the sync sample before frameIndex and keeps the frames before the target. pFrameIndex receives the first frame decoded next.
+ca_result native_decoder_seek_sync(native_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex);
+
 ca_result native_decoder_get_eof(native_decoder *pDecoder, ca_bool *pIsEOF);
 
 ca_result native_decoder_uninit(native_decoder *pDecoder);
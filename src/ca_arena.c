@@ -0,0 +1,102 @@
+#include "ca_arena.h"
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// Blocks are chained newest first. The allocations follow the header.
+typedef struct ca_arena_block
+{
+  struct ca_arena_block *pNext;
+  size_t capacity;
+  size_t used;
+} ca_arena_block;
+
+#define ARENA_HEADER_SIZE ((sizeof(ca_arena_block) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static ca_arena_block *ca_arena_block_alloc(size_t capacity)
+{
+  ca_arena_block *pBlock = (ca_arena_block *)malloc(ARENA_HEADER_SIZE + capacity);
+  if (pBlock == NULL)
+  {
+    return NULL;
+  }
+
+  pBlock->pNext = NULL;
+  pBlock->capacity = capacity;
+  pBlock->used = 0;
+  return pBlock;
+}
+
+ca_result ca_arena_init(ca_arena *pArena, size_t blockSize)
+{
+  pArena->blockSize = blockSize == 0 ? ARENA_DEFAULT_BLOCK_SIZE : blockSize;
+  pArena->pBlocks = ca_arena_block_alloc(pArena->blockSize);
+  return pArena->pBlocks == NULL ? ca_result_out_of_memory : ca_result_success;
+}
+
+void *ca_arena_alloc(ca_arena *pArena, size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+  ca_arena_block *pBlock = (ca_arena_block *)pArena->pBlocks;
+  if (pBlock != NULL && pBlock->capacity - pBlock->used >= size)
+  {
+    void *p = (ca_uint8 *)pBlock + ARENA_HEADER_SIZE + pBlock->used;
+    pBlock->used += size;
+    return p;
+  }
+
+  // Oversized requests are chained behind the current block, so it keeps serving small requests.
+  ca_bool isOversized = size > pArena->blockSize / 2;
+  ca_arena_block *pNewBlock = ca_arena_block_alloc(isOversized ? size : pArena->blockSize);
+  if (pNewBlock == NULL)
+  {
+    return NULL;
+  }
+
+  pNewBlock->used = size;
+  if (isOversized && pBlock != NULL)
+  {
+    pNewBlock->pNext = pBlock->pNext;
+    pBlock->pNext = pNewBlock;
+  }
+  else
+  {
+    pNewBlock->pNext = pBlock;
+    pArena->pBlocks = pNewBlock;
+  }
+  return (ca_uint8 *)pNewBlock + ARENA_HEADER_SIZE;
+}
+
+void ca_arena_reset(ca_arena *pArena)
+{
+  ca_arena_block *pBlock = (ca_arena_block *)pArena->pBlocks;
+  if (pBlock == NULL)
+  {
+    return;
+  }
+
+  // The head is always a regular block since oversized ones are chained behind it.
+  ca_arena_block *pNext = pBlock->pNext;
+  while (pNext != NULL)
+  {
+    ca_arena_block *pFree = pNext;
+    pNext = pNext->pNext;
+    free(pFree);
+  }
+
+  pBlock->pNext = NULL;
+  pBlock->used = 0;
+}
+
+void ca_arena_uninit(ca_arena *pArena)
+{
+  ca_arena_block *pBlock = (ca_arena_block *)pArena->pBlocks;
+  while (pBlock != NULL)
+  {
+    ca_arena_block *pNext = pBlock->pNext;
+    free(pBlock);
+    pBlock = pNext;
+  }
+  pArena->pBlocks = NULL;
+}
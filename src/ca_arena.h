@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ca_defs.h"
+#include <stddef.h>
+
+// A bump allocator for short-lived allocations which are released together.
+// Requests are served from blocks of blockSize bytes. Larger requests get a block of their own.
+typedef struct
+{
+  size_t blockSize;
+  void *pBlocks;
+} ca_arena;
+
+FFI_PLUGIN_EXPORT ca_result ca_arena_init(ca_arena *pArena, size_t blockSize);
+
+// Returns size bytes aligned to 16 bytes, or NULL when out of memory.
+FFI_PLUGIN_EXPORT void *ca_arena_alloc(ca_arena *pArena, size_t size);
+
+// Releases every allocation at once. The first block is kept for the next use.
+FFI_PLUGIN_EXPORT void ca_arena_reset(ca_arena *pArena);
+
+FFI_PLUGIN_EXPORT void ca_arena_uninit(ca_arena *pArena);
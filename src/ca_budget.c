@@ -0,0 +1,180 @@
+#include "ca_budget.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  ca_uint64 maxSizeInBytes;
+  ca_uint32 maxDecoderCount;
+  ca_budget_usage usage;
+
+  // Raised by each trim so accounts notice it with one atomic load. Starts at one so a zeroed account can tell it has not polled yet.
+  _Atomic ca_uint64 trimGeneration;
+  ca_trim_level trimLevel;
+} ca_budget_state;
+
+static ca_budget_state budget = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .trimGeneration = 1,
+};
+
+// Called with the lock held.
+static void ca_budget_post_trim(ca_trim_level level)
+{
+  budget.trimLevel = level;
+  budget.usage.trimCount++;
+  atomic_fetch_add_explicit(&budget.trimGeneration, 1, memory_order_release);
+}
+
+static ca_bool ca_budget_is_over(ca_uint64 sizeInBytes)
+{
+  return budget.maxSizeInBytes > 0 && sizeInBytes >= budget.maxSizeInBytes;
+}
+
+FFI_PLUGIN_EXPORT void ca_budget_set_limits(ca_uint64 maxSizeInBytes, ca_uint32 maxDecoderCount)
+{
+  pthread_mutex_lock(&budget.lock);
+  budget.maxSizeInBytes = maxSizeInBytes;
+  budget.maxDecoderCount = maxDecoderCount;
+  if (ca_budget_is_over(budget.usage.sizeInBytes) && budget.usage.optionalSizeInBytes > 0)
+  {
+    ca_budget_post_trim(ca_trim_level_moderate);
+  }
+  pthread_mutex_unlock(&budget.lock);
+}
+
+FFI_PLUGIN_EXPORT void ca_budget_get_usage(ca_budget_usage *pUsage)
+{
+  pthread_mutex_lock(&budget.lock);
+  *pUsage = budget.usage;
+  pthread_mutex_unlock(&budget.lock);
+}
+
+FFI_PLUGIN_EXPORT void ca_trim_memory(ca_trim_level level)
+{
+  pthread_mutex_lock(&budget.lock);
+  ca_budget_post_trim(level);
+  pthread_mutex_unlock(&budget.lock);
+}
+
+// MARK: Accounts
+
+ca_result ca_budget_open_decoder(ca_budget_account *pAccount)
+{
+  pthread_mutex_lock(&budget.lock);
+  ca_uint64 requiredSizeInBytes = budget.usage.sizeInBytes - budget.usage.optionalSizeInBytes;
+  if ((budget.maxDecoderCount > 0 && budget.usage.decoderCount >= budget.maxDecoderCount) || ca_budget_is_over(requiredSizeInBytes))
+  {
+    budget.usage.refusedDecoderCount++;
+    pthread_mutex_unlock(&budget.lock);
+    return ca_result_budget_exceeded;
+  }
+
+  // Caches make room for the new decoder instead of refusing it.
+  if (ca_budget_is_over(budget.usage.sizeInBytes))
+  {
+    ca_budget_post_trim(ca_trim_level_moderate);
+  }
+
+  budget.usage.decoderCount++;
+  pAccount->isDecoder = CA_TRUE;
+  pAccount->trimGeneration = atomic_load_explicit(&budget.trimGeneration, memory_order_relaxed);
+  pthread_mutex_unlock(&budget.lock);
+  return ca_result_success;
+}
+
+ca_bool ca_budget_has_room()
+{
+  pthread_mutex_lock(&budget.lock);
+  ca_bool hasRoom = (budget.maxDecoderCount == 0 || budget.usage.decoderCount < budget.maxDecoderCount) && !ca_budget_is_over(budget.usage.sizeInBytes);
+  pthread_mutex_unlock(&budget.lock);
+  return hasRoom;
+}
+
+void ca_budget_set_size(ca_budget_account *pAccount, ca_uint64 sizeInBytes)
+{
+  if (sizeInBytes == pAccount->sizeInBytes)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&budget.lock);
+  budget.usage.sizeInBytes = budget.usage.sizeInBytes - pAccount->sizeInBytes + sizeInBytes;
+  pthread_mutex_unlock(&budget.lock);
+  pAccount->sizeInBytes = sizeInBytes;
+}
+
+ca_uint64 ca_budget_get_available()
+{
+  pthread_mutex_lock(&budget.lock);
+  ca_uint64 availableBytes = budget.maxSizeInBytes == 0 ? ~(ca_uint64)0 : budget.maxSizeInBytes - ca_min(budget.usage.sizeInBytes, budget.maxSizeInBytes);
+  pthread_mutex_unlock(&budget.lock);
+  return availableBytes;
+}
+
+ca_bool ca_budget_reserve(ca_budget_account *pAccount, ca_uint64 sizeInBytes)
+{
+  pthread_mutex_lock(&budget.lock);
+  ca_bool isReserved = budget.maxSizeInBytes == 0 || budget.usage.sizeInBytes + sizeInBytes <= budget.maxSizeInBytes;
+  if (isReserved)
+  {
+    budget.usage.sizeInBytes += sizeInBytes;
+    budget.usage.optionalSizeInBytes += sizeInBytes;
+  }
+  else
+  {
+    budget.usage.refusedOptionalCount++;
+  }
+  pthread_mutex_unlock(&budget.lock);
+
+  if (isReserved)
+  {
+    pAccount->optionalSizeInBytes += sizeInBytes;
+  }
+  return isReserved;
+}
+
+void ca_budget_release(ca_budget_account *pAccount, ca_uint64 sizeInBytes)
+{
+  if (sizeInBytes == 0)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&budget.lock);
+  budget.usage.sizeInBytes -= sizeInBytes;
+  budget.usage.optionalSizeInBytes -= sizeInBytes;
+  pthread_mutex_unlock(&budget.lock);
+  pAccount->optionalSizeInBytes -= sizeInBytes;
+}
+
+ca_bool ca_budget_poll_trim(ca_budget_account *pAccount, ca_trim_level *pLevel)
+{
+  ca_uint64 generation = atomic_load_explicit(&budget.trimGeneration, memory_order_acquire);
+  if (generation == pAccount->trimGeneration)
+  {
+    return CA_FALSE;
+  }
+
+  ca_bool isFirstPoll = pAccount->trimGeneration == 0;
+  pthread_mutex_lock(&budget.lock);
+  pAccount->trimGeneration = atomic_load_explicit(&budget.trimGeneration, memory_order_relaxed);
+  *pLevel = budget.trimLevel;
+  pthread_mutex_unlock(&budget.lock);
+  return !isFirstPoll;
+}
+
+void ca_budget_close(ca_budget_account *pAccount)
+{
+  pthread_mutex_lock(&budget.lock);
+  budget.usage.sizeInBytes -= pAccount->sizeInBytes + pAccount->optionalSizeInBytes;
+  budget.usage.optionalSizeInBytes -= pAccount->optionalSizeInBytes;
+  if (pAccount->isDecoder)
+  {
+    budget.usage.decoderCount--;
+  }
+  pthread_mutex_unlock(&budget.lock);
+  ca_zero_memory(pAccount);
+}
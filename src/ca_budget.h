@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ca_defs.h"
+
+typedef enum
+{
+  // Optional caches give back half of their memory, and decoder pools release half of their idle decoders.
+  ca_trim_level_moderate = 0,
+
+  // Optional caches are emptied, decoder pools release their idle decoders, and playlists close the tracks they opened ahead until the current track ends.
+  ca_trim_level_critical = 1,
+} ca_trim_level;
+
+typedef struct
+{
+  ca_uint32 decoderCount;
+
+  // Memory held by every decoder and playlist, and the part of it held by caches and prefetched frames which can be trimmed.
+  ca_uint64 sizeInBytes;
+  ca_uint64 optionalSizeInBytes;
+
+  // Decoders and optional allocations refused by the limits, and trims run by ca_trim_memory or by a decoder opening over the size limit.
+  ca_uint64 refusedDecoderCount;
+  ca_uint64 refusedOptionalCount;
+  ca_uint64 trimCount;
+} ca_budget_usage;
+
+// Limits shared by every decoder in the process. Zero leaves a limit off, which is the default.
+// Decoders beyond either limit fail to init with ca_result_budget_exceeded. Caches and prefetched frames only grow while the total stays under maxSizeInBytes.
+FFI_PLUGIN_EXPORT void ca_budget_set_limits(ca_uint64 maxSizeInBytes, ca_uint32 maxDecoderCount);
+
+FFI_PLUGIN_EXPORT void ca_budget_get_usage(ca_budget_usage *pUsage);
+
+// Call from any thread, for example on an OS memory warning. Each decoder and playlist trims at the start of its next decode or seek call.
+FFI_PLUGIN_EXPORT void ca_trim_memory(ca_trim_level level);
+
+// MARK: Accounts
+
+// Memory of one decoder or playlist. Zero it before use. Only the owner's thread calls the functions below with it.
+typedef struct
+{
+  ca_bool isDecoder;
+  ca_uint64 sizeInBytes;
+  ca_uint64 optionalSizeInBytes;
+  ca_uint64 trimGeneration;
+} ca_budget_account;
+
+// Counts a new decoder. Fails with ca_result_budget_exceeded when either limit is reached. Optional memory over the size limit is trimmed.
+ca_result ca_budget_open_decoder(ca_budget_account *pAccount);
+
+// Returns whether another decoder could open now.
+ca_bool ca_budget_has_room();
+
+// Records the memory the owner cannot give back.
+void ca_budget_set_size(ca_budget_account *pAccount, ca_uint64 sizeInBytes);
+
+// Bytes of optional memory that fit under the size limit.
+ca_uint64 ca_budget_get_available();
+
+// Takes all of sizeInBytes as optional memory, or nothing when it does not fit.
+ca_bool ca_budget_reserve(ca_budget_account *pAccount, ca_uint64 sizeInBytes);
+
+void ca_budget_release(ca_budget_account *pAccount, ca_uint64 sizeInBytes);
+
+// Returns whether ca_trim_memory was called since the last poll, with the level of the latest call.
+ca_bool ca_budget_poll_trim(ca_budget_account *pAccount, ca_trim_level *pLevel);
+
+// Gives back everything the account holds.
+void ca_budget_close(ca_budget_account *pAccount);
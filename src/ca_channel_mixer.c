@@ -0,0 +1,496 @@
+#include "ca_channel_mixer.h"
+#include "ca_cpu.h"
+#include "ca_miniaudio.h"
+#include <pthread.h>
+#include <string.h>
+
+#if CA_SUPPORT_SSE2
+#include <immintrin.h>
+#endif
+
+#if CA_SUPPORT_NEON
+#include <arm_neon.h>
+#endif
+
+// The SIMD kernels accumulate in the same order as the scalar one, so the output is bit-identical.
+// GCC ignores the pragma, so CMakeLists.txt builds this file with -ffp-contract=off instead.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#define MIXER_SQRT_HALF 0.70710678f
+
+typedef void (*ca_channel_mixer_kernel)(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount);
+
+typedef struct
+{
+  ca_channel_mixer_kernel generic;
+  ca_channel_mixer_kernel toStereo;
+  ca_channel_mixer_kernel toMono;
+} ca_channel_mixer_kernels;
+
+// MARK: Kernels
+
+static void ca_channel_mixer_generic_scalar(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  for (ca_uint64 frame = 0; frame < frameCount; frame++)
+  {
+    const float *pFrameIn = pIn + frame * channelsIn;
+    float *pFrameOut = pOut + frame * channelsOut;
+    for (ca_uint32 out = 0; out < channelsOut; out++)
+    {
+      const float *pRow = pMatrix + out * channelsIn;
+      float sum = 0;
+      for (ca_uint32 in = 0; in < channelsIn; in++)
+      {
+        sum = sum + pRow[in] * pFrameIn[in];
+      }
+      pFrameOut[out] = sum;
+    }
+  }
+}
+
+#if CA_SUPPORT_SSE2
+CA_TARGET_SSE2 static void ca_channel_mixer_to_stereo_sse2(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  __m128 weights[CA_MAX_CHANNELS];
+  for (ca_uint32 in = 0; in < channelsIn; in++)
+  {
+    weights[in] = _mm_setr_ps(pMatrix[in], pMatrix[channelsIn + in], pMatrix[in], pMatrix[channelsIn + in]);
+  }
+
+  // Two frames per iteration, laid out as L0 R0 L1 R1.
+  ca_uint64 frame = 0;
+  for (; frame + 2 <= frameCount; frame += 2)
+  {
+    const float *pFrame0 = pIn + frame * channelsIn;
+    const float *pFrame1 = pFrame0 + channelsIn;
+    __m128 sum = _mm_setzero_ps();
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_setr_ps(pFrame0[in], pFrame0[in], pFrame1[in], pFrame1[in]), weights[in]));
+    }
+    _mm_storeu_ps(pOut + frame * 2, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame * 2, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+
+CA_TARGET_SSE2 static void ca_channel_mixer_to_mono_sse2(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  ca_uint64 frame = 0;
+  for (; frame + 4 <= frameCount; frame += 4)
+  {
+    const float *pFrame = pIn + frame * channelsIn;
+    __m128 sum = _mm_setzero_ps();
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      __m128 samples = _mm_setr_ps(pFrame[in], pFrame[channelsIn + in], pFrame[channelsIn * 2 + in], pFrame[channelsIn * 3 + in]);
+      sum = _mm_add_ps(sum, _mm_mul_ps(samples, _mm_set1_ps(pMatrix[in])));
+    }
+    _mm_storeu_ps(pOut + frame, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+#endif
+
+#if CA_SUPPORT_AVX2
+CA_TARGET_AVX2 static void ca_channel_mixer_to_stereo_avx2(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  __m256 weights[CA_MAX_CHANNELS];
+  for (ca_uint32 in = 0; in < channelsIn; in++)
+  {
+    float left = pMatrix[in];
+    float right = pMatrix[channelsIn + in];
+    weights[in] = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+  }
+
+  // Four frames per iteration. The gather reads every input sample twice, once for each output channel.
+  const int stride = (int)channelsIn;
+  const __m256i offsets = _mm256_setr_epi32(0, 0, stride, stride, stride * 2, stride * 2, stride * 3, stride * 3);
+  ca_uint64 frame = 0;
+  for (; frame + 4 <= frameCount; frame += 4)
+  {
+    const float *pFrame = pIn + frame * channelsIn;
+    __m256 sum = _mm256_setzero_ps();
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_i32gather_ps(pFrame + in, offsets, 4), weights[in]));
+    }
+    _mm256_storeu_ps(pOut + frame * 2, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame * 2, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+
+CA_TARGET_AVX2 static void ca_channel_mixer_to_mono_avx2(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  const int stride = (int)channelsIn;
+  const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+  ca_uint64 frame = 0;
+  for (; frame + 8 <= frameCount; frame += 8)
+  {
+    const float *pFrame = pIn + frame * channelsIn;
+    __m256 sum = _mm256_setzero_ps();
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_i32gather_ps(pFrame + in, offsets, 4), _mm256_set1_ps(pMatrix[in])));
+    }
+    _mm256_storeu_ps(pOut + frame, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+#endif
+
+#if CA_SUPPORT_NEON
+static void ca_channel_mixer_to_stereo_neon(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  float32x4_t weights[CA_MAX_CHANNELS];
+  for (ca_uint32 in = 0; in < channelsIn; in++)
+  {
+    float32x2_t pair = vset_lane_f32(pMatrix[channelsIn + in], vdup_n_f32(pMatrix[in]), 1);
+    weights[in] = vcombine_f32(pair, pair);
+  }
+
+  ca_uint64 frame = 0;
+  for (; frame + 2 <= frameCount; frame += 2)
+  {
+    const float *pFrame0 = pIn + frame * channelsIn;
+    const float *pFrame1 = pFrame0 + channelsIn;
+    float32x4_t sum = vdupq_n_f32(0);
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      float32x4_t samples = vcombine_f32(vdup_n_f32(pFrame0[in]), vdup_n_f32(pFrame1[in]));
+      sum = vaddq_f32(sum, vmulq_f32(samples, weights[in]));
+    }
+    vst1q_f32(pOut + frame * 2, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame * 2, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+
+static void ca_channel_mixer_to_mono_neon(const float *pMatrix, float *pOut, const float *pIn, ca_uint32 channelsIn, ca_uint32 channelsOut, ca_uint64 frameCount)
+{
+  ca_uint64 frame = 0;
+  for (; frame + 4 <= frameCount; frame += 4)
+  {
+    const float *pFrame = pIn + frame * channelsIn;
+    float32x4_t sum = vdupq_n_f32(0);
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      float32x4_t samples = vdupq_n_f32(pFrame[in]);
+      samples = vld1q_lane_f32(pFrame + channelsIn + in, samples, 1);
+      samples = vld1q_lane_f32(pFrame + channelsIn * 2 + in, samples, 2);
+      samples = vld1q_lane_f32(pFrame + channelsIn * 3 + in, samples, 3);
+      sum = vaddq_f32(sum, vmulq_n_f32(samples, pMatrix[in]));
+    }
+    vst1q_f32(pOut + frame, sum);
+  }
+
+  ca_channel_mixer_generic_scalar(pMatrix, pOut + frame, pIn + frame * channelsIn, channelsIn, channelsOut, frameCount - frame);
+}
+#endif
+
+static const ca_channel_mixer_kernels scalarMixerKernels = {
+    .generic = ca_channel_mixer_generic_scalar,
+    .toStereo = ca_channel_mixer_generic_scalar,
+    .toMono = ca_channel_mixer_generic_scalar,
+};
+
+static pthread_once_t mixerKernelsOnce = PTHREAD_ONCE_INIT;
+static ca_channel_mixer_kernels simdMixerKernels;
+
+static void ca_channel_mixer_init_kernels()
+{
+  ca_uint32 features = ca_get_cpu_features();
+  simdMixerKernels = scalarMixerKernels;
+
+#if CA_SUPPORT_SSE2
+  if (features & ca_cpu_feature_sse2)
+  {
+    simdMixerKernels.toStereo = ca_channel_mixer_to_stereo_sse2;
+    simdMixerKernels.toMono = ca_channel_mixer_to_mono_sse2;
+  }
+#endif
+
+#if CA_SUPPORT_AVX2
+  if (features & ca_cpu_feature_avx2)
+  {
+    simdMixerKernels.toStereo = ca_channel_mixer_to_stereo_avx2;
+    simdMixerKernels.toMono = ca_channel_mixer_to_mono_avx2;
+  }
+#endif
+
+#if CA_SUPPORT_NEON
+  if (features & ca_cpu_feature_neon)
+  {
+    simdMixerKernels.toStereo = ca_channel_mixer_to_stereo_neon;
+    simdMixerKernels.toMono = ca_channel_mixer_to_mono_neon;
+  }
+#endif
+
+  (void)features;
+}
+
+// MARK: Matrix
+
+static ca_bool ca_channel_map_contains(const ca_channel *pChannelMap, ca_uint32 channels, ca_channel channel)
+{
+  for (ca_uint32 i = 0; i < channels; i++)
+  {
+    if (pChannelMap[i] == channel)
+    {
+      return CA_TRUE;
+    }
+  }
+  return CA_FALSE;
+}
+
+// Weight of an input position in an output position when the output does not have the input position.
+static float ca_channel_mixer_get_itu_weight(ca_channel in, ca_channel out, const ca_channel *pMapOut, ca_uint32 channelsOut)
+{
+  ca_bool hasSides = ca_channel_map_contains(pMapOut, channelsOut, ca_channel_side_left);
+  ca_bool hasBacks = ca_channel_map_contains(pMapOut, channelsOut, ca_channel_back_left);
+  ca_bool hasFronts = ca_channel_map_contains(pMapOut, channelsOut, ca_channel_front_left);
+
+  switch (in)
+  {
+  case ca_channel_mono:
+    if (hasFronts)
+    {
+      return (out == ca_channel_front_left || out == ca_channel_front_right) ? 1 : 0;
+    }
+    return out == ca_channel_front_center ? 1 : 0;
+  case ca_channel_front_center:
+    return (out == ca_channel_front_left || out == ca_channel_front_right) ? MIXER_SQRT_HALF : 0;
+  case ca_channel_front_left_center:
+    return out == ca_channel_front_left ? 1 : 0;
+  case ca_channel_front_right_center:
+    return out == ca_channel_front_right ? 1 : 0;
+  case ca_channel_back_left:
+    return hasSides ? (out == ca_channel_side_left ? 1 : 0) : (out == ca_channel_front_left ? MIXER_SQRT_HALF : 0);
+  case ca_channel_back_right:
+    return hasSides ? (out == ca_channel_side_right ? 1 : 0) : (out == ca_channel_front_right ? MIXER_SQRT_HALF : 0);
+  case ca_channel_side_left:
+    return hasBacks ? (out == ca_channel_back_left ? 1 : 0) : (out == ca_channel_front_left ? MIXER_SQRT_HALF : 0);
+  case ca_channel_side_right:
+    return hasBacks ? (out == ca_channel_back_right ? 1 : 0) : (out == ca_channel_front_right ? MIXER_SQRT_HALF : 0);
+  case ca_channel_back_center:
+    if (hasBacks)
+    {
+      return (out == ca_channel_back_left || out == ca_channel_back_right) ? MIXER_SQRT_HALF : 0;
+    }
+    if (hasSides)
+    {
+      return (out == ca_channel_side_left || out == ca_channel_side_right) ? MIXER_SQRT_HALF : 0;
+    }
+    return (out == ca_channel_front_left || out == ca_channel_front_right) ? 0.5f : 0;
+  case ca_channel_top_front_left:
+  case ca_channel_top_back_left:
+    return out == ca_channel_front_left ? MIXER_SQRT_HALF : 0;
+  case ca_channel_top_front_right:
+  case ca_channel_top_back_right:
+    return out == ca_channel_front_right ? MIXER_SQRT_HALF : 0;
+  case ca_channel_top_center:
+  case ca_channel_top_front_center:
+  case ca_channel_top_back_center:
+    return (out == ca_channel_front_left || out == ca_channel_front_right) ? 0.5f : 0;
+  default:
+    // The LFE is dropped as recommended by ITU-R BS.775.
+    return 0;
+  }
+}
+
+static void ca_channel_mixer_build_itu_matrix(float *pMatrix, const ca_channel *pMapIn, ca_uint32 channelsIn, const ca_channel *pMapOut, ca_uint32 channelsOut)
+{
+  for (ca_uint32 out = 0; out < channelsOut; out++)
+  {
+    for (ca_uint32 in = 0; in < channelsIn; in++)
+    {
+      float weight = 0;
+      if (pMapIn[in] == pMapOut[out])
+      {
+        weight = 1;
+      }
+      else if (!ca_channel_map_contains(pMapOut, channelsOut, pMapIn[in]))
+      {
+        weight = ca_channel_mixer_get_itu_weight(pMapIn[in], pMapOut[out], pMapOut, channelsOut);
+      }
+      pMatrix[out * channelsIn + in] = weight;
+    }
+  }
+}
+
+static void ca_channel_mixer_build_matrix(float *pMatrix, const ca_channel *pMapIn, ca_uint32 channelsIn, const ca_channel *pMapOut, ca_uint32 channelsOut)
+{
+  ca_bool isMonoOut = channelsOut == 1 && pMapOut[0] == ca_channel_mono;
+  ca_bool isMonoIn = channelsIn == 1 && pMapIn[0] == ca_channel_mono;
+  if (!isMonoOut || isMonoIn)
+  {
+    ca_channel_mixer_build_itu_matrix(pMatrix, pMapIn, channelsIn, pMapOut, channelsOut);
+    return;
+  }
+
+  // Mono is the average of the stereo downmix.
+  const ca_channel stereo[] = {ca_channel_front_left, ca_channel_front_right};
+  float stereoMatrix[2 * CA_MAX_CHANNELS];
+  ca_channel_mixer_build_itu_matrix(stereoMatrix, pMapIn, channelsIn, stereo, 2);
+  for (ca_uint32 in = 0; in < channelsIn; in++)
+  {
+    pMatrix[in] = 0.5f * (stereoMatrix[in] + stereoMatrix[channelsIn + in]);
+  }
+}
+
+// MARK: Channel maps
+
+void ca_get_flac_channel_map(ca_channel *pChannelMap, ca_uint32 channels)
+{
+  ma_channel_map_init_standard(ma_standard_channel_map_flac, (ma_channel *)pChannelMap, channels, channels);
+}
+
+ca_bool ca_channel_map_from_mask(ca_channel *pChannelMap, ca_uint32 channels, ca_uint32 mask)
+{
+  ca_uint32 channel = 0;
+  for (ca_uint32 bit = 0; bit <= ca_channel_top_back_right - ca_channel_front_left && channel < channels; bit++)
+  {
+    if ((mask & (1u << bit)) != 0)
+    {
+      pChannelMap[channel++] = (ca_channel)(ca_channel_front_left + bit);
+    }
+  }
+  return channel == channels;
+}
+
+ca_channel ca_channel_from_apple_label(ca_uint32 label)
+{
+  // Left through TopBackRight are numbered in the order of the positions.
+  if (label >= 1 && label <= 18)
+  {
+    return (ca_channel)(ca_channel_front_left + label - 1);
+  }
+
+  switch (label)
+  {
+  case 33: // RearSurroundLeft
+    return ca_channel_back_left;
+  case 34: // RearSurroundRight
+    return ca_channel_back_right;
+  case 35: // LeftWide
+    return ca_channel_side_left;
+  case 36: // RightWide
+    return ca_channel_side_right;
+  case 37: // LFE2
+    return ca_channel_lfe;
+  case 38: // LeftTotal
+    return ca_channel_front_left;
+  case 39: // RightTotal
+    return ca_channel_front_right;
+  case 42: // Mono
+    return ca_channel_mono;
+  default:
+    return ca_channel_none;
+  }
+}
+
+ca_bool ca_channel_map_is_positioned(const ca_channel *pChannelMap, ca_uint32 channels)
+{
+  return !ca_channel_map_contains(pChannelMap, channels, ca_channel_none);
+}
+
+// MARK: Public API
+
+FFI_PLUGIN_EXPORT void ca_get_standard_channel_map(ca_channel *pChannelMap, ca_uint32 channels)
+{
+  ma_channel_map_init_standard(ma_standard_channel_map_microsoft, (ma_channel *)pChannelMap, channels, channels);
+}
+
+FFI_PLUGIN_EXPORT ca_channel_mixer_config ca_channel_mixer_config_init(ca_uint32 channelsIn, ca_uint32 channelsOut)
+{
+  ca_channel_mixer_config config = {
+      .channelsIn = channelsIn,
+      .channelsOut = channelsOut,
+      .pChannelMapIn = NULL,
+      .pChannelMapOut = NULL,
+      .mixMode = ca_channel_mix_mode_itu,
+      .pMatrix = NULL,
+      .isSimdDisabled = CA_FALSE,
+  };
+  return config;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_channel_mixer_init(ca_channel_mixer *pMixer, ca_channel_mixer_config config)
+{
+  if (config.channelsIn == 0 || config.channelsIn > CA_MAX_CHANNELS || config.channelsOut == 0 || config.channelsOut > CA_MAX_CHANNELS)
+  {
+    return ca_result_invalid_args;
+  }
+
+  if (config.mixMode == ca_channel_mix_mode_custom)
+  {
+    if (config.pMatrix == NULL)
+    {
+      return ca_result_invalid_args;
+    }
+    memcpy(pMixer->matrix, config.pMatrix, sizeof(float) * config.channelsIn * config.channelsOut);
+  }
+  else
+  {
+    ca_channel mapIn[CA_MAX_CHANNELS];
+    ca_channel mapOut[CA_MAX_CHANNELS];
+    if (config.pChannelMapIn == NULL)
+    {
+      ca_get_standard_channel_map(mapIn, config.channelsIn);
+    }
+    else
+    {
+      memcpy(mapIn, config.pChannelMapIn, config.channelsIn);
+    }
+
+    if (config.pChannelMapOut == NULL)
+    {
+      ca_get_standard_channel_map(mapOut, config.channelsOut);
+    }
+    else
+    {
+      memcpy(mapOut, config.pChannelMapOut, config.channelsOut);
+    }
+
+    ca_channel_mixer_build_matrix(pMixer->matrix, mapIn, config.channelsIn, mapOut, config.channelsOut);
+  }
+
+  const ca_channel_mixer_kernels *pKernels = &scalarMixerKernels;
+  if (!config.isSimdDisabled)
+  {
+    pthread_once(&mixerKernelsOnce, ca_channel_mixer_init_kernels);
+    pKernels = &simdMixerKernels;
+  }
+
+  if (config.channelsOut == 2)
+  {
+    pMixer->pKernel = (const void *)pKernels->toStereo;
+  }
+  else if (config.channelsOut == 1)
+  {
+    pMixer->pKernel = (const void *)pKernels->toMono;
+  }
+  else
+  {
+    pMixer->pKernel = (const void *)pKernels->generic;
+  }
+
+  // The pointers are not owned by the mixer.
+  config.pChannelMapIn = NULL;
+  config.pChannelMapOut = NULL;
+  config.pMatrix = NULL;
+  pMixer->config = config;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_channel_mixer_process(ca_channel_mixer *pMixer, float *pFramesOut, const float *pFramesIn, ca_uint64 frameCount)
+{
+  ca_channel_mixer_kernel pKernel = (ca_channel_mixer_kernel)pMixer->pKernel;
+  pKernel(pMixer->matrix, pFramesOut, pFramesIn, pMixer->config.channelsIn, pMixer->config.channelsOut, frameCount);
+  return ca_result_success;
+}
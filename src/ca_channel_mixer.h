@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ca_defs.h"
+
+#define CA_MAX_CHANNELS 32
+
+// Speaker positions. The values are the same as ma_channel.
+typedef ca_uint8 ca_channel;
+
+typedef enum
+{
+  ca_channel_none = 0,
+  ca_channel_mono = 1,
+  ca_channel_front_left = 2,
+  ca_channel_front_right = 3,
+  ca_channel_front_center = 4,
+  ca_channel_lfe = 5,
+  ca_channel_back_left = 6,
+  ca_channel_back_right = 7,
+  ca_channel_front_left_center = 8,
+  ca_channel_front_right_center = 9,
+  ca_channel_back_center = 10,
+  ca_channel_side_left = 11,
+  ca_channel_side_right = 12,
+  ca_channel_top_center = 13,
+  ca_channel_top_front_left = 14,
+  ca_channel_top_front_center = 15,
+  ca_channel_top_front_right = 16,
+  ca_channel_top_back_left = 17,
+  ca_channel_top_back_center = 18,
+  ca_channel_top_back_right = 19,
+} ca_channel_position;
+
+typedef enum
+{
+  // Downmixes with the ITU-R BS.775 coefficients and maps matching positions when upmixing.
+  ca_channel_mix_mode_itu = 0,
+
+  // Uses pMatrix as is.
+  ca_channel_mix_mode_custom = 1,
+} ca_channel_mix_mode;
+
+typedef struct
+{
+  ca_uint32 channelsIn;
+  ca_uint32 channelsOut;
+
+  // NULL uses the standard layout of the channel count, e.g. FL FR FC LFE SL SR for 6 channels.
+  const ca_channel *pChannelMapIn;
+  const ca_channel *pChannelMapOut;
+
+  ca_channel_mix_mode mixMode;
+
+  // channelsOut rows of channelsIn weights. Used by ca_channel_mix_mode_custom and copied by ca_channel_mixer_init.
+  const float *pMatrix;
+
+  // Forces the scalar kernel.
+  ca_bool isSimdDisabled;
+} ca_channel_mixer_config;
+
+typedef struct
+{
+  ca_channel_mixer_config config;
+  float matrix[CA_MAX_CHANNELS * CA_MAX_CHANNELS];
+  const void *pKernel;
+} ca_channel_mixer;
+
+// Fills pChannelMap with the standard layout of the channel count.
+FFI_PLUGIN_EXPORT void ca_get_standard_channel_map(ca_channel *pChannelMap, ca_uint32 channels);
+
+// Fills pChannelMap with the FLAC order of the channel count, e.g. FL FR FC LFE BL BR for 6 channels.
+void ca_get_flac_channel_map(ca_channel *pChannelMap, ca_uint32 channels);
+
+// Fills pChannelMap from a WAVE_FORMAT_EXTENSIBLE channel mask, whose bits follow the positions from ca_channel_front_left on. CAF channel bitmaps use the same bits.
+// Returns CA_FALSE when the mask names fewer positions than channels.
+ca_bool ca_channel_map_from_mask(ca_channel *pChannelMap, ca_uint32 channels, ca_uint32 mask);
+
+// Returns the position of a Core Audio AudioChannelLabel, or ca_channel_none when it has none.
+ca_channel ca_channel_from_apple_label(ca_uint32 label);
+
+// Returns whether every channel has a position. Sources with unpositioned channels are mixed with the standard map instead.
+ca_bool ca_channel_map_is_positioned(const ca_channel *pChannelMap, ca_uint32 channels);
+
+FFI_PLUGIN_EXPORT ca_channel_mixer_config ca_channel_mixer_config_init(ca_uint32 channelsIn, ca_uint32 channelsOut);
+
+FFI_PLUGIN_EXPORT ca_result ca_channel_mixer_init(ca_channel_mixer *pMixer, ca_channel_mixer_config config);
+
+// Mixes interleaved f32 frames. pFramesOut and pFramesIn must not overlap.
+FFI_PLUGIN_EXPORT ca_result ca_channel_mixer_process(ca_channel_mixer *pMixer, float *pFramesOut, const float *pFramesIn, ca_uint64 frameCount);
@@ -0,0 +1,121 @@
+#include "ca_checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  ca_checkpoint checkpoint;
+  ca_uint64 serial;
+} ca_checkpoint_entry;
+
+typedef struct
+{
+  // Sorted by frameIndex.
+  ca_checkpoint_entry *pEntries;
+  ca_uint32 count;
+  ca_uint64 nextSerial;
+} ca_checkpoint_ring_data;
+
+// Returns the number of entries at or before frameIndex.
+static ca_uint32 ca_checkpoint_ring_upper_bound(ca_checkpoint_ring_data *pData, ca_uint64 frameIndex)
+{
+  ca_uint32 low = 0, high = pData->count;
+  while (low < high)
+  {
+    ca_uint32 middle = low + (high - low) / 2;
+    if (pData->pEntries[middle].checkpoint.frameIndex <= frameIndex)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+ca_result ca_checkpoint_ring_init(ca_checkpoint_ring *pRing, ca_uint32 capacity, ca_uint64 interval)
+{
+  if (capacity == 0 || interval == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_checkpoint_ring_data *pData = (ca_checkpoint_ring_data *)calloc(1, sizeof(ca_checkpoint_ring_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->pEntries = (ca_checkpoint_entry *)malloc(sizeof(ca_checkpoint_entry) * capacity);
+  if (pData->pEntries == NULL)
+  {
+    free(pData);
+    return ca_result_out_of_memory;
+  }
+
+  pRing->interval = interval;
+  pRing->capacity = capacity;
+  pRing->pData = pData;
+  return ca_result_success;
+}
+
+void ca_checkpoint_ring_push(ca_checkpoint_ring *pRing, ca_uint64 frameIndex, ca_uint64 byteOffset)
+{
+  ca_checkpoint_ring_data *pData = (ca_checkpoint_ring_data *)pRing->pData;
+  ca_uint32 index = ca_checkpoint_ring_upper_bound(pData, frameIndex);
+  if (index > 0 && frameIndex - pData->pEntries[index - 1].checkpoint.frameIndex < pRing->interval)
+  {
+    return;
+  }
+
+  // A full ring gives up the entry pushed first, which is not always the first by position after seeking back.
+  if (pData->count == pRing->capacity)
+  {
+    ca_uint32 oldest = 0;
+    for (ca_uint32 i = 1; i < pData->count; i++)
+    {
+      if (pData->pEntries[i].serial < pData->pEntries[oldest].serial)
+      {
+        oldest = i;
+      }
+    }
+
+    memmove(&pData->pEntries[oldest], &pData->pEntries[oldest + 1], sizeof(ca_checkpoint_entry) * (pData->count - oldest - 1));
+    pData->count--;
+    index -= oldest < index ? 1 : 0;
+  }
+
+  memmove(&pData->pEntries[index + 1], &pData->pEntries[index], sizeof(ca_checkpoint_entry) * (pData->count - index));
+  pData->pEntries[index].checkpoint.frameIndex = frameIndex;
+  pData->pEntries[index].checkpoint.byteOffset = byteOffset;
+  pData->pEntries[index].serial = pData->nextSerial++;
+  pData->count++;
+}
+
+ca_bool ca_checkpoint_ring_find(ca_checkpoint_ring *pRing, ca_uint64 frameIndex, ca_checkpoint *pCheckpoint)
+{
+  ca_checkpoint_ring_data *pData = (ca_checkpoint_ring_data *)pRing->pData;
+  ca_uint32 index = ca_checkpoint_ring_upper_bound(pData, frameIndex);
+  if (index == 0 || frameIndex - pData->pEntries[index - 1].checkpoint.frameIndex > pRing->interval * CA_CHECKPOINT_MAX_INTERVALS)
+  {
+    return CA_FALSE;
+  }
+
+  *pCheckpoint = pData->pEntries[index - 1].checkpoint;
+  return CA_TRUE;
+}
+
+void ca_checkpoint_ring_uninit(ca_checkpoint_ring *pRing)
+{
+  ca_checkpoint_ring_data *pData = (ca_checkpoint_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  free(pData->pEntries);
+  free(pData);
+  pRing->pData = NULL;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// Where decoding resumes at frameIndex without searching the stream: the byte offset of the packet starting there.
+typedef struct
+{
+  ca_uint64 frameIndex;
+  ca_uint64 byteOffset;
+} ca_checkpoint;
+
+// Keeps up to capacity checkpoints at least interval frames apart, sorted by frame. The oldest one is dropped when a new one does not fit.
+typedef struct
+{
+  ca_uint64 interval;
+  ca_uint32 capacity;
+  void *pData;
+} ca_checkpoint_ring;
+
+ca_result ca_checkpoint_ring_init(ca_checkpoint_ring *pRing, ca_uint32 capacity, ca_uint64 interval);
+
+// Adds a checkpoint unless another one lies less than an interval before it.
+void ca_checkpoint_ring_push(ca_checkpoint_ring *pRing, ca_uint64 frameIndex, ca_uint64 byteOffset);
+
+// Farthest a checkpoint found by ca_checkpoint_ring_find lies before the target, in intervals.
+// Resuming from a farther one decodes more frames than the seek search it replaces reads, so those seeks search as usual.
+#define CA_CHECKPOINT_MAX_INTERVALS 2
+
+// Finds the last checkpoint at or before frameIndex and no more than CA_CHECKPOINT_MAX_INTERVALS intervals before it.
+ca_bool ca_checkpoint_ring_find(ca_checkpoint_ring *pRing, ca_uint64 frameIndex, ca_checkpoint *pCheckpoint);
+
+void ca_checkpoint_ring_uninit(ca_checkpoint_ring *pRing);
@@ -0,0 +1,1657 @@
+#include "ca_convert.h"
+#include "ca_cpu.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#if CA_SUPPORT_SSE2
+#include <immintrin.h>
+#endif
+
+#if CA_SUPPORT_NEON
+#include <arm_neon.h>
+#endif
+
+// The kernels must round exactly once per operation to stay bit-identical across instruction sets.
+// GCC ignores the pragma, so CMakeLists.txt builds this file with -ffp-contract=off instead.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#define CONVERT_BLOCK_SIZE 256
+#define CONVERT_FORMAT_COUNT (ca_sample_format_f32 + 1)
+
+typedef void (*ca_convert_to_f32_proc)(float *pOut, const void *pIn, ca_uint32 count);
+typedef void (*ca_convert_from_f32_proc)(void *pOut, const float *pIn, const float *pDither, ca_uint32 count);
+typedef void (*ca_convert_to_s32_proc)(ca_int32 *pOut, const void *pIn, ca_uint32 count);
+typedef void (*ca_convert_from_s32_proc)(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count);
+typedef void (*ca_convert_deinterleave_proc)(void **ppOut, const void *pIn, ca_uint32 frameCount);
+typedef void (*ca_convert_swap_proc)(void *pSamples, ca_uint32 count);
+
+typedef struct
+{
+  ca_convert_to_f32_proc toF32[CONVERT_FORMAT_COUNT];
+  ca_convert_from_f32_proc fromF32[CONVERT_FORMAT_COUNT];
+  ca_convert_to_s32_proc toS32[CONVERT_FORMAT_COUNT];
+  ca_convert_from_s32_proc fromS32[CONVERT_FORMAT_COUNT];
+  ca_convert_deinterleave_proc deinterleave16Stereo;
+  ca_convert_deinterleave_proc deinterleave32Stereo;
+  ca_convert_swap_proc swap16;
+  ca_convert_swap_proc swap32;
+} ca_convert_kernels;
+
+// Scale, clamp range and right shift from s32 of each integer format.
+#define U8_SCALE 128.0f
+#define U8_MIN -128.0f
+#define U8_MAX 127.0f
+#define U8_SHIFT 24
+#define S16_SCALE 32768.0f
+#define S16_MIN -32768.0f
+#define S16_MAX 32767.0f
+#define S16_SHIFT 16
+#define S24_SCALE 8388608.0f
+#define S24_MIN -8388608.0f
+#define S24_MAX 8388607.0f
+#define S24_SHIFT 8
+#define S32_SCALE 2147483648.0f
+#define S32_MIN -2147483648.0f
+#define S32_MAX 2147483520.0f // The largest float below 2^31
+
+static inline float ca_convert_clamp(float value, float min, float max)
+{
+  // Matches the NaN handling of minps/maxps.
+  value = value < max ? value : max;
+  value = value > min ? value : min;
+  return value;
+}
+
+static inline ca_int32 ca_convert_clamp_s32(ca_int32 value, ca_int32 min, ca_int32 max)
+{
+  return value < min ? min : (value > max ? max : value);
+}
+
+static inline ca_int32 ca_convert_read_s24(const ca_uint8 *pIn)
+{
+  return (ca_int32)(((ca_uint32)pIn[0] << 8) | ((ca_uint32)pIn[1] << 16) | ((ca_uint32)pIn[2] << 24));
+}
+
+static inline void ca_convert_write_s24(ca_uint8 *pOut, ca_int32 value)
+{
+  pOut[0] = (ca_uint8)value;
+  pOut[1] = (ca_uint8)(value >> 8);
+  pOut[2] = (ca_uint8)(value >> 16);
+}
+
+// Narrows s32 to the precision of (32 - shift) bits. The dither is added at half scale so the sum can not overflow.
+static inline ca_int32 ca_convert_narrow_s32(ca_int32 value, const ca_int32 *pDither, ca_uint32 index, int shift)
+{
+  if (pDither == NULL)
+  {
+    return value >> shift;
+  }
+
+  ca_int32 dithered = ((value >> 1) + (pDither[index] >> 1)) >> (shift - 1);
+  ca_int32 max = (ca_int32)((1u << (31 - shift)) - 1);
+  return ca_convert_clamp_s32(dithered, -max - 1, max);
+}
+
+// MARK: Scalar kernels
+
+static void ca_convert_u8_to_f32_scalar(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (float)((ca_int32)pSamples[i] - 128) * (1.0f / U8_SCALE);
+  }
+}
+
+static void ca_convert_s16_to_f32_scalar(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (float)pSamples[i] * (1.0f / S16_SCALE);
+  }
+}
+
+static void ca_convert_s24_to_f32_scalar(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (float)ca_convert_read_s24(pSamples + i * 3) * (1.0f / S32_SCALE);
+  }
+}
+
+static void ca_convert_s32_to_f32_scalar(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (float)pSamples[i] * (1.0f / S32_SCALE);
+  }
+}
+
+static void ca_convert_f32_to_u8_scalar(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    float value = pIn[i] * U8_SCALE;
+    if (pDither != NULL)
+    {
+      value = value + pDither[i];
+    }
+    pSamples[i] = (ca_uint8)(lrintf(ca_convert_clamp(value, U8_MIN, U8_MAX)) + 128);
+  }
+}
+
+static void ca_convert_f32_to_s16_scalar(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    float value = pIn[i] * S16_SCALE;
+    if (pDither != NULL)
+    {
+      value = value + pDither[i];
+    }
+    pSamples[i] = (short)lrintf(ca_convert_clamp(value, S16_MIN, S16_MAX));
+  }
+}
+
+static void ca_convert_f32_to_s24_scalar(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    float value = pIn[i] * S24_SCALE;
+    if (pDither != NULL)
+    {
+      value = value + pDither[i];
+    }
+    ca_convert_write_s24(pSamples + i * 3, (ca_int32)lrintf(ca_convert_clamp(value, S24_MIN, S24_MAX)));
+  }
+}
+
+// f32 carries fewer bits than s32, so it is never dithered.
+static void ca_convert_f32_to_s32_scalar(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  (void)pDither;
+  ca_int32 *pSamples = (ca_int32 *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pSamples[i] = (ca_int32)lrintf(ca_convert_clamp(pIn[i] * S32_SCALE, S32_MIN, S32_MAX));
+  }
+}
+
+static void ca_convert_u8_to_s32_scalar(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (ca_int32)(((ca_uint32)pSamples[i] << 24) ^ 0x80000000u);
+  }
+}
+
+static void ca_convert_s16_to_s32_scalar(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const unsigned short *pSamples = (const unsigned short *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = (ca_int32)((ca_uint32)pSamples[i] << 16);
+  }
+}
+
+static void ca_convert_s24_to_s32_scalar(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pOut[i] = ca_convert_read_s24(pSamples + i * 3);
+  }
+}
+
+static void ca_convert_s32_to_u8_scalar(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pSamples[i] = (ca_uint8)(ca_convert_narrow_s32(pIn[i], pDither, i, U8_SHIFT) + 128);
+  }
+}
+
+static void ca_convert_s32_to_s16_scalar(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    pSamples[i] = (short)ca_convert_narrow_s32(pIn[i], pDither, i, S16_SHIFT);
+  }
+}
+
+static void ca_convert_s32_to_s24_scalar(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    ca_convert_write_s24(pSamples + i * 3, ca_convert_narrow_s32(pIn[i], pDither, i, S24_SHIFT));
+  }
+}
+
+static void ca_convert_deinterleave_16_stereo_scalar(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const short *pSamples = (const short *)pIn;
+  short *pLeft = (short *)ppOut[0];
+  short *pRight = (short *)ppOut[1];
+  for (ca_uint32 i = 0; i < frameCount; i++)
+  {
+    pLeft[i] = pSamples[i * 2];
+    pRight[i] = pSamples[i * 2 + 1];
+  }
+}
+
+static void ca_convert_deinterleave_32_stereo_scalar(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+  ca_int32 *pLeft = (ca_int32 *)ppOut[0];
+  ca_int32 *pRight = (ca_int32 *)ppOut[1];
+  for (ca_uint32 i = 0; i < frameCount; i++)
+  {
+    pLeft[i] = pSamples[i * 2];
+    pRight[i] = pSamples[i * 2 + 1];
+  }
+}
+
+static void ca_convert_swap_16_scalar(void *pSamples, ca_uint32 count)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    ca_uint8 byte = pBytes[i * 2];
+    pBytes[i * 2] = pBytes[i * 2 + 1];
+    pBytes[i * 2 + 1] = byte;
+  }
+}
+
+static void ca_convert_swap_32_scalar(void *pSamples, ca_uint32 count)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    ca_uint8 *pSample = pBytes + i * 4;
+    ca_uint8 byte0 = pSample[0];
+    ca_uint8 byte1 = pSample[1];
+    pSample[0] = pSample[3];
+    pSample[1] = pSample[2];
+    pSample[2] = byte1;
+    pSample[3] = byte0;
+  }
+}
+
+static const ca_convert_kernels scalarKernels = {
+    .toF32 = {NULL, ca_convert_u8_to_f32_scalar, ca_convert_s16_to_f32_scalar, ca_convert_s24_to_f32_scalar, ca_convert_s32_to_f32_scalar, NULL},
+    .fromF32 = {NULL, ca_convert_f32_to_u8_scalar, ca_convert_f32_to_s16_scalar, ca_convert_f32_to_s24_scalar, ca_convert_f32_to_s32_scalar, NULL},
+    .toS32 = {NULL, ca_convert_u8_to_s32_scalar, ca_convert_s16_to_s32_scalar, ca_convert_s24_to_s32_scalar, NULL, NULL},
+    .fromS32 = {NULL, ca_convert_s32_to_u8_scalar, ca_convert_s32_to_s16_scalar, ca_convert_s32_to_s24_scalar, NULL, NULL},
+    .deinterleave16Stereo = ca_convert_deinterleave_16_stereo_scalar,
+    .deinterleave32Stereo = ca_convert_deinterleave_32_stereo_scalar,
+    .swap16 = ca_convert_swap_16_scalar,
+    .swap32 = ca_convert_swap_32_scalar,
+};
+
+// MARK: SSE2 kernels
+
+#if CA_SUPPORT_SSE2
+CA_TARGET_SSE2 static inline __m128 ca_convert_clamp_sse2(__m128 value, float min, float max)
+{
+  return _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(max)), _mm_set1_ps(min));
+}
+
+CA_TARGET_SSE2 static inline __m128i ca_convert_narrow_s32_sse2(__m128i value, const ca_int32 *pDither, int shift)
+{
+  if (pDither == NULL)
+  {
+    return _mm_sra_epi32(value, _mm_cvtsi32_si128(shift));
+  }
+
+  __m128i dither = _mm_loadu_si128((const __m128i *)pDither);
+  __m128i sum = _mm_add_epi32(_mm_srai_epi32(value, 1), _mm_srai_epi32(dither, 1));
+  return _mm_sra_epi32(sum, _mm_cvtsi32_si128(shift - 1));
+}
+
+CA_TARGET_SSE2 static void ca_convert_u8_to_f32_sse2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  const __m128 scale = _mm_set1_ps(1.0f / U8_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i bytes = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pSamples + i)), bias);
+    __m128i lo16 = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+    __m128i hi16 = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+    _mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16)), scale));
+    _mm_storeu_ps(pOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16)), scale));
+    _mm_storeu_ps(pOut + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16)), scale));
+    _mm_storeu_ps(pOut + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16)), scale));
+  }
+
+  ca_convert_u8_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_s16_to_f32_sse2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+  const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i samples = _mm_loadu_si128((const __m128i *)(pSamples + i));
+    _mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)), scale));
+    _mm_storeu_ps(pOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)), scale));
+  }
+
+  ca_convert_s16_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_s32_to_f32_sse2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+  const __m128 scale = _mm_set1_ps(1.0f / S32_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    _mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pSamples + i))), scale));
+  }
+
+  ca_convert_s32_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_SSE2 static inline __m128i ca_convert_f32_to_s32_sse2_step(const float *pIn, const float *pDither, float scale, float min, float max)
+{
+  __m128 value = _mm_mul_ps(_mm_loadu_ps(pIn), _mm_set1_ps(scale));
+  if (pDither != NULL)
+  {
+    value = _mm_add_ps(value, _mm_loadu_ps(pDither));
+  }
+  return _mm_cvtps_epi32(ca_convert_clamp_sse2(value, min, max));
+}
+
+CA_TARGET_SSE2 static void ca_convert_f32_to_u8_sse2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i v0 = ca_convert_f32_to_s32_sse2_step(pIn + i, pDither == NULL ? NULL : pDither + i, U8_SCALE, U8_MIN, U8_MAX);
+    __m128i v1 = ca_convert_f32_to_s32_sse2_step(pIn + i + 4, pDither == NULL ? NULL : pDither + i + 4, U8_SCALE, U8_MIN, U8_MAX);
+    __m128i v2 = ca_convert_f32_to_s32_sse2_step(pIn + i + 8, pDither == NULL ? NULL : pDither + i + 8, U8_SCALE, U8_MIN, U8_MAX);
+    __m128i v3 = ca_convert_f32_to_s32_sse2_step(pIn + i + 12, pDither == NULL ? NULL : pDither + i + 12, U8_SCALE, U8_MIN, U8_MAX);
+    __m128i packed = _mm_packs_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+    _mm_storeu_si128((__m128i *)(pSamples + i), _mm_xor_si128(packed, bias));
+  }
+
+  ca_convert_f32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_f32_to_s16_sse2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i v0 = ca_convert_f32_to_s32_sse2_step(pIn + i, pDither == NULL ? NULL : pDither + i, S16_SCALE, S16_MIN, S16_MAX);
+    __m128i v1 = ca_convert_f32_to_s32_sse2_step(pIn + i + 4, pDither == NULL ? NULL : pDither + i + 4, S16_SCALE, S16_MIN, S16_MAX);
+    _mm_storeu_si128((__m128i *)(pSamples + i), _mm_packs_epi32(v0, v1));
+  }
+
+  ca_convert_f32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_f32_to_s24_sse2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  ca_int32 values[4];
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    _mm_storeu_si128((__m128i *)values, ca_convert_f32_to_s32_sse2_step(pIn + i, pDither == NULL ? NULL : pDither + i, S24_SCALE, S24_MIN, S24_MAX));
+    for (int j = 0; j < 4; j++)
+    {
+      ca_convert_write_s24(pSamples + (i + j) * 3, values[j]);
+    }
+  }
+
+  ca_convert_f32_to_s24_scalar(pSamples + i * 3, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_f32_to_s32_sse2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  (void)pDither;
+  ca_int32 *pSamples = (ca_int32 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    _mm_storeu_si128((__m128i *)(pSamples + i), ca_convert_f32_to_s32_sse2_step(pIn + i, NULL, S32_SCALE, S32_MIN, S32_MAX));
+  }
+
+  ca_convert_f32_to_s32_scalar(pSamples + i, pIn + i, NULL, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_u8_to_s32_sse2(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  const __m128i zero = _mm_setzero_si128();
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i bytes = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pSamples + i)), bias);
+    __m128i lo16 = _mm_unpacklo_epi8(zero, bytes);
+    __m128i hi16 = _mm_unpackhi_epi8(zero, bytes);
+    _mm_storeu_si128((__m128i *)(pOut + i), _mm_unpacklo_epi16(zero, lo16));
+    _mm_storeu_si128((__m128i *)(pOut + i + 4), _mm_unpackhi_epi16(zero, lo16));
+    _mm_storeu_si128((__m128i *)(pOut + i + 8), _mm_unpacklo_epi16(zero, hi16));
+    _mm_storeu_si128((__m128i *)(pOut + i + 12), _mm_unpackhi_epi16(zero, hi16));
+  }
+
+  ca_convert_u8_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_s16_to_s32_sse2(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+  const __m128i zero = _mm_setzero_si128();
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i samples = _mm_loadu_si128((const __m128i *)(pSamples + i));
+    _mm_storeu_si128((__m128i *)(pOut + i), _mm_unpacklo_epi16(zero, samples));
+    _mm_storeu_si128((__m128i *)(pOut + i + 4), _mm_unpackhi_epi16(zero, samples));
+  }
+
+  ca_convert_s16_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_s32_to_u8_sse2(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i v0 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i)), pDither == NULL ? NULL : pDither + i, U8_SHIFT);
+    __m128i v1 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i + 4)), pDither == NULL ? NULL : pDither + i + 4, U8_SHIFT);
+    __m128i v2 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i + 8)), pDither == NULL ? NULL : pDither + i + 8, U8_SHIFT);
+    __m128i v3 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i + 12)), pDither == NULL ? NULL : pDither + i + 12, U8_SHIFT);
+    __m128i packed = _mm_packs_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+    _mm_storeu_si128((__m128i *)(pSamples + i), _mm_xor_si128(packed, bias));
+  }
+
+  ca_convert_s32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_s32_to_s16_sse2(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i v0 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i)), pDither == NULL ? NULL : pDither + i, S16_SHIFT);
+    __m128i v1 = ca_convert_narrow_s32_sse2(_mm_loadu_si128((const __m128i *)(pIn + i + 4)), pDither == NULL ? NULL : pDither + i + 4, S16_SHIFT);
+    _mm_storeu_si128((__m128i *)(pSamples + i), _mm_packs_epi32(v0, v1));
+  }
+
+  ca_convert_s32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_deinterleave_16_stereo_sse2(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const short *pSamples = (const short *)pIn;
+  short *pLeft = (short *)ppOut[0];
+  short *pRight = (short *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= frameCount; i += 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)(pSamples + i * 2));
+    __m128i b = _mm_loadu_si128((const __m128i *)(pSamples + i * 2 + 8));
+    __m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    _mm_storeu_si128((__m128i *)(pLeft + i), left);
+    _mm_storeu_si128((__m128i *)(pRight + i), right);
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_16_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_deinterleave_32_stereo_sse2(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const float *pSamples = (const float *)pIn;
+  float *pLeft = (float *)ppOut[0];
+  float *pRight = (float *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= frameCount; i += 4)
+  {
+    __m128 a = _mm_loadu_ps(pSamples + i * 2);
+    __m128 b = _mm_loadu_ps(pSamples + i * 2 + 4);
+    _mm_storeu_ps(pLeft + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(pRight + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_32_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+CA_TARGET_SSE2 static inline __m128i ca_convert_swap_16_sse2_step(__m128i value)
+{
+  return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+}
+
+CA_TARGET_SSE2 static void ca_convert_swap_16_sse2(void *pSamples, ca_uint32 count)
+{
+  short *pValues = (short *)pSamples;
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i value = _mm_loadu_si128((const __m128i *)(pValues + i));
+    _mm_storeu_si128((__m128i *)(pValues + i), ca_convert_swap_16_sse2_step(value));
+  }
+
+  ca_convert_swap_16_scalar(pValues + i, count - i);
+}
+
+CA_TARGET_SSE2 static void ca_convert_swap_32_sse2(void *pSamples, ca_uint32 count)
+{
+  ca_int32 *pValues = (ca_int32 *)pSamples;
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    // Swap the 16-bit halves, then the bytes of each half.
+    __m128i value = _mm_loadu_si128((const __m128i *)(pValues + i));
+    value = _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128((__m128i *)(pValues + i), ca_convert_swap_16_sse2_step(value));
+  }
+
+  ca_convert_swap_32_scalar(pValues + i, count - i);
+}
+
+static const ca_convert_kernels sse2Kernels = {
+    .toF32 = {NULL, ca_convert_u8_to_f32_sse2, ca_convert_s16_to_f32_sse2, NULL, ca_convert_s32_to_f32_sse2, NULL},
+    .fromF32 = {NULL, ca_convert_f32_to_u8_sse2, ca_convert_f32_to_s16_sse2, ca_convert_f32_to_s24_sse2, ca_convert_f32_to_s32_sse2, NULL},
+    .toS32 = {NULL, ca_convert_u8_to_s32_sse2, ca_convert_s16_to_s32_sse2, NULL, NULL, NULL},
+    .fromS32 = {NULL, ca_convert_s32_to_u8_sse2, ca_convert_s32_to_s16_sse2, NULL, NULL, NULL},
+    .deinterleave16Stereo = ca_convert_deinterleave_16_stereo_sse2,
+    .deinterleave32Stereo = ca_convert_deinterleave_32_stereo_sse2,
+    .swap16 = ca_convert_swap_16_sse2,
+    .swap32 = ca_convert_swap_32_sse2,
+};
+#endif
+
+// MARK: AVX2 kernels
+
+#if CA_SUPPORT_AVX2
+CA_TARGET_AVX2 static inline __m256i ca_convert_f32_to_s32_avx2_step(const float *pIn, const float *pDither, float scale, float min, float max)
+{
+  __m256 value = _mm256_mul_ps(_mm256_loadu_ps(pIn), _mm256_set1_ps(scale));
+  if (pDither != NULL)
+  {
+    value = _mm256_add_ps(value, _mm256_loadu_ps(pDither));
+  }
+  value = _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(max)), _mm256_set1_ps(min));
+  return _mm256_cvtps_epi32(value);
+}
+
+CA_TARGET_AVX2 static inline __m256i ca_convert_narrow_s32_avx2(__m256i value, const ca_int32 *pDither, int shift)
+{
+  if (pDither == NULL)
+  {
+    return _mm256_sra_epi32(value, _mm_cvtsi32_si128(shift));
+  }
+
+  __m256i dither = _mm256_loadu_si256((const __m256i *)pDither);
+  __m256i sum = _mm256_add_epi32(_mm256_srai_epi32(value, 1), _mm256_srai_epi32(dither, 1));
+  return _mm256_sra_epi32(sum, _mm_cvtsi32_si128(shift - 1));
+}
+
+// Loads 8 packed 24-bit samples into the upper 24 bits of each lane. Reads 4 bytes past the last sample.
+CA_TARGET_AVX2 static inline __m256i ca_convert_load_s24_avx2(const ca_uint8 *pIn)
+{
+  const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)pIn), shuffle);
+  __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pIn + 12)), shuffle);
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+CA_TARGET_AVX2 static inline void ca_convert_store_s24_avx2(ca_uint8 *pOut, __m256i value)
+{
+  const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  __m256i packed = _mm256_shuffle_epi8(value, shuffle);
+  __m128i lo = _mm256_castsi256_si128(packed);
+  __m128i hi = _mm256_extracti128_si256(packed, 1);
+  _mm_storel_epi64((__m128i *)pOut, lo);
+  ca_int32 loTail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+  memcpy(pOut + 8, &loTail, 4);
+  _mm_storel_epi64((__m128i *)(pOut + 12), hi);
+  ca_int32 hiTail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+  memcpy(pOut + 20, &hiTail, 4);
+}
+
+CA_TARGET_AVX2 static void ca_convert_u8_to_f32_avx2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  const __m256 scale = _mm256_set1_ps(1.0f / U8_SCALE);
+  const __m256i bias = _mm256_set1_epi32(128);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i samples = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pSamples + i))), bias);
+    _mm256_storeu_ps(pOut + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+  }
+
+  ca_convert_u8_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s16_to_f32_avx2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+  const __m256 scale = _mm256_set1_ps(1.0f / S16_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pSamples + i)));
+    _mm256_storeu_ps(pOut + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+  }
+
+  ca_convert_s16_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s24_to_f32_avx2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  const __m256 scale = _mm256_set1_ps(1.0f / S32_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 10 <= count; i += 8)
+  {
+    _mm256_storeu_ps(pOut + i, _mm256_mul_ps(_mm256_cvtepi32_ps(ca_convert_load_s24_avx2(pSamples + i * 3)), scale));
+  }
+
+  ca_convert_s24_to_f32_scalar(pOut + i, pSamples + i * 3, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s32_to_f32_avx2(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+  const __m256 scale = _mm256_set1_ps(1.0f / S32_SCALE);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    _mm256_storeu_ps(pOut + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(pSamples + i))), scale));
+  }
+
+  ca_convert_s32_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_f32_to_u8_avx2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  const __m256i bias = _mm256_set1_epi8((char)0x80);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  ca_uint32 i = 0;
+  for (; i + 32 <= count; i += 32)
+  {
+    __m256i v0 = ca_convert_f32_to_s32_avx2_step(pIn + i, pDither == NULL ? NULL : pDither + i, U8_SCALE, U8_MIN, U8_MAX);
+    __m256i v1 = ca_convert_f32_to_s32_avx2_step(pIn + i + 8, pDither == NULL ? NULL : pDither + i + 8, U8_SCALE, U8_MIN, U8_MAX);
+    __m256i v2 = ca_convert_f32_to_s32_avx2_step(pIn + i + 16, pDither == NULL ? NULL : pDither + i + 16, U8_SCALE, U8_MIN, U8_MAX);
+    __m256i v3 = ca_convert_f32_to_s32_avx2_step(pIn + i + 24, pDither == NULL ? NULL : pDither + i + 24, U8_SCALE, U8_MIN, U8_MAX);
+
+    // The packs work per 128-bit lane, so the dwords are put back in order afterwards.
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v0, v1), _mm256_packs_epi32(v2, v3));
+    packed = _mm256_permutevar8x32_epi32(packed, order);
+    _mm256_storeu_si256((__m256i *)(pSamples + i), _mm256_xor_si256(packed, bias));
+  }
+
+  ca_convert_f32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_f32_to_s16_avx2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i v0 = ca_convert_f32_to_s32_avx2_step(pIn + i, pDither == NULL ? NULL : pDither + i, S16_SCALE, S16_MIN, S16_MAX);
+    __m256i v1 = ca_convert_f32_to_s32_avx2_step(pIn + i + 8, pDither == NULL ? NULL : pDither + i + 8, S16_SCALE, S16_MIN, S16_MAX);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v0, v1), 0xD8);
+    _mm256_storeu_si256((__m256i *)(pSamples + i), packed);
+  }
+
+  ca_convert_f32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_f32_to_s24_avx2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    ca_convert_store_s24_avx2(pSamples + i * 3, ca_convert_f32_to_s32_avx2_step(pIn + i, pDither == NULL ? NULL : pDither + i, S24_SCALE, S24_MIN, S24_MAX));
+  }
+
+  ca_convert_f32_to_s24_scalar(pSamples + i * 3, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_f32_to_s32_avx2(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  (void)pDither;
+  ca_int32 *pSamples = (ca_int32 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    _mm256_storeu_si256((__m256i *)(pSamples + i), ca_convert_f32_to_s32_avx2_step(pIn + i, NULL, S32_SCALE, S32_MIN, S32_MAX));
+  }
+
+  ca_convert_f32_to_s32_scalar(pSamples + i, pIn + i, NULL, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_u8_to_s32_avx2(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i samples = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pSamples + i)));
+    _mm256_storeu_si256((__m256i *)(pOut + i), _mm256_xor_si256(_mm256_slli_epi32(samples, 24), bias));
+  }
+
+  ca_convert_u8_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s16_to_s32_avx2(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pSamples + i)));
+    _mm256_storeu_si256((__m256i *)(pOut + i), _mm256_slli_epi32(samples, 16));
+  }
+
+  ca_convert_s16_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s24_to_s32_avx2(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 10 <= count; i += 8)
+  {
+    _mm256_storeu_si256((__m256i *)(pOut + i), ca_convert_load_s24_avx2(pSamples + i * 3));
+  }
+
+  ca_convert_s24_to_s32_scalar(pOut + i, pSamples + i * 3, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s32_to_u8_avx2(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  const __m256i bias = _mm256_set1_epi8((char)0x80);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  ca_uint32 i = 0;
+  for (; i + 32 <= count; i += 32)
+  {
+    __m256i v0 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i)), pDither == NULL ? NULL : pDither + i, U8_SHIFT);
+    __m256i v1 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i + 8)), pDither == NULL ? NULL : pDither + i + 8, U8_SHIFT);
+    __m256i v2 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i + 16)), pDither == NULL ? NULL : pDither + i + 16, U8_SHIFT);
+    __m256i v3 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i + 24)), pDither == NULL ? NULL : pDither + i + 24, U8_SHIFT);
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v0, v1), _mm256_packs_epi32(v2, v3));
+    packed = _mm256_permutevar8x32_epi32(packed, order);
+    _mm256_storeu_si256((__m256i *)(pSamples + i), _mm256_xor_si256(packed, bias));
+  }
+
+  ca_convert_s32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s32_to_s16_avx2(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i v0 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i)), pDither == NULL ? NULL : pDither + i, S16_SHIFT);
+    __m256i v1 = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i + 8)), pDither == NULL ? NULL : pDither + i + 8, S16_SHIFT);
+    _mm256_storeu_si256((__m256i *)(pSamples + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(v0, v1), 0xD8));
+  }
+
+  ca_convert_s32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_s32_to_s24_avx2(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  const __m256i min = _mm256_set1_epi32(-8388608);
+  const __m256i max = _mm256_set1_epi32(8388607);
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i value = ca_convert_narrow_s32_avx2(_mm256_loadu_si256((const __m256i *)(pIn + i)), pDither == NULL ? NULL : pDither + i, S24_SHIFT);
+    ca_convert_store_s24_avx2(pSamples + i * 3, _mm256_max_epi32(_mm256_min_epi32(value, max), min));
+  }
+
+  ca_convert_s32_to_s24_scalar(pSamples + i * 3, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_deinterleave_16_stereo_avx2(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const short *pSamples = (const short *)pIn;
+  short *pLeft = (short *)ppOut[0];
+  short *pRight = (short *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= frameCount; i += 16)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(pSamples + i * 2));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(pSamples + i * 2 + 16));
+    __m256i left = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+    __m256i right = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+    _mm256_storeu_si256((__m256i *)(pLeft + i), _mm256_permute4x64_epi64(left, 0xD8));
+    _mm256_storeu_si256((__m256i *)(pRight + i), _mm256_permute4x64_epi64(right, 0xD8));
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_16_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_deinterleave_32_stereo_avx2(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const float *pSamples = (const float *)pIn;
+  float *pLeft = (float *)ppOut[0];
+  float *pRight = (float *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= frameCount; i += 8)
+  {
+    __m256 a = _mm256_loadu_ps(pSamples + i * 2);
+    __m256 b = _mm256_loadu_ps(pSamples + i * 2 + 8);
+    __m256d left = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256d right = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm256_storeu_ps(pLeft + i, _mm256_castpd_ps(_mm256_permute4x64_pd(left, 0xD8)));
+    _mm256_storeu_ps(pRight + i, _mm256_castpd_ps(_mm256_permute4x64_pd(right, 0xD8)));
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_32_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+CA_TARGET_AVX2 static void ca_convert_swap_avx2(void *pSamples, ca_uint32 byteCount, __m256i mask)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  for (ca_uint32 i = 0; i < byteCount; i += 32)
+  {
+    __m256i value = _mm256_loadu_si256((const __m256i *)(pBytes + i));
+    _mm256_storeu_si256((__m256i *)(pBytes + i), _mm256_shuffle_epi8(value, mask));
+  }
+}
+
+CA_TARGET_AVX2 static void ca_convert_swap_16_avx2(void *pSamples, ca_uint32 count)
+{
+  const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  ca_uint32 vectorCount = count & ~15u;
+  ca_convert_swap_avx2(pSamples, vectorCount * 2, mask);
+  ca_convert_swap_16_scalar((short *)pSamples + vectorCount, count - vectorCount);
+}
+
+CA_TARGET_AVX2 static void ca_convert_swap_32_avx2(void *pSamples, ca_uint32 count)
+{
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  ca_uint32 vectorCount = count & ~7u;
+  ca_convert_swap_avx2(pSamples, vectorCount * 4, mask);
+  ca_convert_swap_32_scalar((ca_int32 *)pSamples + vectorCount, count - vectorCount);
+}
+
+static const ca_convert_kernels avx2Kernels = {
+    .toF32 = {NULL, ca_convert_u8_to_f32_avx2, ca_convert_s16_to_f32_avx2, ca_convert_s24_to_f32_avx2, ca_convert_s32_to_f32_avx2, NULL},
+    .fromF32 = {NULL, ca_convert_f32_to_u8_avx2, ca_convert_f32_to_s16_avx2, ca_convert_f32_to_s24_avx2, ca_convert_f32_to_s32_avx2, NULL},
+    .toS32 = {NULL, ca_convert_u8_to_s32_avx2, ca_convert_s16_to_s32_avx2, ca_convert_s24_to_s32_avx2, NULL, NULL},
+    .fromS32 = {NULL, ca_convert_s32_to_u8_avx2, ca_convert_s32_to_s16_avx2, ca_convert_s32_to_s24_avx2, NULL, NULL},
+    .deinterleave16Stereo = ca_convert_deinterleave_16_stereo_avx2,
+    .deinterleave32Stereo = ca_convert_deinterleave_32_stereo_avx2,
+    .swap16 = ca_convert_swap_16_avx2,
+    .swap32 = ca_convert_swap_32_avx2,
+};
+#endif
+
+// MARK: NEON kernels
+
+#if CA_SUPPORT_NEON
+static inline float32x4_t ca_convert_clamp_neon(float32x4_t value, float min, float max)
+{
+  // Selects instead of vminq/vmaxq so NaN behaves like the scalar kernels.
+  float32x4_t vmax = vdupq_n_f32(max);
+  float32x4_t vmin = vdupq_n_f32(min);
+  value = vbslq_f32(vcltq_f32(value, vmax), value, vmax);
+  value = vbslq_f32(vcgtq_f32(value, vmin), value, vmin);
+  return value;
+}
+
+static inline int32x4_t ca_convert_f32_to_s32_neon_step(const float *pIn, const float *pDither, float scale, float min, float max)
+{
+  float32x4_t value = vmulq_n_f32(vld1q_f32(pIn), scale);
+  if (pDither != NULL)
+  {
+    value = vaddq_f32(value, vld1q_f32(pDither));
+  }
+  return vcvtnq_s32_f32(ca_convert_clamp_neon(value, min, max));
+}
+
+static inline int32x4_t ca_convert_narrow_s32_neon(int32x4_t value, const ca_int32 *pDither, int shift)
+{
+  if (pDither == NULL)
+  {
+    return vshlq_s32(value, vdupq_n_s32(-shift));
+  }
+
+  int32x4_t sum = vaddq_s32(vshrq_n_s32(value, 1), vshrq_n_s32(vld1q_s32(pDither), 1));
+  return vshlq_s32(sum, vdupq_n_s32(-(shift - 1)));
+}
+
+// Loads 16 packed 24-bit samples into the upper 24 bits of each lane.
+static inline void ca_convert_load_s24_neon(const ca_uint8 *pIn, int32x4_t *pOut)
+{
+  uint8x16x3_t bytes = vld3q_u8(pIn);
+  uint8x16x2_t low = vzipq_u8(vdupq_n_u8(0), bytes.val[0]);
+  uint8x16x2_t high = vzipq_u8(bytes.val[1], bytes.val[2]);
+  uint16x8x2_t first = vzipq_u16(vreinterpretq_u16_u8(low.val[0]), vreinterpretq_u16_u8(high.val[0]));
+  uint16x8x2_t second = vzipq_u16(vreinterpretq_u16_u8(low.val[1]), vreinterpretq_u16_u8(high.val[1]));
+  pOut[0] = vreinterpretq_s32_u16(first.val[0]);
+  pOut[1] = vreinterpretq_s32_u16(first.val[1]);
+  pOut[2] = vreinterpretq_s32_u16(second.val[0]);
+  pOut[3] = vreinterpretq_s32_u16(second.val[1]);
+}
+
+// Stores the lower 24 bits of 16 samples.
+static inline void ca_convert_store_s24_neon(ca_uint8 *pOut, const int32x4_t *pValues)
+{
+  uint16x8_t low01 = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(pValues[0])), vmovn_u32(vreinterpretq_u32_s32(pValues[1])));
+  uint16x8_t low23 = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(pValues[2])), vmovn_u32(vreinterpretq_u32_s32(pValues[3])));
+  uint16x8_t high01 = vcombine_u16(vshrn_n_u32(vreinterpretq_u32_s32(pValues[0]), 16), vshrn_n_u32(vreinterpretq_u32_s32(pValues[1]), 16));
+  uint16x8_t high23 = vcombine_u16(vshrn_n_u32(vreinterpretq_u32_s32(pValues[2]), 16), vshrn_n_u32(vreinterpretq_u32_s32(pValues[3]), 16));
+
+  uint8x16x3_t bytes;
+  bytes.val[0] = vcombine_u8(vmovn_u16(low01), vmovn_u16(low23));
+  bytes.val[1] = vcombine_u8(vshrn_n_u16(low01, 8), vshrn_n_u16(low23, 8));
+  bytes.val[2] = vcombine_u8(vmovn_u16(high01), vmovn_u16(high23));
+  vst3q_u8(pOut, bytes);
+}
+
+static void ca_convert_u8_to_f32_neon(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    int8x16_t bytes = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(pSamples + i), vdupq_n_u8(0x80)));
+    int16x8_t lo16 = vmovl_s8(vget_low_s8(bytes));
+    int16x8_t hi16 = vmovl_s8(vget_high_s8(bytes));
+    vst1q_f32(pOut + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo16))), 1.0f / U8_SCALE));
+    vst1q_f32(pOut + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo16))), 1.0f / U8_SCALE));
+    vst1q_f32(pOut + i + 8, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi16))), 1.0f / U8_SCALE));
+    vst1q_f32(pOut + i + 12, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi16))), 1.0f / U8_SCALE));
+  }
+
+  ca_convert_u8_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+static void ca_convert_s16_to_f32_neon(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    int16x8_t samples = vld1q_s16(pSamples + i);
+    vst1q_f32(pOut + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), 1.0f / S16_SCALE));
+    vst1q_f32(pOut + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), 1.0f / S16_SCALE));
+  }
+
+  ca_convert_s16_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+static void ca_convert_s24_to_f32_neon(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  int32x4_t values[4];
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    ca_convert_load_s24_neon(pSamples + i * 3, values);
+    for (int j = 0; j < 4; j++)
+    {
+      vst1q_f32(pOut + i + j * 4, vmulq_n_f32(vcvtq_f32_s32(values[j]), 1.0f / S32_SCALE));
+    }
+  }
+
+  ca_convert_s24_to_f32_scalar(pOut + i, pSamples + i * 3, count - i);
+}
+
+static void ca_convert_s32_to_f32_neon(float *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    vst1q_f32(pOut + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(pSamples + i)), 1.0f / S32_SCALE));
+  }
+
+  ca_convert_s32_to_f32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+static void ca_convert_f32_to_u8_neon(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    int32x4_t v0 = ca_convert_f32_to_s32_neon_step(pIn + i, pDither == NULL ? NULL : pDither + i, U8_SCALE, U8_MIN, U8_MAX);
+    int32x4_t v1 = ca_convert_f32_to_s32_neon_step(pIn + i + 4, pDither == NULL ? NULL : pDither + i + 4, U8_SCALE, U8_MIN, U8_MAX);
+    int32x4_t v2 = ca_convert_f32_to_s32_neon_step(pIn + i + 8, pDither == NULL ? NULL : pDither + i + 8, U8_SCALE, U8_MIN, U8_MAX);
+    int32x4_t v3 = ca_convert_f32_to_s32_neon_step(pIn + i + 12, pDither == NULL ? NULL : pDither + i + 12, U8_SCALE, U8_MIN, U8_MAX);
+    int8x16_t packed = vcombine_s8(vqmovn_s16(vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1))), vqmovn_s16(vcombine_s16(vqmovn_s32(v2), vqmovn_s32(v3))));
+    vst1q_u8(pSamples + i, veorq_u8(vreinterpretq_u8_s8(packed), vdupq_n_u8(0x80)));
+  }
+
+  ca_convert_f32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_f32_to_s16_neon(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    int32x4_t v0 = ca_convert_f32_to_s32_neon_step(pIn + i, pDither == NULL ? NULL : pDither + i, S16_SCALE, S16_MIN, S16_MAX);
+    int32x4_t v1 = ca_convert_f32_to_s32_neon_step(pIn + i + 4, pDither == NULL ? NULL : pDither + i + 4, S16_SCALE, S16_MIN, S16_MAX);
+    vst1q_s16(pSamples + i, vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1)));
+  }
+
+  ca_convert_f32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_f32_to_s24_neon(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  int32x4_t values[4];
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      values[j] = ca_convert_f32_to_s32_neon_step(pIn + i + j * 4, pDither == NULL ? NULL : pDither + i + j * 4, S24_SCALE, S24_MIN, S24_MAX);
+    }
+    ca_convert_store_s24_neon(pSamples + i * 3, values);
+  }
+
+  ca_convert_f32_to_s24_scalar(pSamples + i * 3, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_f32_to_s32_neon(void *pOut, const float *pIn, const float *pDither, ca_uint32 count)
+{
+  (void)pDither;
+  ca_int32 *pSamples = (ca_int32 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    vst1q_s32(pSamples + i, ca_convert_f32_to_s32_neon_step(pIn + i, NULL, S32_SCALE, S32_MIN, S32_MAX));
+  }
+
+  ca_convert_f32_to_s32_scalar(pSamples + i, pIn + i, NULL, count - i);
+}
+
+static void ca_convert_u8_to_s32_neon(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    int8x16_t bytes = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(pSamples + i), vdupq_n_u8(0x80)));
+    int16x8_t lo16 = vshll_n_s8(vget_low_s8(bytes), 8);
+    int16x8_t hi16 = vshll_n_s8(vget_high_s8(bytes), 8);
+    vst1q_s32(pOut + i, vshll_n_s16(vget_low_s16(lo16), 16));
+    vst1q_s32(pOut + i + 4, vshll_n_s16(vget_high_s16(lo16), 16));
+    vst1q_s32(pOut + i + 8, vshll_n_s16(vget_low_s16(hi16), 16));
+    vst1q_s32(pOut + i + 12, vshll_n_s16(vget_high_s16(hi16), 16));
+  }
+
+  ca_convert_u8_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+static void ca_convert_s16_to_s32_neon(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const short *pSamples = (const short *)pIn;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    int16x8_t samples = vld1q_s16(pSamples + i);
+    vst1q_s32(pOut + i, vshll_n_s16(vget_low_s16(samples), 16));
+    vst1q_s32(pOut + i + 4, vshll_n_s16(vget_high_s16(samples), 16));
+  }
+
+  ca_convert_s16_to_s32_scalar(pOut + i, pSamples + i, count - i);
+}
+
+static void ca_convert_s24_to_s32_neon(ca_int32 *pOut, const void *pIn, ca_uint32 count)
+{
+  const ca_uint8 *pSamples = (const ca_uint8 *)pIn;
+  int32x4_t values[4];
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    ca_convert_load_s24_neon(pSamples + i * 3, values);
+    for (int j = 0; j < 4; j++)
+    {
+      vst1q_s32(pOut + i + j * 4, values[j]);
+    }
+  }
+
+  ca_convert_s24_to_s32_scalar(pOut + i, pSamples + i * 3, count - i);
+}
+
+static void ca_convert_s32_to_u8_neon(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    int32x4_t v0 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i), pDither == NULL ? NULL : pDither + i, U8_SHIFT);
+    int32x4_t v1 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i + 4), pDither == NULL ? NULL : pDither + i + 4, U8_SHIFT);
+    int32x4_t v2 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i + 8), pDither == NULL ? NULL : pDither + i + 8, U8_SHIFT);
+    int32x4_t v3 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i + 12), pDither == NULL ? NULL : pDither + i + 12, U8_SHIFT);
+    int8x16_t packed = vcombine_s8(vqmovn_s16(vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1))), vqmovn_s16(vcombine_s16(vqmovn_s32(v2), vqmovn_s32(v3))));
+    vst1q_u8(pSamples + i, veorq_u8(vreinterpretq_u8_s8(packed), vdupq_n_u8(0x80)));
+  }
+
+  ca_convert_s32_to_u8_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_s32_to_s16_neon(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  short *pSamples = (short *)pOut;
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    int32x4_t v0 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i), pDither == NULL ? NULL : pDither + i, S16_SHIFT);
+    int32x4_t v1 = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i + 4), pDither == NULL ? NULL : pDither + i + 4, S16_SHIFT);
+    vst1q_s16(pSamples + i, vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1)));
+  }
+
+  ca_convert_s32_to_s16_scalar(pSamples + i, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_s32_to_s24_neon(void *pOut, const ca_int32 *pIn, const ca_int32 *pDither, ca_uint32 count)
+{
+  ca_uint8 *pSamples = (ca_uint8 *)pOut;
+  int32x4_t values[4];
+
+  ca_uint32 i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      int32x4_t value = ca_convert_narrow_s32_neon(vld1q_s32(pIn + i + j * 4), pDither == NULL ? NULL : pDither + i + j * 4, S24_SHIFT);
+      values[j] = vmaxq_s32(vminq_s32(value, vdupq_n_s32(8388607)), vdupq_n_s32(-8388608));
+    }
+    ca_convert_store_s24_neon(pSamples + i * 3, values);
+  }
+
+  ca_convert_s32_to_s24_scalar(pSamples + i * 3, pIn + i, pDither == NULL ? NULL : pDither + i, count - i);
+}
+
+static void ca_convert_deinterleave_16_stereo_neon(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const short *pSamples = (const short *)pIn;
+  short *pLeft = (short *)ppOut[0];
+  short *pRight = (short *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 8 <= frameCount; i += 8)
+  {
+    int16x8x2_t frames = vld2q_s16(pSamples + i * 2);
+    vst1q_s16(pLeft + i, frames.val[0]);
+    vst1q_s16(pRight + i, frames.val[1]);
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_16_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+static void ca_convert_deinterleave_32_stereo_neon(void **ppOut, const void *pIn, ca_uint32 frameCount)
+{
+  const ca_int32 *pSamples = (const ca_int32 *)pIn;
+  ca_int32 *pLeft = (ca_int32 *)ppOut[0];
+  ca_int32 *pRight = (ca_int32 *)ppOut[1];
+
+  ca_uint32 i = 0;
+  for (; i + 4 <= frameCount; i += 4)
+  {
+    int32x4x2_t frames = vld2q_s32(pSamples + i * 2);
+    vst1q_s32(pLeft + i, frames.val[0]);
+    vst1q_s32(pRight + i, frames.val[1]);
+  }
+
+  void *ppRest[2] = {pLeft + i, pRight + i};
+  ca_convert_deinterleave_32_stereo_scalar(ppRest, pSamples + i * 2, frameCount - i);
+}
+
+static void ca_convert_swap_16_neon(void *pSamples, ca_uint32 count)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  ca_uint32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    vst1q_u8(pBytes + i * 2, vrev16q_u8(vld1q_u8(pBytes + i * 2)));
+  }
+
+  ca_convert_swap_16_scalar(pBytes + i * 2, count - i);
+}
+
+static void ca_convert_swap_32_neon(void *pSamples, ca_uint32 count)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  ca_uint32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    vst1q_u8(pBytes + i * 4, vrev32q_u8(vld1q_u8(pBytes + i * 4)));
+  }
+
+  ca_convert_swap_32_scalar(pBytes + i * 4, count - i);
+}
+
+static const ca_convert_kernels neonKernels = {
+    .toF32 = {NULL, ca_convert_u8_to_f32_neon, ca_convert_s16_to_f32_neon, ca_convert_s24_to_f32_neon, ca_convert_s32_to_f32_neon, NULL},
+    .fromF32 = {NULL, ca_convert_f32_to_u8_neon, ca_convert_f32_to_s16_neon, ca_convert_f32_to_s24_neon, ca_convert_f32_to_s32_neon, NULL},
+    .toS32 = {NULL, ca_convert_u8_to_s32_neon, ca_convert_s16_to_s32_neon, ca_convert_s24_to_s32_neon, NULL, NULL},
+    .fromS32 = {NULL, ca_convert_s32_to_u8_neon, ca_convert_s32_to_s16_neon, ca_convert_s32_to_s24_neon, NULL, NULL},
+    .deinterleave16Stereo = ca_convert_deinterleave_16_stereo_neon,
+    .deinterleave32Stereo = ca_convert_deinterleave_32_stereo_neon,
+    .swap16 = ca_convert_swap_16_neon,
+    .swap32 = ca_convert_swap_32_neon,
+};
+#endif
+
+// MARK: Dispatch
+
+static pthread_once_t simdKernelsOnce = PTHREAD_ONCE_INIT;
+static ca_convert_kernels simdKernels;
+
+static void ca_convert_merge_kernels(ca_convert_kernels *pKernels, const ca_convert_kernels *pOverrides)
+{
+  for (int i = 0; i < CONVERT_FORMAT_COUNT; i++)
+  {
+    pKernels->toF32[i] = pOverrides->toF32[i] != NULL ? pOverrides->toF32[i] : pKernels->toF32[i];
+    pKernels->fromF32[i] = pOverrides->fromF32[i] != NULL ? pOverrides->fromF32[i] : pKernels->fromF32[i];
+    pKernels->toS32[i] = pOverrides->toS32[i] != NULL ? pOverrides->toS32[i] : pKernels->toS32[i];
+    pKernels->fromS32[i] = pOverrides->fromS32[i] != NULL ? pOverrides->fromS32[i] : pKernels->fromS32[i];
+  }
+
+  pKernels->deinterleave16Stereo = pOverrides->deinterleave16Stereo != NULL ? pOverrides->deinterleave16Stereo : pKernels->deinterleave16Stereo;
+  pKernels->deinterleave32Stereo = pOverrides->deinterleave32Stereo != NULL ? pOverrides->deinterleave32Stereo : pKernels->deinterleave32Stereo;
+  pKernels->swap16 = pOverrides->swap16 != NULL ? pOverrides->swap16 : pKernels->swap16;
+  pKernels->swap32 = pOverrides->swap32 != NULL ? pOverrides->swap32 : pKernels->swap32;
+}
+
+static void ca_convert_init_simd_kernels()
+{
+  ca_uint32 features = ca_get_cpu_features();
+  simdKernels = scalarKernels;
+
+#if CA_SUPPORT_SSE2
+  if (features & ca_cpu_feature_sse2)
+  {
+    ca_convert_merge_kernels(&simdKernels, &sse2Kernels);
+  }
+#endif
+
+#if CA_SUPPORT_AVX2
+  if (features & ca_cpu_feature_avx2)
+  {
+    ca_convert_merge_kernels(&simdKernels, &avx2Kernels);
+  }
+#endif
+
+#if CA_SUPPORT_NEON
+  if (features & ca_cpu_feature_neon)
+  {
+    ca_convert_merge_kernels(&simdKernels, &neonKernels);
+  }
+#endif
+
+  (void)features;
+}
+
+// MARK: Dither
+
+static inline ca_uint32 ca_convert_next_random(ca_uint32 *pState)
+{
+  *pState = *pState * 1664525u + 1013904223u;
+  return *pState;
+}
+
+// Triangular noise in [-1, 1) LSB of the output format.
+static void ca_convert_generate_f32_dither(ca_uint32 *pState, float *pDither, ca_uint32 count)
+{
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    ca_uint32 a = ca_convert_next_random(pState) >> 8;
+    ca_uint32 b = ca_convert_next_random(pState) >> 8;
+    pDither[i] = (float)(ca_int32)(a + b) * (1.0f / 16777216.0f) - 1.0f;
+  }
+}
+
+// Triangular noise in [-1, 1) LSB of the output format, scaled to s32.
+static void ca_convert_generate_s32_dither(ca_uint32 *pState, ca_int32 *pDither, ca_uint32 count, int shift)
+{
+  for (ca_uint32 i = 0; i < count; i++)
+  {
+    ca_int32 a = (ca_int32)(ca_convert_next_random(pState) >> (32 - shift));
+    ca_int32 b = (ca_int32)(ca_convert_next_random(pState) >> (32 - shift));
+    pDither[i] = a + b - (ca_int32)(1u << shift);
+  }
+}
+
+static int ca_convert_get_shift(ca_sample_format format)
+{
+  switch (format)
+  {
+  case ca_sample_format_u8:
+    return U8_SHIFT;
+  case ca_sample_format_s16:
+    return S16_SHIFT;
+  case ca_sample_format_s24:
+    return S24_SHIFT;
+  default:
+    return 0;
+  }
+}
+
+// MARK: Public API
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_bytes_per_sample(ca_sample_format format)
+{
+  switch (format)
+  {
+  case ca_sample_format_u8:
+    return 1;
+  case ca_sample_format_s16:
+    return 2;
+  case ca_sample_format_s24:
+    return 3;
+  case ca_sample_format_s32:
+  case ca_sample_format_f32:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+FFI_PLUGIN_EXPORT ca_converter_config ca_converter_config_init(ca_sample_format formatIn, ca_sample_format formatOut)
+{
+  ca_converter_config config = {
+      .formatIn = formatIn,
+      .formatOut = formatOut,
+      .ditherMode = ca_dither_mode_none,
+      .ditherSeed = 0x12345678,
+      .isSimdDisabled = CA_FALSE,
+  };
+  return config;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_converter_init(ca_converter *pConverter, ca_converter_config config)
+{
+  if (ca_get_bytes_per_sample(config.formatIn) == 0 || ca_get_bytes_per_sample(config.formatOut) == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  // f32 and s32 carry at least 24 bits, so dither is only useful for the narrower integer formats.
+  ca_bool isNarrowing = config.formatOut != ca_sample_format_f32 && config.formatOut != ca_sample_format_s32 && ca_get_bytes_per_sample(config.formatOut) < ca_get_bytes_per_sample(config.formatIn);
+  if (!isNarrowing)
+  {
+    config.ditherMode = ca_dither_mode_none;
+  }
+
+  if (config.isSimdDisabled)
+  {
+    pConverter->pKernels = &scalarKernels;
+  }
+  else
+  {
+    pthread_once(&simdKernelsOnce, ca_convert_init_simd_kernels);
+    pConverter->pKernels = &simdKernels;
+  }
+
+  pConverter->config = config;
+  pConverter->ditherState = config.ditherSeed;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_converter_process(ca_converter *pConverter, void *pSamplesOut, const void *pSamplesIn, ca_uint64 sampleCount)
+{
+  const ca_convert_kernels *pKernels = (const ca_convert_kernels *)pConverter->pKernels;
+  ca_sample_format formatIn = pConverter->config.formatIn;
+  ca_sample_format formatOut = pConverter->config.formatOut;
+  ca_uint32 bytesPerSampleIn = ca_get_bytes_per_sample(formatIn);
+  ca_uint32 bytesPerSampleOut = ca_get_bytes_per_sample(formatOut);
+  ca_bool isDithering = pConverter->config.ditherMode != ca_dither_mode_none;
+
+  if (formatIn == formatOut)
+  {
+    if (pSamplesOut != pSamplesIn)
+    {
+      memmove(pSamplesOut, pSamplesIn, sampleCount * bytesPerSampleIn);
+    }
+    return ca_result_success;
+  }
+
+  // Integer pairs are converted through s32 without losing bits. The others go through f32.
+  ca_bool isFloat = formatIn == ca_sample_format_f32 || formatOut == ca_sample_format_f32;
+  union
+  {
+    float f32[CONVERT_BLOCK_SIZE];
+    ca_int32 s32[CONVERT_BLOCK_SIZE];
+  } buffer, dither;
+
+  const ca_uint8 *pIn = (const ca_uint8 *)pSamplesIn;
+  ca_uint8 *pOut = (ca_uint8 *)pSamplesOut;
+  while (sampleCount > 0)
+  {
+    ca_uint32 count = (ca_uint32)ca_min(sampleCount, (ca_uint64)CONVERT_BLOCK_SIZE);
+
+    if (isFloat)
+    {
+      const float *pIntermediate = (const float *)pIn;
+      if (formatIn != ca_sample_format_f32)
+      {
+        float *pTarget = formatOut == ca_sample_format_f32 ? (float *)pOut : buffer.f32;
+        pKernels->toF32[formatIn](pTarget, pIn, count);
+        pIntermediate = pTarget;
+      }
+
+      if (formatOut != ca_sample_format_f32)
+      {
+        if (isDithering)
+        {
+          ca_convert_generate_f32_dither(&pConverter->ditherState, dither.f32, count);
+        }
+        pKernels->fromF32[formatOut](pOut, pIntermediate, isDithering ? dither.f32 : NULL, count);
+      }
+    }
+    else
+    {
+      const ca_int32 *pIntermediate = (const ca_int32 *)pIn;
+      if (formatIn != ca_sample_format_s32)
+      {
+        ca_int32 *pTarget = formatOut == ca_sample_format_s32 ? (ca_int32 *)pOut : buffer.s32;
+        pKernels->toS32[formatIn](pTarget, pIn, count);
+        pIntermediate = pTarget;
+      }
+
+      if (formatOut != ca_sample_format_s32)
+      {
+        if (isDithering)
+        {
+          ca_convert_generate_s32_dither(&pConverter->ditherState, dither.s32, count, ca_convert_get_shift(formatOut));
+        }
+        pKernels->fromS32[formatOut](pOut, pIntermediate, isDithering ? dither.s32 : NULL, count);
+      }
+    }
+
+    pIn += (size_t)count * bytesPerSampleIn;
+    pOut += (size_t)count * bytesPerSampleOut;
+    sampleCount -= count;
+  }
+
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_convert_pcm(void *pSamplesOut, ca_sample_format formatOut, const void *pSamplesIn, ca_sample_format formatIn, ca_uint64 sampleCount, ca_dither_mode ditherMode)
+{
+  ca_converter_config config = ca_converter_config_init(formatIn, formatOut);
+  config.ditherMode = ditherMode;
+
+  ca_converter converter;
+  ca_result result = ca_converter_init(&converter, config);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  return ca_converter_process(&converter, pSamplesOut, pSamplesIn, sampleCount);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_deinterleave_pcm(void **ppChannelsOut, const void *pSamplesIn, ca_sample_format format, ca_uint32 channels, ca_uint64 frameCount)
+{
+  ca_uint32 bytesPerSample = ca_get_bytes_per_sample(format);
+  if (bytesPerSample == 0 || channels == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  if (channels == 1)
+  {
+    memcpy(ppChannelsOut[0], pSamplesIn, frameCount * bytesPerSample);
+    return ca_result_success;
+  }
+
+  pthread_once(&simdKernelsOnce, ca_convert_init_simd_kernels);
+  if (channels == 2 && (bytesPerSample == 2 || bytesPerSample == 4))
+  {
+    ca_convert_deinterleave_proc pKernel = bytesPerSample == 2 ? simdKernels.deinterleave16Stereo : simdKernels.deinterleave32Stereo;
+    const ca_uint8 *pIn = (const ca_uint8 *)pSamplesIn;
+    ca_uint64 framesDone = 0;
+    while (framesDone < frameCount)
+    {
+      ca_uint32 count = (ca_uint32)ca_min(frameCount - framesDone, (ca_uint64)0x10000000);
+      void *ppOut[2] = {(ca_uint8 *)ppChannelsOut[0] + framesDone * bytesPerSample, (ca_uint8 *)ppChannelsOut[1] + framesDone * bytesPerSample};
+      pKernel(ppOut, pIn + framesDone * bytesPerSample * 2, count);
+      framesDone += count;
+    }
+    return ca_result_success;
+  }
+
+  const ca_uint8 *pIn = (const ca_uint8 *)pSamplesIn;
+  for (ca_uint32 channel = 0; channel < channels; channel++)
+  {
+    ca_uint8 *pOut = (ca_uint8 *)ppChannelsOut[channel];
+    const ca_uint8 *pSample = pIn + channel * bytesPerSample;
+    for (ca_uint64 i = 0; i < frameCount; i++)
+    {
+      memcpy(pOut, pSample, bytesPerSample);
+      pOut += bytesPerSample;
+      pSample += (size_t)bytesPerSample * channels;
+    }
+  }
+
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_swap_pcm_bytes(void *pSamples, ca_uint32 bytesPerSample, ca_uint64 sampleCount)
+{
+  ca_uint8 *pBytes = (ca_uint8 *)pSamples;
+  switch (bytesPerSample)
+  {
+  case 1:
+    return ca_result_success;
+  case 2:
+  case 4:
+  {
+    pthread_once(&simdKernelsOnce, ca_convert_init_simd_kernels);
+    ca_convert_swap_proc pKernel = bytesPerSample == 2 ? simdKernels.swap16 : simdKernels.swap32;
+    ca_uint64 samplesDone = 0;
+    while (samplesDone < sampleCount)
+    {
+      ca_uint32 count = (ca_uint32)ca_min(sampleCount - samplesDone, (ca_uint64)0x10000000);
+      pKernel(pBytes + samplesDone * bytesPerSample, count);
+      samplesDone += count;
+    }
+    return ca_result_success;
+  }
+  case 3:
+  case 8:
+    for (ca_uint64 i = 0; i < sampleCount; i++)
+    {
+      ca_uint8 *pSample = pBytes + i * bytesPerSample;
+      for (ca_uint32 j = 0; j < bytesPerSample / 2; j++)
+      {
+        ca_uint8 byte = pSample[j];
+        pSample[j] = pSample[bytesPerSample - 1 - j];
+        pSample[bytesPerSample - 1 - j] = byte;
+      }
+    }
+    return ca_result_success;
+  default:
+    return ca_result_invalid_args;
+  }
+}
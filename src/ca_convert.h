@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ca_defs.h"
+
+typedef struct
+{
+  ca_sample_format formatIn;
+  ca_sample_format formatOut;
+
+  // Dither is applied only when the output has less precision than the input.
+  ca_dither_mode ditherMode;
+  ca_uint32 ditherSeed;
+
+  // Forces the scalar kernels. Their output is bit-identical to the SIMD kernels.
+  ca_bool isSimdDisabled;
+} ca_converter_config;
+
+typedef struct
+{
+  ca_converter_config config;
+  ca_uint32 ditherState;
+  const void *pKernels;
+} ca_converter;
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_bytes_per_sample(ca_sample_format format);
+
+FFI_PLUGIN_EXPORT ca_converter_config ca_converter_config_init(ca_sample_format formatIn, ca_sample_format formatOut);
+
+FFI_PLUGIN_EXPORT ca_result ca_converter_init(ca_converter *pConverter, ca_converter_config config);
+
+// Converts interleaved samples. pSamplesOut and pSamplesIn must not overlap unless the formats are the same size.
+FFI_PLUGIN_EXPORT ca_result ca_converter_process(ca_converter *pConverter, void *pSamplesOut, const void *pSamplesIn, ca_uint64 sampleCount);
+
+// A stateless shortcut of ca_converter_process.
+FFI_PLUGIN_EXPORT ca_result ca_convert_pcm(void *pSamplesOut, ca_sample_format formatOut, const void *pSamplesIn, ca_sample_format formatIn, ca_uint64 sampleCount, ca_dither_mode ditherMode);
+
+// Splits interleaved samples into one buffer per channel. Stereo 16 and 32-bit samples use the SIMD kernels.
+FFI_PLUGIN_EXPORT ca_result ca_deinterleave_pcm(void **ppChannelsOut, const void *pSamplesIn, ca_sample_format format, ca_uint32 channels, ca_uint64 frameCount);
+
+// Reverses the byte order of each sample in place. Used to read big-endian containers.
+FFI_PLUGIN_EXPORT ca_result ca_swap_pcm_bytes(void *pSamples, ca_uint32 bytesPerSample, ca_uint64 sampleCount);
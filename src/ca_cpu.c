@@ -0,0 +1,65 @@
+#include "ca_cpu.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#if CA_SUPPORT_SSE2
+#include <cpuid.h>
+#endif
+
+static pthread_once_t cpuFeaturesOnce = PTHREAD_ONCE_INIT;
+static ca_uint32 cpuFeatures = 0;
+
+#if CA_SUPPORT_SSE2
+static ca_uint64 ca_cpu_xgetbv(ca_uint32 index)
+{
+  ca_uint32 eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+  return ((ca_uint64)edx << 32) | eax;
+}
+#endif
+
+static void ca_cpu_detect_features()
+{
+  ca_uint32 features = 0;
+
+#if CA_SUPPORT_SSE2
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    if (edx & (1 << 26))
+    {
+      features |= ca_cpu_feature_sse2;
+    }
+
+    // AVX2 also needs the OS to preserve the YMM registers.
+    ca_bool isAvxUsable = (ecx & (1 << 27)) && (ecx & (1 << 28)) && (ca_cpu_xgetbv(0) & 0x6) == 0x6;
+    if (isAvxUsable && __get_cpuid_max(0, NULL) >= 7)
+    {
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      if (ebx & (1 << 5))
+      {
+        features |= ca_cpu_feature_avx2;
+      }
+    }
+  }
+#endif
+
+#if CA_SUPPORT_NEON
+  // NEON is mandatory on AArch64.
+  features |= ca_cpu_feature_neon;
+#endif
+
+  cpuFeatures = features;
+}
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_cpu_features()
+{
+  pthread_once(&cpuFeaturesOnce, ca_cpu_detect_features);
+  return cpuFeatures;
+}
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_cpu_count()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count < 1 ? 1 : (ca_uint32)count;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ca_defs.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CA_ARCH_X86 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define CA_ARCH_ARM64 1
+#endif
+
+#if CA_ARCH_X86 && (defined(__GNUC__) || defined(__clang__))
+#define CA_SUPPORT_SSE2 1
+#define CA_SUPPORT_AVX2 1
+#define CA_TARGET_SSE2 __attribute__((target("sse2")))
+#define CA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if CA_ARCH_ARM64
+#define CA_SUPPORT_NEON 1
+#endif
+
+typedef enum
+{
+  ca_cpu_feature_sse2 = 1 << 0,
+  ca_cpu_feature_avx2 = 1 << 1,
+  ca_cpu_feature_neon = 1 << 2,
+} ca_cpu_feature;
+
+// Returns the ca_cpu_feature bits supported by both the build and the running CPU. The detection runs only once.
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_cpu_features();
+
+// Returns the number of online CPU cores, at least 1.
+FFI_PLUGIN_EXPORT ca_uint32 ca_get_cpu_count();
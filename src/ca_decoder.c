@@ -1,4 +1,18 @@
 #include "ca_decoder.h"
+#include "ca_budget.h"
+#include "ca_decoder_output.h"
+#include "ca_flac_decoder.h"
+#include "ca_io.h"
+#include "ca_mp3_decoder.h"
+#include "ca_frame_scan.h"
+#include "ca_mp4_index.h"
+#include "ca_pcm_cache.h"
+#include "ca_pcm_decoder.h"
+#include "ca_time.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
 #if __APPLE__
 #include "darwin/audio_file_stream.h"
@@ -9,12 +23,1055 @@
 #include "android/native_decoder.h"
 #endif
 
+// AAC decoders need the previous packets for the overlap of the first decoded one. ALAC packets decode on their own.
+#define DECODER_MP4_AAC_PREROLL_SAMPLES 2
+#define DECODER_MP4_CODEC_ALAC 0x616C6163
+
+// Cached frames passed on per decode call, about a packet's worth.
+#define DECODER_CACHE_READ_FRAMES 4096
+
+// Released chunks kept for the next decode calls, enough for consumers holding a few blocks each.
+#define DECODER_CHUNK_POOL_CAPACITY 16
+
+typedef enum
+{
+  ca_decoder_backend_platform,
+  ca_decoder_backend_pcm,
+  ca_decoder_backend_flac,
+  ca_decoder_backend_mp3,
+} ca_decoder_backend_type;
+
+typedef struct
+{
+  ca_decoder_backend_type backendType;
+  void *pBackend;
+  ca_decoder_config config;
+  ca_decoder_read_proc pReadProc;
+  ca_decoder_seek_proc pSeekProc;
+  ca_decoder_tell_proc pTellProc;
+  ca_decoder_decoded_proc pDecodedProc;
+  void *pUserData;
+  float *pChannelMixMatrix;
+
+  ca_decoder_output output;
+  ca_bool isOutputReady;
+  ca_bool isOutputFlushed;
+  ca_result outputResult;
+
+  // Set after ca_decoder_reinit while the output stage of the previous source waits to be reused.
+  ca_bool isOutputKept;
+
+  // Set for MP4 sources, which the platform backends seek by packet without removing the priming frames.
+  ca_mp4_index *pMp4Index;
+  ca_bool isMp4Positioned;
+  ca_uint64 mp4FramesToDiscard;
+  ca_uint64 mp4Position;
+
+  // Set for ADTS sources, whose length the platform backends estimate from the bitrate. Their frames are counted when the length is first asked for.
+  ca_bool isAdts;
+  ca_bool isAdtsCounted;
+  ca_uint64 adtsSampleCount;
+  ca_uint32 adtsSampleRate;
+
+  // Output frames ca_decoder_decode_budget may still deliver while it runs, and whether it has delivered any yet.
+  ca_bool isBudgeted;
+  ca_uint64 budgetFrames;
+  ca_bool isBudgetUsed;
+
+  // Backend frames past the frame budget, delivered before anything else is decoded.
+  ca_uint8 *pHeldFrames;
+  ca_uint32 heldFrameCount;
+  ca_uint32 heldFrameCapacity;
+
+  // Seeks posted by ca_decoder_request_seek. Only the newest pending one is applied before the next decode.
+  pthread_mutex_t seekLock;
+  ca_uint64 pendingSeekFrame;
+  ca_decoder_seek_flags pendingSeekFlags;
+  ca_uint64 pendingSeekMicros;
+  _Atomic ca_uint64 requestedGeneration;
+  _Atomic ca_uint64 appliedGeneration;
+
+  // Written under seekLock so other threads can read it. isScrubbed is set while the last seek that ran was a scrub.
+  ca_decoder_scrub_stats scrubStats;
+  ca_bool isScrubbed;
+
+  // Start of the scrub seek whose first frames are not delivered yet.
+  ca_bool isScrubLatencyPending;
+  ca_uint64 scrubStartMicros;
+
+  // Backend frames decoded recently. cachePosition is the backend frame delivered next, unknown after a scrub or a failed seek.
+  // While isCacheReading is set the frames come from the cache and the backend stays wherever it stopped.
+  ca_bool isCacheEnabled;
+  ca_pcm_cache cache;
+  ca_bool isCachePositionKnown;
+  ca_bool isCacheReading;
+  ca_uint64 cachePosition;
+  ca_decoder_pcm_cache_stats cacheStats;
+
+  // Memory reported to the process budget. The cache windows are its optional part.
+  ca_budget_account account;
+
+  // Chunks passed to pDecodedChunkProc, and the output frame the next delivered frames start at.
+  ca_pcm_chunk_pool chunkPool;
+  ca_uint64 outputPosition;
+} ca_decoder_data;
+
+static ca_result ca_decoder_backend_get_format(ca_decoder_data *pData, ca_audio_format *pFormat)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_get_format((ca_pcm_decoder *)pData->pBackend, pFormat);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_get_format((ca_flac_decoder *)pData->pBackend, pFormat);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_get_format((ca_mp3_decoder *)pData->pBackend, pFormat);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  audio_file_stream_format format;
+  ca_result result = audio_file_stream_get_format((audio_file_stream *)pData->pBackend, &format);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  pFormat->channels = format.channels;
+  pFormat->sample_rate = format.sample_rate;
+  pFormat->sample_foramt = format.sample_foramt;
+  pFormat->length = format.length;
+  pFormat->apple.format_id = format.format_id;
+  return ca_result_success;
+#elif ANDROID
+  return native_decoder_get_format((native_decoder *)pData->pBackend, pFormat);
+#else
+  return ca_result_unknown_failed;
+#endif
+}
+
+// Fills the positions of the backend channels. MP3 and the Android codecs have no layout beyond the standard one.
+static ca_result ca_decoder_backend_get_channel_map(ca_decoder_data *pData, ca_uint32 channels, ca_channel *pChannelMap)
+{
+  // The output stage rejects these channel counts.
+  if (channels == 0 || channels > CA_MAX_CHANNELS)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_get_channel_map((ca_pcm_decoder *)pData->pBackend, pChannelMap);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_get_channel_map((ca_flac_decoder *)pData->pBackend, pChannelMap);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  if (pData->backendType == ca_decoder_backend_platform)
+  {
+    return audio_file_stream_get_channel_map((audio_file_stream *)pData->pBackend, channels, pChannelMap);
+  }
+#endif
+  ca_get_standard_channel_map(pChannelMap, channels);
+  return ca_result_success;
+}
+
+static ca_read_result ca_decoder_on_read(void *pBufferIn, ca_uint32 bytesToRead, ca_uint32 *pBytesRead, void *pUserData)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pUserData;
+  return pData->pReadProc(pBufferIn, bytesToRead, pBytesRead, pData->pUserData);
+}
+
+static ca_seek_result ca_decoder_on_seek(ca_int64 byteOffset, ca_seek_origin origin, void *pUserData)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pUserData;
+  return pData->pSeekProc(byteOffset, origin, pData->pUserData);
+}
+
+// The portable backends are given no tell proc when the host has none. The platform backends always call it, so it fails instead.
+static ca_tell_result ca_decoder_on_tell(ca_uint64 *pPosition, ca_uint64 *pLength, void *pUserData)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pUserData;
+  if (pData->pTellProc == NULL)
+  {
+    return ca_tell_result_failed;
+  }
+
+  return pData->pTellProc(pPosition, pLength, pData->pUserData);
+}
+
+// Android's MediaExtractor shifts the sample times by the edit list and its codecs drop the priming frames themselves.
+static ca_uint64 ca_decoder_mp4_get_backend_priming(ca_decoder_data *pData, ca_uint32 sampleRate)
+{
+#if ANDROID
+  return ca_mp4_index_ticks_to_frames(pData->pMp4Index, pData->pMp4Index->primingTicks, sampleRate);
+#else
+  (void)pData;
+  (void)sampleRate;
+  return 0;
+#endif
+}
+
+// Drops the priming frames and the frames decoded before a seek target, then cuts the padding after the last playable frame.
+static void ca_decoder_mp4_trim(ca_decoder_data *pData, ca_uint32 *pFrameCount, void **ppBuffer)
+{
+  ca_mp4_index *pIndex = pData->pMp4Index;
+  ca_uint32 sampleRate = pData->output.sampleRateIn;
+  if (!pData->isMp4Positioned)
+  {
+    pData->mp4FramesToDiscard = ca_mp4_index_ticks_to_frames(pIndex, pIndex->primingTicks, sampleRate) - ca_decoder_mp4_get_backend_priming(pData, sampleRate);
+    pData->mp4Position = 0;
+    pData->isMp4Positioned = CA_TRUE;
+  }
+
+  ca_uint32 discardCount = (ca_uint32)ca_min((ca_uint64)*pFrameCount, pData->mp4FramesToDiscard);
+  ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatIn) * pData->output.channelsIn;
+  *ppBuffer = (ca_uint8 *)*ppBuffer + (size_t)discardCount * bytesPerFrame;
+  *pFrameCount -= discardCount;
+  pData->mp4FramesToDiscard -= discardCount;
+
+  ca_uint64 length = ca_mp4_index_get_length(pIndex, sampleRate);
+  ca_uint64 remaining = length > pData->mp4Position ? length - pData->mp4Position : 0;
+  *pFrameCount = (ca_uint32)ca_min((ca_uint64)*pFrameCount, remaining);
+  pData->mp4Position += *pFrameCount;
+}
+
+// Copies the converted frames into a pooled chunk, so consumers keep them by reference instead of copying them again.
+static void ca_decoder_deliver_chunk(ca_decoder_data *pData, ca_uint32 frameCount, void *pBuffer)
+{
+  ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatOut) * pData->output.channels;
+  ca_pcm_chunk *pChunk = ca_pcm_chunk_pool_acquire(&pData->chunkPool, frameCount * bytesPerFrame);
+  if (pChunk == NULL)
+  {
+    pData->outputResult = ca_result_out_of_memory;
+    return;
+  }
+
+  pChunk->sampleFormat = pData->output.formatOut;
+  pChunk->channels = pData->output.channels;
+  pChunk->sampleRate = pData->output.sampleRateOut;
+  pChunk->frameIndex = pData->outputPosition;
+  pChunk->frameCount = frameCount;
+  memcpy(pChunk->pFrames, pBuffer, (size_t)frameCount * bytesPerFrame);
+  pData->config.pDecodedChunkProc(pChunk, pData->pUserData);
+  ca_pcm_chunk_release(pChunk);
+}
+
+// Converts backend frames and passes them to the host. NULL pBuffer flushes the output stage.
+static void ca_decoder_deliver_output(ca_decoder_data *pData, ca_uint32 frameCount, void *pBuffer)
+{
+  ca_uint32 frameCountOut = 0;
+  if (pData->config.pDecodedPlanarProc != NULL)
+  {
+    void **ppChannels = NULL;
+    ca_result result = ca_decoder_output_process_planar(&pData->output, frameCount, pBuffer, &ppChannels, &frameCountOut);
+    if (result != ca_result_success)
+    {
+      pData->outputResult = result;
+      return;
+    }
+
+    if (frameCountOut > 0)
+    {
+      pData->config.pDecodedPlanarProc(frameCountOut, ppChannels, pData->pUserData);
+    }
+  }
+  else
+  {
+    void *pBufferOut = NULL;
+    ca_result result = ca_decoder_output_process(&pData->output, frameCount, pBuffer, &pBufferOut, &frameCountOut);
+    if (result != ca_result_success)
+    {
+      pData->outputResult = result;
+      return;
+    }
+
+    if (frameCountOut > 0 && pData->config.pDecodedChunkProc != NULL)
+    {
+      ca_decoder_deliver_chunk(pData, frameCountOut, pBufferOut);
+    }
+    else if (frameCountOut > 0)
+    {
+      pData->pDecodedProc(frameCountOut, pBufferOut, pData->pUserData);
+    }
+  }
+
+  pData->outputPosition += frameCountOut;
+
+  // Scrub latency runs until the host has the first frames after the jump.
+  if (pData->isScrubLatencyPending && frameCountOut > 0)
+  {
+    ca_uint64 latency = ca_get_time_micros() - pData->scrubStartMicros;
+    pthread_mutex_lock(&pData->seekLock);
+    pData->scrubStats.lastLatencyMicros = latency;
+    pData->scrubStats.maxLatencyMicros = ca_max(pData->scrubStats.maxLatencyMicros, latency);
+    pthread_mutex_unlock(&pData->seekLock);
+    pData->isScrubLatencyPending = CA_FALSE;
+  }
+
+  if (pData->isBudgeted)
+  {
+    pData->budgetFrames -= ca_min((ca_uint64)frameCountOut, pData->budgetFrames);
+    pData->isBudgetUsed = pData->isBudgetUsed || frameCountOut > 0;
+  }
+}
+
+// Returns the backend frames which fit into the frame budget.
+// A call which has not delivered anything yet takes the frames of one more output frame when less fits, so budgets smaller than what one backend frame resamples to still make progress.
+static ca_uint32 ca_decoder_get_budget_frames_in(ca_decoder_data *pData)
+{
+  ca_uint64 frameCount = ca_min(pData->budgetFrames, (ca_uint64)0xFFFFFFFF);
+  if (pData->output.isResampling && frameCount != 0)
+  {
+    frameCount = ca_resampler_get_max_input_frame_count(&pData->output.resampler, frameCount);
+    if (frameCount == 0 && !pData->isBudgetUsed)
+    {
+      frameCount = ca_resampler_get_max_input_frame_count(&pData->output.resampler, 0) + 1;
+    }
+  }
+  return (ca_uint32)ca_min(frameCount, (ca_uint64)0xFFFFFFFF);
+}
+
+// Cuts the frames past the frame budget and keeps them for the next call.
+static void ca_decoder_hold(ca_decoder_data *pData, ca_uint32 *pFrameCount, void *pBuffer)
+{
+  ca_uint32 frameCount = ca_min(*pFrameCount, ca_decoder_get_budget_frames_in(pData));
+  ca_uint32 heldCount = *pFrameCount - frameCount;
+  if (heldCount == 0)
+  {
+    return;
+  }
+
+  ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatIn) * pData->output.channelsIn;
+  if (pData->heldFrameCount + heldCount > pData->heldFrameCapacity)
+  {
+    ca_uint32 capacity = ca_max(pData->heldFrameCount + heldCount, pData->heldFrameCapacity * 2);
+    ca_uint8 *pHeldFrames = (ca_uint8 *)realloc(pData->pHeldFrames, (size_t)capacity * bytesPerFrame);
+    if (pHeldFrames == NULL)
+    {
+      pData->outputResult = ca_result_out_of_memory;
+      *pFrameCount = 0;
+      return;
+    }
+    pData->pHeldFrames = pHeldFrames;
+    pData->heldFrameCapacity = capacity;
+  }
+
+  memcpy(pData->pHeldFrames + (size_t)pData->heldFrameCount * bytesPerFrame, (ca_uint8 *)pBuffer + (size_t)frameCount * bytesPerFrame, (size_t)heldCount * bytesPerFrame);
+  pData->heldFrameCount += heldCount;
+  *pFrameCount = frameCount;
+}
+
+// Delivers the held frames, as many as the budget allows when one is running.
+static void ca_decoder_deliver_held(ca_decoder_data *pData)
+{
+  if (pData->heldFrameCount == 0)
+  {
+    return;
+  }
+
+  ca_uint32 frameCount = pData->isBudgeted ? ca_min(pData->heldFrameCount, ca_decoder_get_budget_frames_in(pData)) : pData->heldFrameCount;
+
+  ca_decoder_deliver_output(pData, frameCount, pData->pHeldFrames);
+  ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatIn) * pData->output.channelsIn;
+  memmove(pData->pHeldFrames, pData->pHeldFrames + (size_t)frameCount * bytesPerFrame, (size_t)(pData->heldFrameCount - frameCount) * bytesPerFrame);
+  pData->heldFrameCount -= frameCount;
+}
+
+// Keeps decoded frames while their position is known. The cache is created once the backend format is known.
+static void ca_decoder_cache_store(ca_decoder_data *pData, ca_uint32 frameCount, void *pBuffer)
+{
+  if (!pData->isCachePositionKnown)
+  {
+    return;
+  }
+
+  if (pData->cache.pData == NULL)
+  {
+    ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatIn) * pData->output.channelsIn;
+    if (ca_pcm_cache_init(&pData->cache, pData->config.pcmCacheSizeInBytes, bytesPerFrame) != ca_result_success)
+    {
+      pData->isCacheEnabled = CA_FALSE;
+      return;
+    }
+    pData->cache.windowLimit = 0;
+  }
+
+  // Each window is reserved from the budget before the cache may allocate it. Without one the least recently used window is reused.
+  if (ca_pcm_cache_is_at_limit(&pData->cache) && ca_budget_reserve(&pData->account, (ca_uint64)pData->cache.windowCapacity * pData->cache.bytesPerFrame))
+  {
+    pData->cache.windowLimit++;
+  }
+
+  ca_pcm_cache_store(&pData->cache, pData->cachePosition, frameCount, pBuffer);
+  pData->cachePosition += frameCount;
+}
+
+// Passes frames through the output stage to the host. NULL pBuffer flushes the output stage.
+static void ca_decoder_deliver(ca_decoder_data *pData, ca_uint32 frameCount, void *pBuffer)
+{
+  if (pData->outputResult != ca_result_success)
+  {
+    return;
+  }
+
+  // The backends know their output format only after the first packets are parsed.
+  if (!pData->isOutputReady)
+  {
+    ca_audio_format format;
+    ca_channel channelMap[CA_MAX_CHANNELS];
+    ca_result result = ca_decoder_backend_get_format(pData, &format);
+    if (result == ca_result_success)
+    {
+      result = ca_decoder_backend_get_channel_map(pData, format.channels, channelMap);
+    }
+
+    if (result == ca_result_success && pData->isOutputKept && ca_decoder_output_is_compatible(&pData->output, format, channelMap))
+    {
+      ca_decoder_output_reset(&pData->output);
+    }
+    else if (result == ca_result_success)
+    {
+      if (pData->isOutputKept)
+      {
+        ca_decoder_output_uninit(&pData->output);
+      }
+      result = ca_decoder_output_init(&pData->output, pData->config, format, channelMap);
+    }
+    pData->isOutputKept = CA_FALSE;
+
+    if (result != ca_result_success)
+    {
+      pData->outputResult = result;
+      return;
+    }
+
+    pData->isOutputReady = CA_TRUE;
+  }
+
+  if (pData->pMp4Index != NULL && pBuffer != NULL && !pData->isCacheReading)
+  {
+    ca_decoder_mp4_trim(pData, &frameCount, &pBuffer);
+    if (frameCount == 0)
+    {
+      return;
+    }
+  }
+
+  if (pData->isCacheEnabled && pBuffer != NULL && !pData->isCacheReading)
+  {
+    ca_decoder_cache_store(pData, frameCount, pBuffer);
+  }
+
+  if (pData->isBudgeted && pBuffer != NULL)
+  {
+    ca_decoder_hold(pData, &frameCount, pBuffer);
+    if (frameCount == 0)
+    {
+      return;
+    }
+  }
+
+  ca_decoder_deliver_output(pData, frameCount, pBuffer);
+}
+
+static void ca_decoder_on_decoded(ca_uint32 frameCount, void *pBuffer, void *pUserData)
+{
+  ca_decoder_deliver((ca_decoder_data *)pUserData, frameCount, pBuffer);
+}
+
+static ca_result ca_decoder_backend_get_eof(ca_decoder_data *pData, ca_bool *pIsEOF)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_get_eof((ca_pcm_decoder *)pData->pBackend, pIsEOF);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_get_eof((ca_flac_decoder *)pData->pBackend, pIsEOF);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_get_eof((ca_mp3_decoder *)pData->pBackend, pIsEOF);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  return audio_file_stream_get_eof((audio_file_stream *)pData->pBackend, pIsEOF);
+#elif ANDROID
+  return native_decoder_get_eof((native_decoder *)pData->pBackend, pIsEOF);
+#else
+  return ca_result_unknown_failed;
+#endif
+}
+
+// Platform backends waiting for codec output give up at deadlineMicros.
+static ca_result ca_decoder_backend_decode_next(ca_decoder_data *pData, ca_uint64 deadlineMicros)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_decode_next((ca_pcm_decoder *)pData->pBackend);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_decode_next((ca_flac_decoder *)pData->pBackend);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_decode_next((ca_mp3_decoder *)pData->pBackend);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  // AudioFileStream parses a fixed number of bytes per call, so it always returns in bounded time.
+  (void)deadlineMicros;
+  return audio_file_stream_decode_next((audio_file_stream *)pData->pBackend);
+#elif ANDROID
+  return native_decoder_decode_next((native_decoder *)pData->pBackend, deadlineMicros);
+#else
+  (void)deadlineMicros;
+  return ca_result_unknown_failed;
+#endif
+}
+
+static ca_result ca_decoder_backend_seek(ca_decoder_data *pData, ca_uint64 frameIndex)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_seek((ca_pcm_decoder *)pData->pBackend, frameIndex);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_seek((ca_flac_decoder *)pData->pBackend, frameIndex);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_seek((ca_mp3_decoder *)pData->pBackend, frameIndex);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  return audio_file_stream_seek((audio_file_stream *)pData->pBackend, frameIndex);
+#elif ANDROID
+  return native_decoder_seek((native_decoder *)pData->pBackend, frameIndex);
+#else
+  return ca_result_unknown_failed;
+#endif
+}
+
+// Seeks to a sync point at or before frameIndex and decodes from there. pFrameIndex receives the first frame decoded next.
+static ca_result ca_decoder_backend_seek_sync(ca_decoder_data *pData, ca_uint64 frameIndex, ca_uint64 *pFrameIndex)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    *pFrameIndex = frameIndex;
+    return ca_pcm_decoder_seek((ca_pcm_decoder *)pData->pBackend, frameIndex);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_seek_sync((ca_flac_decoder *)pData->pBackend, frameIndex, pFrameIndex);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_seek_sync((ca_mp3_decoder *)pData->pBackend, frameIndex, pFrameIndex);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  return audio_file_stream_seek_sync((audio_file_stream *)pData->pBackend, frameIndex, pFrameIndex);
+#elif ANDROID
+  return native_decoder_seek_sync((native_decoder *)pData->pBackend, frameIndex, pFrameIndex);
+#else
+  return ca_result_unknown_failed;
+#endif
+}
+
+static ca_result ca_decoder_backend_uninit(ca_decoder_data *pData)
+{
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return ca_pcm_decoder_uninit((ca_pcm_decoder *)pData->pBackend);
+  case ca_decoder_backend_flac:
+    return ca_flac_decoder_uninit((ca_flac_decoder *)pData->pBackend);
+  case ca_decoder_backend_mp3:
+    return ca_mp3_decoder_uninit((ca_mp3_decoder *)pData->pBackend);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  return audio_file_stream_uninit((audio_file_stream *)pData->pBackend);
+#elif ANDROID
+  return native_decoder_uninit((native_decoder *)pData->pBackend);
+#else
+  return ca_result_unknown_failed;
+#endif
+}
+
+// Platform backends only count their own struct. The buffers of the OS codecs are not visible here.
+static ca_uint64 ca_decoder_backend_get_size_in_bytes(ca_decoder_data *pData)
+{
+  if (pData->pBackend == NULL)
+  {
+    return 0;
+  }
+
+  switch (pData->backendType)
+  {
+  case ca_decoder_backend_pcm:
+    return sizeof(ca_pcm_decoder) + ca_pcm_decoder_get_size_in_bytes((ca_pcm_decoder *)pData->pBackend);
+  case ca_decoder_backend_flac:
+    return sizeof(ca_flac_decoder) + ca_flac_decoder_get_size_in_bytes((ca_flac_decoder *)pData->pBackend);
+  case ca_decoder_backend_mp3:
+    return sizeof(ca_mp3_decoder) + ca_mp3_decoder_get_size_in_bytes((ca_mp3_decoder *)pData->pBackend);
+  default:
+    break;
+  }
+
+#if __APPLE__
+  return sizeof(audio_file_stream);
+#elif ANDROID
+  return sizeof(native_decoder);
+#else
+  return 0;
+#endif
+}
+
+// Seeks the backend to the packet before the target and discards the frames up to the target as they are decoded.
+// A sync seek starts at the packet holding the target instead, without the preroll packets or the discard. pFrameIndex receives the first frame decoded next.
+static ca_result ca_decoder_mp4_seek(ca_decoder_data *pData, ca_uint64 frameIndex, ca_bool isSync, ca_uint64 *pFrameIndex)
+{
+  ca_audio_format format;
+  ca_result result = ca_decoder_backend_get_format(pData, &format);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_mp4_sample sample;
+  ca_uint64 framesToDiscard = 0;
+  ca_uint32 prerollSamples = pData->pMp4Index->codec == DECODER_MP4_CODEC_ALAC || isSync ? 0 : DECODER_MP4_AAC_PREROLL_SAMPLES;
+  result = ca_mp4_index_find_seek_target(pData->pMp4Index, frameIndex, format.sample_rate, prerollSamples, &sample, &framesToDiscard);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The index counts the priming frames, the backend timeline does not when the platform removes them.
+  ca_uint64 backendPriming = ca_decoder_mp4_get_backend_priming(pData, format.sample_rate);
+  ca_uint64 backendFrame = sample.frame - ca_min(sample.frame, backendPriming);
+  result = ca_decoder_backend_seek(pData, backendFrame);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The priming frames are still discarded when the packet holding the target starts with them.
+  ca_uint64 primingFrames = ca_mp4_index_ticks_to_frames(pData->pMp4Index, pData->pMp4Index->primingTicks, format.sample_rate);
+  ca_uint64 startFrame = isSync ? ca_max(sample.frame, primingFrames) : sample.frame + framesToDiscard;
+  pData->mp4FramesToDiscard = startFrame - backendPriming - backendFrame;
+  pData->mp4Position = isSync ? startFrame - primingFrames : frameIndex;
+  pData->isMp4Positioned = CA_TRUE;
+  *pFrameIndex = pData->mp4Position;
+  return ca_result_success;
+}
+
+// Indexes MP4 sources for the platform backend. Returns ca_result_unsupported_format like the portable probes once the source is rewound.
+static ca_result ca_decoder_mp4_index_init(ca_decoder_data *pData)
+{
+  ca_mp4_index *pIndex = (ca_mp4_index *)malloc(sizeof(ca_mp4_index));
+  if (pIndex == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_mp4_index_init(pIndex, ca_source_init(ca_decoder_on_read, ca_decoder_on_seek, pData->pTellProc == NULL ? NULL : ca_decoder_on_tell, pData));
+  if (result == ca_result_success)
+  {
+    pData->pMp4Index = pIndex;
+  }
+  else
+  {
+    free(pIndex);
+  }
+
+  if (result != ca_result_success && result != ca_result_unsupported_format)
+  {
+    return result;
+  }
+  return pData->pSeekProc(0, ca_seek_origin_start, pData->pUserData) == ca_seek_result_success ? ca_result_unsupported_format : ca_result_seek_failed;
+}
+
+static void ca_decoder_mp4_index_uninit(ca_decoder_data *pData)
+{
+  if (pData->pMp4Index != NULL)
+  {
+    ca_mp4_index_uninit(pData->pMp4Index);
+    free(pData->pMp4Index);
+    pData->pMp4Index = NULL;
+  }
+}
+
+// MARK: PCM cache
+
+static void ca_decoder_cache_uninit(ca_decoder_data *pData)
+{
+  ca_pcm_cache_uninit(&pData->cache);
+  ca_budget_release(&pData->account, pData->account.optionalSizeInBytes);
+}
+
+// Runs the latest ca_trim_memory call on the decoding thread. Moderate trims halve the cache windows and critical ones free them all.
+static void ca_decoder_apply_trim(ca_decoder_data *pData)
+{
+  ca_trim_level level;
+  if (!ca_budget_poll_trim(&pData->account, &level) || pData->cache.pData == NULL)
+  {
+    return;
+  }
+
+  ca_uint32 windowLimit = pData->cache.windowLimit;
+  ca_pcm_cache_trim(&pData->cache, level == ca_trim_level_critical ? 0 : windowLimit / 2);
+  ca_budget_release(&pData->account, (ca_uint64)(windowLimit - pData->cache.windowLimit) * pData->cache.windowCapacity * pData->cache.bytesPerFrame);
+}
+
+// Reports the memory the decoder holds besides the cache. Buffers grow while decoding, so it is measured again after each call.
+static void ca_decoder_update_budget(ca_decoder_data *pData)
+{
+  ca_uint64 sizeInBytes = sizeof(ca_decoder_data) + ca_decoder_backend_get_size_in_bytes(pData);
+  if (pData->pChannelMixMatrix != NULL)
+  {
+    sizeInBytes += sizeof(float) * pData->config.outputChannels * pData->config.channelMixMatrixChannelsIn;
+  }
+
+  if (pData->isOutputReady || pData->isOutputKept)
+  {
+    ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(pData->output.formatIn) * pData->output.channelsIn;
+    sizeInBytes += ca_decoder_output_get_size_in_bytes(&pData->output) + (ca_uint64)pData->heldFrameCapacity * bytesPerFrame;
+  }
+
+  if (pData->pMp4Index != NULL)
+  {
+    sizeInBytes += sizeof(ca_mp4_index) + ca_mp4_index_get_size_in_bytes(pData->pMp4Index);
+  }
+
+  // Chunks held by consumers are counted until the decoder is uninitialized.
+  if (pData->chunkPool.pData != NULL)
+  {
+    sizeInBytes += ca_pcm_chunk_pool_get_size_in_bytes(&pData->chunkPool);
+  }
+
+  ca_budget_set_size(&pData->account, sizeInBytes);
+}
+
+static ca_result ca_decoder_backend_seek_exact(ca_decoder_data *pData, ca_uint64 frameIndex)
+{
+  if (pData->pMp4Index != NULL)
+  {
+    ca_uint64 startFrame = 0;
+    return ca_decoder_mp4_seek(pData, frameIndex, CA_FALSE, &startFrame);
+  }
+  return ca_decoder_backend_seek(pData, frameIndex);
+}
+
+// The cache ends the stream where the backend ended it while the frames were stored.
+static ca_result ca_decoder_source_get_eof(ca_decoder_data *pData, ca_bool *pIsEOF)
+{
+  if (pData->isCacheReading)
+  {
+    *pIsEOF = pData->cachePosition == pData->cache.endFrame;
+    return ca_result_success;
+  }
+  return ca_decoder_backend_get_eof(pData, pIsEOF);
+}
+
+// Copies the next frames from the cache when it holds them and decodes them otherwise.
+// Leaving the cached frames seeks the backend to where they end, so decoding resumes exactly there.
+static ca_result ca_decoder_source_decode_next(ca_decoder_data *pData, ca_uint64 deadlineMicros)
+{
+  ca_result result = ca_result_success;
+  if (pData->cache.pData != NULL && pData->isCachePositionKnown)
+  {
+    const void *pFrames = NULL;
+    ca_uint32 frameCount = ca_pcm_cache_read(&pData->cache, pData->cachePosition, DECODER_CACHE_READ_FRAMES, &pFrames);
+    if (frameCount > 0)
+    {
+      if (!pData->isCacheReading)
+      {
+        pData->isCacheReading = CA_TRUE;
+        pData->cacheStats.hitCount++;
+      }
+
+      pData->cachePosition += frameCount;
+      pData->cacheStats.servedFrameCount += frameCount;
+      ca_decoder_deliver(pData, frameCount, (void *)pFrames);
+      return ca_result_success;
+    }
+
+    if (pData->isCacheReading)
+    {
+      if (pData->cachePosition == pData->cache.endFrame)
+      {
+        return ca_result_success;
+      }
+
+      pData->isCacheReading = CA_FALSE;
+      pData->cacheStats.missCount++;
+      result = ca_decoder_backend_seek_exact(pData, pData->cachePosition);
+      if (result != ca_result_success)
+      {
+        pData->isCachePositionKnown = CA_FALSE;
+        return result;
+      }
+    }
+  }
+
+  result = ca_decoder_backend_decode_next(pData, deadlineMicros);
+
+  ca_bool isEOF = CA_FALSE;
+  if (result == ca_result_success && pData->cache.pData != NULL && pData->isCachePositionKnown && ca_decoder_backend_get_eof(pData, &isEOF) == ca_result_success && isEOF)
+  {
+    pData->cache.endFrame = pData->cachePosition;
+  }
+  return result;
+}
+
+// MARK: ADTS
+
+// Finds out whether the stream is ADTS from its first frames and rewinds the source. Returns ca_result_unsupported_format to continue with the platform backend either way.
+static ca_result ca_decoder_adts_probe(ca_decoder_data *pData)
+{
+  ca_frame_scan_result scan;
+  ca_result result = ca_frame_scan_find(ca_source_init(ca_decoder_on_read, ca_decoder_on_seek, ca_decoder_on_tell, pData), 0, &scan);
+  pData->isAdts = result == ca_result_success && scan.stream == ca_frame_stream_adts;
+
+  if (result == ca_result_out_of_memory)
+  {
+    return result;
+  }
+  return pData->pSeekProc(0, ca_seek_origin_start, pData->pUserData) == ca_seek_result_success ? ca_result_unsupported_format : ca_result_seek_failed;
+}
+
+// Counts the frames of an ADTS stream and puts the source back where the platform backend left it.
+static ca_result ca_decoder_adts_count(ca_decoder_data *pData)
+{
+  pData->isAdtsCounted = CA_TRUE;
+  ca_uint64 position = 0;
+  ca_uint64 length = 0;
+  if (pData->pTellProc(&position, &length, pData->pUserData) != ca_tell_result_success)
+  {
+    return ca_result_tell_failed;
+  }
+
+  ca_frame_scan_result scan;
+  ca_result result = ca_frame_scan(ca_source_init(ca_decoder_on_read, ca_decoder_on_seek, ca_decoder_on_tell, pData), 0, pData->config.decodeThreadCount, &scan);
+  if (result == ca_result_success && scan.stream == ca_frame_stream_adts)
+  {
+    pData->adtsSampleCount = scan.sampleCount;
+    pData->adtsSampleRate = scan.sampleRate;
+  }
+
+  if (pData->pSeekProc((ca_int64)position, ca_seek_origin_start, pData->pUserData) != ca_seek_result_success)
+  {
+    return ca_result_seek_failed;
+  }
+  return result == ca_result_out_of_memory ? result : ca_result_success;
+}
+
+typedef ca_result (*ca_decoder_backend_init_proc)(ca_decoder_data *pData);
+
+// Uncompressed containers are read natively so the samples skip the platform decoders.
+static ca_result ca_decoder_pcm_init(ca_decoder_data *pData)
+{
+  ca_pcm_decoder *pPcmDecoder = (ca_pcm_decoder *)malloc(sizeof(ca_pcm_decoder));
+  if (pPcmDecoder == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_pcm_decoder_init(pPcmDecoder, pData->config, ca_decoder_on_read, ca_decoder_on_seek, pData->pTellProc == NULL ? NULL : ca_decoder_on_tell, ca_decoder_on_decoded, pData);
+  if (result != ca_result_success)
+  {
+    free(pPcmDecoder);
+    return result;
+  }
+
+  pData->backendType = ca_decoder_backend_pcm;
+  pData->pBackend = pPcmDecoder;
+  return ca_result_success;
+}
+
+static ca_result ca_decoder_flac_init(ca_decoder_data *pData)
+{
+  ca_flac_decoder *pFlacDecoder = (ca_flac_decoder *)malloc(sizeof(ca_flac_decoder));
+  if (pFlacDecoder == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_flac_decoder_init(pFlacDecoder, pData->config, ca_decoder_on_read, ca_decoder_on_seek, pData->pTellProc == NULL ? NULL : ca_decoder_on_tell, ca_decoder_on_decoded, pData);
+  if (result != ca_result_success)
+  {
+    free(pFlacDecoder);
+    return result;
+  }
+
+  pData->backendType = ca_decoder_backend_flac;
+  pData->pBackend = pFlacDecoder;
+  return ca_result_success;
+}
+
+static ca_result ca_decoder_mp3_init(ca_decoder_data *pData)
+{
+  ca_mp3_decoder *pMp3Decoder = (ca_mp3_decoder *)malloc(sizeof(ca_mp3_decoder));
+  if (pMp3Decoder == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_mp3_decoder_init(pMp3Decoder, pData->config, ca_decoder_on_read, ca_decoder_on_seek, pData->pTellProc == NULL ? NULL : ca_decoder_on_tell, ca_decoder_on_decoded, pData);
+  if (result != ca_result_success)
+  {
+    free(pMp3Decoder);
+    return result;
+  }
+
+  pData->backendType = ca_decoder_backend_mp3;
+  pData->pBackend = pMp3Decoder;
+  return ca_result_success;
+}
+
+static ca_result ca_decoder_platform_init(ca_decoder_data *pData)
+{
+  ca_result result = ca_result_unknown_failed;
+  pData->backendType = ca_decoder_backend_platform;
+
+  // The backends treat a missing seek proc as an unseekable source.
+  ca_decoder_seek_proc pBackendSeekProc = pData->pSeekProc == NULL ? NULL : ca_decoder_on_seek;
+
+#if __APPLE__
+  audio_file_stream *pStream = (audio_file_stream *)malloc(sizeof(audio_file_stream));
+  pData->pBackend = pStream;
+  result = audio_file_stream_init(pStream, pData->config, ca_decoder_on_read, pBackendSeekProc, ca_decoder_on_tell, ca_decoder_on_decoded, pData);
+#endif
+
+#if ANDROID
+  native_decoder *pNativeDecoder = (native_decoder *)malloc(sizeof(native_decoder));
+  pData->pBackend = pNativeDecoder;
+  result = native_decoder_init(pNativeDecoder, pData->config, ca_decoder_on_read, pBackendSeekProc, ca_decoder_on_tell, ca_decoder_on_decoded, pData);
+#endif
+
+  (void)pBackendSeekProc;
+
+  if (result != ca_result_success)
+  {
+    free(pData->pBackend);
+    pData->pBackend = NULL;
+  }
+
+  return result;
+}
+
+// Android keeps the MediaCodec of a platform backend when the new source needs the same codec. Other platforms create the backend again.
+static ca_result ca_decoder_platform_reopen(ca_decoder_data *pData, void *pBackend)
+{
+#if ANDROID
+  native_decoder *pNativeDecoder = (native_decoder *)pBackend;
+  pData->backendType = ca_decoder_backend_platform;
+  pData->pBackend = pNativeDecoder;
+  ca_result result = native_decoder_reopen(pNativeDecoder, ca_decoder_on_read, pData->pSeekProc == NULL ? NULL : ca_decoder_on_seek, ca_decoder_on_tell);
+  if (result != ca_result_success)
+  {
+    native_decoder_uninit(pNativeDecoder);
+    free(pNativeDecoder);
+    pData->pBackend = NULL;
+  }
+  return result;
+#else
+  (void)pBackend;
+  return ca_decoder_platform_init(pData);
+#endif
+}
+
+static void ca_decoder_platform_release(void *pBackend)
+{
+#if ANDROID
+  native_decoder_uninit((native_decoder *)pBackend);
+#endif
+  free(pBackend);
+}
+
+// Probes the source for a backend. pPlatformBackend is the platform backend kept by ca_decoder_reinit, or NULL.
+static ca_result ca_decoder_open_backend(ca_decoder_data *pData, void *pPlatformBackend)
+{
+  // Each probe that does not recognize the stream rewinds the source for the next one.
+  static const ca_decoder_backend_init_proc portableInits[] = {ca_decoder_pcm_init, ca_decoder_flac_init, ca_decoder_mp3_init};
+  ca_result result = ca_result_unsupported_format;
+  if (!pData->config.isPortableBackendDisabled && pData->pSeekProc != NULL)
+  {
+    for (size_t i = 0; i < sizeof(portableInits) / sizeof(portableInits[0]) && result == ca_result_unsupported_format; i++)
+    {
+      result = portableInits[i](pData);
+      if (result == ca_result_unsupported_format && pData->pSeekProc(0, ca_seek_origin_start, pData->pUserData) != ca_seek_result_success)
+      {
+        result = ca_result_seek_failed;
+      }
+    }
+  }
+
+  // MP4 sample tables give the platform backends exact lengths and seeks.
+  if (result == ca_result_unsupported_format && pData->pSeekProc != NULL)
+  {
+    result = ca_decoder_mp4_index_init(pData);
+  }
+
+  // ADTS streams have no length field, so their frame headers are counted instead.
+  if (result == ca_result_unsupported_format && pData->pSeekProc != NULL && pData->pTellProc != NULL)
+  {
+    result = ca_decoder_adts_probe(pData);
+  }
+
+  if (result == ca_result_unsupported_format)
+  {
+    result = pPlatformBackend == NULL ? ca_decoder_platform_init(pData) : ca_decoder_platform_reopen(pData, pPlatformBackend);
+  }
+  else if (pPlatformBackend != NULL)
+  {
+    ca_decoder_platform_release(pPlatformBackend);
+  }
+
+  if (result != ca_result_success)
+  {
+    ca_decoder_mp4_index_uninit(pData);
+    return result;
+  }
+
+  // Only backends whose decoded frames match the positions they seek to exactly keep a cache.
+  pData->isCacheEnabled = pData->config.pcmCacheSizeInBytes > 0 && (pData->backendType != ca_decoder_backend_platform || pData->pMp4Index != NULL);
+  pData->isCachePositionKnown = pData->isCacheEnabled;
+  ca_decoder_update_budget(pData);
+  return ca_result_success;
+}
+
 FFI_PLUGIN_EXPORT ca_decoder_config ca_decoder_config_init()
 {
   ca_decoder_config config = {
 #if __APPLE__
     .appleFileTypeHint = 0,
 #endif
+    .outputSampleFormat = ca_sample_format_unknown,
+    .ditherMode = ca_dither_mode_none,
+    .pDecodedPlanarProc = NULL,
+    .planarAlignment = 32,
+    .pDecodedChunkProc = NULL,
+    .outputSampleRate = 0,
+    .resamplerQuality = ca_resampler_quality_medium,
+    .outputChannels = 0,
+    .channelMixMode = ca_channel_mix_mode_itu,
+    .pChannelMixMatrix = NULL,
+    .channelMixMatrixChannelsIn = 0,
+    .isPortableBackendDisabled = CA_FALSE,
+    .isSeekTableDisabled = CA_FALSE,
+    .decodeThreadCount = 1,
+    .checkpointCount = 0,
+    .checkpointIntervalMillis = 1000,
+    .pcmCacheSizeInBytes = 0,
   };
   return config;
 }
@@ -23,91 +1080,564 @@ FFI_PLUGIN_EXPORT ca_result ca_decoder_init(ca_decoder *pDecoder, ca_decoder_con
 {
   ca_result result = ca_result_unknown_failed;
 
-#if __APPLE__
-  audio_file_stream *pStream = (audio_file_stream *)malloc(sizeof(audio_file_stream));
-  pDecoder->pDecoder = pStream;
-  result = audio_file_stream_init(pStream, config, pReadProc, pSeekProc, pTellProc, pDecodedProc, pUserData);
-#endif
+  if (config.outputSampleFormat != ca_sample_format_unknown && ca_get_bytes_per_sample(config.outputSampleFormat) == 0)
+  {
+    return ca_result_invalid_args;
+  }
 
-#if ANDROID
-  native_decoder *pNativeDecoder = (native_decoder *)malloc(sizeof(native_decoder));
-  pDecoder->pDecoder = pNativeDecoder;
-  result = native_decoder_init(pNativeDecoder, config, pReadProc, pSeekProc, pTellProc, pDecodedProc, pUserData);
-#endif
+  if (config.resamplerQuality > ca_resampler_quality_best)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_bool isAlignmentValid = config.planarAlignment != 0 && (config.planarAlignment & (config.planarAlignment - 1)) == 0;
+  if (config.pDecodedPlanarProc != NULL && (!isAlignmentValid || config.pDecodedChunkProc != NULL))
+  {
+    return ca_result_invalid_args;
+  }
+
+  if (config.outputChannels > CA_MAX_CHANNELS || config.channelMixMode > ca_channel_mix_mode_custom)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_bool isCustomMix = config.channelMixMode == ca_channel_mix_mode_custom;
+  if (isCustomMix && (config.pChannelMixMatrix == NULL || config.outputChannels == 0 || config.channelMixMatrixChannelsIn == 0 || config.channelMixMatrixChannelsIn > CA_MAX_CHANNELS))
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_decoder_data *pData = (ca_decoder_data *)calloc(1, sizeof(ca_decoder_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  result = ca_budget_open_decoder(&pData->account);
+  if (result != ca_result_success)
+  {
+    free(pData);
+    return result;
+  }
+
+  // The matrix is used when the first frames arrive, so the decoder keeps its own copy.
+  if (isCustomMix)
+  {
+    ca_uint64 matrixSizeInBytes = sizeof(float) * config.outputChannels * config.channelMixMatrixChannelsIn;
+    pData->pChannelMixMatrix = (float *)malloc(matrixSizeInBytes);
+    if (pData->pChannelMixMatrix == NULL)
+    {
+      ca_budget_close(&pData->account);
+      free(pData);
+      return ca_result_out_of_memory;
+    }
+    memcpy(pData->pChannelMixMatrix, config.pChannelMixMatrix, matrixSizeInBytes);
+    config.pChannelMixMatrix = pData->pChannelMixMatrix;
+  }
+  else
+  {
+    config.pChannelMixMatrix = NULL;
+  }
+
+  pData->config = config;
+  pData->pReadProc = pReadProc;
+  pData->pSeekProc = pSeekProc;
+  pData->pTellProc = pTellProc;
+  pData->pDecodedProc = pDecodedProc;
+  pData->pUserData = pUserData;
+  pData->outputResult = ca_result_success;
+  pthread_mutex_init(&pData->seekLock, NULL);
+  atomic_init(&pData->requestedGeneration, 0);
+  atomic_init(&pData->appliedGeneration, 0);
+
+  result = config.pDecodedChunkProc == NULL ? ca_result_success : ca_pcm_chunk_pool_init(&pData->chunkPool, DECODER_CHUNK_POOL_CAPACITY);
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_open_backend(pData, NULL);
+  }
 
   if (result != ca_result_success)
   {
-    free(pDecoder->pDecoder);
+    ca_pcm_chunk_pool_uninit(&pData->chunkPool);
+    ca_budget_close(&pData->account);
+    pthread_mutex_destroy(&pData->seekLock);
+    free(pData->pChannelMixMatrix);
+    free(pData);
     return result;
   }
 
+  pDecoder->pDecoder = pData;
   pDecoder->pUserData = pUserData;
   return result;
 }
 
+// Drops everything tied to the previous source. The output stage is kept for the next source.
+static void ca_decoder_reset_stream(ca_decoder_data *pData)
+{
+  pData->isOutputKept = pData->isOutputKept || pData->isOutputReady;
+  pData->isOutputReady = CA_FALSE;
+  pData->isOutputFlushed = CA_FALSE;
+  pData->outputResult = ca_result_success;
+
+  pData->isMp4Positioned = CA_FALSE;
+  pData->mp4FramesToDiscard = 0;
+  pData->mp4Position = 0;
+  pData->isAdts = CA_FALSE;
+  pData->isAdtsCounted = CA_FALSE;
+  pData->adtsSampleCount = 0;
+  pData->adtsSampleRate = 0;
+  pData->isBudgeted = CA_FALSE;
+  pData->budgetFrames = 0;
+  pData->outputPosition = 0;
+
+  // The held-frame buffer is kept, but its capacity is counted in frames of the previous format.
+  pData->heldFrameCount = 0;
+  pData->heldFrameCapacity = 0;
+
+  // A request posted for the previous source is dropped. Generations keep counting up.
+  pthread_mutex_lock(&pData->seekLock);
+  atomic_store_explicit(&pData->appliedGeneration, atomic_load_explicit(&pData->requestedGeneration, memory_order_relaxed), memory_order_release);
+  memset(&pData->scrubStats, 0, sizeof(pData->scrubStats));
+  pData->isScrubbed = CA_FALSE;
+  pthread_mutex_unlock(&pData->seekLock);
+  pData->isScrubLatencyPending = CA_FALSE;
+
+  ca_decoder_cache_uninit(pData);
+  pData->isCacheEnabled = CA_FALSE;
+  pData->isCachePositionKnown = CA_FALSE;
+  pData->isCacheReading = CA_FALSE;
+  pData->cachePosition = 0;
+  memset(&pData->cacheStats, 0, sizeof(pData->cacheStats));
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reinit(ca_decoder *pDecoder, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+
+  // Only Android's platform backend can switch sources. Every other backend is released before the new source is probed.
+  void *pPlatformBackend = NULL;
+#if ANDROID
+  if (pData->backendType == ca_decoder_backend_platform)
+  {
+    pPlatformBackend = pData->pBackend;
+  }
+#endif
+
+  if (pPlatformBackend == NULL && pData->pBackend != NULL)
+  {
+    ca_decoder_backend_uninit(pData);
+    free(pData->pBackend);
+  }
+  pData->pBackend = NULL;
+  ca_decoder_mp4_index_uninit(pData);
+  ca_decoder_reset_stream(pData);
+
+  pData->pReadProc = pReadProc;
+  pData->pSeekProc = pSeekProc;
+  pData->pTellProc = pTellProc;
+  pData->pUserData = pUserData;
+  pDecoder->pUserData = pUserData;
+  return ca_decoder_open_backend(pData, pPlatformBackend);
+}
+
 FFI_PLUGIN_EXPORT ca_result ca_decoder_get_format(ca_decoder *pDecoder, ca_audio_format *pFormat)
 {
-#if __APPLE__
-  audio_file_stream_format format;
-  ca_result result = audio_file_stream_get_format((audio_file_stream *)pDecoder->pDecoder, &format);
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_result result = ca_decoder_backend_get_format(pData, pFormat);
   if (result != ca_result_success)
   {
     return result;
   }
 
-  pFormat->channels = format.channels;
-  pFormat->sample_rate = format.sample_rate;
-  pFormat->sample_foramt = format.sample_foramt;
-  pFormat->length = format.length;
-  pFormat->apple.format_id = format.format_id;
+  if (pData->pMp4Index != NULL && pFormat->sample_rate != 0)
+  {
+    pFormat->length = ca_mp4_index_get_length(pData->pMp4Index, pFormat->sample_rate);
+  }
+
+  if (pData->isAdts && !pData->isAdtsCounted)
+  {
+    result = ca_decoder_adts_count(pData);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  // HE-AAC is decoded at twice the ADTS sample rate.
+  if (pData->adtsSampleRate != 0 && pFormat->sample_rate != 0)
+  {
+    pFormat->length = pData->adtsSampleCount * pFormat->sample_rate / pData->adtsSampleRate;
+  }
+
+  ca_uint32 sampleRate = ca_decoder_output_get_sample_rate(pData->config, pFormat->sample_rate);
+  if (sampleRate != pFormat->sample_rate && pFormat->sample_rate != 0)
+  {
+    pFormat->length = pFormat->length * sampleRate / pFormat->sample_rate;
+  }
+
+  pFormat->sample_rate = sampleRate;
+  pFormat->channels = ca_decoder_output_get_channels(pData->config, pFormat->channels);
+  pFormat->sample_foramt = ca_decoder_output_get_sample_format(pData->config, pFormat->sample_foramt);
   return ca_result_success;
-#endif
+}
 
-#if ANDROID
-  return native_decoder_get_format((native_decoder *)pDecoder->pDecoder, pFormat);
-#endif
+static ca_result ca_decoder_seek_to(ca_decoder_data *pData, ca_uint64 frameIndex, ca_decoder_seek_flags flags, ca_uint64 startMicros)
+{
+  ca_result result = ca_result_unknown_failed;
+  ca_uint64 targetFrame = frameIndex;
+
+  // frameIndex is in the output sample rate.
+  ca_audio_format format;
+  if (pData->config.outputSampleRate != 0)
+  {
+    result = ca_decoder_backend_get_format(pData, &format);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    frameIndex = frameIndex * format.sample_rate / pData->config.outputSampleRate;
+  }
+
+  // A target inside the cache is served from it exactly, even for a scrub, and the backend is left where it is.
+  ca_bool isCached = CA_FALSE;
+  if (pData->cache.pData != NULL)
+  {
+    const void *pFrames = NULL;
+    isCached = ca_pcm_cache_read(&pData->cache, frameIndex, 1, &pFrames) > 0;
+  }
+
+  ca_bool isScrub = (flags & ca_decoder_seek_flag_scrub) != 0;
+  ca_uint64 startFrame = frameIndex;
+  if (isCached)
+  {
+    result = ca_result_success;
+  }
+  else if (pData->pMp4Index != NULL)
+  {
+    result = ca_decoder_mp4_seek(pData, frameIndex, isScrub, &startFrame);
+  }
+  else
+  {
+    result = isScrub ? ca_decoder_backend_seek_sync(pData, frameIndex, &startFrame) : ca_decoder_backend_seek(pData, frameIndex);
+  }
+
+  if (result == ca_result_success && pData->isOutputReady)
+  {
+    ca_decoder_output_reset(&pData->output);
+    pData->isOutputFlushed = CA_FALSE;
+  }
+
+  if (result == ca_result_success)
+  {
+    pData->heldFrameCount = 0;
+  }
+
+  // Frames decoded after a scrub start near the target, so they are not stored until an exact seek.
+  if (pData->isCacheEnabled)
+  {
+    pData->isCacheReading = isCached;
+    pData->isCachePositionKnown = result == ca_result_success && (isCached || !isScrub);
+    pData->cachePosition = frameIndex;
+    if (isCached)
+    {
+      pData->cacheStats.hitCount++;
+    }
+    else
+    {
+      pData->cacheStats.missCount++;
+    }
+  }
+
+  if (pData->config.outputSampleRate != 0 && format.sample_rate != 0)
+  {
+    startFrame = startFrame * pData->config.outputSampleRate / format.sample_rate;
+  }
+
+  if (result == ca_result_success)
+  {
+    pData->outputPosition = isScrub && !isCached ? startFrame : targetFrame;
+  }
+
+  pthread_mutex_lock(&pData->seekLock);
+  pData->isScrubbed = isScrub && result == ca_result_success;
+  if (pData->isScrubbed)
+  {
+    pData->scrubStats.targetFrame = targetFrame;
+    pData->scrubStats.startFrame = startFrame;
+    pData->scrubStats.scrubCount++;
+  }
+  pthread_mutex_unlock(&pData->seekLock);
+
+  pData->isScrubLatencyPending = isScrub && result == ca_result_success;
+  pData->scrubStartMicros = startMicros;
+  return result;
+}
+
+// Runs on the decoding thread before anything is decoded. Requests posted while the seek runs wait for the next call.
+static ca_result ca_decoder_apply_seek_request(ca_decoder_data *pData)
+{
+  ca_uint64 generation = atomic_load_explicit(&pData->requestedGeneration, memory_order_acquire);
+  if (generation == atomic_load_explicit(&pData->appliedGeneration, memory_order_relaxed))
+  {
+    return ca_result_success;
+  }
+
+  pthread_mutex_lock(&pData->seekLock);
+  generation = atomic_load_explicit(&pData->requestedGeneration, memory_order_relaxed);
+  ca_uint64 frameIndex = pData->pendingSeekFrame;
+  ca_decoder_seek_flags flags = pData->pendingSeekFlags;
+  ca_uint64 startMicros = pData->pendingSeekMicros;
+  pthread_mutex_unlock(&pData->seekLock);
+
+  // A failed seek still consumes the request, so the next call decodes from wherever the backend stopped.
+  ca_result result = ca_decoder_seek_to(pData, frameIndex, flags, startMicros);
+  atomic_store_explicit(&pData->appliedGeneration, generation, memory_order_release);
+  return result;
+}
+
+// The resampler holds back the last frames until the backend reaches the end and the held frames are delivered.
+static void ca_decoder_flush_at_end(ca_decoder_data *pData)
+{
+  if (!pData->isOutputReady || !pData->output.isResampling || pData->isOutputFlushed || pData->heldFrameCount > 0)
+  {
+    return;
+  }
+
+  // The last frames come out at once, so a budgeted call which already delivered frames leaves them to a call with room for them.
+  if (pData->isBudgeted && pData->isBudgetUsed && ca_resampler_get_expected_output_frame_count(&pData->output.resampler, 0) > pData->budgetFrames)
+  {
+    return;
+  }
+
+  ca_bool isEOF = CA_FALSE;
+  if (ca_decoder_source_get_eof(pData, &isEOF) == ca_result_success && isEOF)
+  {
+    ca_decoder_deliver(pData, 0, NULL);
+    pData->isOutputFlushed = CA_TRUE;
+  }
+}
+
+// Output stage failures are reported once and the next call retries.
+static ca_result ca_decoder_take_output_result(ca_decoder_data *pData)
+{
+  ca_result result = pData->outputResult;
+  pData->outputResult = ca_result_success;
+  return result;
 }
 
 FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_next(ca_decoder *pDecoder)
 {
-#if __APPLE__
-  return audio_file_stream_decode_next((audio_file_stream *)pDecoder->pDecoder);
-#endif
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_decoder_apply_trim(pData);
+  ca_result seekResult = ca_decoder_apply_seek_request(pData);
+  if (seekResult != ca_result_success)
+  {
+    return seekResult;
+  }
 
-#if ANDROID
-  return native_decoder_decode_next((native_decoder *)pDecoder->pDecoder);
-#endif
+  // Frames held back by ca_decoder_decode_budget come first.
+  if (pData->heldFrameCount > 0)
+  {
+    ca_decoder_deliver_held(pData);
+  }
+  else
+  {
+    ca_result result = ca_decoder_source_decode_next(pData, ~(ca_uint64)0);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  ca_decoder_flush_at_end(pData);
+  ca_decoder_update_budget(pData);
+  return ca_decoder_take_output_result(pData);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_budget(ca_decoder *pDecoder, ca_uint32 maxFrames, ca_uint64 maxMicros)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_decoder_apply_trim(pData);
+  ca_result seekResult = ca_decoder_apply_seek_request(pData);
+  if (seekResult != ca_result_success)
+  {
+    return seekResult;
+  }
+
+  ca_uint64 deadline = maxMicros == 0 ? ~(ca_uint64)0 : ca_get_time_micros() + maxMicros;
+  pData->isBudgeted = CA_TRUE;
+  pData->budgetFrames = maxFrames == 0 ? ~(ca_uint64)0 : maxFrames;
+  pData->isBudgetUsed = CA_FALSE;
+  ca_decoder_deliver_held(pData);
+
+  // Packets are decoded one at a time until a limit is hit. The last packet may overrun maxMicros but never maxFrames.
+  ca_bool isEOF = CA_FALSE;
+  ca_result result = ca_decoder_source_get_eof(pData, &isEOF);
+  while (result == ca_result_success && !isEOF && pData->heldFrameCount == 0 && pData->budgetFrames > 0 && pData->outputResult == ca_result_success)
+  {
+    result = ca_decoder_source_decode_next(pData, deadline);
+    if (result == ca_result_success)
+    {
+      result = ca_decoder_source_get_eof(pData, &isEOF);
+    }
+
+    if (ca_get_time_micros() >= deadline)
+    {
+      break;
+    }
+  }
+
+  if (result == ca_result_success && pData->budgetFrames > 0)
+  {
+    ca_decoder_flush_at_end(pData);
+  }
+
+  pData->isBudgeted = CA_FALSE;
+  ca_decoder_update_budget(pData);
+  ca_result outputResult = ca_decoder_take_output_result(pData);
+  return result != ca_result_success ? result : outputResult;
 }
 
 FFI_PLUGIN_EXPORT ca_result ca_decoder_seek(ca_decoder *pDecoder, ca_uint64 frameIndex)
 {
-#if __APPLE__
-  return audio_file_stream_seek((audio_file_stream *)pDecoder->pDecoder, frameIndex);
-#endif
+  return ca_decoder_seek_with_flags(pDecoder, frameIndex, ca_decoder_seek_flag_none);
+}
 
-#if ANDROID
-  return native_decoder_seek((native_decoder *)pDecoder->pDecoder, frameIndex);
-#endif
+FFI_PLUGIN_EXPORT ca_result ca_decoder_seek_with_flags(ca_decoder *pDecoder, ca_uint64 frameIndex, ca_decoder_seek_flags flags)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_uint64 startMicros = ca_get_time_micros();
+  ca_decoder_apply_trim(pData);
+
+  // A direct seek replaces the pending request and starts a generation of its own. Requests posted while it runs get newer ones.
+  pthread_mutex_lock(&pData->seekLock);
+  ca_uint64 generation = atomic_load_explicit(&pData->requestedGeneration, memory_order_relaxed) + 1;
+  atomic_store_explicit(&pData->requestedGeneration, generation, memory_order_release);
+  atomic_store_explicit(&pData->appliedGeneration, generation, memory_order_release);
+  pthread_mutex_unlock(&pData->seekLock);
+
+  return ca_decoder_seek_to(pData, frameIndex, flags, startMicros);
+}
+
+// Called with seekLock held.
+static ca_uint64 ca_decoder_post_seek(ca_decoder_data *pData, ca_uint64 frameIndex, ca_decoder_seek_flags flags)
+{
+  pData->pendingSeekFrame = frameIndex;
+  pData->pendingSeekFlags = flags;
+  pData->pendingSeekMicros = ca_get_time_micros();
+  ca_uint64 generation = atomic_load_explicit(&pData->requestedGeneration, memory_order_relaxed) + 1;
+  atomic_store_explicit(&pData->requestedGeneration, generation, memory_order_release);
+  return generation;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_request_seek(ca_decoder *pDecoder, ca_uint64 frameIndex, ca_decoder_seek_flags flags, ca_uint64 *pGeneration)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  pthread_mutex_lock(&pData->seekLock);
+  ca_uint64 generation = ca_decoder_post_seek(pData, frameIndex, flags);
+  pthread_mutex_unlock(&pData->seekLock);
+
+  if (pGeneration != NULL)
+  {
+    *pGeneration = generation;
+  }
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_refine_seek(ca_decoder *pDecoder, ca_uint64 *pGeneration)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  pthread_mutex_lock(&pData->seekLock);
+  ca_uint64 generation = atomic_load_explicit(&pData->requestedGeneration, memory_order_relaxed);
+  ca_bool isPending = generation != atomic_load_explicit(&pData->appliedGeneration, memory_order_relaxed);
+  if (isPending && (pData->pendingSeekFlags & ca_decoder_seek_flag_scrub) != 0)
+  {
+    // The pending scrub has not run yet, so it becomes the exact seek.
+    pData->pendingSeekFlags &= ~ca_decoder_seek_flag_scrub;
+  }
+  else if (!isPending && pData->isScrubbed)
+  {
+    generation = ca_decoder_post_seek(pData, pData->scrubStats.targetFrame, ca_decoder_seek_flag_none);
+  }
+  pthread_mutex_unlock(&pData->seekLock);
+
+  if (pGeneration != NULL)
+  {
+    *pGeneration = generation;
+  }
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_scrub_stats(ca_decoder *pDecoder, ca_decoder_scrub_stats *pStats)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  pthread_mutex_lock(&pData->seekLock);
+  *pStats = pData->scrubStats;
+  pthread_mutex_unlock(&pData->seekLock);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_pcm_cache_stats(ca_decoder *pDecoder, ca_decoder_pcm_cache_stats *pStats)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  *pStats = pData->cacheStats;
+  pStats->cachedFrameCount = pData->cache.pData == NULL ? 0 : ca_pcm_cache_get_frame_count(&pData->cache);
+  pStats->sizeInBytes = pData->cache.pData == NULL ? 0 : ca_pcm_cache_get_size_in_bytes(&pData->cache);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_memory_usage(ca_decoder *pDecoder, ca_uint64 *pSizeInBytes)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_decoder_update_budget(pData);
+  *pSizeInBytes = pData->account.sizeInBytes + pData->account.optionalSizeInBytes;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_uint64 ca_decoder_get_seek_generation(ca_decoder *pDecoder)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  return atomic_load_explicit(&pData->appliedGeneration, memory_order_acquire);
 }
 
 FFI_PLUGIN_EXPORT ca_result ca_decoder_get_eof(ca_decoder *pDecoder, ca_bool *pIsEOF)
 {
-#if __APPLE__
-  return audio_file_stream_get_eof((audio_file_stream *)pDecoder->pDecoder, pIsEOF);
-#endif
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_result result = ca_decoder_source_get_eof(pData, pIsEOF);
+  // The stream ends after the held frames and the resampler's last frames are delivered, and not before a pending seek runs.
+  ca_bool isSeekPending = atomic_load_explicit(&pData->requestedGeneration, memory_order_acquire) != atomic_load_explicit(&pData->appliedGeneration, memory_order_relaxed);
+  if (result == ca_result_success && (isSeekPending || pData->heldFrameCount > 0 || (pData->isOutputReady && pData->output.isResampling && !pData->isOutputFlushed)))
+  {
+    *pIsEOF = CA_FALSE;
+  }
+  return result;
+}
 
-#if ANDROID
-  return native_decoder_get_eof((native_decoder *)pDecoder->pDecoder, pIsEOF);
-#endif
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_is_sample_exact(ca_decoder *pDecoder, ca_bool *pIsSampleExact)
+{
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  *pIsSampleExact = pData->backendType != ca_decoder_backend_platform && (pData->backendType != ca_decoder_backend_mp3 || pData->config.isSeekTableDisabled);
+  return ca_result_success;
 }
 
 FFI_PLUGIN_EXPORT ca_result ca_decoder_uninit(ca_decoder *pDecoder)
 {
-#if __APPLE__
-  return audio_file_stream_uninit((audio_file_stream *)pDecoder->pDecoder);
-#endif
+  ca_decoder_data *pData = (ca_decoder_data *)pDecoder->pDecoder;
+  ca_result result = pData->pBackend == NULL ? ca_result_success : ca_decoder_backend_uninit(pData);
+  if (pData->isOutputReady || pData->isOutputKept)
+  {
+    ca_decoder_output_uninit(&pData->output);
+  }
 
-#if ANDROID
-  return native_decoder_uninit((native_decoder *)pDecoder->pDecoder);
-#endif
+  ca_decoder_mp4_index_uninit(pData);
+  ca_decoder_cache_uninit(pData);
+  ca_pcm_chunk_pool_uninit(&pData->chunkPool);
+  ca_budget_close(&pData->account);
+  free(pData->pHeldFrames);
+  free(pData->pBackend);
+  free(pData->pChannelMixMatrix);
+  pthread_mutex_destroy(&pData->seekLock);
+  free(pData);
+  pDecoder->pDecoder = NULL;
+  return result;
 }
@@ -1,10 +1,66 @@
 #pragma once
 
 #include "ca_defs.h"
+#include "ca_channel_mixer.h"
+#include "ca_pcm_chunk.h"
+#include "ca_resampler.h"
+
+typedef void (*ca_decoder_decoded_planar_proc)(ca_uint32 frameCount, void **ppChannels, void *pUserData);
+
+// The decoder releases its reference after the proc returns. Call ca_pcm_chunk_retain to keep the chunk longer.
+typedef void (*ca_decoder_decoded_chunk_proc)(ca_pcm_chunk *pChunk, void *pUserData);
 
 typedef struct
 {
   int appleFileTypeHint;
+
+  // Sample format passed to the decoded proc. ca_sample_format_unknown keeps the backend format.
+  ca_sample_format outputSampleFormat;
+  ca_dither_mode ditherMode;
+
+  // Sample rate passed to the decoded proc. Zero keeps the backend sample rate.
+  ca_uint32 outputSampleRate;
+  ca_resampler_quality resamplerQuality;
+
+  // When set, frames are delivered to this proc with one buffer per channel instead of the decoded proc.
+  ca_decoder_decoded_planar_proc pDecodedPlanarProc;
+
+  // Alignment of each channel buffer in bytes. Must be a power of two.
+  ca_uint32 planarAlignment;
+
+  // When set, frames are delivered to this proc in chunks from a pool owned by the decoder instead of the decoded proc. Cannot be combined with pDecodedPlanarProc.
+  ca_decoder_decoded_chunk_proc pDecodedChunkProc;
+
+  // Channel count passed to the decoded proc. Zero keeps the backend channel count.
+  // Mixing follows the layout of the source, read from WAV channel masks, CAF channel layouts, FLAC channel masks and the Apple codecs, and falls back to the standard layout.
+  ca_uint32 outputChannels;
+  ca_channel_mix_mode channelMixMode;
+
+  // outputChannels rows of channelMixMatrixChannelsIn weights used by ca_channel_mix_mode_custom. Copied by ca_decoder_init.
+  // Sources whose channel count differs from channelMixMatrixChannelsIn fail with ca_result_unsupported_format.
+  const float *pChannelMixMatrix;
+  ca_uint32 channelMixMatrixChannelsIn;
+
+  // Uncompressed WAV, AIFF and CAF streams, FLAC and MP3 streams are read natively when the source is seekable. Set to always use the platform decoder.
+  ca_bool isPortableBackendDisabled;
+
+  // Exact seeks on MP3 streams far past the frames scanned so far jump with the seek table and can land a few frames off.
+  // Set to scan the frame headers up to every target instead, which keeps them sample exact but reads the stream up to the target.
+  ca_bool isSeekTableDisabled;
+
+  // Threads decoding FLAC frame groups and counting MP3 and ADTS frames in parallel. Zero uses one thread per CPU core.
+  ca_uint32 decodeThreadCount;
+
+  // Positions of up to checkpointCount frames decoded recently, checkpointIntervalMillis apart, so seeking back near them skips the search.
+  // Seeks more than two intervals past the nearest checkpoint search the stream as usual.
+  // Zero disables them. Only FLAC streams read natively keep checkpoints.
+  ca_uint32 checkpointCount;
+  ca_uint32 checkpointIntervalMillis;
+
+  // Bytes of recently decoded frames kept so seeks and reads inside them are copied instead of decoded again. Zero disables the cache.
+  // Streams read natively and MP4 files keep a cache. Frames decoded after a scrub seek are not kept.
+  // The cache only grows while the process budget of ca_budget.h has room, and shrinks on ca_trim_memory.
+  ca_uint64 pcmCacheSizeInBytes;
 } ca_decoder_config;
 
 typedef struct
@@ -21,16 +77,90 @@ typedef ca_tell_result (*ca_decoder_tell_proc)(ca_uint64 *pPosition, ca_uint64 *
 
 typedef void (*ca_decoder_decoded_proc)(ca_uint32 frameCount, void *pBuffer, void *pUserData);
 
+typedef enum
+{
+  ca_decoder_seek_flag_none = 0,
+
+  // Jumps to the sync point or packet at or before the target and decodes from there, without the preroll and the frames cut up to the target.
+  // The first frames can be a few milliseconds to a few packets early. Uncompressed streams still seek exactly.
+  ca_decoder_seek_flag_scrub = 1 << 0,
+} ca_decoder_seek_flags;
+
+typedef struct
+{
+  // Target of the last scrub seek and the first frame it decoded, in output frames.
+  ca_uint64 targetFrame;
+  ca_uint64 startFrame;
+
+  // Time from the seek call or request until the first frames of a scrub seek reached the decoded proc.
+  ca_uint64 lastLatencyMicros;
+  ca_uint64 maxLatencyMicros;
+  ca_uint64 scrubCount;
+} ca_decoder_scrub_stats;
+
+typedef struct
+{
+  // Seeks and reads which found their frames in the cache, and those which had to decode them.
+  ca_uint64 hitCount;
+  ca_uint64 missCount;
+
+  // Frames copied from the cache, and frames and bytes it holds, in the backend sample rate.
+  ca_uint64 servedFrameCount;
+  ca_uint64 cachedFrameCount;
+  ca_uint64 sizeInBytes;
+} ca_decoder_pcm_cache_stats;
+
 FFI_PLUGIN_EXPORT ca_decoder_config ca_decoder_config_init();
 
+// Fails with ca_result_budget_exceeded when the limits set by ca_budget_set_limits leave no room for another decoder.
 FFI_PLUGIN_EXPORT ca_result ca_decoder_init(ca_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
 
+// Switches an initialized decoder to a new source with the same config and decoded proc, which is cheaper than ca_decoder_uninit and ca_decoder_init.
+// The output stage is kept when the new source has the same format, and Android keeps its MediaCodec when the new source uses the same codec.
+// Seek requests, scrub stats and the PCM cache of the previous source are dropped. On failure the decoder can only be reinitialized again or uninitialized.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reinit(ca_decoder *pDecoder, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData);
+
 FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_next(ca_decoder *pDecoder);
 
+// Decodes until maxFrames frames are delivered or maxMicros microseconds pass, zero leaving that limit off.
+// Frames decoded past maxFrames are kept and delivered first by the next call. When resampling, a call can stop a few frames short of maxFrames.
+// It only delivers more when maxFrames is smaller than what one source frame or the end of the stream resamples to, so the first frames it delivers make progress.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_budget(ca_decoder *pDecoder, ca_uint32 maxFrames, ca_uint64 maxMicros);
+
 FFI_PLUGIN_EXPORT ca_result ca_decoder_seek(ca_decoder *pDecoder, ca_uint64 frameIndex);
 
+FFI_PLUGIN_EXPORT ca_result ca_decoder_seek_with_flags(ca_decoder *pDecoder, ca_uint64 frameIndex, ca_decoder_seek_flags flags);
+
+// Posts a seek from any thread. It runs at the start of the next decode call, and a newer request replaces one that has not run yet.
+// pGeneration receives the generation frames decoded after the seek belong to. It can be NULL.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_request_seek(ca_decoder *pDecoder, ca_uint64 frameIndex, ca_decoder_seek_flags flags, ca_uint64 *pGeneration);
+
+// Call from any thread when scrubbing stops. A pending scrub request becomes exact, or an exact request for the target of the last scrub seek is posted.
+// Does nothing when the last seek was exact. pGeneration receives the newest requested generation. It can be NULL.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_refine_seek(ca_decoder *pDecoder, ca_uint64 *pGeneration);
+
+// Callable from any thread.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_scrub_stats(ca_decoder *pDecoder, ca_decoder_scrub_stats *pStats);
+
+// Call from the decoding thread.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_pcm_cache_stats(ca_decoder *pDecoder, ca_decoder_pcm_cache_stats *pStats);
+
+// Returns the bytes the decoder holds, as counted by the process budget of ca_budget.h. Platform codecs only count what the decoder allocated itself.
+// Call from the decoding thread.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_memory_usage(ca_decoder *pDecoder, ca_uint64 *pSizeInBytes);
+
+// Returns the generation of the frames being delivered, raised by each seek that runs. Callable from any thread, including the decoded proc.
+// Buffered frames from an older generation than the one a request returned precede the seek and can be dropped.
+FFI_PLUGIN_EXPORT ca_uint64 ca_decoder_get_seek_generation(ca_decoder *pDecoder);
+
 FFI_PLUGIN_EXPORT ca_result ca_decoder_get_eof(ca_decoder *pDecoder, ca_bool *pIsEOF);
 
+// The first call on an ADTS stream counts its frames to get the length, which reads the whole source. Call from the decoding thread.
 FFI_PLUGIN_EXPORT ca_result ca_decoder_get_format(ca_decoder *pDecoder, ca_audio_format *pFormat);
 
+// Sets pIsSampleExact when exact seeks land on the target frame and decode the same samples as a sequential decode, which holds for the streams read natively.
+// MP3 streams only count when isSeekTableDisabled is set.
+// Platform codecs can start a few frames off and depend on the packets decoded before the seek.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_get_is_sample_exact(ca_decoder *pDecoder, ca_bool *pIsSampleExact);
+
 FFI_PLUGIN_EXPORT ca_result ca_decoder_uninit(ca_decoder *pDecoder);
@@ -0,0 +1,252 @@
+#include "ca_decoder_async.h"
+#include "ca_thread_pool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if __linux__
+#include <sys/eventfd.h>
+#define DECODER_ASYNC_EVENTFD 1
+#endif
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t idleCond;
+  ca_bool isBusy;
+  // Completion procs still running. A proc that posts the next request overlaps with that request's own proc.
+  ca_uint32 callbackCount;
+  ca_uint32 frameCount;
+  ca_decoder_async_completion_proc pCompletionProc;
+  void *pUserData;
+
+  ca_result result;
+  ca_bool isEOF;
+
+  // The same descriptor twice for an eventfd.
+  int readFd;
+  int writeFd;
+} ca_decoder_async_data;
+
+static pthread_once_t sharedPoolOnce = PTHREAD_ONCE_INIT;
+static ca_thread_pool sharedPool;
+static ca_result sharedPoolResult = ca_result_unknown_failed;
+
+// The pool lives for the rest of the process.
+static void ca_decoder_async_init_pool()
+{
+  sharedPoolResult = ca_thread_pool_init(&sharedPool, 0);
+}
+
+// MARK: Event
+
+static ca_result ca_decoder_async_open_event(ca_decoder_async_data *pData)
+{
+#if DECODER_ASYNC_EVENTFD
+  pData->readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  pData->writeFd = pData->readFd;
+  return pData->readFd < 0 ? ca_result_unknown_failed : ca_result_success;
+#else
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    return ca_result_unknown_failed;
+  }
+
+  for (int i = 0; i < 2; i++)
+  {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  pData->readFd = fds[0];
+  pData->writeFd = fds[1];
+  return ca_result_success;
+#endif
+}
+
+static void ca_decoder_async_signal(ca_decoder_async_data *pData)
+{
+#if DECODER_ASYNC_EVENTFD
+  eventfd_write(pData->writeFd, 1);
+#else
+  // A full pipe is already readable, so a failed write loses nothing.
+  ca_uint8 byte = 1;
+  (void)!write(pData->writeFd, &byte, 1);
+#endif
+}
+
+static void ca_decoder_async_clear(ca_decoder_async_data *pData)
+{
+#if DECODER_ASYNC_EVENTFD
+  eventfd_t value;
+  eventfd_read(pData->readFd, &value);
+#else
+  ca_uint8 bytes[64];
+  while (read(pData->readFd, bytes, sizeof(bytes)) > 0)
+  {
+  }
+#endif
+}
+
+static void ca_decoder_async_close_event(ca_decoder_async_data *pData)
+{
+  close(pData->readFd);
+  if (pData->writeFd != pData->readFd)
+  {
+    close(pData->writeFd);
+  }
+}
+
+// MARK: Requests
+
+static void ca_decoder_async_job(void *pJobData)
+{
+  ca_decoder_async *pAsync = (ca_decoder_async *)pJobData;
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)pAsync->pData;
+
+  // The budget call holds back the frames past frameCount for the next request.
+  ca_bool isEOF = CA_FALSE;
+  ca_result result = ca_decoder_decode_budget(pAsync->pDecoder, pData->frameCount, 0);
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_get_eof(pAsync->pDecoder, &isEOF);
+  }
+
+  // The request is finished before the completion proc runs, so the proc can post the next one.
+  // Waiters are held until the proc returns.
+  ca_decoder_async_completion_proc pCompletionProc = pData->pCompletionProc;
+  void *pUserData = pData->pUserData;
+  pthread_mutex_lock(&pData->lock);
+  pData->result = result;
+  pData->isEOF = isEOF;
+  pData->isBusy = CA_FALSE;
+  if (pCompletionProc != NULL)
+  {
+    pData->callbackCount++;
+  }
+  ca_decoder_async_signal(pData);
+  pthread_cond_broadcast(&pData->idleCond);
+  pthread_mutex_unlock(&pData->lock);
+
+  if (pCompletionProc == NULL)
+  {
+    return;
+  }
+
+  pCompletionProc(result, isEOF, pUserData);
+
+  pthread_mutex_lock(&pData->lock);
+  pData->callbackCount--;
+  pthread_cond_broadcast(&pData->idleCond);
+  pthread_mutex_unlock(&pData->lock);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_async_init(ca_decoder_async *pAsync, ca_decoder *pDecoder)
+{
+  pthread_once(&sharedPoolOnce, ca_decoder_async_init_pool);
+  if (sharedPoolResult != ca_result_success)
+  {
+    return sharedPoolResult;
+  }
+
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)calloc(1, sizeof(ca_decoder_async_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_decoder_async_open_event(pData);
+  if (result != ca_result_success)
+  {
+    free(pData);
+    return result;
+  }
+
+  pthread_mutex_init(&pData->lock, NULL);
+  pthread_cond_init(&pData->idleCond, NULL);
+  pData->result = ca_result_success;
+  pAsync->pDecoder = pDecoder;
+  pAsync->pData = pData;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT int ca_decoder_async_get_fd(ca_decoder_async *pAsync)
+{
+  return ((ca_decoder_async_data *)pAsync->pData)->readFd;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_async(ca_decoder_async *pAsync, ca_uint32 frameCount, ca_decoder_async_completion_proc pCompletionProc, void *pUserData)
+{
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)pAsync->pData;
+  pthread_mutex_lock(&pData->lock);
+  if (pData->isBusy || frameCount == 0)
+  {
+    pthread_mutex_unlock(&pData->lock);
+    return ca_result_invalid_args;
+  }
+
+  pData->isBusy = CA_TRUE;
+  pData->frameCount = frameCount;
+  pData->pCompletionProc = pCompletionProc;
+  pData->pUserData = pUserData;
+  pthread_mutex_unlock(&pData->lock);
+
+  ca_result result = ca_thread_pool_submit(&sharedPool, ca_decoder_async_job, pAsync);
+  if (result != ca_result_success)
+  {
+    pthread_mutex_lock(&pData->lock);
+    pData->isBusy = CA_FALSE;
+    pthread_mutex_unlock(&pData->lock);
+  }
+  return result;
+}
+
+FFI_PLUGIN_EXPORT void ca_decoder_async_poll(ca_decoder_async *pAsync, ca_bool *pIsBusy, ca_result *pResult, ca_bool *pIsEOF)
+{
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)pAsync->pData;
+  pthread_mutex_lock(&pData->lock);
+  ca_decoder_async_clear(pData);
+  if (pIsBusy != NULL)
+  {
+    *pIsBusy = pData->isBusy;
+  }
+
+  if (pResult != NULL)
+  {
+    *pResult = pData->result;
+  }
+
+  if (pIsEOF != NULL)
+  {
+    *pIsEOF = pData->isEOF;
+  }
+  pthread_mutex_unlock(&pData->lock);
+}
+
+FFI_PLUGIN_EXPORT void ca_decoder_async_wait(ca_decoder_async *pAsync)
+{
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)pAsync->pData;
+  pthread_mutex_lock(&pData->lock);
+  while (pData->isBusy || pData->callbackCount > 0)
+  {
+    pthread_cond_wait(&pData->idleCond, &pData->lock);
+  }
+  pthread_mutex_unlock(&pData->lock);
+}
+
+FFI_PLUGIN_EXPORT void ca_decoder_async_uninit(ca_decoder_async *pAsync)
+{
+  ca_decoder_async_data *pData = (ca_decoder_async_data *)pAsync->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  ca_decoder_async_wait(pAsync);
+  ca_decoder_async_close_event(pData);
+  pthread_cond_destroy(&pData->idleCond);
+  pthread_mutex_destroy(&pData->lock);
+  free(pData);
+  pAsync->pData = NULL;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+// Called on a worker thread when a request finishes. The proc may post the next request on the same decoder,
+// but must not call ca_decoder_async_wait or ca_decoder_async_uninit, which wait for the proc to return.
+typedef void (*ca_decoder_async_completion_proc)(ca_result result, ca_bool isEOF, void *pUserData);
+
+// Runs decode requests of a decoder on a thread pool shared by every async decoder, so many streams need no thread each.
+// A file descriptor becomes readable when a request finishes, for event loops polling many streams.
+typedef struct
+{
+  ca_decoder *pDecoder;
+  void *pData;
+} ca_decoder_async;
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_async_init(ca_decoder_async *pAsync, ca_decoder *pDecoder);
+
+// Returns the descriptor to poll for readability. It is an eventfd on Linux and Android and the read end of a pipe elsewhere.
+FFI_PLUGIN_EXPORT int ca_decoder_async_get_fd(ca_decoder_async *pAsync);
+
+// Decodes until frameCount frames are delivered to the decoder's decoded proc or the stream ends, on a worker thread.
+// The decoder must not be used until the request finishes. Fails with ca_result_invalid_args while another request runs.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_decode_async(ca_decoder_async *pAsync, ca_uint32 frameCount, ca_decoder_async_completion_proc pCompletionProc, void *pUserData);
+
+// Makes the descriptor unreadable and returns the outcome of the last finished request.
+// pIsBusy is set while a request runs. Any of the pointers can be NULL.
+FFI_PLUGIN_EXPORT void ca_decoder_async_poll(ca_decoder_async *pAsync, ca_bool *pIsBusy, ca_result *pResult, ca_bool *pIsEOF);
+
+// Blocks until the running request finishes and its completion proc returns.
+FFI_PLUGIN_EXPORT void ca_decoder_async_wait(ca_decoder_async *pAsync);
+
+// Waits for the running request and its completion proc, then closes the descriptor. The decoder is not uninitialized.
+FFI_PLUGIN_EXPORT void ca_decoder_async_uninit(ca_decoder_async *pAsync);
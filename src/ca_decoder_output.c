@@ -0,0 +1,391 @@
+#include "ca_decoder_output.h"
+#include <string.h>
+
+ca_sample_format ca_decoder_output_get_sample_format(ca_decoder_config config, ca_sample_format backendFormat)
+{
+  return config.outputSampleFormat == ca_sample_format_unknown ? backendFormat : config.outputSampleFormat;
+}
+
+ca_uint32 ca_decoder_output_get_channels(ca_decoder_config config, ca_uint32 backendChannels)
+{
+  return config.outputChannels == 0 ? backendChannels : config.outputChannels;
+}
+
+ca_uint32 ca_decoder_output_get_sample_rate(ca_decoder_config config, ca_uint32 backendSampleRate)
+{
+  return config.outputSampleRate == 0 ? backendSampleRate : config.outputSampleRate;
+}
+
+ca_result ca_decoder_output_init(ca_decoder_output *pOutput, ca_decoder_config config, ca_audio_format backendFormat, const ca_channel *pChannelMapIn)
+{
+  pOutput->channelsIn = backendFormat.channels;
+  pOutput->channels = ca_decoder_output_get_channels(config, backendFormat.channels);
+  pOutput->formatIn = backendFormat.sample_foramt;
+  pOutput->formatOut = ca_decoder_output_get_sample_format(config, backendFormat.sample_foramt);
+  pOutput->isMixing = pOutput->channelsIn != pOutput->channels || config.channelMixMode == ca_channel_mix_mode_custom;
+  pOutput->sampleRateIn = backendFormat.sample_rate;
+  pOutput->sampleRateOut = ca_decoder_output_get_sample_rate(config, backendFormat.sample_rate);
+  pOutput->isResampling = pOutput->sampleRateIn != pOutput->sampleRateOut;
+  pOutput->planarAlignment = config.planarAlignment;
+  pOutput->isScratchReady = CA_FALSE;
+
+  if (pOutput->channelsIn == 0 || pOutput->channelsIn > CA_MAX_CHANNELS)
+  {
+    return ca_result_unsupported_format;
+  }
+  memcpy(pOutput->channelMapIn, pChannelMapIn, pOutput->channelsIn);
+
+  if (config.channelMixMode == ca_channel_mix_mode_custom && config.channelMixMatrixChannelsIn != pOutput->channelsIn)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_result result;
+  ca_sample_format converterFormatIn = pOutput->formatIn;
+  if (pOutput->isMixing || pOutput->isResampling)
+  {
+    result = ca_converter_init(&pOutput->inputConverter, ca_converter_config_init(pOutput->formatIn, ca_sample_format_f32));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    converterFormatIn = ca_sample_format_f32;
+  }
+
+  if (pOutput->isMixing)
+  {
+    ca_channel_mixer_config mixerConfig = ca_channel_mixer_config_init(pOutput->channelsIn, pOutput->channels);
+    mixerConfig.pChannelMapIn = pOutput->channelMapIn;
+    mixerConfig.mixMode = config.channelMixMode;
+    mixerConfig.pMatrix = config.pChannelMixMatrix;
+    result = ca_channel_mixer_init(&pOutput->mixer, mixerConfig);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  if (pOutput->isResampling)
+  {
+    ca_resampler_config resamplerConfig = ca_resampler_config_init(pOutput->channels, pOutput->sampleRateIn, pOutput->sampleRateOut);
+    resamplerConfig.quality = config.resamplerQuality;
+    result = ca_resampler_init(&pOutput->resampler, resamplerConfig);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  ca_converter_config converterConfig = ca_converter_config_init(converterFormatIn, pOutput->formatOut);
+  converterConfig.ditherMode = config.ditherMode;
+  result = ca_converter_init(&pOutput->converter, converterConfig);
+  if (result != ca_result_success && pOutput->isResampling)
+  {
+    ca_resampler_uninit(&pOutput->resampler);
+  }
+
+  return result;
+}
+
+// Returns an upper bound of the scratch one call takes, including the arena's rounding of each allocation.
+// A resampler producing more than its estimate chains an extra block, which the next reset frees.
+static ca_uint64 ca_decoder_output_get_scratch_size(ca_decoder_output *pOutput, ca_uint32 frameCount, ca_bool isPlanar)
+{
+  ca_uint64 frameCountOut = pOutput->isResampling ? ca_resampler_get_expected_output_frame_count(&pOutput->resampler, frameCount) : frameCount;
+  ca_bool isFloat = pOutput->isMixing || pOutput->isResampling;
+  ca_uint64 sizeInBytes = 0;
+  if ((isFloat ? ca_sample_format_f32 : pOutput->formatIn) != pOutput->formatOut)
+  {
+    sizeInBytes += frameCountOut * pOutput->channels * ca_get_bytes_per_sample(pOutput->formatOut) + 16;
+  }
+
+  if (isFloat && pOutput->formatIn != ca_sample_format_f32)
+  {
+    sizeInBytes += (ca_uint64)frameCount * pOutput->channelsIn * sizeof(float) + 16;
+  }
+
+  if (pOutput->isMixing)
+  {
+    sizeInBytes += (ca_uint64)frameCount * pOutput->channels * sizeof(float) + 16;
+  }
+
+  if (pOutput->isResampling)
+  {
+    sizeInBytes += frameCountOut * pOutput->channels * sizeof(float) + 16;
+  }
+
+  if (isPlanar)
+  {
+    ca_uint64 alignment = pOutput->planarAlignment;
+    ca_uint64 strideInBytes = (frameCountOut * ca_get_bytes_per_sample(pOutput->formatOut) + alignment - 1) & ~(alignment - 1);
+    sizeInBytes += strideInBytes * pOutput->channels + alignment + sizeof(void *) * pOutput->channels + 32;
+  }
+  return sizeInBytes;
+}
+
+// Releases the buffers of the previous call. The arena is replaced by a larger one when the call needs more than its block.
+static ca_result ca_decoder_output_begin(ca_decoder_output *pOutput, ca_uint64 scratchSize)
+{
+  if (scratchSize == 0)
+  {
+    return ca_result_success;
+  }
+
+  if (pOutput->isScratchReady && scratchSize <= pOutput->scratch.blockSize)
+  {
+    ca_arena_reset(&pOutput->scratch);
+    return ca_result_success;
+  }
+
+  if (pOutput->isScratchReady)
+  {
+    ca_arena_uninit(&pOutput->scratch);
+  }
+
+  // A quarter more, so calls growing slowly do not replace the arena every time.
+  ca_result result = ca_arena_init(&pOutput->scratch, (size_t)(scratchSize + scratchSize / 4));
+  pOutput->isScratchReady = result == ca_result_success;
+  return result;
+}
+
+static ca_result ca_decoder_output_to_float(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, const float **ppFramesOut)
+{
+  ca_result result;
+  const float *pFramesIn = (const float *)pBufferIn;
+  if (pOutput->formatIn != ca_sample_format_f32)
+  {
+    ca_uint64 sampleCount = (ca_uint64)frameCount * pOutput->channelsIn;
+    float *pFloatIn = (float *)ca_arena_alloc(&pOutput->scratch, (size_t)(sampleCount * sizeof(float)));
+    if (pFloatIn == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    result = ca_converter_process(&pOutput->inputConverter, pFloatIn, pBufferIn, sampleCount);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    pFramesIn = pFloatIn;
+  }
+
+  if (pOutput->isMixing)
+  {
+    float *pMixOut = (float *)ca_arena_alloc(&pOutput->scratch, (size_t)((ca_uint64)frameCount * pOutput->channels * sizeof(float)));
+    if (pMixOut == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    result = ca_channel_mixer_process(&pOutput->mixer, pMixOut, pFramesIn, frameCount);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    pFramesIn = pMixOut;
+  }
+
+  *ppFramesOut = pFramesIn;
+  return ca_result_success;
+}
+
+static ca_result ca_decoder_output_resample(ca_decoder_output *pOutput, ca_uint32 frameCount, const float *pFramesIn, float **ppFramesOut, ca_uint64 *pFrameCountOut)
+{
+  ca_uint64 bytesPerFrame = sizeof(float) * pOutput->channels;
+  ca_uint64 capacity = ca_resampler_get_expected_output_frame_count(&pOutput->resampler, frameCount);
+  ca_uint64 consumed = 0;
+  ca_uint64 produced = 0;
+  float *pResampleOut = NULL;
+  ca_result result;
+  for (;;)
+  {
+    // A larger buffer takes over the frames produced so far.
+    float *pBuffer = (float *)ca_arena_alloc(&pOutput->scratch, (size_t)(capacity * bytesPerFrame));
+    if (pBuffer == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    if (produced > 0)
+    {
+      memcpy(pBuffer, pResampleOut, (size_t)(produced * bytesPerFrame));
+    }
+    pResampleOut = pBuffer;
+
+    float *pFramesOut = pResampleOut + produced * pOutput->channels;
+    ca_uint64 framesIn = frameCount - consumed;
+    ca_uint64 framesOut = capacity - produced;
+    result = ca_resampler_process(&pOutput->resampler, pFramesIn == NULL ? NULL : pFramesIn + consumed * pOutput->channels, &framesIn, pFramesOut, &framesOut);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    consumed += pFramesIn == NULL ? 0 : framesIn;
+    produced += framesOut;
+
+    // The estimate is an upper bound, so a full output buffer is the only reason to go around again.
+    if (produced < capacity || (pFramesIn != NULL && consumed == frameCount))
+    {
+      break;
+    }
+    capacity *= 2;
+  }
+
+  *ppFramesOut = pResampleOut;
+  *pFrameCountOut = produced;
+  return ca_result_success;
+}
+
+static ca_result ca_decoder_output_convert(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, void **ppBufferOut, ca_uint32 *pFrameCountOut)
+{
+  ca_sample_format formatIn = pOutput->formatIn;
+  ca_uint64 frameCountOut = frameCount;
+  ca_result result;
+
+  if (pBufferIn != NULL && (pOutput->isMixing || pOutput->isResampling))
+  {
+    const float *pFrames = NULL;
+    result = ca_decoder_output_to_float(pOutput, frameCount, pBufferIn, &pFrames);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    pBufferIn = (void *)pFrames;
+    formatIn = ca_sample_format_f32;
+  }
+
+  if (pOutput->isResampling)
+  {
+    float *pResampled = NULL;
+    result = ca_decoder_output_resample(pOutput, frameCount, (const float *)pBufferIn, &pResampled, &frameCountOut);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    pBufferIn = pResampled;
+    formatIn = ca_sample_format_f32;
+  }
+  else if (pBufferIn == NULL)
+  {
+    frameCountOut = 0;
+  }
+
+  *pFrameCountOut = (ca_uint32)frameCountOut;
+  if (formatIn == pOutput->formatOut)
+  {
+    *ppBufferOut = pBufferIn;
+    return ca_result_success;
+  }
+
+  ca_uint64 sampleCount = frameCountOut * pOutput->channels;
+  void *pBuffer = ca_arena_alloc(&pOutput->scratch, (size_t)(sampleCount * ca_get_bytes_per_sample(pOutput->formatOut)));
+  if (pBuffer == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  *ppBufferOut = pBuffer;
+  return ca_converter_process(&pOutput->converter, pBuffer, pBufferIn, sampleCount);
+}
+
+ca_result ca_decoder_output_process(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, void **ppBufferOut, ca_uint32 *pFrameCountOut)
+{
+  ca_result result = ca_decoder_output_begin(pOutput, ca_decoder_output_get_scratch_size(pOutput, frameCount, CA_FALSE));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  return ca_decoder_output_convert(pOutput, frameCount, pBufferIn, ppBufferOut, pFrameCountOut);
+}
+
+static ca_result ca_decoder_output_alloc_planar(ca_decoder_output *pOutput, ca_uint64 frameCount, void ***pppChannels)
+{
+  // Every channel starts on an aligned address, so the stride is rounded up to the alignment.
+  ca_uint64 alignment = pOutput->planarAlignment;
+  ca_uint64 strideInBytes = (frameCount * ca_get_bytes_per_sample(pOutput->formatOut) + alignment - 1) & ~(alignment - 1);
+  void **ppChannels = (void **)ca_arena_alloc(&pOutput->scratch, sizeof(void *) * pOutput->channels);
+  void *pPlanarBuffer = ca_arena_alloc(&pOutput->scratch, (size_t)(strideInBytes * pOutput->channels + alignment));
+  if (ppChannels == NULL || pPlanarBuffer == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_uint8 *pAligned = (ca_uint8 *)(((size_t)pPlanarBuffer + alignment - 1) & ~(size_t)(alignment - 1));
+  for (ca_uint32 channel = 0; channel < pOutput->channels; channel++)
+  {
+    ppChannels[channel] = pAligned + strideInBytes * channel;
+  }
+
+  *pppChannels = ppChannels;
+  return ca_result_success;
+}
+
+ca_result ca_decoder_output_process_planar(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, void ***pppChannelsOut, ca_uint32 *pFrameCountOut)
+{
+  ca_result result = ca_decoder_output_begin(pOutput, ca_decoder_output_get_scratch_size(pOutput, frameCount, CA_TRUE));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  void *pInterleaved = NULL;
+  result = ca_decoder_output_convert(pOutput, frameCount, pBufferIn, &pInterleaved, pFrameCountOut);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  result = ca_decoder_output_alloc_planar(pOutput, *pFrameCountOut, pppChannelsOut);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  return ca_deinterleave_pcm(*pppChannelsOut, pInterleaved, pOutput->formatOut, pOutput->channels, *pFrameCountOut);
+}
+
+ca_bool ca_decoder_output_is_compatible(ca_decoder_output *pOutput, ca_audio_format backendFormat, const ca_channel *pChannelMapIn)
+{
+  return pOutput->channelsIn == backendFormat.channels && pOutput->formatIn == backendFormat.sample_foramt && pOutput->sampleRateIn == backendFormat.sample_rate && memcmp(pOutput->channelMapIn, pChannelMapIn, pOutput->channelsIn) == 0;
+}
+
+ca_uint64 ca_decoder_output_get_size_in_bytes(ca_decoder_output *pOutput)
+{
+  ca_uint64 sizeInBytes = pOutput->isScratchReady ? pOutput->scratch.blockSize : 0;
+
+  if (pOutput->isResampling)
+  {
+    const ca_resampler *pResampler = &pOutput->resampler;
+    sizeInBytes += sizeof(float) * ((ca_uint64)pResampler->tableRows * pResampler->taps + pResampler->taps + (ca_uint64)pResampler->bufferCapacity * pResampler->config.channels);
+  }
+  return sizeInBytes;
+}
+
+void ca_decoder_output_reset(ca_decoder_output *pOutput)
+{
+  if (pOutput->isResampling)
+  {
+    ca_resampler_reset(&pOutput->resampler);
+  }
+}
+
+void ca_decoder_output_uninit(ca_decoder_output *pOutput)
+{
+  if (pOutput->isResampling)
+  {
+    ca_resampler_uninit(&pOutput->resampler);
+  }
+
+  if (pOutput->isScratchReady)
+  {
+    ca_arena_uninit(&pOutput->scratch);
+    pOutput->isScratchReady = CA_FALSE;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ca_arena.h"
+#include "ca_channel_mixer.h"
+#include "ca_convert.h"
+#include "ca_decoder.h"
+#include "ca_resampler.h"
+
+// Converts the frames emitted by a backend into the format requested by ca_decoder_config.
+typedef struct
+{
+  ca_uint32 channelsIn;
+  ca_uint32 channels;
+  ca_channel channelMapIn[CA_MAX_CHANNELS];
+  ca_sample_format formatIn;
+  ca_sample_format formatOut;
+  ca_converter converter;
+
+  // Mixing and resampling run in f32 between the input and output conversions.
+  ca_converter inputConverter;
+
+  // Channels are mixed before resampling so the resampler runs on fewer channels when downmixing.
+  ca_bool isMixing;
+  ca_channel_mixer mixer;
+
+  ca_bool isResampling;
+  ca_uint32 sampleRateIn;
+  ca_uint32 sampleRateOut;
+  ca_resampler resampler;
+
+  ca_uint32 planarAlignment;
+
+  // Buffers of the current process call. Each call resets the arena, which grows to the largest call so far, so steady decoding allocates nothing.
+  ca_arena scratch;
+  ca_bool isScratchReady;
+} ca_decoder_output;
+
+// Returns the sample format delivered to the decoded proc for the given backend format.
+ca_sample_format ca_decoder_output_get_sample_format(ca_decoder_config config, ca_sample_format backendFormat);
+
+// Returns the channel count delivered to the decoded proc for the given backend channel count.
+ca_uint32 ca_decoder_output_get_channels(ca_decoder_config config, ca_uint32 backendChannels);
+
+// Returns the sample rate delivered to the decoded proc for the given backend sample rate.
+ca_uint32 ca_decoder_output_get_sample_rate(ca_decoder_config config, ca_uint32 backendSampleRate);
+
+// pChannelMapIn holds the positions of the backend channels, which the mixer uses to downmix and upmix.
+ca_result ca_decoder_output_init(ca_decoder_output *pOutput, ca_decoder_config config, ca_audio_format backendFormat, const ca_channel *pChannelMapIn);
+
+// Returns the converted frames in ppBufferOut. The buffer is valid until the next call.
+// Passing NULL as pBufferIn flushes the frames held back by the resampler.
+ca_result ca_decoder_output_process(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, void **ppBufferOut, ca_uint32 *pFrameCountOut);
+
+// Returns the converted frames as aligned per-channel buffers. The buffers are valid until the next call.
+ca_result ca_decoder_output_process_planar(ca_decoder_output *pOutput, ca_uint32 frameCount, void *pBufferIn, void ***pppChannelsOut, ca_uint32 *pFrameCountOut);
+
+// Returns whether the stage converts frames of backendFormat, so a decoder switching sources can keep it.
+ca_bool ca_decoder_output_is_compatible(ca_decoder_output *pOutput, ca_audio_format backendFormat, const ca_channel *pChannelMapIn);
+
+// Returns the bytes of the scratch arena and the resampler's tables.
+ca_uint64 ca_decoder_output_get_size_in_bytes(ca_decoder_output *pOutput);
+
+// Drops the frames buffered for resampling. Called when the backend seeks.
+void ca_decoder_output_reset(ca_decoder_output *pOutput);
+
+void ca_decoder_output_uninit(ca_decoder_output *pOutput);
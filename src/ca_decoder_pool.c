@@ -0,0 +1,163 @@
+#include "ca_decoder_pool.h"
+#include "ca_budget.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  ca_decoder_config config;
+  ca_decoder_decoded_proc pDecodedProc;
+
+  pthread_mutex_t lock;
+  ca_decoder **ppIdle;
+  ca_uint32 idleCount;
+  ca_uint32 capacity;
+
+  // Only polls ca_trim_memory. The decoders count their own memory, and the first poll comes before any decoder is idle.
+  ca_budget_account account;
+} ca_decoder_pool_data;
+
+static ca_result ca_decoder_pool_destroy(ca_decoder *pDecoder)
+{
+  ca_result result = ca_decoder_uninit(pDecoder);
+  free(pDecoder);
+  return result;
+}
+
+// Drops half of the idle decoders after ca_trim_memory, or all of them at the critical level, least recently released first.
+static void ca_decoder_pool_trim(ca_decoder_pool_data *pData)
+{
+  ca_trim_level level;
+  ca_uint32 dropCount = 0;
+  pthread_mutex_lock(&pData->lock);
+  if (ca_budget_poll_trim(&pData->account, &level))
+  {
+    dropCount = level == ca_trim_level_critical ? pData->idleCount : pData->idleCount / 2;
+  }
+  pthread_mutex_unlock(&pData->lock);
+
+  // Taken one at a time so the lock is not held while a decoder uninitializes.
+  for (; dropCount > 0; dropCount--)
+  {
+    ca_decoder *pDecoder = NULL;
+    pthread_mutex_lock(&pData->lock);
+    if (pData->idleCount > 0)
+    {
+      pDecoder = pData->ppIdle[0];
+      memmove(pData->ppIdle, pData->ppIdle + 1, --pData->idleCount * sizeof(ca_decoder *));
+    }
+    pthread_mutex_unlock(&pData->lock);
+
+    if (pDecoder == NULL)
+    {
+      break;
+    }
+    ca_decoder_pool_destroy(pDecoder);
+  }
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_init(ca_decoder_pool *pPool, ca_decoder_config config, ca_decoder_decoded_proc pDecodedProc, ca_uint32 capacity)
+{
+  ca_decoder_pool_data *pData = (ca_decoder_pool_data *)calloc(1, sizeof(ca_decoder_pool_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->ppIdle = (ca_decoder **)calloc(capacity == 0 ? 1 : capacity, sizeof(ca_decoder *));
+  if (pData->ppIdle == NULL)
+  {
+    free(pData);
+    return ca_result_out_of_memory;
+  }
+
+  pData->config = config;
+  pData->pDecodedProc = pDecodedProc;
+  pData->capacity = capacity;
+  pthread_mutex_init(&pData->lock, NULL);
+  pPool->pData = pData;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_acquire(ca_decoder_pool *pPool, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData, ca_decoder **ppDecoder)
+{
+  ca_decoder_pool_data *pData = (ca_decoder_pool_data *)pPool->pData;
+  ca_decoder_pool_trim(pData);
+
+  ca_decoder *pDecoder = NULL;
+  pthread_mutex_lock(&pData->lock);
+  if (pData->idleCount > 0)
+  {
+    pDecoder = pData->ppIdle[--pData->idleCount];
+  }
+  pthread_mutex_unlock(&pData->lock);
+
+  // A decoder whose reinit fails can only be reinitialized or uninitialized, so it is dropped.
+  ca_result result;
+  if (pDecoder != NULL)
+  {
+    result = ca_decoder_reinit(pDecoder, pReadProc, pSeekProc, pTellProc, pUserData);
+    if (result != ca_result_success)
+    {
+      ca_decoder_pool_destroy(pDecoder);
+      return result;
+    }
+  }
+  else
+  {
+    pDecoder = (ca_decoder *)malloc(sizeof(ca_decoder));
+    if (pDecoder == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    result = ca_decoder_init(pDecoder, pData->config, pReadProc, pSeekProc, pTellProc, pData->pDecodedProc, pUserData);
+    if (result != ca_result_success)
+    {
+      free(pDecoder);
+      return result;
+    }
+  }
+
+  *ppDecoder = pDecoder;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_release(ca_decoder_pool *pPool, ca_decoder *pDecoder)
+{
+  ca_decoder_pool_data *pData = (ca_decoder_pool_data *)pPool->pData;
+
+  pthread_mutex_lock(&pData->lock);
+  ca_bool isKept = pData->idleCount < pData->capacity;
+  if (isKept)
+  {
+    pData->ppIdle[pData->idleCount++] = pDecoder;
+  }
+  pthread_mutex_unlock(&pData->lock);
+
+  ca_result result = isKept ? ca_result_success : ca_decoder_pool_destroy(pDecoder);
+  ca_decoder_pool_trim(pData);
+  return result;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_uninit(ca_decoder_pool *pPool)
+{
+  ca_decoder_pool_data *pData = (ca_decoder_pool_data *)pPool->pData;
+
+  ca_result result = ca_result_success;
+  for (ca_uint32 i = 0; i < pData->idleCount; i++)
+  {
+    ca_result uninitResult = ca_decoder_pool_destroy(pData->ppIdle[i]);
+    if (result == ca_result_success)
+    {
+      result = uninitResult;
+    }
+  }
+
+  pthread_mutex_destroy(&pData->lock);
+  free(pData->ppIdle);
+  free(pData);
+  pPool->pData = NULL;
+  return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+// Keeps released decoders so later sources reuse them through ca_decoder_reinit instead of being initialized from scratch.
+// Every decoder shares the config and decoded proc given at init. Callable from any thread.
+typedef struct
+{
+  void *pData;
+} ca_decoder_pool;
+
+// Up to capacity idle decoders are kept. After ca_trim_memory, the next acquire or release uninitializes half of them, or all of them at the critical level.
+// Idle decoders count toward the limits of ca_budget.h. The decoded proc receives the pUserData given to ca_decoder_pool_acquire.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_init(ca_decoder_pool *pPool, ca_decoder_config config, ca_decoder_decoded_proc pDecodedProc, ca_uint32 capacity);
+
+// Returns a decoder reading the given source, an idle one when there is one.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_acquire(ca_decoder_pool *pPool, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData, ca_decoder **ppDecoder);
+
+// Returns a decoder from ca_decoder_pool_acquire. It is kept idle or uninitialized when the pool is full.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_release(ca_decoder_pool *pPool, ca_decoder *pDecoder);
+
+// Uninitializes the idle decoders. Acquired decoders must be released first.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_pool_uninit(ca_decoder_pool *pPool);
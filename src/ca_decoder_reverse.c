@@ -0,0 +1,291 @@
+#include "ca_decoder_reverse.h"
+#include "ca_decoder_async.h"
+#include "ca_convert.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Output frames decoded before each block when resampling and dropped, so the resampler has settled when the block starts.
+#define DECODER_REVERSE_RESAMPLER_PREROLL_FRAMES 256
+
+typedef struct
+{
+  ca_decoder_async async;
+  ca_decoder_read_proc pReadProc;
+  ca_decoder_seek_proc pSeekProc;
+  ca_decoder_tell_proc pTellProc;
+  ca_decoder_decoded_proc pDecodedProc;
+  void *pUserData;
+
+  ca_uint32 bytesPerFrame;
+  ca_uint32 blockFrames;
+  ca_uint32 prerollFrames;
+  ca_uint64 length;
+  ca_uint64 position;
+
+  // Two blocks, so one is decoded while the other is reversed and delivered.
+  ca_uint8 *pBlocks[2];
+  ca_uint32 blockFrameCounts[2];
+
+  // Block the decoded proc fills, the frames it takes and the preroll frames it drops first.
+  int fillIndex;
+  ca_uint32 fillFrames;
+  ca_uint32 skipFrames;
+
+  // Set while the block starting at prefetchStart is decoded in the background or waits to be delivered.
+  ca_bool isPrefetching;
+  ca_uint64 prefetchStart;
+} ca_decoder_reverse_data;
+
+// The decoder passes the host's user data to the source procs and this reader's data to the decoded proc.
+static ca_read_result ca_decoder_reverse_on_read(void *pBufferIn, ca_uint32 bytesToRead, ca_uint32 *pBytesRead, void *pUserData)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pUserData;
+  return pData->pReadProc(pBufferIn, bytesToRead, pBytesRead, pData->pUserData);
+}
+
+static ca_seek_result ca_decoder_reverse_on_seek(ca_int64 byteOffset, ca_seek_origin origin, void *pUserData)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pUserData;
+  return pData->pSeekProc(byteOffset, origin, pData->pUserData);
+}
+
+static ca_tell_result ca_decoder_reverse_on_tell(ca_uint64 *pPosition, ca_uint64 *pLength, void *pUserData)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pUserData;
+  return pData->pTellProc(pPosition, pLength, pData->pUserData);
+}
+
+// Frames past the end of the block belong to the next one and are dropped.
+static void ca_decoder_reverse_on_decoded(ca_uint32 frameCount, void *pBuffer, void *pUserData)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pUserData;
+  ca_uint32 skipCount = ca_min(frameCount, pData->skipFrames);
+  pBuffer = (ca_uint8 *)pBuffer + (size_t)skipCount * pData->bytesPerFrame;
+  frameCount -= skipCount;
+  pData->skipFrames -= skipCount;
+
+  int index = pData->fillIndex;
+  ca_uint32 count = ca_min(frameCount, pData->fillFrames - pData->blockFrameCounts[index]);
+  memcpy(pData->pBlocks[index] + (size_t)pData->blockFrameCounts[index] * pData->bytesPerFrame, pBuffer, (size_t)count * pData->bytesPerFrame);
+  pData->blockFrameCounts[index] += count;
+}
+
+// MARK: Blocks
+
+static ca_uint64 ca_decoder_reverse_get_block_start(ca_decoder_reverse_data *pData, ca_uint64 blockEnd)
+{
+  return blockEnd - ca_min(blockEnd, (ca_uint64)pData->blockFrames);
+}
+
+// Returns the frame decoding starts at.
+static ca_uint64 ca_decoder_reverse_begin_block(ca_decoder_reverse_data *pData, int index, ca_uint64 start, ca_uint64 end)
+{
+  pData->fillIndex = index;
+  pData->fillFrames = (ca_uint32)(end - start);
+  pData->skipFrames = (ca_uint32)ca_min(start, (ca_uint64)pData->prerollFrames);
+  pData->blockFrameCounts[index] = 0;
+  return start - pData->skipFrames;
+}
+
+// Tops up a block on the calling thread. The budgeted decode can deliver a few frames less than asked when resampling.
+static ca_result ca_decoder_reverse_finish_block(ca_decoder_reverse *pReverse)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  ca_result result = ca_result_success;
+  while (pData->blockFrameCounts[pData->fillIndex] < pData->fillFrames)
+  {
+    ca_bool isEOF = CA_FALSE;
+    result = ca_decoder_get_eof(&pReverse->decoder, &isEOF);
+    if (result != ca_result_success || isEOF)
+    {
+      break;
+    }
+
+    result = ca_decoder_decode_budget(&pReverse->decoder, pData->skipFrames + pData->fillFrames - pData->blockFrameCounts[pData->fillIndex], 0);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+  }
+  return result;
+}
+
+// The seek request runs on the worker at the start of the decode request.
+static void ca_decoder_reverse_prefetch(ca_decoder_reverse *pReverse, int index, ca_uint64 end)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  ca_uint64 start = ca_decoder_reverse_get_block_start(pData, end);
+  ca_uint64 seekFrame = ca_decoder_reverse_begin_block(pData, index, start, end);
+  ca_decoder_request_seek(&pReverse->decoder, seekFrame, ca_decoder_seek_flag_none, NULL);
+  pData->isPrefetching = ca_decoder_decode_async(&pData->async, (ca_uint32)(end - seekFrame), NULL, NULL) == ca_result_success;
+  pData->prefetchStart = start;
+}
+
+// Drops the block decoded in the background.
+static void ca_decoder_reverse_cancel_prefetch(ca_decoder_reverse_data *pData)
+{
+  ca_decoder_async_wait(&pData->async);
+  pData->isPrefetching = CA_FALSE;
+}
+
+static void ca_decoder_reverse_frames(ca_uint8 *pFrames, ca_uint32 frameCount, ca_uint32 bytesPerFrame)
+{
+  ca_uint8 *pFirst = pFrames;
+  ca_uint8 *pLast = pFrames + (size_t)(frameCount - 1) * bytesPerFrame;
+  while (pFirst < pLast)
+  {
+    for (ca_uint32 i = 0; i < bytesPerFrame; i++)
+    {
+      ca_uint8 byte = pFirst[i];
+      pFirst[i] = pLast[i];
+      pLast[i] = byte;
+    }
+    pFirst += bytesPerFrame;
+    pLast -= bytesPerFrame;
+  }
+}
+
+// MARK: API
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_init(ca_decoder_reverse *pReverse, ca_decoder_config config, ca_uint32 blockFrames, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (config.pDecodedPlanarProc != NULL || config.pDecodedChunkProc != NULL || pSeekProc == NULL || pDecodedProc == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)calloc(1, sizeof(ca_decoder_reverse_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->pReadProc = pReadProc;
+  pData->pSeekProc = pSeekProc;
+  pData->pTellProc = pTellProc;
+  pData->pDecodedProc = pDecodedProc;
+  pData->pUserData = pUserData;
+
+  ca_result result = ca_decoder_init(&pReverse->decoder, config, ca_decoder_reverse_on_read, ca_decoder_reverse_on_seek, pTellProc == NULL ? NULL : ca_decoder_reverse_on_tell, ca_decoder_reverse_on_decoded, pData);
+  if (result != ca_result_success)
+  {
+    free(pData);
+    return result;
+  }
+
+  ca_audio_format format;
+  result = ca_decoder_get_format(&pReverse->decoder, &format);
+  if (result == ca_result_success)
+  {
+    pData->bytesPerFrame = ca_get_bytes_per_sample(format.sample_foramt) * format.channels;
+    pData->blockFrames = blockFrames == 0 ? ca_max(format.sample_rate / 2, 1u) : blockFrames;
+    pData->prerollFrames = config.outputSampleRate != 0 ? DECODER_REVERSE_RESAMPLER_PREROLL_FRAMES : 0;
+    pData->length = format.length;
+    pData->position = format.length;
+    for (int i = 0; i < 2 && result == ca_result_success; i++)
+    {
+      pData->pBlocks[i] = (ca_uint8 *)malloc((size_t)pData->blockFrames * pData->bytesPerFrame);
+      result = pData->pBlocks[i] == NULL ? ca_result_out_of_memory : ca_result_success;
+    }
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_async_init(&pData->async, &pReverse->decoder);
+  }
+
+  if (result != ca_result_success)
+  {
+    ca_decoder_uninit(&pReverse->decoder);
+    free(pData->pBlocks[0]);
+    free(pData->pBlocks[1]);
+    free(pData);
+    return result;
+  }
+
+  pReverse->pData = pData;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_decode_next(ca_decoder_reverse *pReverse)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  if (pData->position == 0)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint64 start = ca_decoder_reverse_get_block_start(pData, pData->position);
+  ca_result result = ca_result_success;
+  ca_decoder_async_wait(&pData->async);
+  if (pData->isPrefetching && pData->prefetchStart == start)
+  {
+    ca_decoder_async_poll(&pData->async, NULL, &result, NULL);
+  }
+  else
+  {
+    ca_uint64 seekFrame = ca_decoder_reverse_begin_block(pData, 0, start, pData->position);
+    result = ca_decoder_seek(&pReverse->decoder, seekFrame);
+  }
+  pData->isPrefetching = CA_FALSE;
+
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_reverse_finish_block(pReverse);
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The earlier block is decoded into the other buffer while this one is delivered and played.
+  int index = pData->fillIndex;
+  ca_uint32 frameCount = pData->blockFrameCounts[index];
+  pData->position = start;
+  if (start > 0)
+  {
+    ca_decoder_reverse_prefetch(pReverse, !index, start);
+  }
+
+  if (frameCount > 0)
+  {
+    ca_decoder_reverse_frames(pData->pBlocks[index], frameCount, pData->bytesPerFrame);
+    pData->pDecodedProc(frameCount, pData->pBlocks[index], pData->pUserData);
+  }
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_seek(ca_decoder_reverse *pReverse, ca_uint64 frameIndex)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  ca_decoder_reverse_cancel_prefetch(pData);
+  pData->position = pData->length == 0 ? frameIndex : ca_min(frameIndex, pData->length);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_get_position(ca_decoder_reverse *pReverse, ca_uint64 *pFrameIndex)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  *pFrameIndex = pData->position;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_get_eof(ca_decoder_reverse *pReverse, ca_bool *pIsEOF)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  *pIsEOF = pData->position == 0;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_uninit(ca_decoder_reverse *pReverse)
+{
+  ca_decoder_reverse_data *pData = (ca_decoder_reverse_data *)pReverse->pData;
+  ca_decoder_async_uninit(&pData->async);
+  ca_result result = ca_decoder_uninit(&pReverse->decoder);
+  free(pData->pBlocks[0]);
+  free(pData->pBlocks[1]);
+  free(pData);
+  pReverse->pData = NULL;
+  return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+// Plays a stream backwards. Each block of frames is decoded forward from its start and delivered reversed, the last block first.
+// The block before the one delivered is decoded on the async decoders' thread pool in the meantime.
+// Blocks are reached with the decoder's seeks, so its seek index, checkpoints and PCM cache are used when the config enables them.
+typedef struct
+{
+  ca_decoder decoder;
+  void *pData;
+} ca_decoder_reverse;
+
+// pDecodedProc receives every block with its frames in reverse order. Planar and chunk output are not supported.
+// Zero blockFrames uses half a second. Playback starts at the end of the stream, so streams of unknown length need a seek first.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_init(ca_decoder_reverse *pReverse, ca_decoder_config config, ca_uint32 blockFrames, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
+
+// Delivers the block ending at the current position and moves the position to its start.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_decode_next(ca_decoder_reverse *pReverse);
+
+// The next block ends right before frameIndex.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_seek(ca_decoder_reverse *pReverse, ca_uint64 frameIndex);
+
+// Returns the frame following the next block to be delivered.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_get_position(ca_decoder_reverse *pReverse, ca_uint64 *pFrameIndex);
+
+// Set once the first frame of the stream is delivered.
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_get_eof(ca_decoder_reverse *pReverse, ca_bool *pIsEOF);
+
+FFI_PLUGIN_EXPORT ca_result ca_decoder_reverse_uninit(ca_decoder_reverse *pReverse);
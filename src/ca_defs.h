@@ -24,11 +24,15 @@ typedef enum
   ca_result_tell_failed = -4,
   ca_result_not_initialized = -5,
   ca_result_unsupported_format = -6,
+  ca_result_write_failed = -7,
+  ca_result_out_of_memory = -8,
+  ca_result_budget_exceeded = -9,
   ca_result_unknown_failed = -1000,
 } ca_result;
 
 typedef int ca_bool;
 
+typedef unsigned char ca_uint8;
 typedef unsigned long long ca_uint64;
 typedef unsigned int ca_uint32;
 typedef long long ca_int64;
@@ -41,6 +45,12 @@ typedef enum
   ca_read_result_failed = -2,
 } ca_read_result;
 
+typedef enum
+{
+  ca_write_result_success = 0,
+  ca_write_result_failed = -1,
+} ca_write_result;
+
 typedef enum
 {
   ca_seek_result_success = 0,
@@ -65,6 +75,12 @@ typedef enum
   ca_sample_format_f32 = 5,
 } ca_sample_format;
 
+typedef enum
+{
+  ca_dither_mode_none = 0,
+  ca_dither_mode_triangle = 1,
+} ca_dither_mode;
+
 typedef struct
 {
   ca_uint32 channels;
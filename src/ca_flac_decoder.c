@@ -0,0 +1,1165 @@
+#include "ca_flac_decoder.h"
+#include "ca_checkpoint.h"
+#include "ca_convert.h"
+#include "ca_cpu.h"
+#include "ca_miniaudio.h"
+#include "ca_thread_pool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Compressed bytes decoded by one job. A batch holds one group per job.
+#define FLAC_GROUP_SIZE (128 * 1024)
+#define FLAC_GROUPS_PER_THREAD 2
+#define FLAC_MAX_WINDOW_SIZE (64 * 1024 * 1024)
+
+// Seeking without a SEEKTABLE bisects the stream until the range is smaller than this, then skips frames from there.
+#define FLAC_SEEK_PROBE_SIZE (64 * 1024)
+#define FLAC_SEEK_MAX_PROBES 48
+
+#define FLAC_STREAMINFO_SIZE 34
+#define FLAC_HEADER_SIZE (8 + FLAC_STREAMINFO_SIZE)
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_SEEKTABLE 3
+#define FLAC_BLOCK_VORBIS_COMMENT 4
+#define FLAC_SEEKPOINT_SIZE 18
+#define FLAC_PLACEHOLDER_SEEKPOINT 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  ca_uint64 sample;
+  ca_uint64 offset;
+} ca_flac_seekpoint;
+
+typedef struct
+{
+  size_t offset;
+  size_t size;
+  ca_uint64 firstSample;
+  ca_uint32 blockSize;
+} ca_flac_frame;
+
+typedef struct
+{
+  const ca_uint8 *pHeader;
+  const ca_uint8 *pWindow;
+  const ca_flac_frame *pFrames;
+  ca_uint32 frameCount;
+  ca_uint32 bytesPerFrame;
+  ca_sample_format format;
+
+  void *pSamples;
+  ca_uint64 capacityInFrames;
+  ca_uint64 frameCountOut;
+} ca_flac_group;
+
+typedef struct
+{
+  ca_decoder_read_proc readFunc;
+  ca_decoder_seek_proc seekFunc;
+  ca_decoder_tell_proc tellFunc;
+  ca_decoder_decoded_proc decodedFunc;
+
+  ca_audio_format format;
+  ca_uint32 bitsPerSample;
+  ca_uint32 bytesPerFrame;
+  ca_uint32 minBlockSize;
+  ca_uint32 maxBlockSize;
+  ca_uint32 maxFrameSize;
+
+  // From the WAVEFORMATEXTENSIBLE_CHANNEL_MASK comment. Zero keeps the FLAC channel order.
+  ca_uint32 channelMask;
+
+  // fLaC and a STREAMINFO block without the total length. Prepended to every group for dr_flac.
+  ca_uint8 header[FLAC_HEADER_SIZE];
+  ca_uint64 dataOffset;
+  ca_uint64 streamLength;
+  ca_flac_seekpoint *pSeekpoints;
+  ca_uint32 seekpointCount;
+
+  // Compressed bytes read ahead of the frames being decoded, starting at windowOffset of the source.
+  ca_uint8 *pWindow;
+  ca_uint64 windowOffset;
+  size_t windowSize;
+  size_t windowCapacity;
+  ca_bool isSourceAtEnd;
+
+  ca_flac_frame *pFrames;
+  ca_uint32 frameCapacity;
+  ca_flac_group *pGroups;
+  ca_uint32 groupCount;
+
+  // The first sample of the next frame. Unknown after a seek until a frame is found.
+  ca_bool hasExpectedSample;
+  ca_uint64 expectedSample;
+  ca_uint64 skipUntil;
+  ca_uint64 cursor;
+  ca_bool isEOF;
+
+  ca_bool hasPool;
+  ca_thread_pool pool;
+
+  // Offsets of frames decoded recently, so seeking back to them needs no bisection.
+  ca_bool hasCheckpoints;
+  ca_checkpoint_ring checkpoints;
+} ca_flac_decoder_data;
+
+// MARK: CRC
+
+static pthread_once_t flacCrcOnce = PTHREAD_ONCE_INIT;
+static ca_uint8 flacCrc8Table[256];
+static ca_uint32 flacCrc16Table[256];
+
+static void ca_flac_init_crc_tables()
+{
+  for (ca_uint32 i = 0; i < 256; i++)
+  {
+    ca_uint32 crc8 = i;
+    ca_uint32 crc16 = i << 8;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc8 = (crc8 & 0x80) ? ((crc8 << 1) ^ 0x07) : (crc8 << 1);
+      crc16 = (crc16 & 0x8000) ? ((crc16 << 1) ^ 0x8005) : (crc16 << 1);
+    }
+    flacCrc8Table[i] = (ca_uint8)crc8;
+    flacCrc16Table[i] = crc16 & 0xFFFF;
+  }
+}
+
+static ca_uint8 ca_flac_crc8(const ca_uint8 *p, size_t size)
+{
+  ca_uint8 crc = 0;
+  for (size_t i = 0; i < size; i++)
+  {
+    crc = flacCrc8Table[crc ^ p[i]];
+  }
+  return crc;
+}
+
+// Every frame ends with the CRC-16 of the frame bytes before it.
+static ca_bool ca_flac_check_frame_crc(const ca_uint8 *p, size_t size)
+{
+  if (size < 2)
+  {
+    return CA_FALSE;
+  }
+
+  ca_uint32 crc = 0;
+  for (size_t i = 0; i < size - 2; i++)
+  {
+    crc = ((crc << 8) & 0xFFFF) ^ flacCrc16Table[(crc >> 8) ^ p[i]];
+  }
+  return crc == (((ca_uint32)p[size - 2] << 8) | p[size - 1]);
+}
+
+// MARK: Frames
+
+// Parses the frame header at p. Headers that do not match the stream are rejected so false sync codes are skipped.
+static ca_bool ca_flac_parse_frame_header(const ca_flac_decoder_data *pData, const ca_uint8 *p, size_t available, ca_flac_frame *pFrame)
+{
+  static const ca_uint32 sampleSizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  if (available < 5 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8)
+  {
+    return CA_FALSE;
+  }
+
+  ca_uint32 blockSizeCode = p[2] >> 4;
+  ca_uint32 sampleRateCode = p[2] & 0x0F;
+  ca_uint32 channelCode = p[3] >> 4;
+  ca_uint32 sampleSizeCode = (p[3] >> 1) & 0x07;
+  if (blockSizeCode == 0 || sampleRateCode == 15 || channelCode > 10 || sampleSizeCode == 3 || (p[3] & 1) != 0)
+  {
+    return CA_FALSE;
+  }
+
+  ca_uint32 channels = channelCode < 8 ? channelCode + 1 : 2;
+  if (channels != pData->format.channels || (sampleSizeCode != 0 && sampleSizes[sampleSizeCode] != pData->bitsPerSample))
+  {
+    return CA_FALSE;
+  }
+
+  // The frame or sample number is coded like UTF-8.
+  ca_uint32 extraBytes;
+  ca_uint64 number;
+  if (p[4] < 0x80)
+  {
+    extraBytes = 0;
+    number = p[4];
+  }
+  else if ((p[4] & 0xE0) == 0xC0)
+  {
+    extraBytes = 1;
+    number = p[4] & 0x1F;
+  }
+  else if ((p[4] & 0xF0) == 0xE0)
+  {
+    extraBytes = 2;
+    number = p[4] & 0x0F;
+  }
+  else if ((p[4] & 0xF8) == 0xF0)
+  {
+    extraBytes = 3;
+    number = p[4] & 0x07;
+  }
+  else if ((p[4] & 0xFC) == 0xF8)
+  {
+    extraBytes = 4;
+    number = p[4] & 0x03;
+  }
+  else if ((p[4] & 0xFE) == 0xFC)
+  {
+    extraBytes = 5;
+    number = p[4] & 0x01;
+  }
+  else if (p[4] == 0xFE)
+  {
+    extraBytes = 6;
+    number = 0;
+  }
+  else
+  {
+    return CA_FALSE;
+  }
+
+  size_t pos = 5;
+  if (available < pos + extraBytes)
+  {
+    return CA_FALSE;
+  }
+
+  for (ca_uint32 i = 0; i < extraBytes; i++, pos++)
+  {
+    if ((p[pos] & 0xC0) != 0x80)
+    {
+      return CA_FALSE;
+    }
+    number = (number << 6) | (p[pos] & 0x3F);
+  }
+
+  ca_uint32 blockSizeBytes = blockSizeCode == 6 ? 1 : (blockSizeCode == 7 ? 2 : 0);
+  ca_uint32 sampleRateBytes = sampleRateCode == 12 ? 1 : ((sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0);
+  if (available < pos + blockSizeBytes + sampleRateBytes + 1)
+  {
+    return CA_FALSE;
+  }
+
+  ca_uint32 blockSize;
+  if (blockSizeCode == 1)
+  {
+    blockSize = 192;
+  }
+  else if (blockSizeCode <= 5)
+  {
+    blockSize = 576u << (blockSizeCode - 2);
+  }
+  else if (blockSizeCode == 6)
+  {
+    blockSize = (ca_uint32)p[pos] + 1;
+  }
+  else if (blockSizeCode == 7)
+  {
+    blockSize = (((ca_uint32)p[pos] << 8) | p[pos + 1]) + 1;
+  }
+  else
+  {
+    blockSize = 256u << (blockSizeCode - 8);
+  }
+  pos += blockSizeBytes + sampleRateBytes;
+
+  if (ca_flac_crc8(p, pos) != p[pos] || (pData->maxBlockSize != 0 && blockSize > pData->maxBlockSize))
+  {
+    return CA_FALSE;
+  }
+
+  // Fixed block size streams number frames instead of samples.
+  ca_bool isVariableBlockSize = (p[1] & 1) != 0;
+  if (isVariableBlockSize)
+  {
+    pFrame->firstSample = number;
+  }
+  else
+  {
+    ca_uint32 fixedBlockSize = pData->minBlockSize == pData->maxBlockSize ? pData->maxBlockSize : blockSize;
+    pFrame->firstSample = number * fixedBlockSize;
+  }
+
+  pFrame->blockSize = blockSize;
+  return CA_TRUE;
+}
+
+// Returns the offset of the first frame header in [start, end), or SIZE_MAX.
+static size_t ca_flac_find_frame(const ca_flac_decoder_data *pData, const ca_uint8 *pBytes, size_t start, size_t end, ca_bool hasExpectedSample, ca_uint64 expectedSample, ca_flac_frame *pFrame)
+{
+  size_t pos = start;
+  while (pos + 1 < end)
+  {
+    const ca_uint8 *pSync = (const ca_uint8 *)memchr(pBytes + pos, 0xFF, end - pos - 1);
+    if (pSync == NULL)
+    {
+      break;
+    }
+
+    pos = (size_t)(pSync - pBytes);
+    if (ca_flac_parse_frame_header(pData, pSync, end - pos, pFrame) && (!hasExpectedSample || pFrame->firstSample == expectedSample))
+    {
+      pFrame->offset = pos;
+      return pos;
+    }
+    pos++;
+  }
+
+  return SIZE_MAX;
+}
+
+// Finds where the frame at pFrame ends, which is the next header continuing its samples.
+// Returns CA_FALSE when more bytes are needed to tell.
+static ca_bool ca_flac_find_frame_end(const ca_flac_decoder_data *pData, const ca_uint8 *pBytes, size_t end, ca_bool isAtEnd, ca_flac_frame *pFrame)
+{
+  ca_flac_frame next;
+  size_t start = pFrame->offset + 2;
+  size_t searchEnd = end;
+  if (pData->maxFrameSize != 0)
+  {
+    searchEnd = ca_min(end, pFrame->offset + pData->maxFrameSize + 2);
+  }
+
+  size_t nextOffset = ca_flac_find_frame(pData, pBytes, start, searchEnd, CA_TRUE, pFrame->firstSample + pFrame->blockSize, &next);
+  if (nextOffset == SIZE_MAX && (searchEnd < end || isAtEnd))
+  {
+    // The next header is damaged or the stream jumps, so the frame ends at any header.
+    nextOffset = ca_flac_find_frame(pData, pBytes, start, end, CA_FALSE, 0, &next);
+  }
+
+  if (nextOffset != SIZE_MAX)
+  {
+    pFrame->size = nextOffset - pFrame->offset;
+    return CA_TRUE;
+  }
+
+  if (isAtEnd)
+  {
+    pFrame->size = end - pFrame->offset;
+    return CA_TRUE;
+  }
+
+  return CA_FALSE;
+}
+
+// MARK: Groups
+
+static void ca_flac_decode_group(void *pJobData)
+{
+  ca_flac_group *pGroup = (ca_flac_group *)pJobData;
+  ca_uint8 *pOut = (ca_uint8 *)pGroup->pSamples;
+  ca_uint64 written = 0;
+  ca_uint32 runStart = 0;
+  ca_uint64 runFrameCount = 0;
+
+  // Frames failing the CRC are replaced with silence so the timeline stays sample accurate.
+  for (ca_uint32 i = 0; i <= pGroup->frameCount; i++)
+  {
+    const ca_flac_frame *pFrame = i < pGroup->frameCount ? &pGroup->pFrames[i] : NULL;
+    ca_bool isValid = pFrame != NULL && ca_flac_check_frame_crc(pGroup->pWindow + pFrame->offset, pFrame->size);
+    if (isValid)
+    {
+      runFrameCount += pFrame->blockSize;
+      continue;
+    }
+
+    if (runFrameCount > 0)
+    {
+      const ca_flac_frame *pFirst = &pGroup->pFrames[runStart];
+      const ca_flac_frame *pLast = &pGroup->pFrames[i - 1];
+      size_t runSize = pLast->offset + pLast->size - pFirst->offset;
+      ca_uint8 *pRunOut = pOut + written * pGroup->bytesPerFrame;
+      ca_uint64 decoded = ca_miniaudio_decode_flac_frames(pGroup->pHeader, FLAC_HEADER_SIZE, pGroup->pWindow + pFirst->offset, runSize, runFrameCount, pGroup->format, pRunOut);
+      memset(pRunOut + decoded * pGroup->bytesPerFrame, 0, (size_t)(runFrameCount - decoded) * pGroup->bytesPerFrame);
+      written += runFrameCount;
+    }
+
+    if (pFrame != NULL)
+    {
+      memset(pOut + written * pGroup->bytesPerFrame, 0, (size_t)pFrame->blockSize * pGroup->bytesPerFrame);
+      written += pFrame->blockSize;
+    }
+
+    runStart = i + 1;
+    runFrameCount = 0;
+  }
+
+  pGroup->frameCountOut = written;
+}
+
+// MARK: Stream
+
+static ca_result ca_flac_read(ca_flac_decoder *pDecoder, void *pBuffer, size_t size, size_t *pBytesRead)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  size_t totalRead = 0;
+  ca_result result = ca_result_success;
+  while (totalRead < size)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_uint32 bytesToRead = (ca_uint32)ca_min(size - totalRead, (size_t)0x40000000);
+    ca_read_result readResult = pData->readFunc((ca_uint8 *)pBuffer + totalRead, bytesToRead, &bytesRead, pDecoder->pUserData);
+    totalRead += bytesRead;
+    if (readResult == ca_read_result_failed)
+    {
+      result = ca_result_read_failed;
+      break;
+    }
+
+    if (readResult == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+
+  *pBytesRead = totalRead;
+  return result;
+}
+
+static ca_result ca_flac_read_exact(ca_flac_decoder *pDecoder, void *pBuffer, size_t size, ca_uint64 *pPosition)
+{
+  size_t bytesRead = 0;
+  ca_result result = ca_flac_read(pDecoder, pBuffer, size, &bytesRead);
+  *pPosition += bytesRead;
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+  return bytesRead == size ? ca_result_success : ca_result_unsupported_format;
+}
+
+static ca_result ca_flac_skip(ca_flac_decoder *pDecoder, ca_uint64 size, ca_uint64 *pPosition)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (size == 0 || pData->seekFunc((ca_int64)size, ca_seek_origin_current, pDecoder->pUserData) == ca_seek_result_success)
+  {
+    *pPosition += size;
+    return ca_result_success;
+  }
+
+  ca_uint8 buffer[1024];
+  while (size > 0)
+  {
+    size_t chunkSize = (size_t)ca_min(size, (ca_uint64)sizeof(buffer));
+    ca_result result = ca_flac_read_exact(pDecoder, buffer, chunkSize, pPosition);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    size -= chunkSize;
+  }
+  return ca_result_success;
+}
+
+static inline ca_uint32 ca_flac_le32(const ca_uint8 *p)
+{
+  return (ca_uint32)p[0] | ((ca_uint32)p[1] << 8) | ((ca_uint32)p[2] << 16) | ((ca_uint32)p[3] << 24);
+}
+
+// Streams whose channels do not follow the FLAC order name their positions with the WAVEFORMATEXTENSIBLE_CHANNEL_MASK comment.
+// Comments too long to be that one are skipped, so embedded pictures are not read.
+static ca_result ca_flac_read_vorbis_comment(ca_flac_decoder *pDecoder, ca_uint32 blockSize, ca_uint64 *pPosition)
+{
+  static const char maskField[] = "WAVEFORMATEXTENSIBLE_CHANNEL_MASK=";
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  ca_uint64 end = *pPosition + blockSize;
+  ca_uint8 length[4] = {0};
+  ca_result result = ca_result_success;
+
+  // The vendor string comes before the comment count.
+  ca_uint32 commentCount = 0;
+  if (blockSize >= 2 * sizeof(length))
+  {
+    result = ca_flac_read_exact(pDecoder, length, sizeof(length), pPosition);
+    ca_uint32 vendorLength = ca_flac_le32(length);
+    if (result == ca_result_success && vendorLength <= end - *pPosition - sizeof(length))
+    {
+      result = ca_flac_skip(pDecoder, vendorLength, pPosition);
+      if (result == ca_result_success)
+      {
+        result = ca_flac_read_exact(pDecoder, length, sizeof(length), pPosition);
+        commentCount = ca_flac_le32(length);
+      }
+    }
+  }
+
+  for (ca_uint32 i = 0; i < commentCount && result == ca_result_success && end - *pPosition >= sizeof(length); i++)
+  {
+    result = ca_flac_read_exact(pDecoder, length, sizeof(length), pPosition);
+    ca_uint32 commentLength = ca_flac_le32(length);
+    if (result != ca_result_success || commentLength > end - *pPosition)
+    {
+      break;
+    }
+
+    char comment[64];
+    if (commentLength >= sizeof(comment))
+    {
+      result = ca_flac_skip(pDecoder, commentLength, pPosition);
+      continue;
+    }
+
+    result = ca_flac_read_exact(pDecoder, comment, commentLength, pPosition);
+    comment[commentLength] = '\0';
+    if (result == ca_result_success && strncasecmp(comment, maskField, sizeof(maskField) - 1) == 0)
+    {
+      pData->channelMask = (ca_uint32)strtoul(comment + sizeof(maskField) - 1, NULL, 0);
+    }
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+  return ca_flac_skip(pDecoder, end - *pPosition, pPosition);
+}
+
+static ca_result ca_flac_read_metadata(ca_flac_decoder *pDecoder)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  ca_uint64 position = 0;
+  ca_uint8 marker[10];
+  ca_result result = ca_flac_read_exact(pDecoder, marker, 4, &position);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // Some taggers put an ID3v2 tag in front of the stream.
+  if (memcmp(marker, "ID3", 3) == 0)
+  {
+    result = ca_flac_read_exact(pDecoder, marker + 4, 6, &position);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_uint64 tagSize = ((ca_uint64)(marker[6] & 0x7F) << 21) | ((marker[7] & 0x7F) << 14) | ((marker[8] & 0x7F) << 7) | (marker[9] & 0x7F);
+    tagSize += (marker[5] & 0x10) ? 10 : 0;
+    result = ca_flac_skip(pDecoder, tagSize, &position);
+    if (result == ca_result_success)
+    {
+      result = ca_flac_read_exact(pDecoder, marker, 4, &position);
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  if (memcmp(marker, "fLaC", 4) != 0)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_bool hasStreamInfo = CA_FALSE;
+  ca_bool isLast = CA_FALSE;
+  while (!isLast)
+  {
+    ca_uint8 blockHeader[4];
+    result = ca_flac_read_exact(pDecoder, blockHeader, sizeof(blockHeader), &position);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    isLast = (blockHeader[0] & 0x80) != 0;
+    ca_uint32 blockType = blockHeader[0] & 0x7F;
+    ca_uint32 blockSize = ((ca_uint32)blockHeader[1] << 16) | ((ca_uint32)blockHeader[2] << 8) | blockHeader[3];
+    if (blockType == FLAC_BLOCK_STREAMINFO && blockSize == FLAC_STREAMINFO_SIZE)
+    {
+      ca_uint8 *pInfo = pData->header + 8;
+      result = ca_flac_read_exact(pDecoder, pInfo, FLAC_STREAMINFO_SIZE, &position);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      pData->minBlockSize = ((ca_uint32)pInfo[0] << 8) | pInfo[1];
+      pData->maxBlockSize = ((ca_uint32)pInfo[2] << 8) | pInfo[3];
+      pData->maxFrameSize = ((ca_uint32)pInfo[7] << 16) | ((ca_uint32)pInfo[8] << 8) | pInfo[9];
+      pData->format.sample_rate = ((ca_uint32)pInfo[10] << 12) | ((ca_uint32)pInfo[11] << 4) | (pInfo[12] >> 4);
+      pData->format.channels = ((pInfo[12] >> 1) & 0x07) + 1;
+      pData->bitsPerSample = (((ca_uint32)(pInfo[12] & 0x01) << 4) | (pInfo[13] >> 4)) + 1;
+      pData->format.length = ((ca_uint64)(pInfo[13] & 0x0F) << 32) | ((ca_uint64)pInfo[14] << 24) | ((ca_uint64)pInfo[15] << 16) | ((ca_uint64)pInfo[16] << 8) | pInfo[17];
+
+      // dr_flac stops at the total length, which does not apply to a group.
+      pInfo[13] &= 0xF0;
+      memset(pInfo + 14, 0, 4);
+      hasStreamInfo = CA_TRUE;
+    }
+    else if (blockType == FLAC_BLOCK_VORBIS_COMMENT)
+    {
+      result = ca_flac_read_vorbis_comment(pDecoder, blockSize, &position);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+    }
+    else if (blockType == FLAC_BLOCK_SEEKTABLE && pData->pSeekpoints == NULL)
+    {
+      ca_uint8 *pTable = (ca_uint8 *)malloc(blockSize);
+      pData->pSeekpoints = (ca_flac_seekpoint *)malloc(sizeof(ca_flac_seekpoint) * (blockSize / FLAC_SEEKPOINT_SIZE + 1));
+      if (pTable == NULL || pData->pSeekpoints == NULL)
+      {
+        free(pTable);
+        return ca_result_out_of_memory;
+      }
+
+      result = ca_flac_read_exact(pDecoder, pTable, blockSize, &position);
+      for (ca_uint32 i = 0; result == ca_result_success && i < blockSize / FLAC_SEEKPOINT_SIZE; i++)
+      {
+        const ca_uint8 *pPoint = pTable + i * FLAC_SEEKPOINT_SIZE;
+        ca_uint64 sample = 0;
+        ca_uint64 offset = 0;
+        for (int j = 0; j < 8; j++)
+        {
+          sample = (sample << 8) | pPoint[j];
+          offset = (offset << 8) | pPoint[8 + j];
+        }
+
+        if (sample != FLAC_PLACEHOLDER_SEEKPOINT)
+        {
+          pData->pSeekpoints[pData->seekpointCount].sample = sample;
+          pData->pSeekpoints[pData->seekpointCount].offset = offset;
+          pData->seekpointCount++;
+        }
+      }
+
+      free(pTable);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+    }
+    else
+    {
+      result = ca_flac_skip(pDecoder, blockSize, &position);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+    }
+  }
+
+  if (!hasStreamInfo || pData->format.sample_rate == 0 || pData->bitsPerSample < 4)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  memcpy(pData->header, "fLaC", 4);
+  pData->header[4] = 0x80 | FLAC_BLOCK_STREAMINFO;
+  pData->header[5] = 0;
+  pData->header[6] = 0;
+  pData->header[7] = FLAC_STREAMINFO_SIZE;
+  pData->dataOffset = position;
+  return ca_result_success;
+}
+
+static ca_result ca_flac_fill_window(ca_flac_decoder *pDecoder)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (pData->isSourceAtEnd || pData->windowSize == pData->windowCapacity)
+  {
+    return ca_result_success;
+  }
+
+  size_t bytesRead = 0;
+  ca_result result = ca_flac_read(pDecoder, pData->pWindow + pData->windowSize, pData->windowCapacity - pData->windowSize, &bytesRead);
+  pData->windowSize += bytesRead;
+  if (result == ca_result_success && pData->windowSize < pData->windowCapacity)
+  {
+    pData->isSourceAtEnd = CA_TRUE;
+  }
+  return result;
+}
+
+static ca_result ca_flac_grow_window(ca_flac_decoder_data *pData)
+{
+  if (pData->windowCapacity >= FLAC_MAX_WINDOW_SIZE)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_uint8 *pWindow = (ca_uint8 *)realloc(pData->pWindow, pData->windowCapacity * 2);
+  if (pWindow == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->pWindow = pWindow;
+  pData->windowCapacity *= 2;
+  return ca_result_success;
+}
+
+static ca_result ca_flac_reserve_frames(ca_flac_decoder_data *pData, ca_uint32 frameCount)
+{
+  if (frameCount <= pData->frameCapacity)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint32 capacity = ca_max(frameCount, pData->frameCapacity * 2);
+  ca_flac_frame *pFrames = (ca_flac_frame *)realloc(pData->pFrames, sizeof(ca_flac_frame) * capacity);
+  if (pFrames == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->pFrames = pFrames;
+  pData->frameCapacity = capacity;
+  return ca_result_success;
+}
+
+// Collects the complete frames in the window. Returns the number of bytes the frames and skipped garbage occupy.
+static ca_result ca_flac_scan_window(ca_flac_decoder_data *pData, ca_uint32 *pFrameCount, size_t *pConsumed)
+{
+  ca_uint32 frameCount = 0;
+  size_t pos = 0;
+  ca_bool isWindowFull = pData->windowSize == pData->windowCapacity;
+  for (;;)
+  {
+    ca_flac_frame frame;
+    size_t offset = ca_flac_find_frame(pData, pData->pWindow, pos, pData->windowSize, pData->hasExpectedSample, pData->expectedSample, &frame);
+    if (offset == SIZE_MAX && pData->hasExpectedSample && (isWindowFull || pData->isSourceAtEnd))
+    {
+      offset = ca_flac_find_frame(pData, pData->pWindow, pos, pData->windowSize, CA_FALSE, 0, &frame);
+    }
+
+    if (offset == SIZE_MAX)
+    {
+      // Keep the tail in case a header is split across reads.
+      pos = pData->isSourceAtEnd ? pData->windowSize : ca_max(pos, pData->windowSize - ca_min(pData->windowSize, (size_t)16));
+      break;
+    }
+
+    if (!ca_flac_find_frame_end(pData, pData->pWindow, pData->windowSize, pData->isSourceAtEnd, &frame))
+    {
+      pos = offset;
+      break;
+    }
+
+    pos = frame.offset + frame.size;
+    pData->hasExpectedSample = CA_TRUE;
+    pData->expectedSample = frame.firstSample + frame.blockSize;
+    if (pData->hasCheckpoints)
+    {
+      ca_checkpoint_ring_push(&pData->checkpoints, frame.firstSample, pData->windowOffset + frame.offset);
+    }
+
+    // Frames before the seek target are not decoded at all.
+    if (frame.firstSample + frame.blockSize <= pData->skipUntil)
+    {
+      continue;
+    }
+
+    ca_result result = ca_flac_reserve_frames(pData, frameCount + 1);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    pData->pFrames[frameCount++] = frame;
+  }
+
+  *pFrameCount = frameCount;
+  *pConsumed = pos;
+  return ca_result_success;
+}
+
+static ca_result ca_flac_decode_frames(ca_flac_decoder *pDecoder, ca_uint32 frameCount)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  size_t totalSize = 0;
+  for (ca_uint32 i = 0; i < frameCount; i++)
+  {
+    totalSize += pData->pFrames[i].size;
+  }
+
+  // Split the frames into groups of similar compressed size.
+  ca_uint32 groupCount = ca_min(pData->groupCount, frameCount);
+  size_t groupSize = totalSize / groupCount + 1;
+  ca_uint32 groupIndex = 0;
+  ca_uint32 firstFrame = 0;
+  size_t accumulated = 0;
+  for (ca_uint32 i = 0; i < frameCount; i++)
+  {
+    accumulated += pData->pFrames[i].size;
+    ca_bool isGroupFull = accumulated >= groupSize * (groupIndex + 1) && groupIndex + 1 < groupCount;
+    if (!isGroupFull && i + 1 < frameCount)
+    {
+      continue;
+    }
+
+    ca_flac_group *pGroup = &pData->pGroups[groupIndex++];
+    pGroup->pFrames = pData->pFrames + firstFrame;
+    pGroup->frameCount = i + 1 - firstFrame;
+    pGroup->pWindow = pData->pWindow;
+    pGroup->frameCountOut = 0;
+    firstFrame = i + 1;
+
+    ca_uint64 frameCountOut = 0;
+    for (ca_uint32 j = 0; j < pGroup->frameCount; j++)
+    {
+      frameCountOut += pGroup->pFrames[j].blockSize;
+    }
+
+    if (frameCountOut > pGroup->capacityInFrames)
+    {
+      void *pSamples = realloc(pGroup->pSamples, (size_t)frameCountOut * pData->bytesPerFrame);
+      if (pSamples == NULL)
+      {
+        return ca_result_out_of_memory;
+      }
+      pGroup->pSamples = pSamples;
+      pGroup->capacityInFrames = frameCountOut;
+    }
+  }
+
+  if (!pData->hasPool || groupIndex == 1)
+  {
+    for (ca_uint32 i = 0; i < groupIndex; i++)
+    {
+      ca_flac_decode_group(&pData->pGroups[i]);
+    }
+  }
+  else
+  {
+    for (ca_uint32 i = 0; i < groupIndex; i++)
+    {
+      ca_result result = ca_thread_pool_submit(&pData->pool, ca_flac_decode_group, &pData->pGroups[i]);
+      if (result != ca_result_success)
+      {
+        ca_flac_decode_group(&pData->pGroups[i]);
+      }
+    }
+    ca_thread_pool_wait(&pData->pool);
+  }
+
+  // Deliver in stream order, trimming the frame that contains the seek target.
+  for (ca_uint32 i = 0; i < groupIndex; i++)
+  {
+    ca_flac_group *pGroup = &pData->pGroups[i];
+    ca_uint64 firstSample = pGroup->pFrames[0].firstSample;
+    ca_uint64 trim = pData->skipUntil > firstSample ? ca_min(pData->skipUntil - firstSample, pGroup->frameCountOut) : 0;
+    const ca_flac_frame *pLast = &pGroup->pFrames[pGroup->frameCount - 1];
+    pData->cursor = pLast->firstSample + pLast->blockSize;
+    pData->skipUntil = 0;
+    if (pGroup->frameCountOut > trim)
+    {
+      ca_uint8 *pSamples = (ca_uint8 *)pGroup->pSamples + trim * pData->bytesPerFrame;
+      pData->decodedFunc((ca_uint32)(pGroup->frameCountOut - trim), pSamples, pDecoder->pUserData);
+    }
+  }
+
+  return ca_result_success;
+}
+
+// Finds a frame at or after byteOffset that is followed by the next frame. Used to bisect streams without a SEEKTABLE.
+static ca_bool ca_flac_probe(ca_flac_decoder *pDecoder, ca_uint64 byteOffset, ca_uint64 *pFrameOffset, ca_uint64 *pFirstSample)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (pData->seekFunc((ca_int64)byteOffset, ca_seek_origin_start, pDecoder->pUserData) != ca_seek_result_success)
+  {
+    return CA_FALSE;
+  }
+
+  size_t size = 0;
+  if (ca_flac_read(pDecoder, pData->pWindow, FLAC_SEEK_PROBE_SIZE, &size) != ca_result_success)
+  {
+    return CA_FALSE;
+  }
+
+  ca_flac_frame frame;
+  ca_flac_frame next;
+  size_t pos = 0;
+  for (;;)
+  {
+    size_t offset = ca_flac_find_frame(pData, pData->pWindow, pos, size, CA_FALSE, 0, &frame);
+    if (offset == SIZE_MAX)
+    {
+      return CA_FALSE;
+    }
+
+    if (ca_flac_find_frame(pData, pData->pWindow, offset + 2, size, CA_TRUE, frame.firstSample + frame.blockSize, &next) != SIZE_MAX)
+    {
+      *pFrameOffset = byteOffset + offset;
+      *pFirstSample = frame.firstSample;
+      return CA_TRUE;
+    }
+    pos = offset + 1;
+  }
+}
+
+// MARK: Decoder
+
+ca_result ca_flac_decoder_init(ca_flac_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (pSeekProc == NULL)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  pthread_once(&flacCrcOnce, ca_flac_init_crc_tables);
+
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)calloc(1, sizeof(ca_flac_decoder_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->readFunc = pReadProc;
+  pData->seekFunc = pSeekProc;
+  pData->tellFunc = pTellProc;
+  pData->decodedFunc = pDecodedProc;
+  pDecoder->config = config;
+  pDecoder->pUserData = pUserData;
+  pDecoder->pData = pData;
+
+  ca_result result = ca_flac_read_metadata(pDecoder);
+  if (result != ca_result_success)
+  {
+    ca_flac_decoder_uninit(pDecoder);
+    return result;
+  }
+
+  pData->format.sample_foramt = pData->bitsPerSample <= 16 ? ca_sample_format_s16 : ca_sample_format_s32;
+  pData->format.apple.format_id = 0;
+  pData->bytesPerFrame = ca_get_bytes_per_sample(pData->format.sample_foramt) * pData->format.channels;
+
+  ca_uint64 position = 0;
+  ca_uint64 length = 0;
+  if (pTellProc != NULL && pTellProc(&position, &length, pUserData) == ca_tell_result_success)
+  {
+    pData->streamLength = length;
+  }
+
+  // The calling thread decodes a group too, so the pool has one worker less.
+  ca_uint32 threadCount = config.decodeThreadCount == 0 ? ca_get_cpu_count() : config.decodeThreadCount;
+  pData->groupCount = threadCount == 1 ? 1 : threadCount * FLAC_GROUPS_PER_THREAD;
+  if (threadCount > 1 && ca_thread_pool_init(&pData->pool, threadCount - 1) == ca_result_success)
+  {
+    pData->hasPool = CA_TRUE;
+  }
+
+  pData->windowCapacity = ca_max((size_t)FLAC_GROUP_SIZE * pData->groupCount, (size_t)FLAC_SEEK_PROBE_SIZE);
+  pData->windowCapacity = ca_max(pData->windowCapacity, (size_t)pData->maxFrameSize * 2);
+  pData->pWindow = (ca_uint8 *)malloc(pData->windowCapacity);
+  pData->pGroups = (ca_flac_group *)calloc(pData->groupCount, sizeof(ca_flac_group));
+  if (pData->pWindow == NULL || pData->pGroups == NULL)
+  {
+    ca_flac_decoder_uninit(pDecoder);
+    return ca_result_out_of_memory;
+  }
+
+  for (ca_uint32 i = 0; i < pData->groupCount; i++)
+  {
+    pData->pGroups[i].pHeader = pData->header;
+    pData->pGroups[i].bytesPerFrame = pData->bytesPerFrame;
+    pData->pGroups[i].format = pData->format.sample_foramt;
+  }
+
+  if (config.checkpointCount > 0 && config.checkpointIntervalMillis > 0)
+  {
+    ca_uint64 interval = ca_max((ca_uint64)pData->format.sample_rate * config.checkpointIntervalMillis / 1000, (ca_uint64)1);
+    result = ca_checkpoint_ring_init(&pData->checkpoints, config.checkpointCount, interval);
+    if (result != ca_result_success)
+    {
+      ca_flac_decoder_uninit(pDecoder);
+      return result;
+    }
+    pData->hasCheckpoints = CA_TRUE;
+  }
+
+  pData->windowOffset = pData->dataOffset;
+  return ca_result_success;
+}
+
+ca_result ca_flac_decoder_get_format(ca_flac_decoder *pDecoder, ca_audio_format *pFormat)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  *pFormat = pData->format;
+  return ca_result_success;
+}
+
+ca_result ca_flac_decoder_get_channel_map(ca_flac_decoder *pDecoder, ca_channel *pChannelMap)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (pData->channelMask == 0 || !ca_channel_map_from_mask(pChannelMap, pData->format.channels, pData->channelMask))
+  {
+    ca_get_flac_channel_map(pChannelMap, pData->format.channels);
+  }
+  return ca_result_success;
+}
+
+ca_result ca_flac_decoder_decode_next(ca_flac_decoder *pDecoder)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  while (!pData->isEOF)
+  {
+    ca_result result = ca_flac_fill_window(pDecoder);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_uint32 frameCount = 0;
+    size_t consumed = 0;
+    result = ca_flac_scan_window(pData, &frameCount, &consumed);
+    if (result == ca_result_success && frameCount > 0)
+    {
+      result = ca_flac_decode_frames(pDecoder, frameCount);
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    memmove(pData->pWindow, pData->pWindow + consumed, pData->windowSize - consumed);
+    pData->windowSize -= consumed;
+    pData->windowOffset += consumed;
+    pData->isEOF = (pData->isSourceAtEnd && pData->windowSize == 0) || (pData->format.length != 0 && pData->cursor >= pData->format.length);
+    if (frameCount > 0)
+    {
+      break;
+    }
+
+    // A frame larger than the window needs a larger window.
+    if (consumed == 0 && pData->windowSize == pData->windowCapacity)
+    {
+      result = ca_flac_grow_window(pData);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+    }
+  }
+
+  return ca_result_success;
+}
+
+// Positions the source at the frame starting at or before frameIndex and decodes from there, dropping the samples before startSample.
+static ca_result ca_flac_seek(ca_flac_decoder *pDecoder, ca_uint64 frameIndex, ca_bool isSync, ca_uint64 *pStartSample)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (pData->format.length != 0)
+  {
+    frameIndex = ca_min(frameIndex, pData->format.length);
+  }
+
+  // A checkpoint shortly before the target replaces the search.
+  ca_uint64 low = pData->dataOffset;
+  ca_uint64 lowSample = 0;
+  ca_uint64 high = pData->streamLength;
+  ca_checkpoint checkpoint;
+  ca_bool hasCheckpoint = pData->hasCheckpoints && ca_checkpoint_ring_find(&pData->checkpoints, frameIndex, &checkpoint);
+  if (hasCheckpoint)
+  {
+    low = checkpoint.byteOffset;
+    lowSample = checkpoint.frameIndex;
+    high = low;
+  }
+
+  // The SEEKTABLE narrows the range and bisection finishes it, so the number of reads does not grow with the position.
+  for (ca_uint32 i = 0; i < pData->seekpointCount && !hasCheckpoint; i++)
+  {
+    if (pData->pSeekpoints[i].sample <= frameIndex && pData->pSeekpoints[i].sample >= lowSample)
+    {
+      low = pData->dataOffset + pData->pSeekpoints[i].offset;
+      lowSample = pData->pSeekpoints[i].sample;
+    }
+  }
+
+  for (int i = 0; i < FLAC_SEEK_MAX_PROBES && high > low + FLAC_SEEK_PROBE_SIZE; i++)
+  {
+    ca_uint64 middle = low + (high - low) / 2;
+    ca_uint64 frameOffset = 0;
+    ca_uint64 firstSample = 0;
+    if (ca_flac_probe(pDecoder, middle, &frameOffset, &firstSample) && firstSample <= frameIndex && firstSample >= lowSample)
+    {
+      low = frameOffset;
+      lowSample = firstSample;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  if (pData->seekFunc((ca_int64)low, ca_seek_origin_start, pDecoder->pUserData) != ca_seek_result_success)
+  {
+    return ca_result_seek_failed;
+  }
+
+  // A sync seek starts at the frame found by the bisection, which can be a few frames before the target.
+  ca_uint64 startSample = isSync ? lowSample : frameIndex;
+  pData->windowSize = 0;
+  pData->windowOffset = low;
+  pData->isSourceAtEnd = CA_FALSE;
+  pData->hasExpectedSample = CA_FALSE;
+  pData->skipUntil = startSample;
+  pData->cursor = startSample;
+  pData->isEOF = pData->format.length != 0 && startSample >= pData->format.length;
+  *pStartSample = startSample;
+  return ca_result_success;
+}
+
+ca_result ca_flac_decoder_seek(ca_flac_decoder *pDecoder, ca_uint64 frameIndex)
+{
+  ca_uint64 startSample = 0;
+  return ca_flac_seek(pDecoder, frameIndex, CA_FALSE, &startSample);
+}
+
+ca_result ca_flac_decoder_seek_sync(ca_flac_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex)
+{
+  return ca_flac_seek(pDecoder, frameIndex, CA_TRUE, pFrameIndex);
+}
+
+ca_result ca_flac_decoder_get_eof(ca_flac_decoder *pDecoder, ca_bool *pIsEOF)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  *pIsEOF = pData->isEOF;
+  return ca_result_success;
+}
+
+ca_uint64 ca_flac_decoder_get_size_in_bytes(ca_flac_decoder *pDecoder)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  ca_uint64 sizeInBytes = sizeof(ca_flac_decoder_data) + pData->windowCapacity;
+  sizeInBytes += (ca_uint64)sizeof(ca_flac_seekpoint) * pData->seekpointCount + (ca_uint64)sizeof(ca_flac_frame) * pData->frameCapacity;
+  sizeInBytes += (ca_uint64)sizeof(ca_checkpoint) * (pData->hasCheckpoints ? pData->checkpoints.capacity : 0);
+  for (ca_uint32 i = 0; pData->pGroups != NULL && i < pData->groupCount; i++)
+  {
+    sizeInBytes += sizeof(ca_flac_group) + pData->pGroups[i].capacityInFrames * pData->bytesPerFrame;
+  }
+  return sizeInBytes;
+}
+
+ca_result ca_flac_decoder_uninit(ca_flac_decoder *pDecoder)
+{
+  ca_flac_decoder_data *pData = (ca_flac_decoder_data *)pDecoder->pData;
+  if (pData->hasPool)
+  {
+    ca_thread_pool_uninit(&pData->pool);
+  }
+
+  for (ca_uint32 i = 0; pData->pGroups != NULL && i < pData->groupCount; i++)
+  {
+    free(pData->pGroups[i].pSamples);
+  }
+
+  ca_checkpoint_ring_uninit(&pData->checkpoints);
+  free(pData->pGroups);
+  free(pData->pFrames);
+  free(pData->pWindow);
+  free(pData->pSeekpoints);
+  free(pData);
+  pDecoder->pData = NULL;
+  return ca_result_success;
+}
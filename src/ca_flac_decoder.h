@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ca_channel_mixer.h"
+#include "ca_decoder.h"
+
+// Decodes native FLAC streams with the vendored dr_flac.
+// Frames are located by their sync codes and decoded in groups on config.decodeThreadCount threads, then delivered in order.
+typedef struct
+{
+  ca_decoder_config config;
+  void *pUserData;
+  void *pData;
+} ca_flac_decoder;
+
+// Returns ca_result_unsupported_format when the stream is not a native FLAC stream.
+// The stream position is undefined afterwards, so the caller has to seek back before trying another backend.
+ca_result ca_flac_decoder_init(ca_flac_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
+
+ca_result ca_flac_decoder_get_format(ca_flac_decoder *pDecoder, ca_audio_format *pFormat);
+
+// Fills one position per channel from the WAVEFORMATEXTENSIBLE_CHANNEL_MASK comment, or the FLAC order when the stream has none.
+ca_result ca_flac_decoder_get_channel_map(ca_flac_decoder *pDecoder, ca_channel *pChannelMap);
+
+ca_result ca_flac_decoder_decode_next(ca_flac_decoder *pDecoder);
+
+ca_result ca_flac_decoder_seek(ca_flac_decoder *pDecoder, ca_uint64 frameIndex);
+
+// Seeks to the start of a frame at or a few frames before frameIndex without decoding up to the target. pFrameIndex receives the first frame decoded next.
+ca_result ca_flac_decoder_seek_sync(ca_flac_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex);
+
+ca_result ca_flac_decoder_get_eof(ca_flac_decoder *pDecoder, ca_bool *pIsEOF);
+
+// Returns the bytes of the buffers the decoder allocated.
+ca_uint64 ca_flac_decoder_get_size_in_bytes(ca_flac_decoder *pDecoder);
+
+ca_result ca_flac_decoder_uninit(ca_flac_decoder *pDecoder);
@@ -0,0 +1,539 @@
+#include "ca_frame_scan.h"
+#include "ca_cpu.h"
+#include "ca_thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_SCAN_WINDOW_SIZE (256 * 1024)
+#define FRAME_SCAN_HEADER_SIZE 7
+
+// A position is taken as a frame when the headers of this many frames follow each other, or the frames end with the data.
+#define FRAME_SCAN_SYNC_FRAMES 4
+
+// Bytes searched after the ID3v2 tags for the first frame.
+#define FRAME_SCAN_MAX_SYNC_SEARCH (64 * 1024)
+
+// Chunks are small enough to balance the threads and large enough that resynchronizing at their start costs nothing.
+#define FRAME_SCAN_MIN_CHUNK_SIZE (1024 * 1024)
+#define FRAME_SCAN_CHUNKS_PER_THREAD 2
+
+#define FRAME_SCAN_NO_FRAME 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  ca_source source;
+  ca_uint64 length;
+  pthread_mutex_t lock;
+
+  // Header bytes of the first frame. Frames of the stream agree with it in the fields the stream cannot change.
+  ca_frame_stream stream;
+  ca_uint8 streamHeader[4];
+} ca_frame_scanner;
+
+typedef struct
+{
+  ca_frame_scanner *pScanner;
+  ca_uint8 *pBuffer;
+  ca_uint64 offset;
+  ca_uint32 size;
+  ca_result result;
+} ca_frame_scan_window;
+
+// Frames starting in [start, end). The walk begins at a frame when isAtFrame is set and searches for one otherwise.
+// It ends past end with isEndAtFrame set when endOffset is the end of a counted frame, so the next chunk has to start there.
+typedef struct
+{
+  ca_frame_scanner *pScanner;
+  ca_uint64 start;
+  ca_uint64 end;
+  ca_bool isAtFrame;
+
+  ca_uint64 firstFrameOffset;
+  ca_uint64 endOffset;
+  ca_bool isEndAtFrame;
+  ca_uint64 lastFrameEnd;
+  ca_uint64 frameCount;
+  ca_uint64 sampleCount;
+  ca_result result;
+} ca_frame_scan_chunk;
+
+typedef struct
+{
+  ca_uint32 frameSize;
+  ca_uint32 sampleCount;
+  ca_uint32 sampleRate;
+  ca_uint32 channels;
+} ca_frame_scan_header;
+
+// MARK: Headers
+
+static ca_bool ca_frame_scan_parse_mpeg(const ca_uint8 *p, ca_frame_scan_header *pHeader)
+{
+  static const ca_uint32 bitrates[2][3][15] = {
+      {
+          {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+          {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+          {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+      },
+      {
+          {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+          {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+          {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+      },
+  };
+  static const ca_uint32 sampleRates[3] = {44100, 48000, 32000};
+
+  // Free format frames have no bitrate to take the size from.
+  ca_uint32 version = (p[1] >> 3) & 0x03;
+  ca_uint32 layer = 4 - ((p[1] >> 1) & 0x03);
+  ca_uint32 bitrateIndex = p[2] >> 4;
+  ca_uint32 sampleRateIndex = (p[2] >> 2) & 0x03;
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0 || version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+  {
+    return CA_FALSE;
+  }
+
+  ca_bool isMpeg1 = version == 3;
+  ca_uint32 padding = (p[2] >> 1) & 0x01;
+  ca_uint32 bitrate = bitrates[isMpeg1][layer - 1][bitrateIndex] * 1000;
+  pHeader->sampleRate = sampleRates[sampleRateIndex] >> (isMpeg1 ? 0 : (version == 2 ? 1 : 2));
+  pHeader->channels = (p[3] >> 6) == 3 ? 1 : 2;
+  if (layer == 1)
+  {
+    pHeader->sampleCount = 384;
+    pHeader->frameSize = (12 * bitrate / pHeader->sampleRate + padding) * 4;
+  }
+  else
+  {
+    pHeader->sampleCount = (layer == 3 && !isMpeg1) ? 576 : 1152;
+    pHeader->frameSize = pHeader->sampleCount / 8 * bitrate / pHeader->sampleRate + padding;
+  }
+  return pHeader->frameSize >= FRAME_SCAN_HEADER_SIZE;
+}
+
+static ca_bool ca_frame_scan_parse_adts(const ca_uint8 *p, ca_frame_scan_header *pHeader)
+{
+  static const ca_uint32 sampleRates[13] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+  ca_uint32 sampleRateIndex = (p[2] >> 2) & 0x0F;
+  if (p[0] != 0xFF || (p[1] & 0xF6) != 0xF0 || sampleRateIndex >= 13)
+  {
+    return CA_FALSE;
+  }
+
+  // Each raw data block holds 1024 samples. The header is followed by a CRC when protection_absent is clear.
+  ca_uint32 headerSize = (p[1] & 0x01) ? 7 : 9;
+  pHeader->frameSize = ((ca_uint32)(p[3] & 0x03) << 11) | ((ca_uint32)p[4] << 3) | (p[5] >> 5);
+  pHeader->sampleCount = ((p[6] & 0x03) + 1) * 1024;
+  pHeader->sampleRate = sampleRates[sampleRateIndex];
+  pHeader->channels = ((ca_uint32)(p[2] & 0x01) << 2) | (p[3] >> 6);
+  return pHeader->frameSize > headerSize;
+}
+
+static ca_bool ca_frame_scan_parse(ca_frame_stream stream, const ca_uint8 *p, ca_frame_scan_header *pHeader)
+{
+  switch (stream)
+  {
+  case ca_frame_stream_mpeg:
+    return ca_frame_scan_parse_mpeg(p, pHeader);
+  case ca_frame_stream_adts:
+    return ca_frame_scan_parse_adts(p, pHeader);
+  default:
+    return CA_FALSE;
+  }
+}
+
+// MPEG frames of a stream share the version, the layer and the sample rate. ADTS frames share the profile, the sample rate and the channels.
+static ca_bool ca_frame_scan_is_same_stream(const ca_frame_scanner *pScanner, const ca_uint8 *p)
+{
+  const ca_uint8 *pStreamHeader = pScanner->streamHeader;
+  if (pScanner->stream == ca_frame_stream_mpeg)
+  {
+    return ((pStreamHeader[1] ^ p[1]) & 0xFE) == 0 && ((pStreamHeader[2] ^ p[2]) & 0x0C) == 0;
+  }
+  return ((pStreamHeader[1] ^ p[1]) & 0xF7) == 0 && ((pStreamHeader[2] ^ p[2]) & 0xFD) == 0 && ((pStreamHeader[3] ^ p[3]) & 0xC0) == 0;
+}
+
+// MARK: Window
+
+// Returns size bytes at offset, or NULL when they pass the end of the data or the read fails, which sets pWindow->result.
+static const ca_uint8 *ca_frame_scan_peek(ca_frame_scan_window *pWindow, ca_uint64 offset, ca_uint32 size)
+{
+  if (offset >= pWindow->offset && offset + size <= pWindow->offset + pWindow->size)
+  {
+    return pWindow->pBuffer + (offset - pWindow->offset);
+  }
+
+  ca_frame_scanner *pScanner = pWindow->pScanner;
+  if (offset + size > pScanner->length)
+  {
+    return NULL;
+  }
+
+  // The source is shared by the chunks, so a refill seeks and reads under the lock.
+  ca_uint32 readSize = (ca_uint32)ca_min(pScanner->length - offset, (ca_uint64)FRAME_SCAN_WINDOW_SIZE);
+  ca_uint32 totalRead = 0;
+  pthread_mutex_lock(&pScanner->lock);
+  if (pScanner->source.pSeekProc((ca_int64)offset, ca_seek_origin_start, pScanner->source.pUserData) != ca_seek_result_success)
+  {
+    pWindow->result = ca_result_seek_failed;
+  }
+
+  while (totalRead < readSize && pWindow->result == ca_result_success)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result result = pScanner->source.pReadProc(pWindow->pBuffer + totalRead, readSize - totalRead, &bytesRead, pScanner->source.pUserData);
+    totalRead += bytesRead;
+    if (result == ca_read_result_failed)
+    {
+      pWindow->result = ca_result_read_failed;
+    }
+
+    if (result == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pScanner->lock);
+
+  pWindow->offset = offset;
+  pWindow->size = pWindow->result == ca_result_success ? totalRead : 0;
+  return pWindow->size >= size ? pWindow->pBuffer : NULL;
+}
+
+// Checks that FRAME_SCAN_SYNC_FRAMES frames of the stream follow each other from offset, or that fewer end exactly with the data.
+static ca_bool ca_frame_scan_is_synced(ca_frame_scan_window *pWindow, ca_uint64 offset)
+{
+  ca_frame_scanner *pScanner = pWindow->pScanner;
+  for (int i = 0; i < FRAME_SCAN_SYNC_FRAMES; i++)
+  {
+    if (i > 0 && offset == pScanner->length)
+    {
+      return CA_TRUE;
+    }
+
+    ca_frame_scan_header header;
+    const ca_uint8 *p = ca_frame_scan_peek(pWindow, offset, FRAME_SCAN_HEADER_SIZE);
+    if (p == NULL || !ca_frame_scan_parse(pScanner->stream, p, &header) || !ca_frame_scan_is_same_stream(pScanner, p) || offset + header.frameSize > pScanner->length)
+    {
+      return CA_FALSE;
+    }
+    offset += header.frameSize;
+  }
+  return CA_TRUE;
+}
+
+// MARK: Chunks
+
+static void ca_frame_scan_walk(ca_frame_scan_chunk *pChunk)
+{
+  ca_frame_scanner *pScanner = pChunk->pScanner;
+  ca_frame_scan_window window = {pScanner, NULL, 0, 0, ca_result_success};
+  pChunk->firstFrameOffset = FRAME_SCAN_NO_FRAME;
+  pChunk->lastFrameEnd = 0;
+  pChunk->frameCount = 0;
+  pChunk->sampleCount = 0;
+  pChunk->result = ca_result_success;
+
+  window.pBuffer = (ca_uint8 *)malloc(FRAME_SCAN_WINDOW_SIZE);
+  if (window.pBuffer == NULL)
+  {
+    pChunk->result = ca_result_out_of_memory;
+    return;
+  }
+
+  ca_uint64 offset = pChunk->start;
+  ca_bool isAtFrame = pChunk->isAtFrame;
+  while (offset < pChunk->end)
+  {
+    ca_frame_scan_header header;
+    const ca_uint8 *p = ca_frame_scan_peek(&window, offset, FRAME_SCAN_HEADER_SIZE);
+    if (p == NULL)
+    {
+      break;
+    }
+
+    ca_bool isFrame = ca_frame_scan_parse(pScanner->stream, p, &header) && ca_frame_scan_is_same_stream(pScanner, p);
+    if (isFrame && isAtFrame && offset + header.frameSize > pScanner->length)
+    {
+      // A truncated last frame ends the stream.
+      break;
+    }
+
+    if (isFrame && (isAtFrame || ca_frame_scan_is_synced(&window, offset)))
+    {
+      pChunk->firstFrameOffset = ca_min(pChunk->firstFrameOffset, offset);
+      pChunk->frameCount++;
+      pChunk->sampleCount += header.sampleCount;
+      offset += header.frameSize;
+      pChunk->lastFrameEnd = offset;
+      isAtFrame = CA_TRUE;
+      continue;
+    }
+
+    // Lost sync. The next candidate is the next 0xFF byte.
+    isAtFrame = CA_FALSE;
+    offset++;
+    while (offset < pChunk->end)
+    {
+      p = ca_frame_scan_peek(&window, offset, 1);
+      if (p == NULL)
+      {
+        break;
+      }
+
+      ca_uint64 available = ca_min(window.offset + window.size, pChunk->end) - offset;
+      const ca_uint8 *pSync = (const ca_uint8 *)memchr(p, 0xFF, (size_t)available);
+      if (pSync != NULL)
+      {
+        offset += (ca_uint64)(pSync - p);
+        break;
+      }
+      offset += available;
+    }
+
+    if (p == NULL)
+    {
+      break;
+    }
+  }
+
+  pChunk->endOffset = offset;
+  pChunk->isEndAtFrame = isAtFrame;
+  pChunk->result = window.result;
+  free(window.pBuffer);
+}
+
+static void ca_frame_scan_chunk_job(void *pJobData)
+{
+  ca_frame_scan_walk((ca_frame_scan_chunk *)pJobData);
+}
+
+// MARK: Stream
+
+static ca_uint64 ca_frame_scan_skip_id3(ca_frame_scan_window *pWindow, ca_uint64 offset)
+{
+  for (;;)
+  {
+    const ca_uint8 *p = ca_frame_scan_peek(pWindow, offset, 10);
+    if (p == NULL || memcmp(p, "ID3", 3) != 0)
+    {
+      return offset;
+    }
+
+    ca_uint64 tagSize = ((ca_uint64)(p[6] & 0x7F) << 21) | ((ca_uint64)(p[7] & 0x7F) << 14) | ((ca_uint64)(p[8] & 0x7F) << 7) | (p[9] & 0x7F);
+    offset += 10 + tagSize + ((p[5] & 0x10) ? 10 : 0);
+  }
+}
+
+// Finds the first frame and takes the stream from it. A leading Xing, Info or VBRI frame is skipped.
+static ca_result ca_frame_scan_find_stream(ca_frame_scanner *pScanner, ca_uint64 offset, ca_frame_scan_header *pHeader, ca_uint64 *pFirstFrameOffset)
+{
+  ca_frame_scan_window window = {pScanner, NULL, 0, 0, ca_result_success};
+  window.pBuffer = (ca_uint8 *)malloc(FRAME_SCAN_WINDOW_SIZE);
+  if (window.pBuffer == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_result_unsupported_format;
+  offset = ca_frame_scan_skip_id3(&window, offset);
+  ca_uint64 searchEnd = offset + FRAME_SCAN_MAX_SYNC_SEARCH;
+  for (; offset < searchEnd && result == ca_result_unsupported_format && window.result == ca_result_success; offset++)
+  {
+    const ca_uint8 *p = ca_frame_scan_peek(&window, offset, FRAME_SCAN_HEADER_SIZE);
+    if (p == NULL)
+    {
+      break;
+    }
+
+    static const ca_frame_stream streams[] = {ca_frame_stream_mpeg, ca_frame_stream_adts};
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++)
+    {
+      if (!ca_frame_scan_parse(streams[i], p, pHeader))
+      {
+        continue;
+      }
+
+      pScanner->stream = streams[i];
+      memcpy(pScanner->streamHeader, p, sizeof(pScanner->streamHeader));
+      if (ca_frame_scan_is_synced(&window, offset))
+      {
+        result = ca_result_success;
+        *pFirstFrameOffset = offset;
+        break;
+      }
+    }
+  }
+
+  if (result == ca_result_success && pScanner->stream == ca_frame_stream_mpeg && ((pScanner->streamHeader[1] >> 1) & 0x03) == 1)
+  {
+    // The tags sit after the side information of layer III frames, or at a fixed offset for VBRI.
+    ca_bool isMpeg1 = ((pScanner->streamHeader[1] >> 3) & 0x03) == 3;
+    ca_bool isMono = (pScanner->streamHeader[3] >> 6) == 3;
+    ca_uint32 tagOffset = ((pScanner->streamHeader[1] & 0x01) ? 4 : 6) + (isMpeg1 ? (isMono ? 17 : 32) : (isMono ? 9 : 17));
+    const ca_uint8 *p = ca_frame_scan_peek(&window, *pFirstFrameOffset, pHeader->frameSize);
+    ca_bool isInfoFrame = p != NULL && tagOffset + 4 <= pHeader->frameSize && (memcmp(p + tagOffset, "Xing", 4) == 0 || memcmp(p + tagOffset, "Info", 4) == 0);
+    isInfoFrame = isInfoFrame || (p != NULL && 36 + 4 <= pHeader->frameSize && memcmp(p + 36, "VBRI", 4) == 0);
+    *pFirstFrameOffset += isInfoFrame ? pHeader->frameSize : 0;
+  }
+
+  if (window.result != ca_result_success)
+  {
+    result = window.result;
+  }
+  free(window.pBuffer);
+  return result;
+}
+
+// Reads the length of the source and finds its first frame. The lock is initialized on success.
+static ca_result ca_frame_scan_begin(ca_frame_scanner *pScanner, ca_source source, ca_uint64 offset, ca_frame_scan_header *pHeader, ca_uint64 *pFirstFrameOffset)
+{
+  if (source.pReadProc == NULL || source.pSeekProc == NULL || source.pTellProc == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_zero_memory(pScanner);
+  pScanner->source = source;
+
+  ca_uint64 position = 0;
+  if (source.pTellProc(&position, &pScanner->length, source.pUserData) != ca_tell_result_success)
+  {
+    return ca_result_tell_failed;
+  }
+
+  pthread_mutex_init(&pScanner->lock, NULL);
+  ca_result result = ca_frame_scan_find_stream(pScanner, offset, pHeader, pFirstFrameOffset);
+  if (result != ca_result_success)
+  {
+    pthread_mutex_destroy(&pScanner->lock);
+  }
+  return result;
+}
+
+ca_result ca_frame_scan_find(ca_source source, ca_uint64 offset, ca_frame_scan_result *pResult)
+{
+  if (pResult == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_zero_memory(pResult);
+  ca_frame_scanner scanner;
+  ca_frame_scan_header header;
+  ca_uint64 firstFrameOffset = 0;
+  ca_result result = ca_frame_scan_begin(&scanner, source, offset, &header, &firstFrameOffset);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  pResult->stream = scanner.stream;
+  pResult->sampleRate = header.sampleRate;
+  pResult->channels = header.channels;
+  pResult->firstFrameOffset = firstFrameOffset;
+  pthread_mutex_destroy(&scanner.lock);
+  return ca_result_success;
+}
+
+ca_result ca_frame_scan(ca_source source, ca_uint64 offset, ca_uint32 threadCount, ca_frame_scan_result *pResult)
+{
+  if (pResult == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_zero_memory(pResult);
+  ca_frame_scanner scanner;
+  ca_frame_scan_header header;
+  ca_uint64 firstFrameOffset = 0;
+  ca_result result = ca_frame_scan_begin(&scanner, source, offset, &header, &firstFrameOffset);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  threadCount = threadCount == 0 ? ca_get_cpu_count() : threadCount;
+  ca_uint64 dataSize = scanner.length - ca_min(firstFrameOffset, scanner.length);
+  ca_uint64 maxChunkCount = threadCount > 1 ? (ca_uint64)threadCount * FRAME_SCAN_CHUNKS_PER_THREAD : 1;
+  ca_uint32 chunkCount = (ca_uint32)ca_max(ca_min(maxChunkCount, dataSize / FRAME_SCAN_MIN_CHUNK_SIZE), 1ULL);
+  ca_frame_scan_chunk *pChunks = (ca_frame_scan_chunk *)calloc(chunkCount, sizeof(ca_frame_scan_chunk));
+  if (pChunks == NULL)
+  {
+    pthread_mutex_destroy(&scanner.lock);
+    return ca_result_out_of_memory;
+  }
+
+  for (ca_uint32 i = 0; i < chunkCount; i++)
+  {
+    pChunks[i].pScanner = &scanner;
+    pChunks[i].start = firstFrameOffset + dataSize * i / chunkCount;
+    pChunks[i].end = i + 1 == chunkCount ? scanner.length : firstFrameOffset + dataSize * (i + 1) / chunkCount;
+    pChunks[i].isAtFrame = i == 0;
+  }
+
+  // The calling thread scans alongside the workers. Chunks that could not be queued are walked below.
+  ca_thread_pool pool;
+  ca_uint32 submittedCount = 0;
+  if (chunkCount > 1 && threadCount > 1 && ca_thread_pool_init(&pool, threadCount - 1) == ca_result_success)
+  {
+    for (; submittedCount < chunkCount; submittedCount++)
+    {
+      if (ca_thread_pool_submit(&pool, ca_frame_scan_chunk_job, &pChunks[submittedCount]) != ca_result_success)
+      {
+        break;
+      }
+    }
+    ca_thread_pool_wait(&pool);
+    ca_thread_pool_uninit(&pool);
+  }
+
+  for (ca_uint32 i = submittedCount; i < chunkCount; i++)
+  {
+    ca_frame_scan_walk(&pChunks[i]);
+  }
+
+  // A chunk is joined when it starts at the frame where the previous one ended, or the previous one searched up to its start.
+  // Otherwise it is walked again from where the previous one ended, as a sequential scan would.
+  for (ca_uint32 i = 0; i < chunkCount && result == ca_result_success; i++)
+  {
+    ca_frame_scan_chunk *pChunk = &pChunks[i];
+    if (i > 0)
+    {
+      ca_frame_scan_chunk *pPrevious = &pChunks[i - 1];
+      ca_bool isJoined = pPrevious->isEndAtFrame ? pPrevious->endOffset == pChunk->firstFrameOffset : pPrevious->endOffset == pChunk->start;
+      if (!isJoined)
+      {
+        pChunk->start = pPrevious->endOffset;
+        pChunk->isAtFrame = pPrevious->isEndAtFrame;
+        if (pChunk->start < pChunk->end)
+        {
+          ca_frame_scan_walk(pChunk);
+        }
+        else
+        {
+          pChunk->frameCount = 0;
+          pChunk->sampleCount = 0;
+          pChunk->lastFrameEnd = 0;
+          pChunk->endOffset = pChunk->start;
+          pChunk->isEndAtFrame = pPrevious->isEndAtFrame;
+        }
+      }
+    }
+
+    result = pChunk->result;
+    pResult->frameCount += pChunk->frameCount;
+    pResult->sampleCount += pChunk->sampleCount;
+    pResult->endOffset = ca_max(pResult->endOffset, pChunk->lastFrameEnd);
+  }
+
+  pResult->stream = scanner.stream;
+  pResult->sampleRate = header.sampleRate;
+  pResult->channels = header.channels;
+  pResult->firstFrameOffset = firstFrameOffset;
+  free(pChunks);
+  pthread_mutex_destroy(&scanner.lock);
+  return result;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ca_io.h"
+
+typedef enum
+{
+  ca_frame_stream_unknown = 0,
+  ca_frame_stream_mpeg = 1,
+  ca_frame_stream_adts = 2,
+} ca_frame_stream;
+
+// The frames of an MPEG audio or ADTS stream, counted from their headers without decoding.
+typedef struct
+{
+  ca_frame_stream stream;
+  ca_uint32 sampleRate;
+  ca_uint32 channels;
+  ca_uint64 frameCount;
+
+  // Samples per channel in all frames at sampleRate. HE-AAC is decoded at twice the ADTS rate, which doubles the samples too.
+  ca_uint64 sampleCount;
+
+  // The first audio frame and the end of the last one. A Xing, Info or VBRI frame starting an MPEG stream is not counted.
+  ca_uint64 firstFrameOffset;
+  ca_uint64 endOffset;
+} ca_frame_scan_result;
+
+// Counts the frames from offset, where ID3v2 tags are skipped, to the end of the source. Junk between frames is skipped by resynchronizing.
+// The source is split into chunks scanned on threadCount threads, zero using one thread per CPU core. Reads are serialized on the source.
+// The source has to report its length. Its position is undefined afterwards.
+FFI_PLUGIN_EXPORT ca_result ca_frame_scan(ca_source source, ca_uint64 offset, ca_uint32 threadCount, ca_frame_scan_result *pResult);
+
+// Finds the first frame like ca_frame_scan and fills in the stream, sampleRate, channels and firstFrameOffset without counting, so only the start of the source is read.
+FFI_PLUGIN_EXPORT ca_result ca_frame_scan_find(ca_source source, ca_uint64 offset, ca_frame_scan_result *pResult);
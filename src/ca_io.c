@@ -0,0 +1,22 @@
+#include "ca_io.h"
+
+FFI_PLUGIN_EXPORT ca_source ca_source_init(ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData)
+{
+  ca_source source = {
+      .pReadProc = pReadProc,
+      .pSeekProc = pSeekProc,
+      .pTellProc = pTellProc,
+      .pUserData = pUserData,
+  };
+  return source;
+}
+
+FFI_PLUGIN_EXPORT ca_sink ca_sink_init(ca_sink_write_proc pWriteProc, ca_decoder_seek_proc pSeekProc, void *pUserData)
+{
+  ca_sink sink = {
+      .pWriteProc = pWriteProc,
+      .pSeekProc = pSeekProc,
+      .pUserData = pUserData,
+  };
+  return sink;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+typedef ca_write_result (*ca_sink_write_proc)(const void *pBufferOut, ca_uint32 bytesToWrite, ca_uint32 *pBytesWritten, void *pUserData);
+
+// A readable byte stream. The procs have the same contract as the ones passed to ca_decoder_init.
+typedef struct
+{
+  ca_decoder_read_proc pReadProc;
+  ca_decoder_seek_proc pSeekProc;
+  ca_decoder_tell_proc pTellProc;
+  void *pUserData;
+} ca_source;
+
+// A writable byte stream.
+typedef struct
+{
+  ca_sink_write_proc pWriteProc;
+  ca_decoder_seek_proc pSeekProc;
+  void *pUserData;
+} ca_sink;
+
+FFI_PLUGIN_EXPORT ca_source ca_source_init(ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pUserData);
+
+FFI_PLUGIN_EXPORT ca_sink ca_sink_init(ca_sink_write_proc pWriteProc, ca_decoder_seek_proc pSeekProc, void *pUserData);
@@ -0,0 +1,1922 @@
+#include "ca_metadata.h"
+#include "ca_thread_pool.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define METADATA_ARENA_BLOCK_SIZE (64 * 1024)
+#define METADATA_MAX_CHUNK_COUNT 1024
+
+// Text values are read whole. Larger frames and items are skipped, they are not worth the read in a library scan.
+#define METADATA_MAX_TEXT_SIZE (64 * 1024)
+
+// Vorbis comment blocks and ID3v2 tags with whole-tag unsynchronisation are read at once up to this size.
+#define METADATA_MAX_BLOCK_SIZE (1024 * 1024)
+
+// Bytes searched from the end for the last Ogg page.
+#define METADATA_OGG_TAIL_SIZE (64 * 1024)
+
+#define METADATA_PICTURE_TYPE_FRONT_COVER 3
+
+typedef enum
+{
+  ca_metadata_field_none,
+  ca_metadata_field_title,
+  ca_metadata_field_artist,
+  ca_metadata_field_album,
+  ca_metadata_field_album_artist,
+  ca_metadata_field_genre,
+  ca_metadata_field_date,
+  ca_metadata_field_comment,
+  ca_metadata_field_track,
+  ca_metadata_field_track_count,
+  ca_metadata_field_disc,
+  ca_metadata_field_disc_count,
+} ca_metadata_field;
+
+typedef struct
+{
+  const char *pKey;
+  ca_metadata_field field;
+} ca_metadata_field_key;
+
+// Keys are matched case-insensitively. ID3v1 fields are reported with the ID3v2 frame ids.
+static const ca_metadata_field_key metadataFieldKeys[] = {
+    {"TIT2", ca_metadata_field_title},
+    {"TT2", ca_metadata_field_title},
+    {"TITLE", ca_metadata_field_title},
+    {"\xC2\xA9nam", ca_metadata_field_title},
+    {"INAM", ca_metadata_field_title},
+    {"NAME", ca_metadata_field_title},
+    {"TPE1", ca_metadata_field_artist},
+    {"TP1", ca_metadata_field_artist},
+    {"ARTIST", ca_metadata_field_artist},
+    {"\xC2\xA9" "ART", ca_metadata_field_artist},
+    {"IART", ca_metadata_field_artist},
+    {"AUTH", ca_metadata_field_artist},
+    {"TALB", ca_metadata_field_album},
+    {"TAL", ca_metadata_field_album},
+    {"ALBUM", ca_metadata_field_album},
+    {"\xC2\xA9" "alb", ca_metadata_field_album},
+    {"IPRD", ca_metadata_field_album},
+    {"TPE2", ca_metadata_field_album_artist},
+    {"TP2", ca_metadata_field_album_artist},
+    {"ALBUMARTIST", ca_metadata_field_album_artist},
+    {"ALBUM ARTIST", ca_metadata_field_album_artist},
+    {"aART", ca_metadata_field_album_artist},
+    {"TCON", ca_metadata_field_genre},
+    {"TCO", ca_metadata_field_genre},
+    {"GENRE", ca_metadata_field_genre},
+    {"\xC2\xA9gen", ca_metadata_field_genre},
+    {"gnre", ca_metadata_field_genre},
+    {"IGNR", ca_metadata_field_genre},
+    {"TDRC", ca_metadata_field_date},
+    {"TYER", ca_metadata_field_date},
+    {"TYE", ca_metadata_field_date},
+    {"DATE", ca_metadata_field_date},
+    {"\xC2\xA9" "day", ca_metadata_field_date},
+    {"ICRD", ca_metadata_field_date},
+    {"COMM", ca_metadata_field_comment},
+    {"COM", ca_metadata_field_comment},
+    {"COMMENT", ca_metadata_field_comment},
+    {"DESCRIPTION", ca_metadata_field_comment},
+    {"\xC2\xA9" "cmt", ca_metadata_field_comment},
+    {"ICMT", ca_metadata_field_comment},
+    {"ANNO", ca_metadata_field_comment},
+    {"TRCK", ca_metadata_field_track},
+    {"TRK", ca_metadata_field_track},
+    {"TRACKNUMBER", ca_metadata_field_track},
+    {"trkn", ca_metadata_field_track},
+    {"ITRK", ca_metadata_field_track},
+    {"IPRT", ca_metadata_field_track},
+    {"TRACKTOTAL", ca_metadata_field_track_count},
+    {"TOTALTRACKS", ca_metadata_field_track_count},
+    {"TPOS", ca_metadata_field_disc},
+    {"TPA", ca_metadata_field_disc},
+    {"DISCNUMBER", ca_metadata_field_disc},
+    {"disk", ca_metadata_field_disc},
+    {"DISCTOTAL", ca_metadata_field_disc_count},
+    {"TOTALDISCS", ca_metadata_field_disc_count},
+};
+
+// The ID3v1 genre list, which ID3v2 and MP4 refer to by index.
+static const char *const metadataGenres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal",
+    "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+    "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk",
+    "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic",
+    "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta",
+    "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes",
+    "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+};
+
+typedef struct
+{
+  ca_source source;
+  ca_uint32 flags;
+  ca_arena *pArena;
+  ca_metadata *pMetadata;
+
+  ca_uint64 position;
+  ca_uint64 length;
+  ca_bool isLengthKnown;
+
+  ca_uint32 tagCapacity;
+  ca_uint32 pictureCapacity;
+
+  // Reads are served from here instead of the source while a de-unsynchronised ID3v2 tag is parsed.
+  const ca_uint8 *pWindow;
+  ca_uint64 windowOffset;
+  ca_uint64 windowSize;
+} ca_metadata_reader;
+
+// MARK: Byte order
+
+static inline ca_uint32 ca_metadata_le16(const ca_uint8 *p)
+{
+  return (ca_uint32)p[0] | ((ca_uint32)p[1] << 8);
+}
+
+static inline ca_uint32 ca_metadata_le32(const ca_uint8 *p)
+{
+  return ca_metadata_le16(p) | (ca_metadata_le16(p + 2) << 16);
+}
+
+static inline ca_uint64 ca_metadata_le64(const ca_uint8 *p)
+{
+  return (ca_uint64)ca_metadata_le32(p) | ((ca_uint64)ca_metadata_le32(p + 4) << 32);
+}
+
+static inline ca_uint32 ca_metadata_be16(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 8) | (ca_uint32)p[1];
+}
+
+static inline ca_uint32 ca_metadata_be24(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 16) | ca_metadata_be16(p + 1);
+}
+
+static inline ca_uint32 ca_metadata_be32(const ca_uint8 *p)
+{
+  return (ca_metadata_be16(p) << 16) | ca_metadata_be16(p + 2);
+}
+
+static inline ca_uint64 ca_metadata_be64(const ca_uint8 *p)
+{
+  return ((ca_uint64)ca_metadata_be32(p) << 32) | (ca_uint64)ca_metadata_be32(p + 4);
+}
+
+static inline ca_uint32 ca_metadata_synchsafe32(const ca_uint8 *p)
+{
+  return ((ca_uint32)(p[0] & 0x7F) << 21) | ((ca_uint32)(p[1] & 0x7F) << 14) | ((ca_uint32)(p[2] & 0x7F) << 7) | (ca_uint32)(p[3] & 0x7F);
+}
+
+// MARK: Reader
+
+static ca_result ca_metadata_read_at(ca_metadata_reader *pReader, ca_uint64 offset, void *pBuffer, ca_uint32 size, ca_uint32 *pBytesRead)
+{
+  *pBytesRead = 0;
+  if (pReader->pWindow != NULL)
+  {
+    if (offset >= pReader->windowOffset && offset - pReader->windowOffset < pReader->windowSize)
+    {
+      ca_uint64 windowPosition = offset - pReader->windowOffset;
+      *pBytesRead = (ca_uint32)ca_min((ca_uint64)size, pReader->windowSize - windowPosition);
+      memcpy(pBuffer, pReader->pWindow + windowPosition, *pBytesRead);
+    }
+    return ca_result_success;
+  }
+
+  if (offset != pReader->position)
+  {
+    if (pReader->source.pSeekProc((ca_int64)offset, ca_seek_origin_start, pReader->source.pUserData) != ca_seek_result_success)
+    {
+      return ca_result_seek_failed;
+    }
+    pReader->position = offset;
+  }
+
+  ca_uint32 totalRead = 0;
+  while (totalRead < size)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result result = pReader->source.pReadProc((ca_uint8 *)pBuffer + totalRead, size - totalRead, &bytesRead, pReader->source.pUserData);
+    totalRead += bytesRead;
+    if (result == ca_read_result_failed)
+    {
+      pReader->position += totalRead;
+      return ca_result_read_failed;
+    }
+
+    if (result == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+
+  pReader->position += totalRead;
+  *pBytesRead = totalRead;
+  return ca_result_success;
+}
+
+// A short read means a truncated block, which ends the parsing of that block with ca_result_unsupported_format.
+static ca_result ca_metadata_read_exact(ca_metadata_reader *pReader, ca_uint64 offset, void *pBuffer, ca_uint32 size)
+{
+  ca_uint32 bytesRead = 0;
+  ca_result result = ca_metadata_read_at(pReader, offset, pBuffer, size, &bytesRead);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+  return bytesRead == size ? ca_result_success : ca_result_unsupported_format;
+}
+
+// Reads size bytes into the arena. Returns NULL with ca_result_unsupported_format when the block is larger than maxSize.
+static const ca_uint8 *ca_metadata_read_block(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 size, ca_uint64 maxSize, ca_result *pResult)
+{
+  if (size > maxSize)
+  {
+    *pResult = ca_result_unsupported_format;
+    return NULL;
+  }
+
+  ca_uint8 *pBlock = (ca_uint8 *)ca_arena_alloc(pReader->pArena, (size_t)size + 1);
+  if (pBlock == NULL)
+  {
+    *pResult = ca_result_out_of_memory;
+    return NULL;
+  }
+
+  *pResult = ca_metadata_read_exact(pReader, offset, pBlock, (ca_uint32)size);
+  return *pResult == ca_result_success ? pBlock : NULL;
+}
+
+// Ends a parse loop on IO and memory failures only, a malformed block just ends the block.
+static inline ca_bool ca_metadata_is_fatal(ca_result result)
+{
+  return result != ca_result_success && result != ca_result_unsupported_format;
+}
+
+// MARK: Text
+
+static char *ca_metadata_alloc_string(ca_metadata_reader *pReader, size_t size)
+{
+  char *pString = (char *)ca_arena_alloc(pReader->pArena, size + 1);
+  if (pString != NULL)
+  {
+    pString[size] = '\0';
+  }
+  return pString;
+}
+
+// Drops the padding of fixed-size fields.
+static char *ca_metadata_trim(char *pString)
+{
+  if (pString == NULL)
+  {
+    return NULL;
+  }
+
+  size_t size = strlen(pString);
+  while (size > 0 && (pString[size - 1] == ' ' || pString[size - 1] == '\r' || pString[size - 1] == '\n'))
+  {
+    pString[--size] = '\0';
+  }
+  return pString;
+}
+
+static size_t ca_metadata_string_size(const ca_uint8 *p, size_t size)
+{
+  const ca_uint8 *pEnd = (const ca_uint8 *)memchr(p, 0, size);
+  return pEnd == NULL ? size : (size_t)(pEnd - p);
+}
+
+static char *ca_metadata_latin1(ca_metadata_reader *pReader, const ca_uint8 *p, size_t size)
+{
+  size = ca_metadata_string_size(p, size);
+  char *pString = ca_metadata_alloc_string(pReader, size * 2);
+  if (pString == NULL)
+  {
+    return NULL;
+  }
+
+  char *pOut = pString;
+  for (size_t i = 0; i < size; i++)
+  {
+    if (p[i] < 0x80)
+    {
+      *pOut++ = (char)p[i];
+    }
+    else
+    {
+      *pOut++ = (char)(0xC0 | (p[i] >> 6));
+      *pOut++ = (char)(0x80 | (p[i] & 0x3F));
+    }
+  }
+  *pOut = '\0';
+  return ca_metadata_trim(pString);
+}
+
+static ca_bool ca_metadata_is_utf8(const ca_uint8 *p, size_t size)
+{
+  size_t i = 0;
+  while (i < size)
+  {
+    ca_uint32 continuationCount = p[i] < 0x80 ? 0 : (p[i] & 0xE0) == 0xC0 ? 1 : (p[i] & 0xF0) == 0xE0 ? 2 : (p[i] & 0xF8) == 0xF0 ? 3 : 4;
+    if (continuationCount == 4 || i + continuationCount >= size)
+    {
+      return CA_FALSE;
+    }
+
+    for (ca_uint32 j = 1; j <= continuationCount; j++)
+    {
+      if ((p[i + j] & 0xC0) != 0x80)
+      {
+        return CA_FALSE;
+      }
+    }
+    i += continuationCount + 1;
+  }
+  return CA_TRUE;
+}
+
+// Text fields without a declared encoding are taken as UTF-8 when they are valid UTF-8 and as Latin-1 otherwise.
+static char *ca_metadata_text(ca_metadata_reader *pReader, const ca_uint8 *p, size_t size)
+{
+  size = ca_metadata_string_size(p, size);
+  if (!ca_metadata_is_utf8(p, size))
+  {
+    return ca_metadata_latin1(pReader, p, size);
+  }
+
+  char *pString = ca_metadata_alloc_string(pReader, size);
+  if (pString != NULL)
+  {
+    memcpy(pString, p, size);
+  }
+  return ca_metadata_trim(pString);
+}
+
+static char *ca_metadata_utf16(ca_metadata_reader *pReader, const ca_uint8 *p, size_t size, ca_bool isBigEndian)
+{
+  if (size >= 2 && ((p[0] == 0xFE && p[1] == 0xFF) || (p[0] == 0xFF && p[1] == 0xFE)))
+  {
+    isBigEndian = p[0] == 0xFE;
+    p += 2;
+    size -= 2;
+  }
+
+  size_t unitCount = size / 2;
+  char *pString = ca_metadata_alloc_string(pReader, unitCount * 3);
+  if (pString == NULL)
+  {
+    return NULL;
+  }
+
+  char *pOut = pString;
+  for (size_t i = 0; i < unitCount; i++)
+  {
+    ca_uint32 c = isBigEndian ? ca_metadata_be16(p + i * 2) : ca_metadata_le16(p + i * 2);
+    if (c == 0)
+    {
+      break;
+    }
+
+    if (c >= 0xD800 && c < 0xDC00 && i + 1 < unitCount)
+    {
+      ca_uint32 low = isBigEndian ? ca_metadata_be16(p + i * 2 + 2) : ca_metadata_le16(p + i * 2 + 2);
+      if (low >= 0xDC00 && low < 0xE000)
+      {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        i++;
+      }
+    }
+
+    if (c < 0x80)
+    {
+      *pOut++ = (char)c;
+    }
+    else if (c < 0x800)
+    {
+      *pOut++ = (char)(0xC0 | (c >> 6));
+      *pOut++ = (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+      *pOut++ = (char)(0xE0 | (c >> 12));
+      *pOut++ = (char)(0x80 | ((c >> 6) & 0x3F));
+      *pOut++ = (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+      // A surrogate pair takes 4 bytes in UTF-8, no more than its two units were reserved.
+      *pOut++ = (char)(0xF0 | (c >> 18));
+      *pOut++ = (char)(0x80 | ((c >> 12) & 0x3F));
+      *pOut++ = (char)(0x80 | ((c >> 6) & 0x3F));
+      *pOut++ = (char)(0x80 | (c & 0x3F));
+    }
+  }
+  *pOut = '\0';
+  return ca_metadata_trim(pString);
+}
+
+static char *ca_metadata_copy_key(ca_metadata_reader *pReader, const ca_uint8 *p, size_t size)
+{
+  char *pKey = ca_metadata_alloc_string(pReader, size);
+  if (pKey != NULL)
+  {
+    memcpy(pKey, p, size);
+  }
+  return pKey;
+}
+
+static ca_bool ca_metadata_key_equals(const char *pKey, const char *pOther)
+{
+  for (; *pKey != '\0' && *pOther != '\0'; pKey++, pOther++)
+  {
+    char a = (*pKey >= 'a' && *pKey <= 'z') ? (char)(*pKey - 32) : *pKey;
+    char b = (*pOther >= 'a' && *pOther <= 'z') ? (char)(*pOther - 32) : *pOther;
+    if (a != b)
+    {
+      return CA_FALSE;
+    }
+  }
+  return *pKey == *pOther;
+}
+
+// MARK: Tags
+
+// Parses "3" or "3/12" into the number and the optional count.
+static void ca_metadata_parse_number(const char *pValue, ca_uint32 *pNumber, ca_uint32 *pCount)
+{
+  ca_uint32 number = 0;
+  while (*pValue >= '0' && *pValue <= '9')
+  {
+    number = number * 10 + (ca_uint32)(*pValue++ - '0');
+  }
+
+  if (*pNumber == 0)
+  {
+    *pNumber = number;
+  }
+
+  if (pCount != NULL && *pValue == '/')
+  {
+    ca_metadata_parse_number(pValue + 1, pCount, NULL);
+  }
+}
+
+// Resolves "(17)", "17" and "(17)Rock" style references into the genre list.
+static const char *ca_metadata_resolve_genre(const char *pValue)
+{
+  const char *p = pValue[0] == '(' ? pValue + 1 : pValue;
+  ca_uint32 index = 0;
+  const char *pDigits = p;
+  while (*p >= '0' && *p <= '9' && index < 1000)
+  {
+    index = index * 10 + (ca_uint32)(*p++ - '0');
+  }
+
+  ca_bool isReference = p != pDigits && (pValue[0] == '(' ? *p == ')' && p[1] == '\0' : *p == '\0');
+  if (isReference && index < sizeof(metadataGenres) / sizeof(metadataGenres[0]))
+  {
+    return metadataGenres[index];
+  }
+  return pValue;
+}
+
+static void ca_metadata_assign(ca_metadata *pMetadata, const char *pKey, const char *pValue)
+{
+  ca_metadata_field field = ca_metadata_field_none;
+  for (size_t i = 0; i < sizeof(metadataFieldKeys) / sizeof(metadataFieldKeys[0]); i++)
+  {
+    if (ca_metadata_key_equals(pKey, metadataFieldKeys[i].pKey))
+    {
+      field = metadataFieldKeys[i].field;
+      break;
+    }
+  }
+
+  // The first tag of a field wins, e.g. ID3v2 over ID3v1 and the first of repeated Vorbis comments.
+  switch (field)
+  {
+  case ca_metadata_field_title:
+    pMetadata->pTitle = pMetadata->pTitle != NULL ? pMetadata->pTitle : pValue;
+    break;
+  case ca_metadata_field_artist:
+    pMetadata->pArtist = pMetadata->pArtist != NULL ? pMetadata->pArtist : pValue;
+    break;
+  case ca_metadata_field_album:
+    pMetadata->pAlbum = pMetadata->pAlbum != NULL ? pMetadata->pAlbum : pValue;
+    break;
+  case ca_metadata_field_album_artist:
+    pMetadata->pAlbumArtist = pMetadata->pAlbumArtist != NULL ? pMetadata->pAlbumArtist : pValue;
+    break;
+  case ca_metadata_field_genre:
+    pMetadata->pGenre = pMetadata->pGenre != NULL ? pMetadata->pGenre : ca_metadata_resolve_genre(pValue);
+    break;
+  case ca_metadata_field_date:
+    pMetadata->pDate = pMetadata->pDate != NULL ? pMetadata->pDate : pValue;
+    break;
+  case ca_metadata_field_comment:
+    pMetadata->pComment = pMetadata->pComment != NULL ? pMetadata->pComment : pValue;
+    break;
+  case ca_metadata_field_track:
+    ca_metadata_parse_number(pValue, &pMetadata->trackNumber, &pMetadata->trackCount);
+    break;
+  case ca_metadata_field_track_count:
+    ca_metadata_parse_number(pValue, &pMetadata->trackCount, NULL);
+    break;
+  case ca_metadata_field_disc:
+    ca_metadata_parse_number(pValue, &pMetadata->discNumber, &pMetadata->discCount);
+    break;
+  case ca_metadata_field_disc_count:
+    ca_metadata_parse_number(pValue, &pMetadata->discCount, NULL);
+    break;
+  default:
+    break;
+  }
+}
+
+static ca_result ca_metadata_add_tag(ca_metadata_reader *pReader, const char *pKey, const char *pValue)
+{
+  ca_metadata *pMetadata = pReader->pMetadata;
+  if (pKey == NULL || pValue == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  if (pValue[0] == '\0')
+  {
+    return ca_result_success;
+  }
+
+  // The old array stays in the arena until it is reset.
+  if (pMetadata->tagCount == pReader->tagCapacity)
+  {
+    ca_uint32 capacity = pReader->tagCapacity == 0 ? 16 : pReader->tagCapacity * 2;
+    ca_metadata_tag *pTags = (ca_metadata_tag *)ca_arena_alloc(pReader->pArena, sizeof(ca_metadata_tag) * capacity);
+    if (pTags == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    if (pMetadata->tagCount > 0)
+    {
+      memcpy(pTags, pMetadata->pTags, sizeof(ca_metadata_tag) * pMetadata->tagCount);
+    }
+    pMetadata->pTags = pTags;
+    pReader->tagCapacity = capacity;
+  }
+
+  pMetadata->pTags[pMetadata->tagCount].pKey = pKey;
+  pMetadata->pTags[pMetadata->tagCount].pValue = pValue;
+  pMetadata->tagCount++;
+  ca_metadata_assign(pMetadata, pKey, pValue);
+  return ca_result_success;
+}
+
+static ca_result ca_metadata_add_picture(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 length, const char *pMimeType, ca_uint32 pictureType)
+{
+  ca_metadata *pMetadata = pReader->pMetadata;
+  if (pMimeType == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  if (pMetadata->pictureCount == pReader->pictureCapacity)
+  {
+    ca_uint32 capacity = pReader->pictureCapacity == 0 ? 4 : pReader->pictureCapacity * 2;
+    ca_metadata_picture *pPictures = (ca_metadata_picture *)ca_arena_alloc(pReader->pArena, sizeof(ca_metadata_picture) * capacity);
+    if (pPictures == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    if (pMetadata->pictureCount > 0)
+    {
+      memcpy(pPictures, pMetadata->pPictures, sizeof(ca_metadata_picture) * pMetadata->pictureCount);
+    }
+    pMetadata->pPictures = pPictures;
+    pReader->pictureCapacity = capacity;
+  }
+
+  ca_metadata_picture *pPicture = &pMetadata->pPictures[pMetadata->pictureCount++];
+  pPicture->offset = offset;
+  pPicture->length = length;
+  pPicture->pMimeType = pMimeType;
+  pPicture->pictureType = pictureType;
+  return ca_result_success;
+}
+
+// MARK: ID3
+
+// Returns the size of a string in the ID3v2 text encoding and the size of its terminator.
+static size_t ca_metadata_id3_string_size(ca_uint8 encoding, const ca_uint8 *p, size_t size, size_t *pTerminatorSize)
+{
+  if (encoding == 1 || encoding == 2)
+  {
+    size_t i = 0;
+    while (i + 1 < size && (p[i] != 0 || p[i + 1] != 0))
+    {
+      i += 2;
+    }
+    *pTerminatorSize = i + 1 < size ? 2 : 0;
+    return ca_min(i, size);
+  }
+
+  size_t stringSize = ca_metadata_string_size(p, size);
+  *pTerminatorSize = stringSize < size ? 1 : 0;
+  return stringSize;
+}
+
+static char *ca_metadata_id3_string(ca_metadata_reader *pReader, ca_uint8 encoding, const ca_uint8 *p, size_t size)
+{
+  switch (encoding)
+  {
+  case 0:
+    return ca_metadata_latin1(pReader, p, size);
+  case 1:
+    return ca_metadata_utf16(pReader, p, size, CA_FALSE);
+  case 2:
+    return ca_metadata_utf16(pReader, p, size, CA_TRUE);
+  default:
+    return ca_metadata_text(pReader, p, size);
+  }
+}
+
+// Removes the 0x00 inserted after every 0xFF and returns the new size.
+static size_t ca_metadata_id3_unsynchronise(ca_uint8 *p, size_t size)
+{
+  size_t outSize = 0;
+  for (size_t i = 0; i < size; i++)
+  {
+    p[outSize++] = p[i];
+    if (p[i] == 0xFF && i + 1 < size && p[i + 1] == 0x00)
+    {
+      i++;
+    }
+  }
+  return outSize;
+}
+
+static ca_result ca_metadata_id3_text_frame(ca_metadata_reader *pReader, const char *pFrameId, const ca_uint8 *p, size_t size)
+{
+  if (size < 1)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint8 encoding = p[0];
+  p++;
+  size--;
+
+  const char *pKey = pFrameId;
+  if (strcmp(pFrameId, "TXXX") == 0 || strcmp(pFrameId, "TXX") == 0)
+  {
+    // User defined frames are keyed by their description.
+    size_t terminatorSize = 0;
+    size_t descriptionSize = ca_metadata_id3_string_size(encoding, p, size, &terminatorSize);
+    pKey = ca_metadata_id3_string(pReader, encoding, p, descriptionSize);
+    p += descriptionSize + terminatorSize;
+    size -= descriptionSize + terminatorSize;
+  }
+  else if (strcmp(pFrameId, "COMM") == 0 || strcmp(pFrameId, "COM") == 0)
+  {
+    // Skips the language and the short description.
+    if (size < 3)
+    {
+      return ca_result_success;
+    }
+
+    size_t terminatorSize = 0;
+    size_t descriptionSize = ca_metadata_id3_string_size(encoding, p + 3, size - 3, &terminatorSize);
+    p += 3 + descriptionSize + terminatorSize;
+    size -= 3 + descriptionSize + terminatorSize;
+  }
+
+  return ca_metadata_add_tag(pReader, pKey, ca_metadata_id3_string(pReader, encoding, p, size));
+}
+
+static ca_result ca_metadata_id3_picture_frame(ca_metadata_reader *pReader, ca_bool isV22, ca_uint64 frameOffset, ca_uint64 frameSize)
+{
+  ca_uint8 header[512];
+  ca_uint32 headerSize = 0;
+  ca_result result = ca_metadata_read_at(pReader, frameOffset, header, (ca_uint32)ca_min(frameSize, (ca_uint64)sizeof(header)), &headerSize);
+  if (result != ca_result_success || headerSize < 2)
+  {
+    return result;
+  }
+
+  ca_uint8 encoding = header[0];
+  size_t position = 1;
+  const char *pMimeType = NULL;
+  if (isV22)
+  {
+    if (headerSize < 5)
+    {
+      return ca_result_success;
+    }
+
+    pMimeType = memcmp(header + 1, "PNG", 3) == 0 ? "image/png" : memcmp(header + 1, "JPG", 3) == 0 ? "image/jpeg" : ca_metadata_latin1(pReader, header + 1, 3);
+    position += 3;
+  }
+  else
+  {
+    size_t mimeSize = ca_metadata_string_size(header + position, headerSize - position);
+    pMimeType = ca_metadata_latin1(pReader, header + position, mimeSize);
+    position += mimeSize + 1;
+  }
+
+  if (position >= headerSize)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint32 pictureType = header[position++];
+  size_t terminatorSize = 0;
+  size_t descriptionSize = ca_metadata_id3_string_size(encoding, header + position, headerSize - position, &terminatorSize);
+  if (terminatorSize == 0)
+  {
+    // The description does not fit the header buffer, which no real tag does.
+    return ca_result_success;
+  }
+
+  position += descriptionSize + terminatorSize;
+  return ca_metadata_add_picture(pReader, frameOffset + position, frameSize - position, pMimeType, pictureType);
+}
+
+static ca_result ca_metadata_id3_frame(ca_metadata_reader *pReader, const char *pFrameId, ca_bool isV22, ca_uint64 offset, ca_uint64 size, ca_bool isUnsynchronised)
+{
+  ca_bool isPicture = strcmp(pFrameId, "APIC") == 0 || strcmp(pFrameId, "PIC") == 0;
+  ca_bool isText = pFrameId[0] == 'T' || strcmp(pFrameId, "COMM") == 0 || strcmp(pFrameId, "COM") == 0;
+  if (isPicture && (pReader->flags & ca_metadata_flag_pictures) != 0)
+  {
+    // Unsynchronised picture bytes are not the stored bytes, so they have no location to report.
+    return isUnsynchronised ? ca_result_success : ca_metadata_id3_picture_frame(pReader, isV22, offset, size);
+  }
+
+  if (!isText || (pReader->flags & ca_metadata_flag_tags) == 0)
+  {
+    return ca_result_success;
+  }
+
+  ca_result result = ca_result_success;
+  ca_uint8 *pFrame = (ca_uint8 *)ca_metadata_read_block(pReader, offset, size, METADATA_MAX_TEXT_SIZE, &result);
+  if (pFrame == NULL)
+  {
+    return result;
+  }
+
+  if (isUnsynchronised)
+  {
+    size = ca_metadata_id3_unsynchronise(pFrame, (size_t)size);
+  }
+
+  char *pKey = ca_metadata_copy_key(pReader, (const ca_uint8 *)pFrameId, strlen(pFrameId));
+  if (pKey == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+  return ca_metadata_id3_text_frame(pReader, pKey, pFrame, (size_t)size);
+}
+
+// Parses an ID3v2 tag at offset and returns its total size, or zero when there is none.
+static ca_result ca_metadata_id3v2(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 *pTagSize)
+{
+  *pTagSize = 0;
+  ca_uint8 header[10];
+  ca_result result = ca_metadata_read_exact(pReader, offset, header, sizeof(header));
+  if (result != ca_result_success || memcmp(header, "ID3", 3) != 0)
+  {
+    return result == ca_result_unsupported_format ? ca_result_success : result;
+  }
+
+  ca_uint32 version = header[3];
+  ca_uint8 flags = header[5];
+  ca_uint64 tagSize = ca_metadata_synchsafe32(header + 6);
+  *pTagSize = 10 + tagSize + ((version == 4 && (flags & 0x10) != 0) ? 10 : 0);
+  if (version < 2 || version > 4 || (pReader->flags & (ca_metadata_flag_tags | ca_metadata_flag_pictures)) == 0)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint64 position = offset + 10;
+  ca_uint64 end = position + tagSize;
+
+  // Before v2.4 unsynchronisation covers the frame headers too, so the whole tag is restored first.
+  if ((flags & 0x80) != 0 && version < 4)
+  {
+    ca_uint8 *pTag = (ca_uint8 *)ca_metadata_read_block(pReader, position, tagSize, METADATA_MAX_BLOCK_SIZE, &result);
+    if (pTag == NULL)
+    {
+      return ca_metadata_is_fatal(result) ? result : ca_result_success;
+    }
+
+    pReader->pWindow = pTag;
+    pReader->windowOffset = position;
+    pReader->windowSize = ca_metadata_id3_unsynchronise(pTag, (size_t)tagSize);
+    end = position + pReader->windowSize;
+  }
+
+  if ((flags & 0x40) != 0 && version >= 3)
+  {
+    ca_uint8 extendedHeader[4];
+    result = ca_metadata_read_exact(pReader, position, extendedHeader, sizeof(extendedHeader));
+    position += version == 3 ? ca_metadata_be32(extendedHeader) + 4 : ca_metadata_synchsafe32(extendedHeader);
+  }
+
+  ca_uint32 frameHeaderSize = version == 2 ? 6 : 10;
+  while (result == ca_result_success && position + frameHeaderSize <= end)
+  {
+    ca_uint8 frameHeader[10];
+    result = ca_metadata_read_exact(pReader, position, frameHeader, frameHeaderSize);
+    if (result != ca_result_success || frameHeader[0] == 0)
+    {
+      break;
+    }
+
+    char frameId[5] = {0};
+    memcpy(frameId, frameHeader, version == 2 ? 3 : 4);
+    ca_uint64 frameSize = version == 2 ? ca_metadata_be24(frameHeader + 3) : version == 3 ? ca_metadata_be32(frameHeader + 4) : ca_metadata_synchsafe32(frameHeader + 4);
+    ca_uint32 frameFlags = version == 2 ? 0 : ca_metadata_be16(frameHeader + 8);
+    ca_uint64 contentOffset = position + frameHeaderSize;
+    position = contentOffset + frameSize;
+    if (position > end)
+    {
+      break;
+    }
+
+    // Compressed and encrypted frames are skipped. Grouping ids and data length indicators precede the content.
+    ca_bool isSkipped = version == 3 ? (frameFlags & 0x00C0) != 0 : (frameFlags & 0x000C) != 0;
+    ca_uint64 prefixSize = version == 3 ? ((frameFlags & 0x0020) ? 1 : 0) : ((frameFlags & 0x0040) ? 1 : 0) + ((frameFlags & 0x0001) ? 4 : 0);
+    ca_bool isUnsynchronised = pReader->pWindow != NULL || (version == 4 && ((frameFlags & 0x0002) != 0 || (flags & 0x80) != 0));
+    if (isSkipped || frameSize <= prefixSize)
+    {
+      continue;
+    }
+
+    result = ca_metadata_id3_frame(pReader, frameId, version == 2, contentOffset + prefixSize, frameSize - prefixSize, isUnsynchronised);
+    result = ca_metadata_is_fatal(result) ? result : ca_result_success;
+  }
+
+  pReader->pWindow = NULL;
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// Parses the ID3v1 tag in the last 128 bytes.
+static ca_result ca_metadata_id3v1(ca_metadata_reader *pReader)
+{
+  if (!pReader->isLengthKnown || pReader->length < 128 || (pReader->flags & ca_metadata_flag_tags) == 0)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint8 tag[128];
+  ca_result result = ca_metadata_read_exact(pReader, pReader->length - 128, tag, sizeof(tag));
+  if (result != ca_result_success || memcmp(tag, "TAG", 3) != 0)
+  {
+    return ca_metadata_is_fatal(result) ? result : ca_result_success;
+  }
+
+  const struct
+  {
+    const char *pKey;
+    size_t offset;
+    size_t size;
+  } fields[] = {{"TIT2", 3, 30}, {"TPE1", 33, 30}, {"TALB", 63, 30}, {"TYER", 93, 4}, {"COMM", 97, 30}};
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]) && result == ca_result_success; i++)
+  {
+    result = ca_metadata_add_tag(pReader, fields[i].pKey, ca_metadata_text(pReader, tag + fields[i].offset, fields[i].size));
+  }
+
+  // ID3v1.1 keeps the track number in the last byte of the comment.
+  char number[4];
+  if (result == ca_result_success && tag[125] == 0 && tag[126] != 0)
+  {
+    snprintf(number, sizeof(number), "%u", tag[126]);
+    result = ca_metadata_add_tag(pReader, "TRCK", ca_metadata_text(pReader, (const ca_uint8 *)number, strlen(number)));
+  }
+
+  if (result == ca_result_success && tag[127] < sizeof(metadataGenres) / sizeof(metadataGenres[0]))
+  {
+    result = ca_metadata_add_tag(pReader, "TCON", metadataGenres[tag[127]]);
+  }
+  return result;
+}
+
+// MARK: Vorbis comments
+
+// Parses a comment list as stored in FLAC VORBIS_COMMENT blocks and Ogg comment headers. A truncated list keeps the complete comments.
+static ca_result ca_metadata_vorbis_comments(ca_metadata_reader *pReader, const ca_uint8 *p, size_t size)
+{
+  if (size < 4 || ca_metadata_le32(p) > size - 4)
+  {
+    return ca_result_success;
+  }
+
+  size_t position = 4 + ca_metadata_le32(p);
+  if (position + 4 > size)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint32 count = ca_metadata_le32(p + position);
+  position += 4;
+  ca_result result = ca_result_success;
+  for (ca_uint32 i = 0; i < count && result == ca_result_success && position + 4 <= size; i++)
+  {
+    size_t commentSize = ca_metadata_le32(p + position);
+    position += 4;
+    if (commentSize > size - position)
+    {
+      break;
+    }
+
+    const ca_uint8 *pComment = p + position;
+    position += commentSize;
+    const ca_uint8 *pSeparator = (const ca_uint8 *)memchr(pComment, '=', commentSize);
+    if (pSeparator == NULL)
+    {
+      continue;
+    }
+
+    // Base64 pictures have no location in the file to report.
+    size_t keySize = (size_t)(pSeparator - pComment);
+    if (keySize == 22 && memcmp(pComment, "METADATA_BLOCK_PICTURE", 22) == 0)
+    {
+      continue;
+    }
+
+    char *pKey = ca_metadata_copy_key(pReader, pComment, keySize);
+    result = ca_metadata_add_tag(pReader, pKey, ca_metadata_text(pReader, pSeparator + 1, commentSize - keySize - 1));
+  }
+  return result;
+}
+
+// MARK: FLAC
+
+static ca_result ca_metadata_flac_picture(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 size)
+{
+  ca_uint8 header[8];
+  ca_result result = ca_metadata_read_exact(pReader, offset, header, sizeof(header));
+  ca_uint32 mimeSize = result == ca_result_success ? ca_metadata_be32(header + 4) : 0;
+  if (result != ca_result_success || 8 + (ca_uint64)mimeSize + 4 > size)
+  {
+    return result;
+  }
+
+  ca_uint8 *pMimeType = (ca_uint8 *)ca_metadata_read_block(pReader, offset + 8, mimeSize + 4, 256, &result);
+  if (pMimeType == NULL)
+  {
+    return result;
+  }
+
+  ca_uint64 descriptionSize = ca_metadata_be32(pMimeType + mimeSize);
+  ca_uint64 position = 8 + mimeSize + 4 + descriptionSize;
+  ca_uint8 dimensions[20];
+  if (position + sizeof(dimensions) > size)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  result = ca_metadata_read_exact(pReader, offset + position, dimensions, sizeof(dimensions));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  position += sizeof(dimensions);
+  ca_uint64 dataSize = ca_metadata_be32(dimensions + 16);
+  if (position + dataSize > size)
+  {
+    return ca_result_unsupported_format;
+  }
+  return ca_metadata_add_picture(pReader, offset + position, dataSize, ca_metadata_latin1(pReader, pMimeType, mimeSize), ca_metadata_be32(header));
+}
+
+static void ca_metadata_flac_streaminfo(ca_metadata *pMetadata, const ca_uint8 *p)
+{
+  pMetadata->sampleRate = (ca_metadata_be24(p + 10) >> 4) & 0xFFFFF;
+  pMetadata->channels = ((p[12] >> 1) & 0x7) + 1;
+  pMetadata->length = ((ca_uint64)(p[13] & 0x0F) << 32) | ca_metadata_be32(p + 14);
+}
+
+// Walks the metadata blocks following the fLaC marker at offset.
+static ca_result ca_metadata_flac(ca_metadata_reader *pReader, ca_uint64 offset)
+{
+  ca_uint64 position = offset + 4;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_uint8 header[4];
+    result = ca_metadata_read_exact(pReader, position, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    ca_uint32 blockType = header[0] & 0x7F;
+    ca_uint64 blockSize = ca_metadata_be24(header + 1);
+    ca_uint64 blockOffset = position + 4;
+    position = blockOffset + blockSize;
+    if (blockType == 0 && blockSize >= 34 && (pReader->flags & ca_metadata_flag_duration) != 0)
+    {
+      ca_uint8 streamInfo[34];
+      result = ca_metadata_read_exact(pReader, blockOffset, streamInfo, sizeof(streamInfo));
+      if (result == ca_result_success)
+      {
+        ca_metadata_flac_streaminfo(pReader->pMetadata, streamInfo);
+      }
+    }
+    else if (blockType == 4 && (pReader->flags & ca_metadata_flag_tags) != 0)
+    {
+      const ca_uint8 *pBlock = ca_metadata_read_block(pReader, blockOffset, blockSize, METADATA_MAX_BLOCK_SIZE, &result);
+      if (pBlock != NULL)
+      {
+        result = ca_metadata_vorbis_comments(pReader, pBlock, (size_t)blockSize);
+      }
+    }
+    else if (blockType == 6 && (pReader->flags & ca_metadata_flag_pictures) != 0)
+    {
+      result = ca_metadata_flac_picture(pReader, blockOffset, blockSize);
+    }
+
+    result = ca_metadata_is_fatal(result) ? result : ca_result_success;
+    if ((header[0] & 0x80) != 0)
+    {
+      break;
+    }
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// MARK: Ogg
+
+typedef struct
+{
+  ca_uint64 granulePosition;
+  ca_uint32 serial;
+  ca_uint32 segmentCount;
+  ca_uint8 segments[255];
+  ca_uint64 bodyOffset;
+  ca_uint64 bodySize;
+} ca_metadata_ogg_page;
+
+static ca_result ca_metadata_ogg_read_page(ca_metadata_reader *pReader, ca_uint64 offset, ca_metadata_ogg_page *pPage)
+{
+  ca_uint8 header[27];
+  ca_result result = ca_metadata_read_exact(pReader, offset, header, sizeof(header));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  if (memcmp(header, "OggS", 4) != 0)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  pPage->granulePosition = ca_metadata_le64(header + 6);
+  pPage->serial = ca_metadata_le32(header + 14);
+  pPage->segmentCount = header[26];
+  result = ca_metadata_read_exact(pReader, offset + 27, pPage->segments, pPage->segmentCount);
+  pPage->bodyOffset = offset + 27 + pPage->segmentCount;
+  pPage->bodySize = 0;
+  for (ca_uint32 i = 0; i < pPage->segmentCount; i++)
+  {
+    pPage->bodySize += pPage->segments[i];
+  }
+  return result;
+}
+
+// Collects the second packet of the first logical stream, which carries the comment header.
+static const ca_uint8 *ca_metadata_ogg_comment_packet(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint32 serial, size_t *pSize, ca_result *pResult)
+{
+  ca_uint8 *pPacket = NULL;
+  size_t packetSize = 0;
+  size_t packetCapacity = 0;
+  ca_uint32 packetIndex = 0;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT; i++)
+  {
+    ca_metadata_ogg_page page;
+    *pResult = ca_metadata_ogg_read_page(pReader, offset, &page);
+    if (*pResult != ca_result_success)
+    {
+      break;
+    }
+
+    offset = page.bodyOffset + page.bodySize;
+    if (page.serial != serial)
+    {
+      continue;
+    }
+
+    ca_uint64 segmentOffset = page.bodyOffset;
+    for (ca_uint32 j = 0; j < page.segmentCount; j++)
+    {
+      ca_uint32 segmentSize = page.segments[j];
+      if (packetIndex == 1 && segmentSize > 0)
+      {
+        // A comment packet over the limit is cut, the comment parser keeps what is complete.
+        ca_uint32 copySize = (ca_uint32)ca_min((size_t)segmentSize, METADATA_MAX_BLOCK_SIZE - packetSize);
+        if (packetSize + copySize > packetCapacity)
+        {
+          size_t capacity = ca_min(ca_max(ca_max(packetCapacity * 2, (size_t)page.bodySize), packetSize + copySize), (size_t)METADATA_MAX_BLOCK_SIZE);
+          ca_uint8 *pGrown = (ca_uint8 *)ca_arena_alloc(pReader->pArena, capacity);
+          if (pGrown == NULL)
+          {
+            *pResult = ca_result_out_of_memory;
+            return NULL;
+          }
+
+          if (packetSize > 0)
+          {
+            memcpy(pGrown, pPacket, packetSize);
+          }
+          pPacket = pGrown;
+          packetCapacity = capacity;
+        }
+
+        *pResult = ca_metadata_read_exact(pReader, segmentOffset, pPacket + packetSize, copySize);
+        if (*pResult != ca_result_success)
+        {
+          return NULL;
+        }
+        packetSize += copySize;
+      }
+
+      segmentOffset += segmentSize;
+      if (segmentSize < 255)
+      {
+        packetIndex++;
+      }
+
+      if (packetIndex == 2 || packetSize == METADATA_MAX_BLOCK_SIZE)
+      {
+        *pSize = packetSize;
+        return pPacket;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Takes the duration from the granule position of the last page of the stream.
+static ca_result ca_metadata_ogg_length(ca_metadata_reader *pReader, ca_uint32 serial, ca_uint64 *pGranulePosition)
+{
+  *pGranulePosition = 0;
+  if (!pReader->isLengthKnown)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint64 tailSize = ca_min(pReader->length, (ca_uint64)METADATA_OGG_TAIL_SIZE);
+  ca_result result = ca_result_success;
+  const ca_uint8 *pTail = ca_metadata_read_block(pReader, pReader->length - tailSize, tailSize, METADATA_OGG_TAIL_SIZE, &result);
+  if (pTail == NULL)
+  {
+    return result;
+  }
+
+  for (size_t i = tailSize >= 27 ? (size_t)tailSize - 27 + 1 : 0; i > 0; i--)
+  {
+    const ca_uint8 *p = pTail + i - 1;
+    ca_uint64 granulePosition = ca_metadata_le64(p + 6);
+    if (memcmp(p, "OggS", 4) == 0 && ca_metadata_le32(p + 14) == serial && granulePosition != 0xFFFFFFFFFFFFFFFFULL)
+    {
+      *pGranulePosition = granulePosition;
+      break;
+    }
+  }
+  return ca_result_success;
+}
+
+static ca_result ca_metadata_ogg(ca_metadata_reader *pReader)
+{
+  ca_metadata *pMetadata = pReader->pMetadata;
+  ca_metadata_ogg_page page;
+  ca_result result = ca_metadata_ogg_read_page(pReader, 0, &page);
+  ca_uint8 packet[64] = {0};
+  if (result == ca_result_success)
+  {
+    ca_uint32 packetSize = 0;
+    result = ca_metadata_read_at(pReader, page.bodyOffset, packet, (ca_uint32)ca_min(page.bodySize, (ca_uint64)sizeof(packet)), &packetSize);
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The comment header starts with the codec's packet signature. Ogg FLAC carries a FLAC metadata block header instead.
+  size_t commentPrefixSize = 0;
+  ca_uint64 preSkip = 0;
+  if (memcmp(packet, "\x01vorbis", 7) == 0)
+  {
+    pMetadata->channels = packet[11];
+    pMetadata->sampleRate = ca_metadata_le32(packet + 12);
+    commentPrefixSize = 7;
+  }
+  else if (memcmp(packet, "OpusHead", 8) == 0)
+  {
+    pMetadata->channels = packet[9];
+    pMetadata->sampleRate = 48000;
+    preSkip = ca_metadata_le16(packet + 10);
+    commentPrefixSize = 8;
+  }
+  else if (memcmp(packet, "\x7F" "FLAC", 5) == 0 && memcmp(packet + 9, "fLaC", 4) == 0)
+  {
+    ca_metadata_flac_streaminfo(pMetadata, packet + 17);
+    commentPrefixSize = 4;
+  }
+  else
+  {
+    return ca_result_unsupported_format;
+  }
+
+  if ((pReader->flags & ca_metadata_flag_tags) != 0)
+  {
+    size_t commentSize = 0;
+    const ca_uint8 *pComments = ca_metadata_ogg_comment_packet(pReader, 0, page.serial, &commentSize, &result);
+    if (pComments != NULL && commentSize > commentPrefixSize)
+    {
+      result = ca_metadata_vorbis_comments(pReader, pComments + commentPrefixSize, commentSize - commentPrefixSize);
+    }
+
+    if (ca_metadata_is_fatal(result))
+    {
+      return result;
+    }
+  }
+
+  if ((pReader->flags & ca_metadata_flag_duration) != 0)
+  {
+    ca_uint64 granulePosition = 0;
+    result = ca_metadata_ogg_length(pReader, page.serial, &granulePosition);
+    pMetadata->length = granulePosition > preSkip ? granulePosition - preSkip : pMetadata->length;
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// MARK: MP4
+
+typedef struct
+{
+  ca_uint8 type[4];
+  ca_uint64 offset;
+  ca_uint64 contentOffset;
+  ca_uint64 end;
+} ca_metadata_mp4_box;
+
+static ca_result ca_metadata_mp4_read_box(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 parentEnd, ca_metadata_mp4_box *pBox)
+{
+  ca_uint8 header[16];
+  if (offset + 8 > parentEnd)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_result result = ca_metadata_read_exact(pReader, offset, header, 8);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint64 size = ca_metadata_be32(header);
+  ca_uint64 headerSize = 8;
+  if (size == 1)
+  {
+    result = ca_metadata_read_exact(pReader, offset + 8, header + 8, 8);
+    size = ca_metadata_be64(header + 8);
+    headerSize = 16;
+  }
+  else if (size == 0)
+  {
+    size = parentEnd - offset;
+  }
+
+  if (result != ca_result_success || size < headerSize || size > parentEnd - offset)
+  {
+    return result != ca_result_success ? result : ca_result_unsupported_format;
+  }
+
+  memcpy(pBox->type, header + 4, 4);
+  pBox->offset = offset;
+  pBox->contentOffset = offset + headerSize;
+  pBox->end = offset + size;
+  return ca_result_success;
+}
+
+// Finds the first child box of the given type.
+static ca_result ca_metadata_mp4_find_box(ca_metadata_reader *pReader, const ca_metadata_mp4_box *pParent, ca_uint64 contentOffset, const char *pType, ca_metadata_mp4_box *pBox)
+{
+  ca_uint64 offset = contentOffset;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT; i++)
+  {
+    ca_result result = ca_metadata_mp4_read_box(pReader, offset, pParent->end, pBox);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (memcmp(pBox->type, pType, 4) == 0)
+    {
+      return ca_result_success;
+    }
+    offset = pBox->end;
+  }
+  return ca_result_unsupported_format;
+}
+
+static char *ca_metadata_mp4_key(ca_metadata_reader *pReader, const ca_uint8 *pType)
+{
+  // Apple's item atoms start with the copyright sign in Mac OS Roman.
+  if (pType[0] == 0xA9)
+  {
+    char *pKey = ca_metadata_alloc_string(pReader, 5);
+    if (pKey != NULL)
+    {
+      pKey[0] = (char)0xC2;
+      pKey[1] = (char)0xA9;
+      memcpy(pKey + 2, pType + 1, 3);
+    }
+    return pKey;
+  }
+  return ca_metadata_text(pReader, pType, 4);
+}
+
+// Converts a data atom value to text. Track and disc pairs become "3/12", genre indices resolve through the ID3v1 list.
+static char *ca_metadata_mp4_value(ca_metadata_reader *pReader, const ca_uint8 *pItemType, ca_uint32 dataType, const ca_uint8 *p, size_t size)
+{
+  char number[32];
+  if (dataType == 1)
+  {
+    return ca_metadata_text(pReader, p, size);
+  }
+
+  if (dataType == 2)
+  {
+    return ca_metadata_utf16(pReader, p, size, CA_TRUE);
+  }
+
+  if (dataType == 0 && (memcmp(pItemType, "trkn", 4) == 0 || memcmp(pItemType, "disk", 4) == 0) && size >= 6)
+  {
+    ca_uint32 count = ca_metadata_be16(p + 4);
+    if (count > 0)
+    {
+      snprintf(number, sizeof(number), "%u/%u", ca_metadata_be16(p + 2), count);
+    }
+    else
+    {
+      snprintf(number, sizeof(number), "%u", ca_metadata_be16(p + 2));
+    }
+    return ca_metadata_text(pReader, (const ca_uint8 *)number, strlen(number));
+  }
+
+  if (dataType == 0 && memcmp(pItemType, "gnre", 4) == 0 && size >= 2)
+  {
+    ca_uint32 index = ca_metadata_be16(p);
+    const char *pGenre = index > 0 && index <= sizeof(metadataGenres) / sizeof(metadataGenres[0]) ? metadataGenres[index - 1] : "";
+    return ca_metadata_text(pReader, (const ca_uint8 *)pGenre, strlen(pGenre));
+  }
+
+  // Big-endian signed integers of 1 to 8 bytes, e.g. tmpo and cpil.
+  if ((dataType == 21 || dataType == 22) && size >= 1 && size <= 8)
+  {
+    ca_int64 value = dataType == 21 && (p[0] & 0x80) != 0 ? -1 : 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      value = (ca_int64)(((ca_uint64)value << 8) | p[i]);
+    }
+    snprintf(number, sizeof(number), "%lld", value);
+    return ca_metadata_text(pReader, (const ca_uint8 *)number, strlen(number));
+  }
+  return NULL;
+}
+
+static ca_result ca_metadata_mp4_item(ca_metadata_reader *pReader, const ca_metadata_mp4_box *pItem)
+{
+  const char *pKey = NULL;
+  ca_uint64 offset = pItem->contentOffset;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_metadata_mp4_box box;
+    result = ca_metadata_mp4_read_box(pReader, offset, pItem->end, &box);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+    offset = box.end;
+
+    // Freeform items are keyed by their name atom.
+    if (memcmp(box.type, "name", 4) == 0 && box.end - box.contentOffset > 4)
+    {
+      const ca_uint8 *pName = ca_metadata_read_block(pReader, box.contentOffset + 4, box.end - box.contentOffset - 4, 256, &result);
+      pKey = pName != NULL ? ca_metadata_text(pReader, pName, (size_t)(box.end - box.contentOffset - 4)) : NULL;
+      continue;
+    }
+
+    if (memcmp(box.type, "data", 4) != 0 || box.end - box.contentOffset < 8)
+    {
+      continue;
+    }
+
+    ca_uint8 dataHeader[8];
+    result = ca_metadata_read_exact(pReader, box.contentOffset, dataHeader, sizeof(dataHeader));
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    ca_uint32 dataType = ca_metadata_be24(dataHeader + 1);
+    ca_uint64 valueOffset = box.contentOffset + 8;
+    ca_uint64 valueSize = box.end - valueOffset;
+    if (memcmp(pItem->type, "covr", 4) == 0)
+    {
+      if ((pReader->flags & ca_metadata_flag_pictures) != 0)
+      {
+        const char *pMimeType = dataType == 14 ? "image/png" : dataType == 27 ? "image/bmp" : "image/jpeg";
+        result = ca_metadata_add_picture(pReader, valueOffset, valueSize, pMimeType, METADATA_PICTURE_TYPE_FRONT_COVER);
+      }
+      continue;
+    }
+
+    if ((pReader->flags & ca_metadata_flag_tags) == 0)
+    {
+      continue;
+    }
+
+    const ca_uint8 *pValue = ca_metadata_read_block(pReader, valueOffset, valueSize, METADATA_MAX_TEXT_SIZE, &result);
+    if (pValue == NULL)
+    {
+      continue;
+    }
+
+    if (pKey == NULL)
+    {
+      pKey = ca_metadata_mp4_key(pReader, pItem->type);
+    }
+
+    char *pText = ca_metadata_mp4_value(pReader, pItem->type, dataType, pValue, (size_t)valueSize);
+    if (pText != NULL)
+    {
+      result = ca_metadata_add_tag(pReader, pKey, pText);
+    }
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+static ca_result ca_metadata_mp4_meta(ca_metadata_reader *pReader, const ca_metadata_mp4_box *pMeta)
+{
+  // ISO meta boxes are full boxes, QuickTime ones start with their children right away.
+  ca_uint8 peek[8];
+  ca_result result = ca_metadata_read_exact(pReader, pMeta->contentOffset, peek, sizeof(peek));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_metadata_mp4_box ilst;
+  ca_uint64 childOffset = pMeta->contentOffset + (memcmp(peek + 4, "hdlr", 4) == 0 ? 0 : 4);
+  result = ca_metadata_mp4_find_box(pReader, pMeta, childOffset, "ilst", &ilst);
+  ca_uint64 offset = result == ca_result_success ? ilst.contentOffset : 0;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_metadata_mp4_box item;
+    result = ca_metadata_mp4_read_box(pReader, offset, ilst.end, &item);
+    if (result == ca_result_success)
+    {
+      result = ca_metadata_mp4_item(pReader, &item);
+      offset = item.end;
+    }
+  }
+  return result;
+}
+
+// Takes the format and duration from the first sound track.
+static ca_result ca_metadata_mp4_trak(ca_metadata_reader *pReader, const ca_metadata_mp4_box *pTrak)
+{
+  ca_metadata *pMetadata = pReader->pMetadata;
+  ca_metadata_mp4_box mdia, hdlr, mdhd, minf, stbl, stsd;
+  ca_result result = ca_metadata_mp4_find_box(pReader, pTrak, pTrak->contentOffset, "mdia", &mdia);
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_mp4_find_box(pReader, &mdia, mdia.contentOffset, "hdlr", &hdlr);
+  }
+
+  ca_uint8 handler[12];
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_read_exact(pReader, hdlr.contentOffset, handler, sizeof(handler));
+  }
+
+  if (result != ca_result_success || memcmp(handler + 8, "soun", 4) != 0)
+  {
+    return result;
+  }
+
+  ca_uint8 mediaHeader[32];
+  result = ca_metadata_mp4_find_box(pReader, &mdia, mdia.contentOffset, "mdhd", &mdhd);
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_read_exact(pReader, mdhd.contentOffset, mediaHeader, (ca_uint32)ca_min(mdhd.end - mdhd.contentOffset, (ca_uint64)sizeof(mediaHeader)));
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_bool isVersion1 = mediaHeader[0] == 1;
+  ca_uint32 timescale = isVersion1 ? ca_metadata_be32(mediaHeader + 20) : ca_metadata_be32(mediaHeader + 12);
+  ca_uint64 duration = isVersion1 ? ca_metadata_be64(mediaHeader + 24) : ca_metadata_be32(mediaHeader + 16);
+  pMetadata->sampleRate = timescale;
+
+  // The sample entry has the channel count and the 16.16 sample rate, which can differ from the media timescale.
+  ca_uint8 entry[36];
+  result = ca_metadata_mp4_find_box(pReader, &mdia, mdia.contentOffset, "minf", &minf);
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_mp4_find_box(pReader, &minf, minf.contentOffset, "stbl", &stbl);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_mp4_find_box(pReader, &stbl, stbl.contentOffset, "stsd", &stsd);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_read_exact(pReader, stsd.contentOffset + 8, entry, sizeof(entry));
+  }
+
+  if (result == ca_result_success)
+  {
+    pMetadata->channels = ca_metadata_be16(entry + 24);
+    pMetadata->sampleRate = ca_metadata_be32(entry + 32) >> 16;
+  }
+
+  if (timescale > 0 && pMetadata->sampleRate > 0)
+  {
+    pMetadata->length = (ca_uint64)((double)duration * pMetadata->sampleRate / timescale + 0.5);
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+static ca_result ca_metadata_mp4_moov(ca_metadata_reader *pReader, const ca_metadata_mp4_box *pMoov)
+{
+  ca_bool hasTrack = CA_FALSE;
+  ca_uint64 offset = pMoov->contentOffset;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_metadata_mp4_box box;
+    result = ca_metadata_mp4_read_box(pReader, offset, pMoov->end, &box);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+    offset = box.end;
+
+    ca_bool isTagged = (pReader->flags & (ca_metadata_flag_tags | ca_metadata_flag_pictures)) != 0;
+    if (memcmp(box.type, "trak", 4) == 0 && !hasTrack && (pReader->flags & ca_metadata_flag_duration) != 0)
+    {
+      result = ca_metadata_mp4_trak(pReader, &box);
+      hasTrack = pReader->pMetadata->sampleRate > 0;
+    }
+    else if (memcmp(box.type, "udta", 4) == 0 && isTagged)
+    {
+      ca_metadata_mp4_box meta;
+      result = ca_metadata_mp4_find_box(pReader, &box, box.contentOffset, "meta", &meta);
+      if (result == ca_result_success)
+      {
+        result = ca_metadata_mp4_meta(pReader, &meta);
+      }
+    }
+    else if (memcmp(box.type, "meta", 4) == 0 && isTagged)
+    {
+      result = ca_metadata_mp4_meta(pReader, &box);
+    }
+
+    result = ca_metadata_is_fatal(result) ? result : ca_result_success;
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// Walks the top-level boxes by their headers, so a moov box after the media data costs a few seeks.
+static ca_result ca_metadata_mp4(ca_metadata_reader *pReader)
+{
+  ca_metadata_mp4_box file = {{0}, 0, 0, pReader->isLengthKnown ? pReader->length : 0xFFFFFFFFFFFFFFFFULL};
+  ca_uint64 offset = 0;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_metadata_mp4_box box;
+    result = ca_metadata_mp4_read_box(pReader, offset, file.end, &box);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    if (memcmp(box.type, "moov", 4) == 0)
+    {
+      return ca_metadata_mp4_moov(pReader, &box);
+    }
+    offset = box.end;
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// MARK: RIFF and AIFF
+
+static ca_result ca_metadata_riff_info(ca_metadata_reader *pReader, ca_uint64 offset, ca_uint64 end)
+{
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success && offset + 8 <= end; i++)
+  {
+    ca_uint8 header[8];
+    result = ca_metadata_read_exact(pReader, offset, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    ca_uint64 size = ca_metadata_le32(header + 4);
+    const ca_uint8 *pValue = ca_metadata_read_block(pReader, offset + 8, ca_min(size, end - offset - 8), METADATA_MAX_TEXT_SIZE, &result);
+    if (pValue != NULL)
+    {
+      result = ca_metadata_add_tag(pReader, ca_metadata_copy_key(pReader, header, 4), ca_metadata_text(pReader, pValue, (size_t)ca_min(size, end - offset - 8)));
+    }
+
+    result = ca_metadata_is_fatal(result) ? result : ca_result_success;
+    offset += 8 + size + (size & 1);
+  }
+  return result;
+}
+
+static double ca_metadata_extended_float(const ca_uint8 *p)
+{
+  int exponent = (int)(ca_metadata_be16(p) & 0x7FFF);
+  double value = ldexp((double)ca_metadata_be64(p + 2), exponent - 16383 - 63);
+  return (p[0] & 0x80) != 0 ? -value : value;
+}
+
+// Walks the chunks of a RIFF WAVE, RF64 or AIFF file.
+static ca_result ca_metadata_chunks(ca_metadata_reader *pReader, ca_bool isAiff, ca_bool isRF64)
+{
+  ca_metadata *pMetadata = pReader->pMetadata;
+  ca_uint64 offset = 12;
+  ca_uint64 dataSize = 0;
+  ca_uint64 ds64DataSize = 0;
+  ca_uint32 blockAlign = 0;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < METADATA_MAX_CHUNK_COUNT && result == ca_result_success; i++)
+  {
+    ca_uint8 header[8];
+    result = ca_metadata_read_exact(pReader, offset, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    ca_uint64 chunkSize = isAiff ? ca_metadata_be32(header + 4) : ca_metadata_le32(header + 4);
+    ca_uint64 chunkOffset = offset + 8;
+    ca_uint8 content[24] = {0};
+    ca_uint32 contentSize = 0;
+    result = ca_metadata_read_at(pReader, chunkOffset, content, (ca_uint32)ca_min(chunkSize, (ca_uint64)sizeof(content)), &contentSize);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+
+    if (!isAiff && memcmp(header, "ds64", 4) == 0 && isRF64)
+    {
+      ds64DataSize = ca_metadata_le64(content + 8);
+    }
+    else if (!isAiff && memcmp(header, "fmt ", 4) == 0)
+    {
+      pMetadata->channels = ca_metadata_le16(content + 2);
+      pMetadata->sampleRate = ca_metadata_le32(content + 4);
+      blockAlign = ca_metadata_le16(content + 12);
+    }
+    else if (!isAiff && memcmp(header, "data", 4) == 0)
+    {
+      dataSize = chunkSize == 0xFFFFFFFF && isRF64 ? ds64DataSize : chunkSize;
+      chunkSize = dataSize;
+    }
+    else if (!isAiff && memcmp(header, "LIST", 4) == 0 && memcmp(content, "INFO", 4) == 0 && (pReader->flags & ca_metadata_flag_tags) != 0)
+    {
+      result = ca_metadata_riff_info(pReader, chunkOffset + 4, chunkOffset + chunkSize);
+    }
+    else if (isAiff && memcmp(header, "COMM", 4) == 0)
+    {
+      pMetadata->channels = ca_metadata_be16(content);
+      pMetadata->length = ca_metadata_be32(content + 2);
+      pMetadata->sampleRate = (ca_uint32)(ca_metadata_extended_float(content + 8) + 0.5);
+    }
+    else if (isAiff && (memcmp(header, "NAME", 4) == 0 || memcmp(header, "AUTH", 4) == 0 || memcmp(header, "ANNO", 4) == 0) && (pReader->flags & ca_metadata_flag_tags) != 0)
+    {
+      const ca_uint8 *pValue = ca_metadata_read_block(pReader, chunkOffset, chunkSize, METADATA_MAX_TEXT_SIZE, &result);
+      if (pValue != NULL)
+      {
+        result = ca_metadata_add_tag(pReader, ca_metadata_copy_key(pReader, header, 4), ca_metadata_text(pReader, pValue, (size_t)chunkSize));
+      }
+    }
+    else if (memcmp(header, "id3 ", 4) == 0 || memcmp(header, "ID3 ", 4) == 0)
+    {
+      ca_uint64 tagSize = 0;
+      result = ca_metadata_id3v2(pReader, chunkOffset, &tagSize);
+    }
+
+    result = ca_metadata_is_fatal(result) ? result : ca_result_success;
+    offset = chunkOffset + chunkSize + (chunkSize & 1);
+  }
+
+  if (!isAiff && blockAlign > 0)
+  {
+    pMetadata->length = dataSize / blockAlign;
+  }
+  return ca_metadata_is_fatal(result) ? result : ca_result_success;
+}
+
+// MARK: API
+
+ca_result ca_metadata_read(ca_source source, ca_uint32 flags, ca_arena *pArena, ca_metadata *pMetadata)
+{
+  if (source.pReadProc == NULL || source.pSeekProc == NULL || pArena == NULL || pMetadata == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_zero_memory(pMetadata);
+  ca_metadata_reader reader = {0};
+  reader.source = source;
+  reader.flags = flags;
+  reader.pArena = pArena;
+  reader.pMetadata = pMetadata;
+  reader.position = 0xFFFFFFFFFFFFFFFFULL;
+
+  ca_uint64 position = 0;
+  if (source.pTellProc != NULL && source.pTellProc(&position, &reader.length, source.pUserData) == ca_tell_result_success)
+  {
+    reader.isLengthKnown = CA_TRUE;
+  }
+
+  // ID3v2 tags are prepended to MP3 and ADTS streams and sometimes to FLAC files.
+  ca_uint64 offset = 0;
+  ca_result result = ca_result_success;
+  for (int i = 0; i < 4 && result == ca_result_success; i++)
+  {
+    ca_uint64 tagSize = 0;
+    result = ca_metadata_id3v2(&reader, offset, &tagSize);
+    offset += tagSize;
+    if (tagSize == 0)
+    {
+      break;
+    }
+  }
+
+  ca_uint8 header[12] = {0};
+  ca_uint32 headerSize = 0;
+  if (result == ca_result_success)
+  {
+    result = ca_metadata_read_at(&reader, offset, header, sizeof(header), &headerSize);
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  if (headerSize >= 4 && memcmp(header, "fLaC", 4) == 0)
+  {
+    pMetadata->container = ca_metadata_container_flac;
+    return ca_metadata_flac(&reader, offset);
+  }
+
+  if (headerSize >= 2 && header[0] == 0xFF && (header[1] & 0xE0) == 0xE0)
+  {
+    pMetadata->container = (header[1] & 0x06) == 0 ? ca_metadata_container_adts : ca_metadata_container_mp3;
+    return pMetadata->tagCount == 0 ? ca_metadata_id3v1(&reader) : ca_result_success;
+  }
+
+  if (offset > 0 || headerSize < 12)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  if (memcmp(header, "OggS", 4) == 0)
+  {
+    pMetadata->container = ca_metadata_container_ogg;
+    return ca_metadata_ogg(&reader);
+  }
+
+  if (memcmp(header + 4, "ftyp", 4) == 0)
+  {
+    pMetadata->container = ca_metadata_container_mp4;
+    return ca_metadata_mp4(&reader);
+  }
+
+  if ((memcmp(header, "RIFF", 4) == 0 || memcmp(header, "RF64", 4) == 0) && memcmp(header + 8, "WAVE", 4) == 0)
+  {
+    pMetadata->container = ca_metadata_container_wav;
+    return ca_metadata_chunks(&reader, CA_FALSE, memcmp(header, "RF64", 4) == 0);
+  }
+
+  if (memcmp(header, "FORM", 4) == 0 && (memcmp(header + 8, "AIFF", 4) == 0 || memcmp(header + 8, "AIFC", 4) == 0))
+  {
+    pMetadata->container = ca_metadata_container_aiff;
+    return ca_metadata_chunks(&reader, CA_TRUE, CA_FALSE);
+  }
+
+  return ca_result_unsupported_format;
+}
+
+typedef struct
+{
+  const ca_source *pSources;
+  ca_uint32 sourceCount;
+  ca_uint32 flags;
+  ca_metadata_read_proc pReadProc;
+  void *pUserData;
+
+  pthread_mutex_t lock;
+  ca_uint32 nextIndex;
+} ca_metadata_batch;
+
+// Each job is one worker taking sources until none are left, so its arena is reused across sources.
+static void ca_metadata_batch_job(void *pJobData)
+{
+  ca_metadata_batch *pBatch = (ca_metadata_batch *)pJobData;
+  ca_arena arena;
+  ca_result arenaResult = ca_arena_init(&arena, METADATA_ARENA_BLOCK_SIZE);
+  for (;;)
+  {
+    pthread_mutex_lock(&pBatch->lock);
+    ca_uint32 index = pBatch->nextIndex;
+    pBatch->nextIndex += index < pBatch->sourceCount ? 1 : 0;
+    pthread_mutex_unlock(&pBatch->lock);
+    if (index >= pBatch->sourceCount)
+    {
+      break;
+    }
+
+    if (arenaResult != ca_result_success)
+    {
+      pBatch->pReadProc(index, arenaResult, NULL, pBatch->pUserData);
+      continue;
+    }
+
+    ca_metadata metadata;
+    ca_result result = ca_metadata_read(pBatch->pSources[index], pBatch->flags, &arena, &metadata);
+    pBatch->pReadProc(index, result, &metadata, pBatch->pUserData);
+    ca_arena_reset(&arena);
+  }
+
+  if (arenaResult == ca_result_success)
+  {
+    ca_arena_uninit(&arena);
+  }
+}
+
+ca_result ca_metadata_read_batch(const ca_source *pSources, ca_uint32 sourceCount, ca_uint32 flags, ca_uint32 threadCount, ca_metadata_read_proc pReadProc, void *pUserData)
+{
+  if ((pSources == NULL && sourceCount > 0) || pReadProc == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_thread_pool pool;
+  ca_result result = ca_thread_pool_init(&pool, threadCount);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_metadata_batch batch;
+  batch.pSources = pSources;
+  batch.sourceCount = sourceCount;
+  batch.flags = flags;
+  batch.pReadProc = pReadProc;
+  batch.pUserData = pUserData;
+  batch.nextIndex = 0;
+  pthread_mutex_init(&batch.lock, NULL);
+
+  ca_uint32 jobCount = ca_min(pool.threadCount, sourceCount);
+  for (ca_uint32 i = 0; i < jobCount && result == ca_result_success; i++)
+  {
+    result = ca_thread_pool_submit(&pool, ca_metadata_batch_job, &batch);
+  }
+
+  // A job that could not be queued leaves its share to the others, so every source is still read.
+  ca_thread_pool_wait(&pool);
+  ca_thread_pool_uninit(&pool);
+  pthread_mutex_destroy(&batch.lock);
+  return batch.nextIndex == sourceCount ? ca_result_success : result;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ca_arena.h"
+#include "ca_io.h"
+
+typedef enum
+{
+  ca_metadata_flag_tags = 1 << 0,
+  ca_metadata_flag_pictures = 1 << 1,
+  ca_metadata_flag_duration = 1 << 2,
+  ca_metadata_flag_all = 0x7,
+} ca_metadata_flag;
+
+typedef enum
+{
+  ca_metadata_container_unknown = 0,
+  ca_metadata_container_mp3 = 1,
+  ca_metadata_container_flac = 2,
+  ca_metadata_container_ogg = 3,
+  ca_metadata_container_mp4 = 4,
+  ca_metadata_container_wav = 5,
+  ca_metadata_container_aiff = 6,
+  ca_metadata_container_adts = 7,
+} ca_metadata_container;
+
+// A tag as stored in the file. The key is the ID3v2 frame id, the Vorbis comment field name, the MP4 item atom or the RIFF INFO id.
+typedef struct
+{
+  const char *pKey;
+  const char *pValue;
+} ca_metadata_tag;
+
+// Embedded artwork is located, not copied. The picture bytes are at offset in the source.
+typedef struct
+{
+  ca_uint64 offset;
+  ca_uint64 length;
+  const char *pMimeType;
+  ca_uint32 pictureType;
+} ca_metadata_picture;
+
+// Strings are UTF-8 and NULL when absent. They and the arrays live in the arena passed to ca_metadata_read.
+typedef struct
+{
+  ca_metadata_container container;
+
+  const char *pTitle;
+  const char *pArtist;
+  const char *pAlbum;
+  const char *pAlbumArtist;
+  const char *pGenre;
+  const char *pDate;
+  const char *pComment;
+  ca_uint32 trackNumber;
+  ca_uint32 trackCount;
+  ca_uint32 discNumber;
+  ca_uint32 discCount;
+
+  ca_metadata_tag *pTags;
+  ca_uint32 tagCount;
+
+  ca_metadata_picture *pPictures;
+  ca_uint32 pictureCount;
+
+  // Taken from the container headers. Zero when the container does not record them.
+  ca_uint32 sampleRate;
+  ca_uint32 channels;
+  ca_uint64 length;
+} ca_metadata;
+
+// Reads the tags, the artwork locations and the duration selected by flags without decoding any audio.
+// Only the tag blocks and headers are read, so the source has to be seekable.
+FFI_PLUGIN_EXPORT ca_result ca_metadata_read(ca_source source, ca_uint32 flags, ca_arena *pArena, ca_metadata *pMetadata);
+
+// Called on a worker thread for each source of a batch. pMetadata is only valid during the call.
+typedef void (*ca_metadata_read_proc)(ca_uint32 index, ca_result result, const ca_metadata *pMetadata, void *pUserData);
+
+// Reads the sources on threadCount threads, zero using one thread per CPU core. Each thread reuses its own arena.
+// The source procs and pReadProc are called on the worker threads. Returns after every source was read.
+FFI_PLUGIN_EXPORT ca_result ca_metadata_read_batch(const ca_source *pSources, ca_uint32 sourceCount, ca_uint32 flags, ca_uint32 threadCount, ca_metadata_read_proc pReadProc, void *pUserData);
@@ -0,0 +1,122 @@
+#include "ca_miniaudio.h"
+
+#include "miniaudio/miniaudio.c"
+
+// A read-only stream over the header followed by the frames, so the frames do not have to be copied next to the header.
+typedef struct
+{
+  const ma_uint8 *pHeader;
+  size_t headerSize;
+  const ma_uint8 *pFrames;
+  size_t framesSize;
+  size_t position;
+} ca_miniaudio_flac_stream;
+
+static size_t ca_miniaudio_flac_on_read(void *pUserData, void *pBufferOut, size_t bytesToRead)
+{
+  ca_miniaudio_flac_stream *pStream = (ca_miniaudio_flac_stream *)pUserData;
+  size_t totalSize = pStream->headerSize + pStream->framesSize;
+  size_t bytesRead = 0;
+  while (bytesRead < bytesToRead && pStream->position < totalSize)
+  {
+    const ma_uint8 *pSource;
+    size_t available;
+    if (pStream->position < pStream->headerSize)
+    {
+      pSource = pStream->pHeader + pStream->position;
+      available = pStream->headerSize - pStream->position;
+    }
+    else
+    {
+      pSource = pStream->pFrames + (pStream->position - pStream->headerSize);
+      available = totalSize - pStream->position;
+    }
+
+    size_t size = ma_min(available, bytesToRead - bytesRead);
+    memcpy((ma_uint8 *)pBufferOut + bytesRead, pSource, size);
+    bytesRead += size;
+    pStream->position += size;
+  }
+  return bytesRead;
+}
+
+static ma_bool32 ca_miniaudio_flac_on_seek(void *pUserData, int offset, ma_dr_flac_seek_origin origin)
+{
+  ca_miniaudio_flac_stream *pStream = (ca_miniaudio_flac_stream *)pUserData;
+  size_t base = origin == ma_dr_flac_seek_origin_current ? pStream->position : 0;
+  if (offset < 0 || base + (size_t)offset > pStream->headerSize + pStream->framesSize)
+  {
+    return MA_FALSE;
+  }
+
+  pStream->position = base + (size_t)offset;
+  return MA_TRUE;
+}
+
+ca_uint64 ca_miniaudio_decode_flac_frames(const void *pHeader, size_t headerSize, const void *pFrames, size_t framesSize, ca_uint64 frameCount, ca_sample_format format, void *pSamplesOut)
+{
+  ca_miniaudio_flac_stream stream = {
+      .pHeader = (const ma_uint8 *)pHeader,
+      .headerSize = headerSize,
+      .pFrames = (const ma_uint8 *)pFrames,
+      .framesSize = framesSize,
+      .position = 0,
+  };
+
+  ma_dr_flac *pFlac = ma_dr_flac_open(ca_miniaudio_flac_on_read, ca_miniaudio_flac_on_seek, &stream, NULL);
+  if (pFlac == NULL)
+  {
+    return 0;
+  }
+
+  ca_uint64 framesDecoded;
+  if (format == ca_sample_format_s16)
+  {
+    framesDecoded = ma_dr_flac_read_pcm_frames_s16(pFlac, frameCount, (ma_int16 *)pSamplesOut);
+  }
+  else
+  {
+    framesDecoded = ma_dr_flac_read_pcm_frames_s32(pFlac, frameCount, (ma_int32 *)pSamplesOut);
+  }
+
+  ma_dr_flac_close(pFlac);
+  return framesDecoded;
+}
+
+void *ca_miniaudio_mp3_frame_decoder_alloc()
+{
+  ma_dr_mp3dec *pDecoder = (ma_dr_mp3dec *)ma_malloc(sizeof(ma_dr_mp3dec), NULL);
+  if (pDecoder != NULL)
+  {
+    ma_dr_mp3dec_init(pDecoder);
+  }
+  return pDecoder;
+}
+
+size_t ca_miniaudio_mp3_frame_decoder_get_size()
+{
+  return sizeof(ma_dr_mp3dec);
+}
+
+void ca_miniaudio_mp3_frame_decoder_reset(void *pDecoder)
+{
+  ma_dr_mp3dec_init((ma_dr_mp3dec *)pDecoder);
+}
+
+ca_uint32 ca_miniaudio_mp3_frame_decoder_decode(void *pDecoder, const void *pFrame, size_t frameSize, void *pSamplesOut, ca_uint32 *pChannels)
+{
+  ma_dr_mp3dec_frame_info info;
+  int frameCount = ma_dr_mp3dec_decode_frame((ma_dr_mp3dec *)pDecoder, (const ma_uint8 *)pFrame, (int)frameSize, pSamplesOut, &info);
+  if (frameCount <= 0 || info.frame_bytes != (int)frameSize)
+  {
+    return 0;
+  }
+
+  *pChannels = (ca_uint32)info.channels;
+  return (ca_uint32)frameCount;
+}
+
+void ca_miniaudio_mp3_frame_decoder_free(void *pDecoder)
+{
+  ma_free(pDecoder, NULL);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// miniaudio is only used for its codecs and DSP, so the device, engine and graph APIs are compiled out.
+#define MA_NO_DEVICE_IO
+#define MA_NO_RESOURCE_MANAGER
+#define MA_NO_NODE_GRAPH
+#define MA_NO_ENGINE
+#define MA_NO_GENERATION
+
+#include "miniaudio/miniaudio.h"
+
+#include "ca_defs.h"
+#include <stddef.h>
+
+// Decodes FLAC frames with the vendored dr_flac. pHeader holds the fLaC marker and a STREAMINFO block and pFrames holds whole frames.
+// Writes up to frameCount interleaved s16 or s32 frames and returns the number of frames decoded.
+ca_uint64 ca_miniaudio_decode_flac_frames(const void *pHeader, size_t headerSize, const void *pFrames, size_t framesSize, ca_uint64 frameCount, ca_sample_format format, void *pSamplesOut);
+
+#define CA_MINIAUDIO_MP3_MAX_SAMPLES_PER_FRAME (1152 * 2)
+
+// Allocates a frame decoder of the vendored dr_mp3. It carries the bit reservoir and filter history from one frame to the next.
+void *ca_miniaudio_mp3_frame_decoder_alloc();
+
+// Clears the carried state before decoding from another position.
+void ca_miniaudio_mp3_frame_decoder_reset(void *pDecoder);
+
+// Decodes one whole frame into up to CA_MINIAUDIO_MP3_MAX_SAMPLES_PER_FRAME interleaved s16 samples.
+// Returns the frames per channel, or 0 when the frame could not be decoded, e.g. when its bit reservoir was not fed yet.
+ca_uint32 ca_miniaudio_mp3_frame_decoder_decode(void *pDecoder, const void *pFrame, size_t frameSize, void *pSamplesOut, ca_uint32 *pChannels);
+
+size_t ca_miniaudio_mp3_frame_decoder_get_size();
+
+void ca_miniaudio_mp3_frame_decoder_free(void *pDecoder);
@@ -0,0 +1,990 @@
+#include "ca_mp3_decoder.h"
+#include "ca_arena.h"
+#include "ca_frame_scan.h"
+#include "ca_miniaudio.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MP3_BUFFER_SIZE (16 * 1024)
+#define MP3_DECODE_FRAME_COUNT 8
+
+// Every MP3_INDEX_STRIDE th frame offset is kept, so an exact seek walks at most that many headers from the index.
+#define MP3_INDEX_STRIDE 16
+
+// Targets whose estimated offset is further than this from the indexed part jump with the seek table instead of scanning.
+#define MP3_MAX_SCAN_SIZE (2 * 1024 * 1024)
+
+// Enough preceding frame bytes to hold the largest bit reservoir plus the pre-roll frames before the target.
+#define MP3_RESERVOIR_WALK_SIZE 2048
+
+// Headers an exact seek walks without chaining another arena block, enough for frames down to the lowest bitrates.
+#define MP3_SEEK_WALK_CAPACITY 256
+
+// Frames decoded and dropped before the target after a coarse jump.
+#define MP3_COARSE_PREROLL_FRAMES 12
+
+// Samples decoded before a seek target so the granule overlap and the synthesis filter history are primed.
+#define MP3_PREROLL_SAMPLES 1152
+
+#define MP3_SYNC_SEARCH_SIZE (64 * 1024)
+#define MP3_SYNC_FRAME_COUNT 4
+#define MP3_DECODER_DELAY 529
+#define MP3_XING_TOC_SIZE 100
+#define MP3_UNKNOWN_SAMPLE 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  ca_uint32 layer;
+  ca_bool isMpeg1;
+  ca_uint32 bitrate;
+  ca_uint32 sampleRate;
+  ca_uint32 channels;
+  ca_uint32 frameSize;
+  ca_uint32 samplesPerFrame;
+  ca_uint32 sideInfoOffset;
+  ca_uint32 sideInfoSize;
+} ca_mp3_frame_header;
+
+typedef struct
+{
+  ca_uint64 frame;
+  ca_uint64 offset;
+} ca_mp3_seekpoint;
+
+typedef struct
+{
+  ca_decoder_read_proc readFunc;
+  ca_decoder_seek_proc seekFunc;
+  ca_decoder_tell_proc tellFunc;
+  ca_decoder_decoded_proc decodedFunc;
+
+  ca_audio_format format;
+  ca_uint8 streamHeader[4];
+  ca_uint32 samplesPerFrame;
+  ca_uint32 bytesPerFrame;
+  ca_uint64 firstFrameOffset;
+
+  // Stream samples are counted from the first frame. The encoder delay and padding from the LAME tag are trimmed.
+  ca_uint64 startSample;
+  ca_uint64 endSample;
+
+  // Coarse frame offsets from the Xing or VBRI table, or from the bitrate of the first frame.
+  ca_mp3_seekpoint *pSeekpoints;
+  ca_uint32 seekpointCount;
+
+  // Frame offsets and main data sizes walked by an exact seek, reset by each one.
+  ca_arena seekScratch;
+
+  // Exact offsets of every MP3_INDEX_STRIDE th frame before scanFrame.
+  ca_uint64 *pIndex;
+  ca_uint32 indexCount;
+  ca_uint32 indexCapacity;
+  ca_uint64 scanFrame;
+  ca_uint64 scanOffset;
+  ca_bool isScanComplete;
+
+  ca_uint8 *pBuffer;
+  ca_uint64 bufferOffset;
+  size_t bufferSize;
+  ca_uint64 sourcePosition;
+  ca_bool isSourceAtEnd;
+  ca_result ioResult;
+
+  void *pFrameDecoder;
+  short *pFrameSamples;
+  ca_uint8 *pOut;
+  ca_uint64 currentFrame;
+  ca_uint64 currentOffset;
+  ca_uint64 skipUntil;
+
+  // Cleared after a coarse jump, where the frame number is an estimate and must not extend the index.
+  ca_bool isExact;
+  ca_bool isEOF;
+} ca_mp3_decoder_data;
+
+static ca_uint32 ca_mp3_be16(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 8) | p[1];
+}
+
+static ca_uint32 ca_mp3_be32(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 24) | ((ca_uint32)p[1] << 16) | ((ca_uint32)p[2] << 8) | p[3];
+}
+
+// MARK: Frames
+
+static ca_bool ca_mp3_parse_header(const ca_uint8 *p, ca_mp3_frame_header *pHeader)
+{
+  static const ca_uint32 bitrates[2][3][15] = {
+      {
+          {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+          {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+          {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+      },
+      {
+          {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+          {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+          {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+      },
+  };
+  static const ca_uint32 sampleRates[3] = {44100, 48000, 32000};
+
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+  {
+    return CA_FALSE;
+  }
+
+  // Free format streams have no bitrate to compute the frame size from, so they are left to the platform decoder.
+  ca_uint32 version = (p[1] >> 3) & 0x03;
+  ca_uint32 layerBits = (p[1] >> 1) & 0x03;
+  ca_uint32 bitrateIndex = p[2] >> 4;
+  ca_uint32 sampleRateIndex = (p[2] >> 2) & 0x03;
+  if (version == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+  {
+    return CA_FALSE;
+  }
+
+  ca_uint32 padding = (p[2] >> 1) & 0x01;
+  pHeader->isMpeg1 = version == 3;
+  pHeader->layer = 4 - layerBits;
+  pHeader->bitrate = bitrates[pHeader->isMpeg1][pHeader->layer - 1][bitrateIndex] * 1000;
+  pHeader->sampleRate = sampleRates[sampleRateIndex] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+  pHeader->channels = (p[3] >> 6) == 3 ? 1 : 2;
+  if (pHeader->layer == 1)
+  {
+    pHeader->samplesPerFrame = 384;
+    pHeader->frameSize = (12 * pHeader->bitrate / pHeader->sampleRate + padding) * 4;
+  }
+  else
+  {
+    pHeader->samplesPerFrame = (pHeader->layer == 3 && !pHeader->isMpeg1) ? 576 : 1152;
+    pHeader->frameSize = pHeader->samplesPerFrame / 8 * pHeader->bitrate / pHeader->sampleRate + padding;
+  }
+
+  pHeader->sideInfoOffset = (p[1] & 0x01) ? 4 : 6;
+  if (pHeader->layer != 3)
+  {
+    pHeader->sideInfoSize = 0;
+  }
+  else if (pHeader->isMpeg1)
+  {
+    pHeader->sideInfoSize = pHeader->channels == 1 ? 17 : 32;
+  }
+  else
+  {
+    pHeader->sideInfoSize = pHeader->channels == 1 ? 9 : 17;
+  }
+
+  return pHeader->frameSize > pHeader->sideInfoOffset + pHeader->sideInfoSize;
+}
+
+// Frames of a stream share the version, the layer and the sample rate.
+static ca_bool ca_mp3_is_same_stream(const ca_uint8 *pStreamHeader, const ca_uint8 *p)
+{
+  return ((pStreamHeader[1] ^ p[1]) & 0xFE) == 0 && ((pStreamHeader[2] ^ p[2]) & 0x0C) == 0;
+}
+
+// The number of bytes the layer III frame takes from the main data of the preceding frames.
+static ca_uint32 ca_mp3_main_data_begin(const ca_uint8 *p, const ca_mp3_frame_header *pHeader)
+{
+  const ca_uint8 *pSideInfo = p + pHeader->sideInfoOffset;
+  if (pHeader->isMpeg1)
+  {
+    return ((ca_uint32)pSideInfo[0] << 1) | (pSideInfo[1] >> 7);
+  }
+  return pSideInfo[0];
+}
+
+// MARK: Stream
+
+static ca_result ca_mp3_read(ca_mp3_decoder *pDecoder, void *pBuffer, size_t size, size_t *pBytesRead)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  size_t totalRead = 0;
+  ca_result result = ca_result_success;
+  while (totalRead < size)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result readResult = pData->readFunc((ca_uint8 *)pBuffer + totalRead, (ca_uint32)(size - totalRead), &bytesRead, pDecoder->pUserData);
+    totalRead += bytesRead;
+    if (readResult == ca_read_result_failed)
+    {
+      result = ca_result_read_failed;
+      break;
+    }
+
+    if (readResult == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+
+  *pBytesRead = totalRead;
+  return result;
+}
+
+// Returns size bytes at offset through the read buffer, or NULL when the stream ends before them.
+static const ca_uint8 *ca_mp3_peek(ca_mp3_decoder *pDecoder, ca_uint64 offset, size_t size)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 bufferEnd = pData->bufferOffset + pData->bufferSize;
+  if (offset >= pData->bufferOffset && offset + size <= bufferEnd)
+  {
+    return pData->pBuffer + (offset - pData->bufferOffset);
+  }
+
+  // Keep the bytes already read when the request continues the buffer.
+  size_t keptSize = 0;
+  if (offset >= pData->bufferOffset && offset <= bufferEnd)
+  {
+    if (pData->isSourceAtEnd || size > MP3_BUFFER_SIZE)
+    {
+      return NULL;
+    }
+
+    keptSize = (size_t)(bufferEnd - offset);
+    memmove(pData->pBuffer, pData->pBuffer + (offset - pData->bufferOffset), keptSize);
+  }
+
+  ca_uint64 readPosition = offset + keptSize;
+  pData->bufferOffset = offset;
+  pData->bufferSize = keptSize;
+  pData->isSourceAtEnd = CA_FALSE;
+  if (pData->sourcePosition != readPosition)
+  {
+    if (pData->seekFunc((ca_int64)readPosition, ca_seek_origin_start, pDecoder->pUserData) != ca_seek_result_success)
+    {
+      pData->isSourceAtEnd = CA_TRUE;
+      return NULL;
+    }
+    pData->sourcePosition = readPosition;
+  }
+
+  size_t bytesRead = 0;
+  ca_result result = ca_mp3_read(pDecoder, pData->pBuffer + keptSize, MP3_BUFFER_SIZE - keptSize, &bytesRead);
+  pData->sourcePosition += bytesRead;
+  pData->bufferSize += bytesRead;
+  pData->isSourceAtEnd = pData->bufferSize < MP3_BUFFER_SIZE;
+  if (result != ca_result_success)
+  {
+    pData->ioResult = result;
+  }
+
+  return pData->bufferSize >= size ? pData->pBuffer : NULL;
+}
+
+// Returns the frame at offset, or the first frame after it that is followed by another frame of the stream.
+static ca_bool ca_mp3_find_frame(ca_mp3_decoder *pDecoder, ca_uint64 offset, ca_bool isFrameExpected, ca_uint64 *pFrameOffset, ca_mp3_frame_header *pHeader)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  for (ca_uint64 position = offset; position < offset + MP3_SYNC_SEARCH_SIZE; position++)
+  {
+    const ca_uint8 *p = ca_mp3_peek(pDecoder, position, 4);
+    if (p == NULL)
+    {
+      return CA_FALSE;
+    }
+
+    if (!ca_mp3_parse_header(p, pHeader) || !ca_mp3_is_same_stream(pData->streamHeader, p))
+    {
+      continue;
+    }
+
+    if (!isFrameExpected || position != offset)
+    {
+      ca_mp3_frame_header next;
+      const ca_uint8 *pNext = ca_mp3_peek(pDecoder, position + pHeader->frameSize, 4);
+      if (pNext != NULL && (!ca_mp3_parse_header(pNext, &next) || !ca_mp3_is_same_stream(pData->streamHeader, pNext)))
+      {
+        continue;
+      }
+    }
+
+    *pFrameOffset = position;
+    return CA_TRUE;
+  }
+
+  return CA_FALSE;
+}
+
+// MARK: Index
+
+// Records the frame at scanFrame.
+static ca_result ca_mp3_index_frame(ca_mp3_decoder_data *pData, ca_uint64 frameOffset, ca_uint32 frameSize)
+{
+  if (pData->scanFrame % MP3_INDEX_STRIDE == 0)
+  {
+    if (pData->indexCount == pData->indexCapacity)
+    {
+      ca_uint32 capacity = ca_max(pData->indexCapacity * 2, 256);
+      ca_uint64 *pIndex = (ca_uint64 *)realloc(pData->pIndex, sizeof(ca_uint64) * capacity);
+      if (pIndex == NULL)
+      {
+        return ca_result_out_of_memory;
+      }
+      pData->pIndex = pIndex;
+      pData->indexCapacity = capacity;
+    }
+    pData->pIndex[pData->indexCount++] = frameOffset;
+  }
+
+  pData->scanFrame++;
+  pData->scanOffset = frameOffset + frameSize;
+  return ca_result_success;
+}
+
+// Indexes frame headers until targetFrame is indexed or the stream ends.
+static ca_result ca_mp3_scan(ca_mp3_decoder *pDecoder, ca_uint64 targetFrame)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  while (!pData->isScanComplete && pData->scanFrame <= targetFrame)
+  {
+    ca_uint64 frameOffset = 0;
+    ca_mp3_frame_header header;
+    if (!ca_mp3_find_frame(pDecoder, pData->scanOffset, CA_TRUE, &frameOffset, &header) || ca_mp3_peek(pDecoder, frameOffset + header.frameSize - 1, 1) == NULL)
+    {
+      pData->isScanComplete = CA_TRUE;
+      break;
+    }
+
+    ca_result result = ca_mp3_index_frame(pData, frameOffset, header.frameSize);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+
+  return pData->ioResult;
+}
+
+static ca_uint64 ca_mp3_estimate_offset(const ca_mp3_decoder_data *pData, ca_uint64 frame)
+{
+  const ca_mp3_seekpoint *pPoints = pData->pSeekpoints;
+  ca_uint32 i = 1;
+  while (i + 1 < pData->seekpointCount && pPoints[i].frame <= frame)
+  {
+    i++;
+  }
+
+  ca_uint64 frameCount = pPoints[i].frame - pPoints[i - 1].frame;
+  if (frameCount == 0 || frame < pPoints[i - 1].frame)
+  {
+    return pPoints[i - 1].offset;
+  }
+  return pPoints[i - 1].offset + (ca_uint64)((double)(frame - pPoints[i - 1].frame) * (pPoints[i].offset - pPoints[i - 1].offset) / frameCount);
+}
+
+static ca_uint64 ca_mp3_estimate_frame(const ca_mp3_decoder_data *pData, ca_uint64 offset)
+{
+  const ca_mp3_seekpoint *pPoints = pData->pSeekpoints;
+  ca_uint32 i = 1;
+  while (i + 1 < pData->seekpointCount && pPoints[i].offset <= offset)
+  {
+    i++;
+  }
+
+  ca_uint64 size = pPoints[i].offset - pPoints[i - 1].offset;
+  if (size == 0 || offset < pPoints[i - 1].offset)
+  {
+    return pPoints[i - 1].frame;
+  }
+  return pPoints[i - 1].frame + (ca_uint64)((double)(offset - pPoints[i - 1].offset) * (pPoints[i].frame - pPoints[i - 1].frame) / size + 0.5);
+}
+
+// MARK: Seek
+
+// Starts decoding early enough that the frames covering MP3_PREROLL_SAMPLES before the target decode completely, which primes the filter overlap of the target.
+// Those frames need main_data_begin bytes of the preceding frames in the bit reservoir, so decoding starts at the frame holding them.
+static ca_result ca_mp3_seek_exact(ca_mp3_decoder *pDecoder, ca_uint64 targetFrame)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 prerollFrames = (MP3_PREROLL_SAMPLES + pData->samplesPerFrame - 1) / pData->samplesPerFrame;
+  ca_uint64 lastFrame = targetFrame > prerollFrames ? targetFrame - prerollFrames : 0;
+  ca_uint32 anchor = (ca_uint32)(lastFrame / MP3_INDEX_STRIDE);
+  ca_uint32 walkAnchor = anchor;
+  while (walkAnchor > 0 && pData->pIndex[anchor] - pData->pIndex[walkAnchor] < MP3_RESERVOIR_WALK_SIZE)
+  {
+    walkAnchor--;
+  }
+
+  ca_uint64 walkFrame = (ca_uint64)walkAnchor * MP3_INDEX_STRIDE;
+  size_t walkCount = (size_t)(lastFrame - walkFrame + 1);
+  ca_arena_reset(&pData->seekScratch);
+  ca_uint64 *pOffsets = (ca_uint64 *)ca_arena_alloc(&pData->seekScratch, sizeof(ca_uint64) * walkCount);
+  ca_uint32 *pMainDataSizes = (ca_uint32 *)ca_arena_alloc(&pData->seekScratch, sizeof(ca_uint32) * walkCount);
+  if (pOffsets == NULL || pMainDataSizes == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_uint64 offset = pData->pIndex[walkAnchor];
+  ca_uint32 mainDataBegin = 0;
+  for (size_t i = 0; i < walkCount; i++)
+  {
+    ca_mp3_frame_header header;
+    const ca_uint8 *p = NULL;
+    if (ca_mp3_find_frame(pDecoder, offset, CA_TRUE, &pOffsets[i], &header))
+    {
+      p = ca_mp3_peek(pDecoder, pOffsets[i], header.sideInfoOffset + 2);
+    }
+
+    if (p == NULL)
+    {
+      return pData->ioResult != ca_result_success ? pData->ioResult : ca_result_seek_failed;
+    }
+
+    pMainDataSizes[i] = header.frameSize - header.sideInfoOffset - header.sideInfoSize;
+    mainDataBegin = header.layer == 3 ? ca_mp3_main_data_begin(p, &header) : 0;
+    offset = pOffsets[i] + header.frameSize;
+  }
+
+  size_t startIndex = walkCount - 1;
+  ca_int64 reservoirSize = mainDataBegin;
+  while (reservoirSize > 0 && startIndex > 0)
+  {
+    startIndex--;
+    reservoirSize -= pMainDataSizes[startIndex];
+  }
+
+  pData->currentFrame = walkFrame + startIndex;
+  pData->currentOffset = pOffsets[startIndex];
+  pData->isExact = CA_TRUE;
+  return ca_result_success;
+}
+
+// Jumps with the seek table and takes the frame number from it, so the position is only as accurate as the table.
+static ca_result ca_mp3_seek_coarse(ca_mp3_decoder *pDecoder, ca_uint64 targetFrame)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 frame = targetFrame > MP3_COARSE_PREROLL_FRAMES ? targetFrame - MP3_COARSE_PREROLL_FRAMES : 0;
+  ca_uint64 frameOffset = 0;
+  ca_mp3_frame_header header;
+  if (!ca_mp3_find_frame(pDecoder, ca_mp3_estimate_offset(pData, frame), CA_FALSE, &frameOffset, &header))
+  {
+    return pData->ioResult != ca_result_success ? pData->ioResult : ca_result_seek_failed;
+  }
+
+  pData->currentFrame = ca_mp3_estimate_frame(pData, frameOffset);
+  pData->currentOffset = frameOffset;
+  pData->isExact = CA_FALSE;
+  return ca_result_success;
+}
+
+// Hops from the nearest indexed frame to targetFrame without walking back for the bit reservoir.
+static ca_result ca_mp3_seek_indexed(ca_mp3_decoder *pDecoder, ca_uint64 targetFrame)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint32 anchor = (ca_uint32)(targetFrame / MP3_INDEX_STRIDE);
+  ca_uint64 frame = (ca_uint64)anchor * MP3_INDEX_STRIDE;
+  ca_uint64 offset = pData->pIndex[anchor];
+  ca_uint64 frameOffset = offset;
+  for (; frame <= targetFrame; frame++)
+  {
+    ca_mp3_frame_header header;
+    if (!ca_mp3_find_frame(pDecoder, offset, CA_TRUE, &frameOffset, &header))
+    {
+      return pData->ioResult != ca_result_success ? pData->ioResult : ca_result_seek_failed;
+    }
+    offset = frameOffset + header.frameSize;
+  }
+
+  pData->currentFrame = targetFrame;
+  pData->currentOffset = frameOffset;
+  pData->isExact = CA_TRUE;
+  return ca_result_success;
+}
+
+// MARK: Header
+
+static ca_result ca_mp3_read_header(ca_mp3_decoder *pDecoder)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 offset = 0;
+  const ca_uint8 *p = ca_mp3_peek(pDecoder, 0, 10);
+  while (p != NULL && memcmp(p, "ID3", 3) == 0)
+  {
+    offset += ((ca_uint64)(p[6] & 0x7F) << 21) | ((p[7] & 0x7F) << 14) | ((p[8] & 0x7F) << 7) | (p[9] & 0x7F);
+    offset += (p[5] & 0x10) ? 20 : 10;
+    p = ca_mp3_peek(pDecoder, offset, 10);
+  }
+
+  // The stream has to start with a run of frames with consistent headers, so other formats are not mistaken for MP3.
+  ca_mp3_frame_header header;
+  ca_uint64 frameOffset = offset;
+  ca_bool isFound = CA_FALSE;
+  for (; !isFound && frameOffset < offset + MP3_SYNC_SEARCH_SIZE; frameOffset++)
+  {
+    p = ca_mp3_peek(pDecoder, frameOffset, 4);
+    if (p == NULL)
+    {
+      break;
+    }
+
+    if (!ca_mp3_parse_header(p, &header))
+    {
+      continue;
+    }
+
+    memcpy(pData->streamHeader, p, sizeof(pData->streamHeader));
+    ca_uint64 nextOffset = frameOffset;
+    isFound = CA_TRUE;
+    for (int i = 0; isFound && i < MP3_SYNC_FRAME_COUNT; i++)
+    {
+      ca_mp3_frame_header next;
+      const ca_uint8 *pNext = ca_mp3_peek(pDecoder, nextOffset, 4);
+      isFound = pNext != NULL && ca_mp3_parse_header(pNext, &next) && ca_mp3_is_same_stream(pData->streamHeader, pNext);
+      nextOffset += isFound ? next.frameSize : 0;
+    }
+  }
+
+  if (!isFound)
+  {
+    return pData->ioResult != ca_result_success ? pData->ioResult : ca_result_unsupported_format;
+  }
+
+  frameOffset--;
+  p = ca_mp3_peek(pDecoder, frameOffset, header.frameSize);
+  if (p == NULL)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  pData->format.channels = header.channels;
+  pData->format.sample_rate = header.sampleRate;
+  pData->format.sample_foramt = ca_sample_format_s16;
+  pData->samplesPerFrame = header.samplesPerFrame;
+  pData->firstFrameOffset = frameOffset;
+
+  ca_uint64 totalFrames = 0;
+  ca_uint64 streamSize = 0;
+  ca_uint32 delay = 0;
+  ca_uint32 padding = 0;
+  ca_bool hasLameTag = CA_FALSE;
+  ca_uint8 toc[MP3_XING_TOC_SIZE];
+  ca_bool hasToc = CA_FALSE;
+  const ca_uint8 *pVbriTable = NULL;
+  ca_uint32 vbriEntryCount = 0;
+  ca_uint32 vbriScale = 0;
+  ca_uint32 vbriEntrySize = 0;
+  ca_uint32 vbriFramesPerEntry = 0;
+
+  // The first frame may be a silent Xing, Info or VBRI frame describing the stream.
+  ca_uint32 xingOffset = header.sideInfoOffset + header.sideInfoSize;
+  if (header.layer == 3 && xingOffset + 8 <= header.frameSize && (memcmp(p + xingOffset, "Xing", 4) == 0 || memcmp(p + xingOffset, "Info", 4) == 0))
+  {
+    ca_uint32 flags = ca_mp3_be32(p + xingOffset + 4);
+    ca_uint32 fieldsSize = ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? MP3_XING_TOC_SIZE : 0) + ((flags & 8) ? 4 : 0);
+    const ca_uint8 *pField = p + xingOffset + 8;
+    if (xingOffset + 8 + fieldsSize <= header.frameSize)
+    {
+      if (flags & 1)
+      {
+        totalFrames = ca_mp3_be32(pField);
+        pField += 4;
+      }
+
+      if (flags & 2)
+      {
+        streamSize = ca_mp3_be32(pField);
+        pField += 4;
+      }
+
+      if (flags & 4)
+      {
+        memcpy(toc, pField, MP3_XING_TOC_SIZE);
+        hasToc = CA_TRUE;
+        pField += MP3_XING_TOC_SIZE;
+      }
+
+      pField += (flags & 8) ? 4 : 0;
+      ca_uint32 lameOffset = (ca_uint32)(pField - p);
+      if (lameOffset + 24 <= header.frameSize && (memcmp(pField, "LAME", 4) == 0 || memcmp(pField, "Lavf", 4) == 0 || memcmp(pField, "Lavc", 4) == 0))
+      {
+        delay = ((ca_uint32)pField[21] << 4) | (pField[22] >> 4);
+        padding = ((ca_uint32)(pField[22] & 0x0F) << 8) | pField[23];
+        hasLameTag = CA_TRUE;
+      }
+    }
+    pData->firstFrameOffset += header.frameSize;
+  }
+  else if (header.layer == 3 && 36 + 26 <= header.frameSize && memcmp(p + 36, "VBRI", 4) == 0)
+  {
+    const ca_uint8 *pVbri = p + 36;
+    streamSize = ca_mp3_be32(pVbri + 10);
+    totalFrames = ca_mp3_be32(pVbri + 14);
+    vbriEntryCount = ca_mp3_be16(pVbri + 18);
+    vbriScale = ca_mp3_be16(pVbri + 20);
+    vbriEntrySize = ca_mp3_be16(pVbri + 22);
+    vbriFramesPerEntry = ca_mp3_be16(pVbri + 24);
+    if (vbriEntrySize >= 1 && vbriEntrySize <= 4 && 36 + 26 + vbriEntryCount * vbriEntrySize <= header.frameSize)
+    {
+      pVbriTable = pVbri + 26;
+    }
+    pData->firstFrameOffset += header.frameSize;
+  }
+
+  // Without a frame count in the tag the frame headers are counted, so the length is exact instead of estimated from the bitrate.
+  if (totalFrames == 0 && pData->tellFunc != NULL)
+  {
+    ca_frame_scan_result scan;
+    ca_source source = ca_source_init(pData->readFunc, pData->seekFunc, pData->tellFunc, pDecoder->pUserData);
+    if (ca_frame_scan(source, frameOffset, pDecoder->config.decodeThreadCount, &scan) == ca_result_success && scan.stream == ca_frame_stream_mpeg && scan.firstFrameOffset == pData->firstFrameOffset)
+    {
+      totalFrames = scan.frameCount;
+      streamSize = streamSize != 0 ? streamSize : scan.endOffset - frameOffset;
+    }
+
+    if (pData->seekFunc((ca_int64)pData->sourcePosition, ca_seek_origin_start, pDecoder->pUserData) != ca_seek_result_success)
+    {
+      return ca_result_seek_failed;
+    }
+  }
+
+  // The decoder delay is part of the padding in the LAME tag.
+  pData->startSample = hasLameTag ? delay + MP3_DECODER_DELAY : 0;
+  pData->endSample = MP3_UNKNOWN_SAMPLE;
+  if (totalFrames != 0)
+  {
+    pData->endSample = totalFrames * header.samplesPerFrame;
+    pData->endSample -= (hasLameTag && padding > MP3_DECODER_DELAY) ? padding - MP3_DECODER_DELAY : 0;
+    pData->endSample = ca_max(pData->endSample, pData->startSample);
+  }
+
+  ca_uint64 position = 0;
+  ca_uint64 length = 0;
+  if (streamSize == 0 && pData->tellFunc != NULL && pData->tellFunc(&position, &length, pDecoder->pUserData) == ca_tell_result_success && length > pData->firstFrameOffset)
+  {
+    streamSize = length - frameOffset;
+  }
+
+  // Without a table the stream is assumed to have the bitrate of its first frame.
+  ca_uint32 seekpointCount = hasToc ? MP3_XING_TOC_SIZE + 1 : (pVbriTable != NULL ? vbriEntryCount + 1 : 2);
+  if (streamSize != 0)
+  {
+    pData->pSeekpoints = (ca_mp3_seekpoint *)malloc(sizeof(ca_mp3_seekpoint) * seekpointCount);
+    if (pData->pSeekpoints == NULL)
+    {
+      return ca_result_out_of_memory;
+    }
+
+    ca_mp3_seekpoint *pPoints = pData->pSeekpoints;
+    pPoints[0].frame = 0;
+    pPoints[0].offset = pData->firstFrameOffset;
+    if (hasToc && totalFrames != 0)
+    {
+      for (ca_uint32 i = 1; i < MP3_XING_TOC_SIZE; i++)
+      {
+        pPoints[i].frame = totalFrames * i / MP3_XING_TOC_SIZE;
+        pPoints[i].offset = frameOffset + streamSize * toc[i] / 256;
+      }
+      pPoints[MP3_XING_TOC_SIZE].frame = totalFrames;
+      pPoints[MP3_XING_TOC_SIZE].offset = frameOffset + streamSize;
+    }
+    else if (pVbriTable != NULL && totalFrames != 0)
+    {
+      ca_uint64 entryOffset = frameOffset;
+      for (ca_uint32 i = 0; i < vbriEntryCount; i++)
+      {
+        ca_uint32 entry = 0;
+        for (ca_uint32 j = 0; j < vbriEntrySize; j++)
+        {
+          entry = (entry << 8) | pVbriTable[i * vbriEntrySize + j];
+        }
+        entryOffset += (ca_uint64)entry * vbriScale;
+        pPoints[i + 1].frame = ca_min((ca_uint64)(i + 1) * vbriFramesPerEntry, totalFrames);
+        pPoints[i + 1].offset = entryOffset;
+      }
+    }
+    else
+    {
+      seekpointCount = 2;
+      pPoints[1].offset = frameOffset + streamSize;
+      pPoints[1].frame = totalFrames != 0 ? totalFrames : (ca_uint64)((double)(streamSize - (pData->firstFrameOffset - frameOffset)) * header.sampleRate * 8 / ((double)header.bitrate * header.samplesPerFrame));
+    }
+
+    // Tables are not trusted to be monotonic.
+    for (ca_uint32 i = 1; i < seekpointCount; i++)
+    {
+      pPoints[i].frame = ca_max(pPoints[i].frame, pPoints[i - 1].frame);
+      pPoints[i].offset = ca_max(pPoints[i].offset, pPoints[i - 1].offset);
+    }
+    pData->seekpointCount = seekpointCount;
+  }
+
+  if (pData->endSample != MP3_UNKNOWN_SAMPLE)
+  {
+    pData->format.length = pData->endSample - pData->startSample;
+  }
+  else if (pData->seekpointCount >= 2)
+  {
+    pData->format.length = pData->pSeekpoints[pData->seekpointCount - 1].frame * header.samplesPerFrame;
+  }
+
+  return ca_result_success;
+}
+
+// MARK: Decoder
+
+ca_result ca_mp3_decoder_init(ca_mp3_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (pSeekProc == NULL)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)calloc(1, sizeof(ca_mp3_decoder_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->readFunc = pReadProc;
+  pData->seekFunc = pSeekProc;
+  pData->tellFunc = pTellProc;
+  pData->decodedFunc = pDecodedProc;
+  pData->ioResult = ca_result_success;
+  pDecoder->config = config;
+  pDecoder->pUserData = pUserData;
+  pDecoder->pData = pData;
+
+  pData->pBuffer = (ca_uint8 *)malloc(MP3_BUFFER_SIZE);
+  pData->pFrameDecoder = ca_miniaudio_mp3_frame_decoder_alloc();
+  pData->pFrameSamples = (short *)malloc(sizeof(short) * CA_MINIAUDIO_MP3_MAX_SAMPLES_PER_FRAME);
+  ca_result result = ca_arena_init(&pData->seekScratch, (sizeof(ca_uint64) + sizeof(ca_uint32)) * MP3_SEEK_WALK_CAPACITY + 32);
+  if (pData->pBuffer == NULL || pData->pFrameDecoder == NULL || pData->pFrameSamples == NULL || result != ca_result_success)
+  {
+    ca_mp3_decoder_uninit(pDecoder);
+    return ca_result_out_of_memory;
+  }
+
+  result = ca_mp3_read_header(pDecoder);
+  if (result != ca_result_success)
+  {
+    ca_mp3_decoder_uninit(pDecoder);
+    return result;
+  }
+
+  pData->bytesPerFrame = sizeof(short) * pData->format.channels;
+  pData->pOut = (ca_uint8 *)malloc((size_t)pData->bytesPerFrame * pData->samplesPerFrame * MP3_DECODE_FRAME_COUNT);
+  if (pData->pOut == NULL)
+  {
+    ca_mp3_decoder_uninit(pDecoder);
+    return ca_result_out_of_memory;
+  }
+
+  pData->scanOffset = pData->firstFrameOffset;
+  pData->currentOffset = pData->firstFrameOffset;
+  pData->skipUntil = pData->startSample;
+  pData->isExact = CA_TRUE;
+  return ca_result_success;
+}
+
+ca_result ca_mp3_decoder_get_format(ca_mp3_decoder *pDecoder, ca_audio_format *pFormat)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  *pFormat = pData->format;
+  return ca_result_success;
+}
+
+ca_result ca_mp3_decoder_decode_next(ca_mp3_decoder *pDecoder)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint32 channels = pData->format.channels;
+  ca_uint64 samplesPerFrame = pData->samplesPerFrame;
+  ca_uint64 outFrameCount = 0;
+  for (int i = 0; i < MP3_DECODE_FRAME_COUNT && !pData->isEOF; i++)
+  {
+    ca_uint64 frameOffset = 0;
+    ca_mp3_frame_header header;
+    const ca_uint8 *pFrame = NULL;
+    if (ca_mp3_find_frame(pDecoder, pData->currentOffset, CA_TRUE, &frameOffset, &header))
+    {
+      pFrame = ca_mp3_peek(pDecoder, frameOffset, header.frameSize);
+    }
+
+    if (pFrame == NULL)
+    {
+      pData->isScanComplete |= pData->isExact && pData->currentFrame == pData->scanFrame;
+      pData->isEOF = CA_TRUE;
+      break;
+    }
+
+    if (pData->isExact && pData->currentFrame == pData->scanFrame)
+    {
+      ca_result result = ca_mp3_index_frame(pData, frameOffset, header.frameSize);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+    }
+
+    // Frames that do not decode are replaced with silence so the following samples keep their positions.
+    ca_uint32 frameChannels = 0;
+    ca_uint32 frameCount = ca_miniaudio_mp3_frame_decoder_decode(pData->pFrameDecoder, pFrame, header.frameSize, pData->pFrameSamples, &frameChannels);
+    short *pSamples = pData->pFrameSamples;
+    if (frameCount != samplesPerFrame)
+    {
+      memset(pSamples, 0, (size_t)samplesPerFrame * pData->bytesPerFrame);
+    }
+    else if (frameChannels == 1 && channels == 2)
+    {
+      for (ca_uint64 j = samplesPerFrame; j > 0; j--)
+      {
+        pSamples[(j - 1) * 2] = pSamples[j - 1];
+        pSamples[(j - 1) * 2 + 1] = pSamples[j - 1];
+      }
+    }
+    else if (frameChannels == 2 && channels == 1)
+    {
+      for (ca_uint64 j = 0; j < samplesPerFrame; j++)
+      {
+        pSamples[j] = (short)(((int)pSamples[j * 2] + pSamples[j * 2 + 1]) / 2);
+      }
+    }
+
+    ca_uint64 frameStart = pData->currentFrame * samplesPerFrame;
+    ca_uint64 frameEnd = frameStart + samplesPerFrame;
+    ca_uint64 from = ca_max(frameStart, pData->skipUntil);
+    ca_uint64 to = ca_min(frameEnd, pData->endSample);
+    if (to > from)
+    {
+      memcpy(pData->pOut + outFrameCount * pData->bytesPerFrame, (ca_uint8 *)pSamples + (from - frameStart) * pData->bytesPerFrame, (size_t)(to - from) * pData->bytesPerFrame);
+      outFrameCount += to - from;
+    }
+
+    pData->currentFrame++;
+    pData->currentOffset = frameOffset + header.frameSize;
+    pData->isEOF = frameEnd >= pData->endSample;
+  }
+
+  if (outFrameCount > 0)
+  {
+    pData->decodedFunc((ca_uint32)outFrameCount, pData->pOut, pDecoder->pUserData);
+  }
+
+  return pData->ioResult;
+}
+
+ca_result ca_mp3_decoder_seek(ca_mp3_decoder *pDecoder, ca_uint64 frameIndex)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 sample = ca_min(frameIndex + pData->startSample, pData->endSample);
+  ca_uint64 targetFrame = sample / pData->samplesPerFrame;
+
+  // Scanning is exact but its cost grows with the distance, so far targets jump with the seek table instead.
+  ca_result result = ca_result_success;
+  if (targetFrame >= pData->scanFrame && !pData->isScanComplete)
+  {
+    ca_bool isFar = !pDecoder->config.isSeekTableDisabled && pData->seekpointCount >= 2 && ca_mp3_estimate_offset(pData, targetFrame) > pData->scanOffset + MP3_MAX_SCAN_SIZE;
+    if (!isFar)
+    {
+      result = ca_mp3_scan(pDecoder, targetFrame);
+    }
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_miniaudio_mp3_frame_decoder_reset(pData->pFrameDecoder);
+  pData->skipUntil = sample;
+  pData->isEOF = CA_FALSE;
+  if (targetFrame < pData->scanFrame)
+  {
+    return ca_mp3_seek_exact(pDecoder, targetFrame);
+  }
+
+  if (pData->isScanComplete)
+  {
+    pData->currentFrame = pData->scanFrame;
+    pData->currentOffset = pData->scanOffset;
+    pData->isExact = CA_TRUE;
+    pData->isEOF = CA_TRUE;
+    return ca_result_success;
+  }
+
+  return ca_mp3_seek_coarse(pDecoder, targetFrame);
+}
+
+// The first frame decodes to silence when it needs bits from the frames before it.
+ca_result ca_mp3_decoder_seek_sync(ca_mp3_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 sample = ca_min(frameIndex + pData->startSample, pData->endSample);
+  ca_uint64 targetFrame = sample / pData->samplesPerFrame;
+
+  // Without a seek table, a target past the scanned frames is only reachable by scanning, which the exact seek does.
+  ca_bool hasTable = pData->seekpointCount >= 2;
+  if (targetFrame >= pData->scanFrame && !pData->isScanComplete && !hasTable)
+  {
+    ca_result result = ca_mp3_decoder_seek(pDecoder, frameIndex);
+    *pFrameIndex = ca_min(frameIndex, pData->endSample - pData->startSample);
+    return result;
+  }
+
+  ca_miniaudio_mp3_frame_decoder_reset(pData->pFrameDecoder);
+  pData->isEOF = CA_FALSE;
+  ca_result result = ca_result_success;
+  if (targetFrame < pData->scanFrame)
+  {
+    result = ca_mp3_seek_indexed(pDecoder, targetFrame);
+  }
+  else if (pData->isScanComplete)
+  {
+    pData->currentFrame = pData->scanFrame;
+    pData->currentOffset = pData->scanOffset;
+    pData->isExact = CA_TRUE;
+    pData->isEOF = CA_TRUE;
+  }
+  else
+  {
+    result = ca_mp3_seek_coarse(pDecoder, targetFrame);
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint64 startSample = ca_min(ca_max(pData->currentFrame * pData->samplesPerFrame, pData->startSample), pData->endSample);
+  pData->skipUntil = startSample;
+  *pFrameIndex = startSample - pData->startSample;
+  return ca_result_success;
+}
+
+ca_result ca_mp3_decoder_get_eof(ca_mp3_decoder *pDecoder, ca_bool *pIsEOF)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  *pIsEOF = pData->isEOF;
+  return ca_result_success;
+}
+
+ca_uint64 ca_mp3_decoder_get_size_in_bytes(ca_mp3_decoder *pDecoder)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  ca_uint64 sizeInBytes = sizeof(ca_mp3_decoder_data) + MP3_BUFFER_SIZE + ca_miniaudio_mp3_frame_decoder_get_size();
+  sizeInBytes += sizeof(short) * CA_MINIAUDIO_MP3_MAX_SAMPLES_PER_FRAME + (ca_uint64)pData->bytesPerFrame * pData->samplesPerFrame * MP3_DECODE_FRAME_COUNT;
+  sizeInBytes += (ca_uint64)sizeof(ca_uint64) * pData->indexCapacity + (ca_uint64)sizeof(ca_mp3_seekpoint) * pData->seekpointCount + pData->seekScratch.blockSize;
+  return sizeInBytes;
+}
+
+ca_result ca_mp3_decoder_uninit(ca_mp3_decoder *pDecoder)
+{
+  ca_mp3_decoder_data *pData = (ca_mp3_decoder_data *)pDecoder->pData;
+  if (pData->pFrameDecoder != NULL)
+  {
+    ca_miniaudio_mp3_frame_decoder_free(pData->pFrameDecoder);
+  }
+
+  free(pData->pFrameSamples);
+  free(pData->pOut);
+  free(pData->pBuffer);
+  free(pData->pIndex);
+  free(pData->pSeekpoints);
+  ca_arena_uninit(&pData->seekScratch);
+  free(pData);
+  pDecoder->pData = NULL;
+  return ca_result_success;
+}
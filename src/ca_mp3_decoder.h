@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+// Decodes MPEG audio layer I, II and III streams with the vendored dr_mp3 and seeks to exact samples.
+// Frame offsets are indexed while decoding and by scanning frame headers. Seeks too far from the index jump with the Xing or VBRI table instead.
+typedef struct
+{
+  ca_decoder_config config;
+  void *pUserData;
+  void *pData;
+} ca_mp3_decoder;
+
+// Returns ca_result_unsupported_format when the stream does not start with consecutive MPEG audio frames.
+// The stream position is undefined afterwards, so the caller has to seek back before trying another backend.
+ca_result ca_mp3_decoder_init(ca_mp3_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
+
+ca_result ca_mp3_decoder_get_format(ca_mp3_decoder *pDecoder, ca_audio_format *pFormat);
+
+ca_result ca_mp3_decoder_decode_next(ca_mp3_decoder *pDecoder);
+
+ca_result ca_mp3_decoder_seek(ca_mp3_decoder *pDecoder, ca_uint64 frameIndex);
+
+// Seeks to the start of the MPEG frame holding frameIndex without decoding up to the target. Past the scanned frames, it starts a few frames early from the seek table estimate like an exact seek. pFrameIndex receives the first frame decoded next.
+ca_result ca_mp3_decoder_seek_sync(ca_mp3_decoder *pDecoder, ca_uint64 frameIndex, ca_uint64 *pFrameIndex);
+
+ca_result ca_mp3_decoder_get_eof(ca_mp3_decoder *pDecoder, ca_bool *pIsEOF);
+
+// Returns the bytes of the buffers the decoder allocated.
+ca_uint64 ca_mp3_decoder_get_size_in_bytes(ca_mp3_decoder *pDecoder);
+
+ca_result ca_mp3_decoder_uninit(ca_mp3_decoder *pDecoder);
@@ -0,0 +1,1135 @@
+#include "ca_mp4_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+// An absolute sample position is kept every MP4_BLOCK_SAMPLES samples.
+#define MP4_BLOCK_SAMPLES 64
+
+#define MP4_TABLE_BUFFER_SIZE 4096
+#define MP4_MAX_CHILD_COUNT 4096
+
+// Bounds the index of a damaged table to about 2 GB of varints.
+#define MP4_MAX_SAMPLE_COUNT (1u << 28)
+
+// A fragmented file has a moof box for every few seconds of audio.
+#define MP4_MAX_TOP_LEVEL_COUNT (1u << 22)
+
+#define MP4_TFHD_BASE_DATA_OFFSET 0x1
+#define MP4_TFHD_SAMPLE_DESCRIPTION_INDEX 0x2
+#define MP4_TFHD_DEFAULT_SAMPLE_DURATION 0x8
+#define MP4_TFHD_DEFAULT_SAMPLE_SIZE 0x10
+#define MP4_TFHD_DEFAULT_SAMPLE_FLAGS 0x20
+
+#define MP4_TRUN_DATA_OFFSET 0x1
+#define MP4_TRUN_FIRST_SAMPLE_FLAGS 0x4
+#define MP4_TRUN_SAMPLE_DURATION 0x100
+#define MP4_TRUN_SAMPLE_SIZE 0x200
+#define MP4_TRUN_SAMPLE_FLAGS 0x400
+#define MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET 0x800
+
+typedef struct
+{
+  ca_uint64 ticks;
+  ca_uint64 offset;
+  ca_uint32 position;
+} ca_mp4_block;
+
+// Each sample is stored as its size, its duration and the zigzag coded gap between the end of the previous sample and its offset.
+// The gap of the first sample of a block is ignored because the block has the absolute offset.
+typedef struct
+{
+  ca_mp4_block *pBlocks;
+  ca_uint32 blockCount;
+  ca_uint32 blockCapacity;
+
+  ca_uint8 *pStream;
+  ca_uint32 streamSize;
+  ca_uint32 streamCapacity;
+
+  ca_uint64 totalTicks;
+  ca_uint64 lastEnd;
+} ca_mp4_index_data;
+
+typedef struct
+{
+  ca_uint8 type[4];
+  ca_uint64 offset;
+  ca_uint64 contentOffset;
+  ca_uint64 end;
+} ca_mp4_box;
+
+typedef struct
+{
+  ca_source source;
+  ca_uint64 position;
+  ca_uint64 length;
+
+  ca_mp4_index *pIndex;
+  ca_mp4_index_data *pIndexData;
+
+  ca_uint32 movieTimescale;
+  ca_uint32 trackId;
+  ca_bool hasTrack;
+
+  // Edit list of the track. segmentDuration is in the movie timescale, zero when the edit list does not bound the track.
+  ca_bool hasEdit;
+  ca_uint64 mediaTime;
+  ca_uint64 segmentDuration;
+
+  // Sample defaults of the track from mvex/trex.
+  ca_uint32 defaultDuration;
+  ca_uint32 defaultSize;
+} ca_mp4_parser;
+
+// A buffered cursor over the entries of a sample table box.
+typedef struct
+{
+  ca_uint64 offset;
+  ca_uint64 end;
+  ca_uint32 entrySize;
+  ca_uint32 position;
+  ca_uint32 size;
+  ca_uint8 buffer[MP4_TABLE_BUFFER_SIZE];
+} ca_mp4_table;
+
+// MARK: Byte order
+
+static inline ca_uint32 ca_mp4_be16(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 8) | (ca_uint32)p[1];
+}
+
+static inline ca_uint32 ca_mp4_be32(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 24) | ((ca_uint32)p[1] << 16) | ((ca_uint32)p[2] << 8) | (ca_uint32)p[3];
+}
+
+static inline ca_uint64 ca_mp4_be64(const ca_uint8 *p)
+{
+  return ((ca_uint64)ca_mp4_be32(p) << 32) | (ca_uint64)ca_mp4_be32(p + 4);
+}
+
+// MARK: Reader
+
+static ca_result ca_mp4_read_exact(ca_mp4_parser *pParser, ca_uint64 offset, void *pBuffer, ca_uint32 size)
+{
+  if (offset != pParser->position)
+  {
+    if (pParser->source.pSeekProc((ca_int64)offset, ca_seek_origin_start, pParser->source.pUserData) != ca_seek_result_success)
+    {
+      return ca_result_seek_failed;
+    }
+    pParser->position = offset;
+  }
+
+  ca_uint32 totalRead = 0;
+  while (totalRead < size)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result result = pParser->source.pReadProc((ca_uint8 *)pBuffer + totalRead, size - totalRead, &bytesRead, pParser->source.pUserData);
+    totalRead += bytesRead;
+    if (result == ca_read_result_failed)
+    {
+      pParser->position += totalRead;
+      return ca_result_read_failed;
+    }
+
+    if (result == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+
+  pParser->position += totalRead;
+  return totalRead == size ? ca_result_success : ca_result_unsupported_format;
+}
+
+static ca_result ca_mp4_read_box(ca_mp4_parser *pParser, ca_uint64 offset, ca_uint64 parentEnd, ca_mp4_box *pBox)
+{
+  ca_uint8 header[16];
+  if (offset + 8 > parentEnd)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_result result = ca_mp4_read_exact(pParser, offset, header, 8);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint64 size = ca_mp4_be32(header);
+  ca_uint64 headerSize = 8;
+  if (size == 1)
+  {
+    result = ca_mp4_read_exact(pParser, offset + 8, header + 8, 8);
+    size = ca_mp4_be64(header + 8);
+    headerSize = 16;
+  }
+  else if (size == 0)
+  {
+    size = parentEnd - offset;
+  }
+
+  if (result != ca_result_success || size < headerSize || size > parentEnd - offset)
+  {
+    return result != ca_result_success ? result : ca_result_unsupported_format;
+  }
+
+  memcpy(pBox->type, header + 4, 4);
+  pBox->offset = offset;
+  pBox->contentOffset = offset + headerSize;
+  pBox->end = offset + size;
+  return ca_result_success;
+}
+
+static ca_result ca_mp4_find_box(ca_mp4_parser *pParser, const ca_mp4_box *pParent, ca_uint64 contentOffset, const char *pType, ca_mp4_box *pBox)
+{
+  ca_uint64 offset = contentOffset;
+  for (int i = 0; i < MP4_MAX_CHILD_COUNT; i++)
+  {
+    ca_result result = ca_mp4_read_box(pParser, offset, pParent->end, pBox);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (memcmp(pBox->type, pType, 4) == 0)
+    {
+      return ca_result_success;
+    }
+    offset = pBox->end;
+  }
+  return ca_result_unsupported_format;
+}
+
+// Reads up to size bytes of a box's content, zero filling what the box does not have.
+static ca_result ca_mp4_read_content(ca_mp4_parser *pParser, const ca_mp4_box *pBox, ca_uint8 *pBuffer, ca_uint32 size)
+{
+  memset(pBuffer, 0, size);
+  ca_uint32 contentSize = (ca_uint32)ca_min(pBox->end - pBox->contentOffset, (ca_uint64)size);
+  return ca_mp4_read_exact(pParser, pBox->contentOffset, pBuffer, contentSize);
+}
+
+// MARK: Tables
+
+static void ca_mp4_table_start(ca_mp4_table *pTable, ca_uint64 offset, ca_uint64 end, ca_uint32 entrySize)
+{
+  pTable->offset = offset;
+  pTable->end = end;
+  pTable->entrySize = entrySize;
+  pTable->position = 0;
+  pTable->size = 0;
+}
+
+// Starts a cursor after the full box header and the headerSize bytes that precede the entries. The entry count is the last 4 bytes of that header.
+static ca_result ca_mp4_table_init(ca_mp4_parser *pParser, const ca_mp4_box *pBox, ca_uint32 headerSize, ca_uint32 entrySize, ca_uint32 *pEntryCount, ca_mp4_table *pTable)
+{
+  ca_uint8 header[8];
+  ca_uint64 tableOffset = pBox->contentOffset + 4 + headerSize;
+  if (headerSize < 4 || headerSize > sizeof(header) || tableOffset > pBox->end)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_result result = ca_mp4_read_exact(pParser, pBox->contentOffset + 4, header, headerSize);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  *pEntryCount = ca_mp4_be32(header + headerSize - 4);
+  ca_mp4_table_start(pTable, tableOffset, pBox->end, entrySize);
+  return ca_result_success;
+}
+
+// Returns the next entry, or NULL with ca_result_unsupported_format when the box ends.
+static const ca_uint8 *ca_mp4_table_next(ca_mp4_parser *pParser, ca_mp4_table *pTable, ca_result *pResult)
+{
+  if (pTable->size - pTable->position < pTable->entrySize)
+  {
+    ca_uint32 remaining = pTable->size - pTable->position;
+    memmove(pTable->buffer, pTable->buffer + pTable->position, remaining);
+
+    ca_uint32 readSize = (ca_uint32)ca_min(pTable->end - pTable->offset, (ca_uint64)(MP4_TABLE_BUFFER_SIZE - remaining));
+    if (remaining + readSize < pTable->entrySize)
+    {
+      *pResult = ca_result_unsupported_format;
+      return NULL;
+    }
+    readSize -= (remaining + readSize) % pTable->entrySize;
+
+    *pResult = ca_mp4_read_exact(pParser, pTable->offset, pTable->buffer + remaining, readSize);
+    if (*pResult != ca_result_success)
+    {
+      return NULL;
+    }
+
+    pTable->offset += readSize;
+    pTable->position = 0;
+    pTable->size = remaining + readSize;
+  }
+
+  const ca_uint8 *pEntry = pTable->buffer + pTable->position;
+  pTable->position += pTable->entrySize;
+  *pResult = ca_result_success;
+  return pEntry;
+}
+
+// MARK: Index
+
+static ca_bool ca_mp4_put_varint(ca_mp4_index_data *pIndexData, ca_uint64 value)
+{
+  if (pIndexData->streamCapacity - pIndexData->streamSize < 10)
+  {
+    if (pIndexData->streamCapacity > 0x7FFFFFFF)
+    {
+      return CA_FALSE;
+    }
+
+    ca_uint32 capacity = ca_max(pIndexData->streamCapacity * 2, 1024u);
+    ca_uint8 *pStream = (ca_uint8 *)realloc(pIndexData->pStream, capacity);
+    if (pStream == NULL)
+    {
+      return CA_FALSE;
+    }
+    pIndexData->pStream = pStream;
+    pIndexData->streamCapacity = capacity;
+  }
+
+  do
+  {
+    ca_uint8 byte = (ca_uint8)(value & 0x7F);
+    value >>= 7;
+    pIndexData->pStream[pIndexData->streamSize++] = byte | (value != 0 ? 0x80 : 0);
+  } while (value != 0);
+  return CA_TRUE;
+}
+
+static inline ca_uint64 ca_mp4_get_varint(const ca_uint8 *pStream, ca_uint32 *pPosition)
+{
+  ca_uint64 value = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    ca_uint8 byte = pStream[(*pPosition)++];
+    value |= (ca_uint64)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      break;
+    }
+  }
+  return value;
+}
+
+static ca_result ca_mp4_append_sample(ca_mp4_parser *pParser, ca_uint64 offset, ca_uint32 size, ca_uint32 duration)
+{
+  ca_mp4_index *pIndex = pParser->pIndex;
+  ca_mp4_index_data *pIndexData = pParser->pIndexData;
+  if (pIndex->sampleCount >= MP4_MAX_SAMPLE_COUNT)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  if (pIndex->sampleCount % MP4_BLOCK_SAMPLES == 0)
+  {
+    if (pIndexData->blockCount == pIndexData->blockCapacity)
+    {
+      ca_uint32 capacity = ca_max(pIndexData->blockCapacity * 2, 64u);
+      ca_mp4_block *pBlocks = (ca_mp4_block *)realloc(pIndexData->pBlocks, sizeof(ca_mp4_block) * capacity);
+      if (pBlocks == NULL)
+      {
+        return ca_result_out_of_memory;
+      }
+      pIndexData->pBlocks = pBlocks;
+      pIndexData->blockCapacity = capacity;
+    }
+
+    ca_mp4_block *pBlock = &pIndexData->pBlocks[pIndexData->blockCount++];
+    pBlock->ticks = pIndexData->totalTicks;
+    pBlock->offset = offset;
+    pBlock->position = pIndexData->streamSize;
+  }
+
+  ca_int64 gap = (ca_int64)(offset - pIndexData->lastEnd);
+  ca_uint64 zigzag = ((ca_uint64)gap << 1) ^ (ca_uint64)(gap >> 63);
+  if (!ca_mp4_put_varint(pIndexData, size) || !ca_mp4_put_varint(pIndexData, duration) || !ca_mp4_put_varint(pIndexData, zigzag))
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pIndexData->totalTicks += duration;
+  pIndexData->lastEnd = offset + size;
+  pIndex->sampleCount++;
+  return ca_result_success;
+}
+
+// Decodes the next sample of a block walk. The first sample of the block takes the block's absolute offset.
+static void ca_mp4_next_sample(const ca_mp4_index_data *pIndexData, ca_uint32 *pPosition, ca_bool isFirst, ca_uint64 *pOffset, ca_uint32 *pSize, ca_uint32 *pDuration)
+{
+  ca_uint64 end = *pOffset + *pSize;
+  *pSize = (ca_uint32)ca_mp4_get_varint(pIndexData->pStream, pPosition);
+  *pDuration = (ca_uint32)ca_mp4_get_varint(pIndexData->pStream, pPosition);
+  ca_uint64 zigzag = ca_mp4_get_varint(pIndexData->pStream, pPosition);
+  if (!isFirst)
+  {
+    ca_int64 gap = (ca_int64)(zigzag >> 1) ^ -(ca_int64)(zigzag & 1);
+    *pOffset = end + (ca_uint64)gap;
+  }
+}
+
+// MARK: Sample tables
+
+static ca_result ca_mp4_stbl(ca_mp4_parser *pParser, const ca_mp4_box *pStbl)
+{
+  ca_mp4_box stts, stsz, stsc, stco;
+  ca_bool isCo64 = CA_FALSE, isCompact = CA_FALSE;
+  ca_result result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "stts", &stts);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "stsc", &stsc);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "stsz", &stsz);
+    if (result == ca_result_unsupported_format)
+    {
+      isCompact = CA_TRUE;
+      result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "stz2", &stsz);
+    }
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "stco", &stco);
+    if (result == ca_result_unsupported_format)
+    {
+      isCo64 = CA_TRUE;
+      result = ca_mp4_find_box(pParser, pStbl, pStbl->contentOffset, "co64", &stco);
+    }
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // stsz has a uniform size followed by the count, stz2 has a field size in bits.
+  ca_uint8 sizeHeader[8];
+  result = ca_mp4_read_exact(pParser, stsz.contentOffset + 4, sizeHeader, sizeof(sizeHeader));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint32 uniformSize = isCompact ? 0 : ca_mp4_be32(sizeHeader);
+  ca_uint32 fieldSize = isCompact ? sizeHeader[3] : 32;
+  if (fieldSize != 4 && fieldSize != 8 && fieldSize != 16 && fieldSize != 32)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_uint32 sampleCount = 0, timeCount = 0, chunkMapCount = 0, chunkCount = 0;
+  ca_mp4_table *pTables = (ca_mp4_table *)malloc(sizeof(ca_mp4_table) * 4);
+  if (pTables == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_mp4_table *pSizes = &pTables[0], *pTimes = &pTables[1], *pChunkMap = &pTables[2], *pChunks = &pTables[3];
+  result = ca_mp4_table_init(pParser, &stsz, 8, fieldSize == 4 ? 1 : fieldSize / 8, &sampleCount, pSizes);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_table_init(pParser, &stts, 4, 8, &timeCount, pTimes);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_table_init(pParser, &stsc, 4, 12, &chunkMapCount, pChunkMap);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_table_init(pParser, &stco, 4, isCo64 ? 8 : 4, &chunkCount, pChunks);
+  }
+
+  // Walks the chunks and the samples of each chunk. stsc maps runs of chunks to a sample count and stts runs of samples to a duration.
+  ca_uint32 samplesPerChunk = 0, nextFirstChunk = 1, nextSamplesPerChunk = 0, chunkMapIndex = 0;
+  ca_uint32 timeRemaining = 0, duration = 0, timeIndex = 0;
+  ca_uint8 packedSizes = 0;
+  ca_uint32 sampleIndex = 0;
+  for (ca_uint32 chunk = 1; chunk <= chunkCount && sampleIndex < sampleCount && result == ca_result_success; chunk++)
+  {
+    while (chunk >= nextFirstChunk)
+    {
+      samplesPerChunk = nextSamplesPerChunk;
+      nextFirstChunk = 0xFFFFFFFF;
+      const ca_uint8 *pEntry = chunkMapIndex < chunkMapCount ? ca_mp4_table_next(pParser, pChunkMap, &result) : NULL;
+      if (pEntry != NULL)
+      {
+        nextFirstChunk = ca_mp4_be32(pEntry);
+        nextSamplesPerChunk = ca_mp4_be32(pEntry + 4);
+        chunkMapIndex++;
+      }
+    }
+
+    const ca_uint8 *pChunk = ca_mp4_table_next(pParser, pChunks, &result);
+    if (pChunk == NULL)
+    {
+      break;
+    }
+
+    ca_uint64 offset = isCo64 ? ca_mp4_be64(pChunk) : ca_mp4_be32(pChunk);
+    for (ca_uint32 i = 0; i < samplesPerChunk && sampleIndex < sampleCount && result == ca_result_success; i++)
+    {
+      ca_uint32 size = uniformSize;
+      if (uniformSize == 0)
+      {
+        if (fieldSize != 4 || sampleIndex % 2 == 0)
+        {
+          const ca_uint8 *pSize = ca_mp4_table_next(pParser, pSizes, &result);
+          if (pSize == NULL)
+          {
+            break;
+          }
+
+          switch (fieldSize)
+          {
+          case 4:
+            packedSizes = pSize[0];
+            size = packedSizes >> 4;
+            break;
+          case 8:
+            size = pSize[0];
+            break;
+          case 16:
+            size = ca_mp4_be16(pSize);
+            break;
+          default:
+            size = ca_mp4_be32(pSize);
+            break;
+          }
+        }
+        else
+        {
+          size = packedSizes & 0x0F;
+        }
+      }
+
+      // The last duration carries over when stts is shorter than the sample count.
+      while (timeRemaining == 0 && timeIndex < timeCount)
+      {
+        const ca_uint8 *pTime = ca_mp4_table_next(pParser, pTimes, &result);
+        if (pTime == NULL)
+        {
+          break;
+        }
+        timeRemaining = ca_mp4_be32(pTime);
+        duration = ca_mp4_be32(pTime + 4);
+        timeIndex++;
+      }
+
+      if (result != ca_result_success || offset + size > pParser->length)
+      {
+        break;
+      }
+
+      result = ca_mp4_append_sample(pParser, offset, size, duration);
+      offset += size;
+      timeRemaining -= timeRemaining > 0 ? 1 : 0;
+      sampleIndex++;
+    }
+  }
+
+  free(pTables);
+
+  // A truncated table still indexes the samples before the damage.
+  if (result == ca_result_unsupported_format && pParser->pIndex->sampleCount > 0)
+  {
+    result = ca_result_success;
+  }
+  return result;
+}
+
+// MARK: Movie
+
+static ca_result ca_mp4_edts(ca_mp4_parser *pParser, const ca_mp4_box *pEdts)
+{
+  ca_mp4_box elst;
+  ca_result result = ca_mp4_find_box(pParser, pEdts, pEdts->contentOffset, "elst", &elst);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint8 header[8];
+  result = ca_mp4_read_exact(pParser, elst.contentOffset, header, sizeof(header));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // Empty edits (media_time -1) delay the start, which a decoder has no use for. The first edit into the media gives the priming.
+  ca_bool isVersion1 = header[0] == 1;
+  ca_uint32 entryCount = ca_mp4_be32(header + 4);
+  ca_uint32 entrySize = isVersion1 ? 20 : 12;
+  ca_uint64 offset = elst.contentOffset + 8;
+  for (ca_uint32 i = 0; i < entryCount && offset + entrySize <= elst.end; i++, offset += entrySize)
+  {
+    ca_uint8 entry[20];
+    result = ca_mp4_read_exact(pParser, offset, entry, entrySize);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_int64 mediaTime = isVersion1 ? (ca_int64)ca_mp4_be64(entry + 8) : (ca_int64)(ca_int32)ca_mp4_be32(entry + 4);
+    if (mediaTime < 0)
+    {
+      continue;
+    }
+
+    pParser->hasEdit = CA_TRUE;
+    pParser->mediaTime = (ca_uint64)mediaTime;
+    pParser->segmentDuration = isVersion1 ? ca_mp4_be64(entry) : ca_mp4_be32(entry);
+    break;
+  }
+  return ca_result_success;
+}
+
+// Indexes the first sound track. Returns ca_result_unsupported_format for other tracks so the caller moves on.
+static ca_result ca_mp4_trak(ca_mp4_parser *pParser, const ca_mp4_box *pTrak)
+{
+  ca_mp4_index *pIndex = pParser->pIndex;
+  ca_mp4_box tkhd, mdia, hdlr, mdhd, minf, stbl, stsd, edts;
+  ca_uint8 handler[12], trackHeader[24], mediaHeader[24], entry[36];
+  ca_result result = ca_mp4_find_box(pParser, pTrak, pTrak->contentOffset, "mdia", &mdia);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, &mdia, mdia.contentOffset, "hdlr", &hdlr);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_read_content(pParser, &hdlr, handler, sizeof(handler));
+  }
+
+  if (result != ca_result_success || memcmp(handler + 8, "soun", 4) != 0)
+  {
+    return result != ca_result_success ? result : ca_result_unsupported_format;
+  }
+
+  result = ca_mp4_find_box(pParser, pTrak, pTrak->contentOffset, "tkhd", &tkhd);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_read_content(pParser, &tkhd, trackHeader, sizeof(trackHeader));
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, &mdia, mdia.contentOffset, "mdhd", &mdhd);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_read_content(pParser, &mdhd, mediaHeader, sizeof(mediaHeader));
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, &mdia, mdia.contentOffset, "minf", &minf);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, &minf, minf.contentOffset, "stbl", &stbl);
+  }
+
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_find_box(pParser, &stbl, stbl.contentOffset, "stsd", &stsd);
+  }
+
+  // The first sample entry follows the version, the flags and the entry count.
+  if (result == ca_result_success)
+  {
+    result = stsd.contentOffset + 8 + sizeof(entry) <= stsd.end ? ca_mp4_read_exact(pParser, stsd.contentOffset + 8, entry, sizeof(entry)) : ca_result_unsupported_format;
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_bool isVersion1 = trackHeader[0] == 1;
+  pParser->trackId = ca_mp4_be32(trackHeader + (isVersion1 ? 20 : 12));
+  isVersion1 = mediaHeader[0] == 1;
+  pIndex->timescale = ca_mp4_be32(mediaHeader + (isVersion1 ? 20 : 12));
+  pIndex->codec = ca_mp4_be32(entry + 4);
+  pIndex->channels = ca_mp4_be16(entry + 24);
+
+  // The 16.16 rate overflows above 65535 Hz, where the media timescale is the rate.
+  pIndex->sampleRate = ca_mp4_be32(entry + 32) >> 16;
+  if (pIndex->sampleRate == 0)
+  {
+    pIndex->sampleRate = pIndex->timescale;
+  }
+
+  if (pIndex->timescale == 0)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  pParser->hasTrack = CA_TRUE;
+  result = ca_mp4_find_box(pParser, pTrak, pTrak->contentOffset, "edts", &edts);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_edts(pParser, &edts);
+  }
+
+  if (result == ca_result_success || result == ca_result_unsupported_format)
+  {
+    result = ca_mp4_stbl(pParser, &stbl);
+  }
+
+  // Fragmented files have empty sample tables.
+  return result == ca_result_unsupported_format ? ca_result_success : result;
+}
+
+static ca_result ca_mp4_mvex(ca_mp4_parser *pParser, const ca_mp4_box *pMvex)
+{
+  ca_uint64 offset = pMvex->contentOffset;
+  for (int i = 0; i < MP4_MAX_CHILD_COUNT; i++)
+  {
+    ca_mp4_box trex;
+    ca_result result = ca_mp4_find_box(pParser, pMvex, offset, "trex", &trex);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    offset = trex.end;
+
+    ca_uint8 defaults[24];
+    result = ca_mp4_read_content(pParser, &trex, defaults, sizeof(defaults));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (ca_mp4_be32(defaults + 4) == pParser->trackId)
+    {
+      pParser->defaultDuration = ca_mp4_be32(defaults + 12);
+      pParser->defaultSize = ca_mp4_be32(defaults + 16);
+      return ca_result_success;
+    }
+  }
+  return ca_result_unsupported_format;
+}
+
+static ca_result ca_mp4_moov(ca_mp4_parser *pParser, const ca_mp4_box *pMoov)
+{
+  ca_mp4_box mvhd, mvex;
+  ca_uint8 movieHeader[24];
+  ca_result result = ca_mp4_find_box(pParser, pMoov, pMoov->contentOffset, "mvhd", &mvhd);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_read_content(pParser, &mvhd, movieHeader, sizeof(movieHeader));
+  }
+
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+  pParser->movieTimescale = ca_mp4_be32(movieHeader + (movieHeader[0] == 1 ? 20 : 12));
+
+  ca_uint64 offset = pMoov->contentOffset;
+  while (!pParser->hasTrack)
+  {
+    ca_mp4_box trak;
+    result = ca_mp4_find_box(pParser, pMoov, offset, "trak", &trak);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    offset = trak.end;
+
+    result = ca_mp4_trak(pParser, &trak);
+    if (result != ca_result_success && result != ca_result_unsupported_format)
+    {
+      return result;
+    }
+  }
+
+  result = ca_mp4_find_box(pParser, pMoov, pMoov->contentOffset, "mvex", &mvex);
+  if (result == ca_result_success)
+  {
+    pParser->pIndex->isFragmented = CA_TRUE;
+    result = ca_mp4_mvex(pParser, &mvex);
+  }
+  return result == ca_result_unsupported_format ? ca_result_success : result;
+}
+
+// MARK: Fragments
+
+static ca_result ca_mp4_trun(ca_mp4_parser *pParser, const ca_mp4_box *pTrun, ca_uint64 *pDataOffset, ca_uint32 defaultDuration, ca_uint32 defaultSize)
+{
+  ca_uint8 header[16];
+  ca_result result = ca_mp4_read_content(pParser, pTrun, header, sizeof(header));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint32 flags = ca_mp4_be32(header) & 0xFFFFFF;
+  ca_uint32 sampleCount = ca_mp4_be32(header + 4);
+  ca_uint32 headerSize = 8;
+  if ((flags & MP4_TRUN_DATA_OFFSET) != 0)
+  {
+    *pDataOffset += (ca_uint64)(ca_int64)(ca_int32)ca_mp4_be32(header + headerSize);
+    headerSize += 4;
+  }
+
+  if ((flags & MP4_TRUN_FIRST_SAMPLE_FLAGS) != 0)
+  {
+    headerSize += 4;
+  }
+
+  ca_uint32 entrySize = 0;
+  ca_uint32 durationPosition = entrySize;
+  entrySize += (flags & MP4_TRUN_SAMPLE_DURATION) != 0 ? 4 : 0;
+  ca_uint32 sizePosition = entrySize;
+  entrySize += (flags & MP4_TRUN_SAMPLE_SIZE) != 0 ? 4 : 0;
+  entrySize += (flags & MP4_TRUN_SAMPLE_FLAGS) != 0 ? 4 : 0;
+  entrySize += (flags & MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET) != 0 ? 4 : 0;
+
+  // The entries are absent when every flag is off and all samples take the defaults.
+  ca_mp4_table table;
+  ca_mp4_table_start(&table, pTrun->contentOffset + headerSize, pTrun->end, entrySize);
+
+  for (ca_uint32 i = 0; i < sampleCount && result == ca_result_success; i++)
+  {
+    ca_uint32 duration = defaultDuration, size = defaultSize;
+    if (entrySize > 0)
+    {
+      const ca_uint8 *pEntry = ca_mp4_table_next(pParser, &table, &result);
+      if (pEntry == NULL)
+      {
+        break;
+      }
+      duration = (flags & MP4_TRUN_SAMPLE_DURATION) != 0 ? ca_mp4_be32(pEntry + durationPosition) : duration;
+      size = (flags & MP4_TRUN_SAMPLE_SIZE) != 0 ? ca_mp4_be32(pEntry + sizePosition) : size;
+    }
+
+    if (*pDataOffset + size > pParser->length)
+    {
+      return ca_result_unsupported_format;
+    }
+
+    result = ca_mp4_append_sample(pParser, *pDataOffset, size, duration);
+    *pDataOffset += size;
+  }
+  return result;
+}
+
+static ca_result ca_mp4_traf(ca_mp4_parser *pParser, const ca_mp4_box *pMoof, const ca_mp4_box *pTraf)
+{
+  ca_mp4_box tfhd;
+  ca_uint8 header[40];
+  ca_result result = ca_mp4_find_box(pParser, pTraf, pTraf->contentOffset, "tfhd", &tfhd);
+  if (result == ca_result_success)
+  {
+    result = ca_mp4_read_content(pParser, &tfhd, header, sizeof(header));
+  }
+
+  if (result != ca_result_success || ca_mp4_be32(header + 4) != pParser->trackId)
+  {
+    return result;
+  }
+
+  // Without an explicit base the data is addressed from the moof box, which is what muxers write in practice.
+  ca_uint32 flags = ca_mp4_be32(header) & 0xFFFFFF;
+  ca_uint32 position = 8;
+  ca_uint64 dataOffset = pMoof->offset;
+  ca_uint32 defaultDuration = pParser->defaultDuration, defaultSize = pParser->defaultSize;
+  if ((flags & MP4_TFHD_BASE_DATA_OFFSET) != 0)
+  {
+    dataOffset = ca_mp4_be64(header + position);
+    position += 8;
+  }
+
+  if ((flags & MP4_TFHD_SAMPLE_DESCRIPTION_INDEX) != 0)
+  {
+    position += 4;
+  }
+
+  if ((flags & MP4_TFHD_DEFAULT_SAMPLE_DURATION) != 0)
+  {
+    defaultDuration = ca_mp4_be32(header + position);
+    position += 4;
+  }
+
+  if ((flags & MP4_TFHD_DEFAULT_SAMPLE_SIZE) != 0)
+  {
+    defaultSize = ca_mp4_be32(header + position);
+  }
+
+  // A trun box without a data offset continues where the previous one ended.
+  ca_uint64 offset = pTraf->contentOffset;
+  ca_uint64 baseOffset = dataOffset;
+  for (int i = 0; i < MP4_MAX_CHILD_COUNT; i++)
+  {
+    ca_mp4_box trun;
+    result = ca_mp4_find_box(pParser, pTraf, offset, "trun", &trun);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+    offset = trun.end;
+
+    ca_uint8 trunFlags[4];
+    result = ca_mp4_read_exact(pParser, trun.contentOffset, trunFlags, sizeof(trunFlags));
+    if (result == ca_result_success && (trunFlags[3] & MP4_TRUN_DATA_OFFSET) != 0)
+    {
+      dataOffset = baseOffset;
+    }
+
+    if (result == ca_result_success)
+    {
+      result = ca_mp4_trun(pParser, &trun, &dataOffset, defaultDuration, defaultSize);
+    }
+
+    if (result != ca_result_success)
+    {
+      break;
+    }
+  }
+  return result == ca_result_unsupported_format ? ca_result_success : result;
+}
+
+static ca_result ca_mp4_moof(ca_mp4_parser *pParser, const ca_mp4_box *pMoof)
+{
+  ca_uint64 offset = pMoof->contentOffset;
+  for (int i = 0; i < MP4_MAX_CHILD_COUNT; i++)
+  {
+    ca_mp4_box traf;
+    ca_result result = ca_mp4_find_box(pParser, pMoof, offset, "traf", &traf);
+    if (result != ca_result_success)
+    {
+      return result == ca_result_unsupported_format ? ca_result_success : result;
+    }
+    offset = traf.end;
+
+    result = ca_mp4_traf(pParser, pMoof, &traf);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+  return ca_result_success;
+}
+
+// MARK: Lookup
+
+static inline ca_uint64 ca_mp4_frames(ca_uint64 ticks, ca_uint32 timescale, ca_uint32 sampleRate)
+{
+  if (timescale == sampleRate || timescale == 0)
+  {
+    return ticks;
+  }
+  return ticks / timescale * sampleRate + ticks % timescale * sampleRate / timescale;
+}
+
+static void ca_mp4_index_reset(ca_mp4_index *pIndex)
+{
+  ca_mp4_index_data *pIndexData = (ca_mp4_index_data *)pIndex->pData;
+  if (pIndexData != NULL)
+  {
+    free(pIndexData->pBlocks);
+    free(pIndexData->pStream);
+    free(pIndexData);
+  }
+  ca_zero_memory(pIndex);
+}
+
+ca_result ca_mp4_index_init(ca_mp4_index *pIndex, ca_source source)
+{
+  if (pIndex == NULL || source.pReadProc == NULL || source.pSeekProc == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_zero_memory(pIndex);
+  ca_mp4_parser parser = {0};
+  parser.source = source;
+  parser.position = 0xFFFFFFFFFFFFFFFFULL;
+  parser.length = 0xFFFFFFFFFFFFFFFFULL;
+  parser.pIndex = pIndex;
+
+  ca_uint64 position = 0;
+  if (source.pTellProc != NULL && source.pTellProc(&position, &parser.length, source.pUserData) != ca_tell_result_success)
+  {
+    parser.length = 0xFFFFFFFFFFFFFFFFULL;
+  }
+
+  ca_mp4_box file = {{0}, 0, 0, parser.length};
+  ca_mp4_box box;
+  ca_result result = ca_mp4_read_box(&parser, 0, file.end, &box);
+  if (result != ca_result_success || memcmp(box.type, "ftyp", 4) != 0)
+  {
+    return result == ca_result_success ? ca_result_unsupported_format : result;
+  }
+
+  parser.pIndexData = (ca_mp4_index_data *)calloc(1, sizeof(ca_mp4_index_data));
+  if (parser.pIndexData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+  pIndex->pData = parser.pIndexData;
+
+  // The top-level boxes are walked by their headers. Fragments are only indexed once the moov box has named the track.
+  ca_uint64 offset = box.end;
+  for (ca_uint32 i = 0; i < MP4_MAX_TOP_LEVEL_COUNT && result == ca_result_success; i++)
+  {
+    result = ca_mp4_read_box(&parser, offset, file.end, &box);
+    if (result != ca_result_success)
+    {
+      break;
+    }
+    offset = box.end;
+
+    if (memcmp(box.type, "moov", 4) == 0 && !parser.hasTrack)
+    {
+      result = ca_mp4_moov(&parser, &box);
+    }
+    else if (memcmp(box.type, "moof", 4) == 0 && parser.hasTrack && pIndex->isFragmented)
+    {
+      result = ca_mp4_moof(&parser, &box);
+    }
+  }
+
+  if (result != ca_result_unsupported_format && result != ca_result_success)
+  {
+    ca_mp4_index_reset(pIndex);
+    return result;
+  }
+
+  if (!parser.hasTrack || pIndex->sampleCount == 0)
+  {
+    ca_mp4_index_reset(pIndex);
+    return ca_result_unsupported_format;
+  }
+
+  ca_uint64 totalTicks = parser.pIndexData->totalTicks;
+  pIndex->primingTicks = parser.hasEdit ? ca_min(parser.mediaTime, totalTicks) : 0;
+  pIndex->presentationTicks = totalTicks - pIndex->primingTicks;
+  if (parser.hasEdit && parser.segmentDuration > 0 && parser.movieTimescale > 0)
+  {
+    ca_uint64 segmentTicks = ca_mp4_frames(parser.segmentDuration, parser.movieTimescale, pIndex->timescale);
+    pIndex->presentationTicks = ca_min(pIndex->presentationTicks, segmentTicks);
+  }
+  return ca_result_success;
+}
+
+ca_uint64 ca_mp4_index_ticks_to_frames(const ca_mp4_index *pIndex, ca_uint64 ticks, ca_uint32 sampleRate)
+{
+  return ca_mp4_frames(ticks, pIndex->timescale, sampleRate);
+}
+
+ca_uint64 ca_mp4_index_get_length(const ca_mp4_index *pIndex, ca_uint32 sampleRate)
+{
+  ca_uint64 primingFrames = ca_mp4_frames(pIndex->primingTicks, pIndex->timescale, sampleRate);
+  return ca_mp4_frames(pIndex->primingTicks + pIndex->presentationTicks, pIndex->timescale, sampleRate) - primingFrames;
+}
+
+ca_result ca_mp4_index_get_sample(const ca_mp4_index *pIndex, ca_uint32 sampleIndex, ca_uint32 sampleRate, ca_mp4_sample *pSample)
+{
+  if (pIndex == NULL || pIndex->pData == NULL || sampleIndex >= pIndex->sampleCount)
+  {
+    return ca_result_invalid_args;
+  }
+
+  const ca_mp4_index_data *pIndexData = (const ca_mp4_index_data *)pIndex->pData;
+  const ca_mp4_block *pBlock = &pIndexData->pBlocks[sampleIndex / MP4_BLOCK_SAMPLES];
+  ca_uint32 position = pBlock->position;
+  ca_uint64 offset = pBlock->offset, ticks = pBlock->ticks;
+  ca_uint32 size = 0, duration = 0;
+  for (ca_uint32 i = 0; i <= sampleIndex % MP4_BLOCK_SAMPLES; i++)
+  {
+    ticks += duration;
+    ca_mp4_next_sample(pIndexData, &position, i == 0, &offset, &size, &duration);
+  }
+
+  ca_uint64 frame = ca_mp4_frames(ticks, pIndex->timescale, sampleRate);
+  pSample->sampleIndex = sampleIndex;
+  pSample->offset = offset;
+  pSample->size = size;
+  pSample->frame = frame;
+  pSample->frameCount = (ca_uint32)(ca_mp4_frames(ticks + duration, pIndex->timescale, sampleRate) - frame);
+  return ca_result_success;
+}
+
+ca_result ca_mp4_index_find_seek_target(const ca_mp4_index *pIndex, ca_uint64 frameIndex, ca_uint32 sampleRate, ca_uint32 prerollSamples, ca_mp4_sample *pSample, ca_uint64 *pFramesToDiscard)
+{
+  if (pIndex == NULL || pIndex->pData == NULL || pIndex->sampleCount == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  // The last block starting at or before the target, then the sample holding it. Targets past the end land on the last sample.
+  const ca_mp4_index_data *pIndexData = (const ca_mp4_index_data *)pIndex->pData;
+  ca_uint64 target = frameIndex + ca_mp4_frames(pIndex->primingTicks, pIndex->timescale, sampleRate);
+  ca_uint32 low = 0, high = pIndexData->blockCount;
+  while (high - low > 1)
+  {
+    ca_uint32 middle = low + (high - low) / 2;
+    if (ca_mp4_frames(pIndexData->pBlocks[middle].ticks, pIndex->timescale, sampleRate) <= target)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  const ca_mp4_block *pBlock = &pIndexData->pBlocks[low];
+  ca_uint32 position = pBlock->position;
+  ca_uint64 offset = pBlock->offset, ticks = pBlock->ticks;
+  ca_uint32 size = 0, duration = 0;
+  ca_uint32 sampleIndex = low * MP4_BLOCK_SAMPLES;
+  ca_uint32 blockEnd = ca_min(sampleIndex + MP4_BLOCK_SAMPLES, pIndex->sampleCount);
+  for (; sampleIndex < blockEnd; sampleIndex++)
+  {
+    ca_mp4_next_sample(pIndexData, &position, sampleIndex == low * MP4_BLOCK_SAMPLES, &offset, &size, &duration);
+    if (ca_mp4_frames(ticks + duration, pIndex->timescale, sampleRate) > target)
+    {
+      break;
+    }
+    ticks += duration;
+  }
+  sampleIndex = ca_min(sampleIndex, pIndex->sampleCount - 1);
+
+  ca_result result = ca_mp4_index_get_sample(pIndex, sampleIndex - ca_min(sampleIndex, prerollSamples), sampleRate, pSample);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  *pFramesToDiscard = target - pSample->frame;
+  return ca_result_success;
+}
+
+ca_uint64 ca_mp4_index_get_size_in_bytes(const ca_mp4_index *pIndex)
+{
+  const ca_mp4_index_data *pIndexData = (const ca_mp4_index_data *)pIndex->pData;
+  if (pIndexData == NULL)
+  {
+    return 0;
+  }
+  return sizeof(ca_mp4_index_data) + (ca_uint64)sizeof(ca_mp4_block) * pIndexData->blockCapacity + pIndexData->streamCapacity;
+}
+
+void ca_mp4_index_uninit(ca_mp4_index *pIndex)
+{
+  ca_mp4_index_reset(pIndex);
+}
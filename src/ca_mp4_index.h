@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ca_io.h"
+
+// A sample of the indexed track. frame and frameCount are in the requested sample rate and include the priming frames.
+typedef struct
+{
+  ca_uint32 sampleIndex;
+  ca_uint64 offset;
+  ca_uint32 size;
+  ca_uint64 frame;
+  ca_uint32 frameCount;
+} ca_mp4_sample;
+
+// The sample table of the first audio track of an ISO-BMFF (MP4, M4A) file, read from stts, stsz, stsc and stco/co64 or from the fragments' trun boxes.
+// Sample sizes, durations and offset gaps are stored as varints with an absolute position every few samples, so a lookup decodes at most one block.
+typedef struct
+{
+  // The sample entry type, e.g. 'mp4a' or 'alac', and its format.
+  ca_uint32 codec;
+  ca_uint32 channels;
+  ca_uint32 sampleRate;
+
+  // Media timescale of the track. The priming and presentation lengths come from the edit list.
+  ca_uint32 timescale;
+  ca_uint64 primingTicks;
+  ca_uint64 presentationTicks;
+
+  ca_uint32 sampleCount;
+  ca_bool isFragmented;
+  void *pData;
+} ca_mp4_index;
+
+// Returns ca_result_unsupported_format when the source is not an MP4 file with an audio track. The source position is undefined afterwards.
+ca_result ca_mp4_index_init(ca_mp4_index *pIndex, ca_source source);
+
+// Converts media ticks to frames of sampleRate, which is the decoder output rate and can differ from the timescale.
+ca_uint64 ca_mp4_index_ticks_to_frames(const ca_mp4_index *pIndex, ca_uint64 ticks, ca_uint32 sampleRate);
+
+// Returns the playable frames after the priming frames are removed.
+ca_uint64 ca_mp4_index_get_length(const ca_mp4_index *pIndex, ca_uint32 sampleRate);
+
+ca_result ca_mp4_index_get_sample(const ca_mp4_index *pIndex, ca_uint32 sampleIndex, ca_uint32 sampleRate, ca_mp4_sample *pSample);
+
+// Finds where to start decoding for the playable frame frameIndex.
+// Decoding starts prerollSamples before the sample holding the frame, and pFramesToDiscard receives the frames decoded before it.
+ca_result ca_mp4_index_find_seek_target(const ca_mp4_index *pIndex, ca_uint64 frameIndex, ca_uint32 sampleRate, ca_uint32 prerollSamples, ca_mp4_sample *pSample, ca_uint64 *pFramesToDiscard);
+
+// Returns the bytes of the sample tables.
+ca_uint64 ca_mp4_index_get_size_in_bytes(const ca_mp4_index *pIndex);
+
+void ca_mp4_index_uninit(ca_mp4_index *pIndex);
@@ -0,0 +1,250 @@
+#include "ca_pcm_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The size is split evenly, so replaying a short loop keeps most of it while a new window replaces at most an eighth.
+#define PCM_CACHE_WINDOW_COUNT 8
+
+typedef struct
+{
+  ca_uint64 startFrame;
+  ca_uint32 frameCount;
+  ca_uint64 lastUsed;
+  ca_uint8 *pFrames;
+} ca_pcm_cache_window;
+
+typedef struct
+{
+  ca_pcm_cache_window windows[PCM_CACHE_WINDOW_COUNT];
+
+  // Window the last stored frames went to, or -1.
+  int appendIndex;
+  ca_uint64 nextSerial;
+} ca_pcm_cache_data;
+
+static ca_pcm_cache_window *ca_pcm_cache_find(ca_pcm_cache_data *pData, ca_uint64 frameIndex)
+{
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    ca_pcm_cache_window *pWindow = &pData->windows[i];
+    if (pWindow->frameCount > 0 && frameIndex >= pWindow->startFrame && frameIndex - pWindow->startFrame < pWindow->frameCount)
+    {
+      return pWindow;
+    }
+  }
+  return NULL;
+}
+
+// Returns the start of the first window after frameIndex, so a new window stops short of it.
+static ca_uint64 ca_pcm_cache_next_start(ca_pcm_cache_data *pData, ca_uint64 frameIndex)
+{
+  ca_uint64 nextStart = ~(ca_uint64)0;
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    ca_pcm_cache_window *pWindow = &pData->windows[i];
+    if (pWindow->frameCount > 0 && pWindow->startFrame > frameIndex)
+    {
+      nextStart = ca_min(nextStart, pWindow->startFrame);
+    }
+  }
+  return nextStart;
+}
+
+static ca_uint32 ca_pcm_cache_count_buffers(ca_pcm_cache_data *pData)
+{
+  ca_uint32 bufferCount = 0;
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    bufferCount += pData->windows[i].pFrames != NULL;
+  }
+  return bufferCount;
+}
+
+// Takes an unused window or the least recently used one, within windowLimit. Returns -1 when none can be used.
+static int ca_pcm_cache_take_window(ca_pcm_cache *pCache, ca_pcm_cache_data *pData)
+{
+  ca_bool canAllocate = ca_pcm_cache_count_buffers(pData) < pCache->windowLimit;
+  int index = -1;
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    ca_pcm_cache_window *pWindow = &pData->windows[i];
+    if (pWindow->pFrames == NULL && !canAllocate)
+    {
+      continue;
+    }
+
+    if (index < 0 || (pData->windows[index].frameCount > 0 && (pWindow->frameCount == 0 || pWindow->lastUsed < pData->windows[index].lastUsed)))
+    {
+      index = i;
+    }
+  }
+
+  if (index < 0)
+  {
+    return -1;
+  }
+
+  ca_pcm_cache_window *pWindow = &pData->windows[index];
+  if (pWindow->pFrames == NULL)
+  {
+    pWindow->pFrames = (ca_uint8 *)malloc((size_t)pCache->windowCapacity * pCache->bytesPerFrame);
+    if (pWindow->pFrames == NULL)
+    {
+      return -1;
+    }
+  }
+
+  pWindow->frameCount = 0;
+  return index;
+}
+
+ca_result ca_pcm_cache_init(ca_pcm_cache *pCache, ca_uint64 sizeInBytes, ca_uint32 bytesPerFrame)
+{
+  ca_uint64 windowCapacity = bytesPerFrame == 0 ? 0 : sizeInBytes / PCM_CACHE_WINDOW_COUNT / bytesPerFrame;
+  if (windowCapacity == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)calloc(1, sizeof(ca_pcm_cache_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->appendIndex = -1;
+  pCache->bytesPerFrame = bytesPerFrame;
+  pCache->windowCapacity = (ca_uint32)ca_min(windowCapacity, (ca_uint64)0xFFFFFFFF);
+  pCache->windowLimit = PCM_CACHE_WINDOW_COUNT;
+  pCache->endFrame = ~(ca_uint64)0;
+  pCache->pData = pData;
+  return ca_result_success;
+}
+
+void ca_pcm_cache_store(ca_pcm_cache *pCache, ca_uint64 frameIndex, ca_uint32 frameCount, const void *pFrames)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  const ca_uint8 *pBytes = (const ca_uint8 *)pFrames;
+  while (frameCount > 0)
+  {
+    ca_uint32 count = 0;
+    ca_pcm_cache_window *pWindow = ca_pcm_cache_find(pData, frameIndex);
+    if (pWindow != NULL)
+    {
+      count = (ca_uint32)ca_min((ca_uint64)frameCount, pWindow->startFrame + pWindow->frameCount - frameIndex);
+      pWindow->lastUsed = pData->nextSerial++;
+      pData->appendIndex = (int)(pWindow - pData->windows);
+    }
+    else
+    {
+      // Frames following the last stored ones grow the same window until it is full.
+      pWindow = pData->appendIndex < 0 ? NULL : &pData->windows[pData->appendIndex];
+      if (pWindow == NULL || pWindow->startFrame + pWindow->frameCount != frameIndex || pWindow->frameCount == pCache->windowCapacity)
+      {
+        pData->appendIndex = ca_pcm_cache_take_window(pCache, pData);
+        if (pData->appendIndex < 0)
+        {
+          return;
+        }
+        pWindow = &pData->windows[pData->appendIndex];
+        pWindow->startFrame = frameIndex;
+      }
+
+      ca_uint64 space = ca_min((ca_uint64)(pCache->windowCapacity - pWindow->frameCount), ca_pcm_cache_next_start(pData, frameIndex) - frameIndex);
+      count = (ca_uint32)ca_min((ca_uint64)frameCount, space);
+      memcpy(pWindow->pFrames + (size_t)pWindow->frameCount * pCache->bytesPerFrame, pBytes, (size_t)count * pCache->bytesPerFrame);
+      pWindow->frameCount += count;
+      pWindow->lastUsed = pData->nextSerial++;
+    }
+
+    frameIndex += count;
+    frameCount -= count;
+    pBytes += (size_t)count * pCache->bytesPerFrame;
+  }
+}
+
+ca_uint32 ca_pcm_cache_read(ca_pcm_cache *pCache, ca_uint64 frameIndex, ca_uint32 maxFrames, const void **ppFrames)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  ca_pcm_cache_window *pWindow = ca_pcm_cache_find(pData, frameIndex);
+  if (pWindow == NULL)
+  {
+    return 0;
+  }
+
+  ca_uint64 offset = frameIndex - pWindow->startFrame;
+  pWindow->lastUsed = pData->nextSerial++;
+  *ppFrames = pWindow->pFrames + (size_t)offset * pCache->bytesPerFrame;
+  return (ca_uint32)ca_min((ca_uint64)maxFrames, pWindow->frameCount - offset);
+}
+
+ca_bool ca_pcm_cache_is_at_limit(ca_pcm_cache *pCache)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  return pCache->windowLimit < PCM_CACHE_WINDOW_COUNT && ca_pcm_cache_count_buffers(pData) >= pCache->windowLimit;
+}
+
+void ca_pcm_cache_trim(ca_pcm_cache *pCache, ca_uint32 windowLimit)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  for (ca_uint32 bufferCount = ca_pcm_cache_count_buffers(pData); bufferCount > windowLimit; bufferCount--)
+  {
+    int index = -1;
+    for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+    {
+      if (pData->windows[i].pFrames != NULL && (index < 0 || pData->windows[i].lastUsed < pData->windows[index].lastUsed))
+      {
+        index = i;
+      }
+    }
+
+    ca_pcm_cache_window *pWindow = &pData->windows[index];
+    free(pWindow->pFrames);
+    pWindow->pFrames = NULL;
+    pWindow->frameCount = 0;
+    if (pData->appendIndex == index)
+    {
+      pData->appendIndex = -1;
+    }
+  }
+
+  pCache->windowLimit = ca_min(pCache->windowLimit, windowLimit);
+}
+
+ca_uint64 ca_pcm_cache_get_frame_count(ca_pcm_cache *pCache)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  ca_uint64 frameCount = 0;
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    frameCount += pData->windows[i].frameCount;
+  }
+  return frameCount;
+}
+
+ca_uint64 ca_pcm_cache_get_size_in_bytes(ca_pcm_cache *pCache)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  ca_uint64 sizeInBytes = 0;
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    sizeInBytes += pData->windows[i].pFrames == NULL ? 0 : (ca_uint64)pCache->windowCapacity * pCache->bytesPerFrame;
+  }
+  return sizeInBytes;
+}
+
+void ca_pcm_cache_uninit(ca_pcm_cache *pCache)
+{
+  ca_pcm_cache_data *pData = (ca_pcm_cache_data *)pCache->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  for (int i = 0; i < PCM_CACHE_WINDOW_COUNT; i++)
+  {
+    free(pData->windows[i].pFrames);
+  }
+  free(pData);
+  pCache->pData = NULL;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// Recently decoded frames in a few windows of contiguous frames, keyed by frame index and bounded by a byte size.
+// The least recently used window is reused when a new one does not fit.
+typedef struct
+{
+  ca_uint32 bytesPerFrame;
+  ca_uint32 windowCapacity;
+
+  // Windows which may hold a buffer at once. Starts at all of them, and the least recently used buffer is reused once they are taken.
+  ca_uint32 windowLimit;
+
+  // Frame index the stream ends at, or ~0 while unknown.
+  ca_uint64 endFrame;
+  void *pData;
+} ca_pcm_cache;
+
+ca_result ca_pcm_cache_init(ca_pcm_cache *pCache, ca_uint64 sizeInBytes, ca_uint32 bytesPerFrame);
+
+// Copies frames decoded from frameIndex. Frames already cached are skipped.
+void ca_pcm_cache_store(ca_pcm_cache *pCache, ca_uint64 frameIndex, ca_uint32 frameCount, const void *pFrames);
+
+// Returns the number of cached frames from frameIndex up to maxFrames, and points ppFrames at them.
+ca_uint32 ca_pcm_cache_read(ca_pcm_cache *pCache, ca_uint64 frameIndex, ca_uint32 maxFrames, const void **ppFrames);
+
+// Returns whether every window allowed by windowLimit holds a buffer while more windows exist.
+ca_bool ca_pcm_cache_is_at_limit(ca_pcm_cache *pCache);
+
+// Frees the least recently used buffers beyond windowLimit and lowers the limit to it.
+void ca_pcm_cache_trim(ca_pcm_cache *pCache, ca_uint32 windowLimit);
+
+ca_uint64 ca_pcm_cache_get_frame_count(ca_pcm_cache *pCache);
+
+ca_uint64 ca_pcm_cache_get_size_in_bytes(ca_pcm_cache *pCache);
+
+void ca_pcm_cache_uninit(ca_pcm_cache *pCache);
@@ -0,0 +1,192 @@
+#include "ca_pcm_chunk.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCM_CHUNK_ALIGNMENT 16
+
+struct ca_pcm_chunk_pool_data;
+
+// The frames follow the header in the same allocation.
+typedef struct ca_pcm_chunk_entry
+{
+  ca_pcm_chunk chunk;
+  _Atomic ca_uint32 refCount;
+  ca_uint32 capacity;
+  struct ca_pcm_chunk_pool_data *pPool;
+  struct ca_pcm_chunk_entry *pNext;
+} ca_pcm_chunk_entry;
+
+#define PCM_CHUNK_HEADER_SIZE ((sizeof(ca_pcm_chunk_entry) + PCM_CHUNK_ALIGNMENT - 1) & ~(size_t)(PCM_CHUNK_ALIGNMENT - 1))
+
+typedef struct ca_pcm_chunk_pool_data
+{
+  pthread_mutex_t lock;
+  ca_pcm_chunk_entry *pIdle;
+  ca_uint32 idleCount;
+  ca_uint32 idleCapacity;
+
+  // Chunks allocated and not freed yet, idle or referenced. The pool is freed with the last of them once it is closed.
+  ca_uint32 chunkCount;
+  ca_uint64 sizeInBytes;
+  ca_bool isClosed;
+} ca_pcm_chunk_pool_data;
+
+static void ca_pcm_chunk_pool_destroy(ca_pcm_chunk_pool_data *pData)
+{
+  pthread_mutex_destroy(&pData->lock);
+  free(pData);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_pcm_chunk_pool_init(ca_pcm_chunk_pool *pPool, ca_uint32 idleCapacity)
+{
+  ca_pcm_chunk_pool_data *pData = (ca_pcm_chunk_pool_data *)calloc(1, sizeof(ca_pcm_chunk_pool_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->idleCapacity = idleCapacity;
+  pthread_mutex_init(&pData->lock, NULL);
+  pPool->pData = pData;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_pcm_chunk *ca_pcm_chunk_pool_acquire(ca_pcm_chunk_pool *pPool, ca_uint32 sizeInBytes)
+{
+  ca_pcm_chunk_pool_data *pData = (ca_pcm_chunk_pool_data *)pPool->pData;
+
+  ca_pcm_chunk_entry *pEntry = NULL;
+  ca_pcm_chunk_entry *pTooSmall = NULL;
+  pthread_mutex_lock(&pData->lock);
+  for (ca_pcm_chunk_entry **ppEntry = &pData->pIdle; *ppEntry != NULL; ppEntry = &(*ppEntry)->pNext)
+  {
+    if ((*ppEntry)->capacity >= sizeInBytes)
+    {
+      pEntry = *ppEntry;
+      *ppEntry = pEntry->pNext;
+      pData->idleCount--;
+      break;
+    }
+  }
+
+  // The new chunk takes the place of an idle one, so the pool does not grow past what its consumers hold.
+  if (pEntry == NULL && pData->pIdle != NULL)
+  {
+    pTooSmall = pData->pIdle;
+    pData->pIdle = pTooSmall->pNext;
+    pData->idleCount--;
+    pData->chunkCount--;
+    pData->sizeInBytes -= pTooSmall->capacity;
+  }
+  pthread_mutex_unlock(&pData->lock);
+  free(pTooSmall);
+
+  if (pEntry == NULL)
+  {
+    // malloc only guarantees the alignment of the largest scalar type, which is 8 bytes on 32-bit platforms.
+    void *pMemory = NULL;
+    if (posix_memalign(&pMemory, PCM_CHUNK_ALIGNMENT, PCM_CHUNK_HEADER_SIZE + sizeInBytes) != 0)
+    {
+      return NULL;
+    }
+    pEntry = (ca_pcm_chunk_entry *)pMemory;
+
+    pEntry->capacity = sizeInBytes;
+    pEntry->pPool = pData;
+    pthread_mutex_lock(&pData->lock);
+    pData->chunkCount++;
+    pData->sizeInBytes += sizeInBytes;
+    pthread_mutex_unlock(&pData->lock);
+  }
+
+  pEntry->pNext = NULL;
+  atomic_store_explicit(&pEntry->refCount, 1, memory_order_relaxed);
+  ca_zero_memory(&pEntry->chunk);
+  pEntry->chunk.pFrames = (ca_uint8 *)pEntry + PCM_CHUNK_HEADER_SIZE;
+  pEntry->chunk.pData = pEntry;
+  return &pEntry->chunk;
+}
+
+FFI_PLUGIN_EXPORT ca_uint64 ca_pcm_chunk_pool_get_size_in_bytes(ca_pcm_chunk_pool *pPool)
+{
+  ca_pcm_chunk_pool_data *pData = (ca_pcm_chunk_pool_data *)pPool->pData;
+  pthread_mutex_lock(&pData->lock);
+  ca_uint64 sizeInBytes = pData->sizeInBytes;
+  pthread_mutex_unlock(&pData->lock);
+  return sizeInBytes;
+}
+
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_pool_uninit(ca_pcm_chunk_pool *pPool)
+{
+  ca_pcm_chunk_pool_data *pData = (ca_pcm_chunk_pool_data *)pPool->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pData->lock);
+  ca_pcm_chunk_entry *pIdle = pData->pIdle;
+  pData->pIdle = NULL;
+  pData->chunkCount -= pData->idleCount;
+  pData->idleCount = 0;
+  pData->isClosed = CA_TRUE;
+  ca_bool isDone = pData->chunkCount == 0;
+  pthread_mutex_unlock(&pData->lock);
+
+  while (pIdle != NULL)
+  {
+    ca_pcm_chunk_entry *pNext = pIdle->pNext;
+    free(pIdle);
+    pIdle = pNext;
+  }
+
+  if (isDone)
+  {
+    ca_pcm_chunk_pool_destroy(pData);
+  }
+  pPool->pData = NULL;
+}
+
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_retain(ca_pcm_chunk *pChunk)
+{
+  ca_pcm_chunk_entry *pEntry = (ca_pcm_chunk_entry *)pChunk->pData;
+  atomic_fetch_add_explicit(&pEntry->refCount, 1, memory_order_relaxed);
+}
+
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_release(ca_pcm_chunk *pChunk)
+{
+  ca_pcm_chunk_entry *pEntry = (ca_pcm_chunk_entry *)pChunk->pData;
+  if (atomic_fetch_sub_explicit(&pEntry->refCount, 1, memory_order_acq_rel) != 1)
+  {
+    return;
+  }
+
+  ca_pcm_chunk_pool_data *pData = pEntry->pPool;
+  pthread_mutex_lock(&pData->lock);
+  ca_bool isKept = !pData->isClosed && pData->idleCount < pData->idleCapacity;
+  if (isKept)
+  {
+    pEntry->pNext = pData->pIdle;
+    pData->pIdle = pEntry;
+    pData->idleCount++;
+  }
+  else
+  {
+    pData->chunkCount--;
+    pData->sizeInBytes -= pEntry->capacity;
+  }
+  ca_bool isDone = pData->isClosed && pData->chunkCount == 0;
+  pthread_mutex_unlock(&pData->lock);
+
+  if (!isKept)
+  {
+    free(pEntry);
+  }
+
+  if (isDone)
+  {
+    ca_pcm_chunk_pool_destroy(pData);
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// Decoded frames shared by reference, so several consumers can keep them without copying.
+// A chunk stays valid until its last reference is released, and then goes back to the pool it came from.
+typedef struct
+{
+  ca_sample_format sampleFormat;
+  ca_uint32 channels;
+  ca_uint32 sampleRate;
+
+  // Output frame the chunk starts at. Counted from the last seek, whose target it starts from.
+  ca_uint64 frameIndex;
+  ca_uint32 frameCount;
+
+  // Interleaved frames, aligned to 16 bytes.
+  void *pFrames;
+  void *pData;
+} ca_pcm_chunk;
+
+// Chunks released by every reference are kept for reuse. Callable from any thread.
+typedef struct
+{
+  void *pData;
+} ca_pcm_chunk_pool;
+
+// Up to idleCapacity released chunks are kept. Larger requests replace the idle chunks which are too small.
+FFI_PLUGIN_EXPORT ca_result ca_pcm_chunk_pool_init(ca_pcm_chunk_pool *pPool, ca_uint32 idleCapacity);
+
+// Returns a chunk holding at least sizeInBytes with one reference, or NULL when out of memory. The caller fills in the fields.
+FFI_PLUGIN_EXPORT ca_pcm_chunk *ca_pcm_chunk_pool_acquire(ca_pcm_chunk_pool *pPool, ca_uint32 sizeInBytes);
+
+// Bytes of every chunk the pool allocated, idle or still referenced.
+FFI_PLUGIN_EXPORT ca_uint64 ca_pcm_chunk_pool_get_size_in_bytes(ca_pcm_chunk_pool *pPool);
+
+// Frees the idle chunks. Chunks still referenced are freed by their last release instead of going back to the pool.
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_pool_uninit(ca_pcm_chunk_pool *pPool);
+
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_retain(ca_pcm_chunk *pChunk);
+
+FFI_PLUGIN_EXPORT void ca_pcm_chunk_release(ca_pcm_chunk *pChunk);
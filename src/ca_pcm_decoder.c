@@ -0,0 +1,959 @@
+#include "ca_pcm_decoder.h"
+#include "ca_channel_mixer.h"
+#include "ca_convert.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCM_DECODE_SIZE 32768
+#define PCM_MAX_CHUNK_COUNT 1024
+#define PCM_UNKNOWN_SIZE 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  ca_decoder_read_proc readFunc;
+  ca_decoder_seek_proc seekFunc;
+  ca_decoder_tell_proc tellFunc;
+  ca_decoder_decoded_proc decodedFunc;
+
+  ca_audio_format format;
+  ca_uint32 bytesPerSample;
+  ca_uint32 bytesPerFrame;
+  ca_bool isBigEndian;
+  ca_bool isSigned8;
+  ca_bool isLengthKnown;
+  ca_uint64 dataOffset;
+  ca_bool hasChannelMap;
+  ca_channel channelMap[CA_MAX_CHANNELS];
+
+  // The frames of a decode_next call are read here and passed to the decoded proc as is.
+  void *pBuffer;
+  ca_uint32 bufferFrameCount;
+
+  ca_uint64 cursor;
+  ca_bool isEOF;
+} ca_pcm_decoder_data;
+
+// The container fields needed to locate and interpret the sample data.
+typedef struct
+{
+  ca_uint32 channels;
+  double sampleRate;
+  ca_uint32 bytesPerSample;
+  ca_uint32 bitsPerSample;
+  ca_bool isFloat;
+  ca_bool isBigEndian;
+  ca_bool isSigned8;
+  ca_bool hasFormat;
+
+  // Set by the WAVE_FORMAT_EXTENSIBLE channel mask or the CAF chan chunk.
+  ca_bool hasChannelMap;
+  ca_channel channelMap[CA_MAX_CHANNELS];
+
+  ca_bool hasData;
+  ca_uint64 dataOffset;
+  ca_uint64 dataSize;
+  ca_uint64 frameCount;
+} ca_pcm_container;
+
+typedef struct
+{
+  ca_pcm_decoder *pDecoder;
+  ca_uint64 position;
+} ca_pcm_reader;
+
+// MARK: Byte order
+
+static inline ca_uint32 ca_pcm_le16(const ca_uint8 *p)
+{
+  return (ca_uint32)p[0] | ((ca_uint32)p[1] << 8);
+}
+
+static inline ca_uint32 ca_pcm_le32(const ca_uint8 *p)
+{
+  return ca_pcm_le16(p) | (ca_pcm_le16(p + 2) << 16);
+}
+
+static inline ca_uint64 ca_pcm_le64(const ca_uint8 *p)
+{
+  return (ca_uint64)ca_pcm_le32(p) | ((ca_uint64)ca_pcm_le32(p + 4) << 32);
+}
+
+static inline ca_uint32 ca_pcm_be16(const ca_uint8 *p)
+{
+  return ((ca_uint32)p[0] << 8) | (ca_uint32)p[1];
+}
+
+static inline ca_uint32 ca_pcm_be32(const ca_uint8 *p)
+{
+  return (ca_pcm_be16(p) << 16) | ca_pcm_be16(p + 2);
+}
+
+static inline ca_uint64 ca_pcm_be64(const ca_uint8 *p)
+{
+  return ((ca_uint64)ca_pcm_be32(p) << 32) | (ca_uint64)ca_pcm_be32(p + 4);
+}
+
+// MARK: Reader
+
+static ca_result ca_pcm_reader_read(ca_pcm_reader *pReader, void *pBuffer, ca_uint32 size)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pReader->pDecoder->pData;
+  ca_uint32 totalRead = 0;
+  while (totalRead < size)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result result = pData->readFunc((ca_uint8 *)pBuffer + totalRead, size - totalRead, &bytesRead, pReader->pDecoder->pUserData);
+    totalRead += bytesRead;
+    if (result == ca_read_result_failed)
+    {
+      return ca_result_read_failed;
+    }
+
+    if (result == ca_read_result_at_end || bytesRead == 0)
+    {
+      break;
+    }
+  }
+
+  pReader->position += totalRead;
+
+  // A truncated header is not a container we can play.
+  return totalRead == size ? ca_result_success : ca_result_unsupported_format;
+}
+
+static ca_result ca_pcm_reader_skip(ca_pcm_reader *pReader, ca_uint64 size)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pReader->pDecoder->pData;
+  if (size == 0)
+  {
+    return ca_result_success;
+  }
+
+  if (pData->seekFunc((ca_int64)size, ca_seek_origin_current, pReader->pDecoder->pUserData) == ca_seek_result_success)
+  {
+    pReader->position += size;
+    return ca_result_success;
+  }
+
+  ca_uint8 buffer[1024];
+  while (size > 0)
+  {
+    ca_uint32 chunkSize = (ca_uint32)ca_min(size, (ca_uint64)sizeof(buffer));
+    ca_result result = ca_pcm_reader_read(pReader, buffer, chunkSize);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    size -= chunkSize;
+  }
+
+  return ca_result_success;
+}
+
+// MARK: WAV
+
+static const ca_uint8 w64RiffGuid[16] = {'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const ca_uint8 w64WaveGuid[16] = {'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const ca_uint8 w64FmtGuid[16] = {'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const ca_uint8 w64DataGuid[16] = {'d', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+// The tail shared by the KSDATAFORMAT_SUBTYPE GUIDs of WAVE_FORMAT_EXTENSIBLE.
+static const ca_uint8 wavSubtypeGuidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+#define PCM_WAVE_FORMAT_PCM 0x0001
+#define PCM_WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define PCM_WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static ca_result ca_pcm_parse_wav_fmt(ca_pcm_reader *pReader, ca_pcm_container *pContainer, ca_uint64 chunkSize)
+{
+  ca_uint8 fmt[40] = {0};
+  ca_uint32 fmtSize = (ca_uint32)ca_min(chunkSize, (ca_uint64)sizeof(fmt));
+  if (fmtSize < 16)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_result result = ca_pcm_reader_read(pReader, fmt, fmtSize);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint32 formatTag = ca_pcm_le16(fmt);
+  ca_uint32 channels = ca_pcm_le16(fmt + 2);
+  ca_uint32 blockAlign = ca_pcm_le16(fmt + 12);
+  ca_uint32 bitsPerSample = ca_pcm_le16(fmt + 14);
+  ca_uint32 channelMask = 0;
+  if (formatTag == PCM_WAVE_FORMAT_EXTENSIBLE)
+  {
+    if (fmtSize < 40 || memcmp(fmt + 26, wavSubtypeGuidTail, sizeof(wavSubtypeGuidTail)) != 0)
+    {
+      return ca_result_unsupported_format;
+    }
+    formatTag = ca_pcm_le16(fmt + 24);
+    channelMask = ca_pcm_le32(fmt + 20);
+  }
+
+  if ((formatTag != PCM_WAVE_FORMAT_PCM && formatTag != PCM_WAVE_FORMAT_IEEE_FLOAT) || channels == 0 || blockAlign % channels != 0)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  pContainer->channels = channels;
+  pContainer->sampleRate = ca_pcm_le32(fmt + 4);
+  pContainer->bytesPerSample = blockAlign / channels;
+  pContainer->bitsPerSample = bitsPerSample;
+  pContainer->isFloat = formatTag == PCM_WAVE_FORMAT_IEEE_FLOAT;
+  pContainer->isBigEndian = CA_FALSE;
+  pContainer->isSigned8 = CA_FALSE;
+  pContainer->hasFormat = CA_TRUE;
+  pContainer->hasChannelMap = channels <= CA_MAX_CHANNELS && channelMask != 0 && ca_channel_map_from_mask(pContainer->channelMap, channels, channelMask);
+  return ca_pcm_reader_skip(pReader, chunkSize - fmtSize);
+}
+
+static ca_result ca_pcm_parse_riff(ca_pcm_reader *pReader, ca_pcm_container *pContainer, ca_bool isRF64)
+{
+  ca_uint64 ds64DataSize = PCM_UNKNOWN_SIZE;
+  for (int i = 0; i < PCM_MAX_CHUNK_COUNT; i++)
+  {
+    ca_uint8 header[8];
+    ca_result result = ca_pcm_reader_read(pReader, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_uint64 chunkSize = ca_pcm_le32(header + 4);
+    if (memcmp(header, "ds64", 4) == 0 && isRF64)
+    {
+      ca_uint8 ds64[24];
+      if (chunkSize < sizeof(ds64))
+      {
+        return ca_result_unsupported_format;
+      }
+
+      result = ca_pcm_reader_read(pReader, ds64, sizeof(ds64));
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      ds64DataSize = ca_pcm_le64(ds64 + 8);
+      result = ca_pcm_reader_skip(pReader, chunkSize - sizeof(ds64));
+    }
+    else if (memcmp(header, "fmt ", 4) == 0)
+    {
+      result = ca_pcm_parse_wav_fmt(pReader, pContainer, chunkSize);
+      if (result == ca_result_success)
+      {
+        result = ca_pcm_reader_skip(pReader, chunkSize & 1);
+      }
+    }
+    else if (memcmp(header, "data", 4) == 0)
+    {
+      if (chunkSize == 0xFFFFFFFF)
+      {
+        chunkSize = isRF64 ? ds64DataSize : PCM_UNKNOWN_SIZE;
+      }
+      else if (chunkSize == 0)
+      {
+        // Streaming writers leave the size empty until the file is closed.
+        chunkSize = PCM_UNKNOWN_SIZE;
+      }
+
+      pContainer->hasData = CA_TRUE;
+      pContainer->dataOffset = pReader->position;
+      pContainer->dataSize = chunkSize;
+      if (pContainer->hasFormat || chunkSize == PCM_UNKNOWN_SIZE)
+      {
+        return ca_result_success;
+      }
+      result = ca_pcm_reader_skip(pReader, chunkSize + (chunkSize & 1));
+    }
+    else
+    {
+      result = ca_pcm_reader_skip(pReader, chunkSize + (chunkSize & 1));
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (pContainer->hasFormat && pContainer->hasData)
+    {
+      return ca_result_success;
+    }
+  }
+
+  return ca_result_unsupported_format;
+}
+
+static ca_result ca_pcm_parse_w64(ca_pcm_reader *pReader, ca_pcm_container *pContainer)
+{
+  for (int i = 0; i < PCM_MAX_CHUNK_COUNT; i++)
+  {
+    ca_uint8 header[24];
+    ca_result result = ca_pcm_reader_read(pReader, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    // W64 chunk sizes include the header and chunks are aligned to 8 bytes.
+    ca_uint64 chunkSize = ca_pcm_le64(header + 16);
+    if (chunkSize < sizeof(header))
+    {
+      return ca_result_unsupported_format;
+    }
+    chunkSize -= sizeof(header);
+    ca_uint64 padding = (8 - (chunkSize & 7)) & 7;
+
+    if (memcmp(header, w64FmtGuid, 16) == 0)
+    {
+      result = ca_pcm_parse_wav_fmt(pReader, pContainer, chunkSize);
+      if (result == ca_result_success)
+      {
+        result = ca_pcm_reader_skip(pReader, padding);
+      }
+    }
+    else if (memcmp(header, w64DataGuid, 16) == 0)
+    {
+      pContainer->hasData = CA_TRUE;
+      pContainer->dataOffset = pReader->position;
+      pContainer->dataSize = chunkSize;
+      if (pContainer->hasFormat)
+      {
+        return ca_result_success;
+      }
+      result = ca_pcm_reader_skip(pReader, chunkSize + padding);
+    }
+    else
+    {
+      result = ca_pcm_reader_skip(pReader, chunkSize + padding);
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (pContainer->hasFormat && pContainer->hasData)
+    {
+      return ca_result_success;
+    }
+  }
+
+  return ca_result_unsupported_format;
+}
+
+// MARK: AIFF
+
+// Converts the 80-bit IEEE 754 extended value used by the COMM chunk.
+static double ca_pcm_read_extended(const ca_uint8 *p)
+{
+  int exponent = (int)(ca_pcm_be16(p) & 0x7FFF);
+  ca_uint64 mantissa = ca_pcm_be64(p + 2);
+  if (exponent == 0 && mantissa == 0)
+  {
+    return 0;
+  }
+
+  double value = ldexp((double)mantissa, exponent - 16383 - 63);
+  return (p[0] & 0x80) ? -value : value;
+}
+
+static ca_result ca_pcm_parse_aiff(ca_pcm_reader *pReader, ca_pcm_container *pContainer, ca_bool isAIFC)
+{
+  for (int i = 0; i < PCM_MAX_CHUNK_COUNT; i++)
+  {
+    ca_uint8 header[8];
+    ca_result result = ca_pcm_reader_read(pReader, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_uint64 chunkSize = ca_pcm_be32(header + 4);
+    if (memcmp(header, "COMM", 4) == 0)
+    {
+      ca_uint8 comm[22];
+      ca_uint32 commSize = isAIFC ? 22 : 18;
+      if (chunkSize < commSize)
+      {
+        return ca_result_unsupported_format;
+      }
+
+      result = ca_pcm_reader_read(pReader, comm, commSize);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      pContainer->channels = ca_pcm_be16(comm);
+      pContainer->frameCount = ca_pcm_be32(comm + 2);
+      pContainer->bitsPerSample = ca_pcm_be16(comm + 6);
+      pContainer->bytesPerSample = (pContainer->bitsPerSample + 7) / 8;
+      pContainer->sampleRate = ca_pcm_read_extended(comm + 8);
+      pContainer->isFloat = CA_FALSE;
+      pContainer->isBigEndian = CA_TRUE;
+      pContainer->isSigned8 = CA_TRUE;
+      if (isAIFC)
+      {
+        const ca_uint8 *pCompression = comm + 18;
+        if (memcmp(pCompression, "sowt", 4) == 0)
+        {
+          pContainer->isBigEndian = CA_FALSE;
+        }
+        else if (memcmp(pCompression, "fl32", 4) == 0 || memcmp(pCompression, "FL32", 4) == 0)
+        {
+          pContainer->isFloat = CA_TRUE;
+          pContainer->bytesPerSample = 4;
+        }
+        else if (memcmp(pCompression, "raw ", 4) == 0)
+        {
+          pContainer->isSigned8 = CA_FALSE;
+        }
+        else if (memcmp(pCompression, "NONE", 4) != 0 && memcmp(pCompression, "twos", 4) != 0)
+        {
+          return ca_result_unsupported_format;
+        }
+      }
+
+      pContainer->hasFormat = CA_TRUE;
+      result = ca_pcm_reader_skip(pReader, chunkSize - commSize + (chunkSize & 1));
+    }
+    else if (memcmp(header, "SSND", 4) == 0)
+    {
+      ca_uint8 ssnd[8];
+      if (chunkSize < sizeof(ssnd))
+      {
+        return ca_result_unsupported_format;
+      }
+
+      result = ca_pcm_reader_read(pReader, ssnd, sizeof(ssnd));
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      ca_uint32 offset = ca_pcm_be32(ssnd);
+      if (offset > chunkSize - sizeof(ssnd))
+      {
+        return ca_result_unsupported_format;
+      }
+
+      result = ca_pcm_reader_skip(pReader, offset);
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      pContainer->hasData = CA_TRUE;
+      pContainer->dataOffset = pReader->position;
+      pContainer->dataSize = chunkSize - sizeof(ssnd) - offset;
+      if (pContainer->hasFormat)
+      {
+        return ca_result_success;
+      }
+      result = ca_pcm_reader_skip(pReader, pContainer->dataSize + (chunkSize & 1));
+    }
+    else
+    {
+      result = ca_pcm_reader_skip(pReader, chunkSize + (chunkSize & 1));
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (pContainer->hasFormat && pContainer->hasData)
+    {
+      return ca_result_success;
+    }
+  }
+
+  return ca_result_unsupported_format;
+}
+
+// MARK: CAF
+
+#define PCM_CAF_FLAG_IS_FLOAT 1
+#define PCM_CAF_FLAG_IS_LITTLE_ENDIAN 2
+
+#define PCM_CAF_LAYOUT_USE_DESCRIPTIONS 0
+#define PCM_CAF_LAYOUT_USE_BITMAP (1 << 16)
+#define PCM_CAF_DESCRIPTION_SIZE 20
+
+// The channel labels of the layout tags used for mono, stereo and 5.x files, e.g. kAudioChannelLayoutTag_MPEG_5_1_C.
+typedef struct
+{
+  ca_uint32 tag;
+  ca_uint8 labels[6];
+} ca_pcm_caf_layout;
+
+static const ca_pcm_caf_layout cafLayouts[] = {
+    {(100 << 16) | 1, {42}},
+    {(101 << 16) | 2, {1, 2}},
+    {(102 << 16) | 2, {1, 2}},
+    {(117 << 16) | 5, {1, 2, 3, 5, 6}},
+    {(118 << 16) | 5, {1, 2, 5, 6, 3}},
+    {(119 << 16) | 5, {1, 3, 2, 5, 6}},
+    {(120 << 16) | 5, {3, 1, 2, 5, 6}},
+    {(121 << 16) | 6, {1, 2, 3, 4, 5, 6}},
+    {(122 << 16) | 6, {1, 2, 5, 6, 3, 4}},
+    {(123 << 16) | 6, {1, 3, 2, 5, 6, 4}},
+    {(124 << 16) | 6, {3, 1, 2, 5, 6, 4}},
+};
+
+// Reads the AudioChannelLayout of a chan chunk. Layouts this parser does not know leave the standard map.
+static ca_result ca_pcm_parse_caf_chan(ca_pcm_reader *pReader, ca_pcm_container *pContainer, ca_uint64 chunkSize)
+{
+  ca_uint8 layout[12];
+  if (chunkSize < sizeof(layout))
+  {
+    return ca_pcm_reader_skip(pReader, chunkSize);
+  }
+
+  ca_result result = ca_pcm_reader_read(pReader, layout, sizeof(layout));
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  ca_uint64 consumed = sizeof(layout);
+  ca_uint32 tag = ca_pcm_be32(layout);
+  ca_uint32 channels = pContainer->channels;
+  ca_channel *pChannelMap = pContainer->channelMap;
+  if (channels == 0 || channels > CA_MAX_CHANNELS)
+  {
+    return ca_pcm_reader_skip(pReader, chunkSize - consumed);
+  }
+
+  if (tag == PCM_CAF_LAYOUT_USE_BITMAP)
+  {
+    pContainer->hasChannelMap = ca_channel_map_from_mask(pChannelMap, channels, ca_pcm_be32(layout + 4));
+  }
+  else if (tag == PCM_CAF_LAYOUT_USE_DESCRIPTIONS && ca_pcm_be32(layout + 8) == channels && chunkSize - consumed >= (ca_uint64)channels * PCM_CAF_DESCRIPTION_SIZE)
+  {
+    for (ca_uint32 i = 0; i < channels && result == ca_result_success; i++)
+    {
+      ca_uint8 description[PCM_CAF_DESCRIPTION_SIZE];
+      result = ca_pcm_reader_read(pReader, description, sizeof(description));
+      pChannelMap[i] = ca_channel_from_apple_label(ca_pcm_be32(description));
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+    consumed += (ca_uint64)channels * PCM_CAF_DESCRIPTION_SIZE;
+    pContainer->hasChannelMap = ca_channel_map_is_positioned(pChannelMap, channels);
+  }
+  else
+  {
+    for (size_t i = 0; i < sizeof(cafLayouts) / sizeof(cafLayouts[0]); i++)
+    {
+      if (cafLayouts[i].tag == tag && (tag & 0xFFFF) == channels)
+      {
+        for (ca_uint32 j = 0; j < channels; j++)
+        {
+          pChannelMap[j] = ca_channel_from_apple_label(cafLayouts[i].labels[j]);
+        }
+        pContainer->hasChannelMap = CA_TRUE;
+        break;
+      }
+    }
+  }
+
+  return ca_pcm_reader_skip(pReader, chunkSize - consumed);
+}
+
+static ca_result ca_pcm_parse_caf(ca_pcm_reader *pReader, ca_pcm_container *pContainer)
+{
+  for (int i = 0; i < PCM_MAX_CHUNK_COUNT; i++)
+  {
+    ca_uint8 header[12];
+    ca_result result = ca_pcm_reader_read(pReader, header, sizeof(header));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    ca_uint64 chunkSize = ca_pcm_be64(header + 4);
+    if (memcmp(header, "desc", 4) == 0)
+    {
+      ca_uint8 desc[32];
+      if (chunkSize < sizeof(desc))
+      {
+        return ca_result_unsupported_format;
+      }
+
+      result = ca_pcm_reader_read(pReader, desc, sizeof(desc));
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      ca_uint64 sampleRateBits = ca_pcm_be64(desc);
+      ca_uint32 flags = ca_pcm_be32(desc + 12);
+      ca_uint32 bytesPerPacket = ca_pcm_be32(desc + 16);
+      ca_uint32 framesPerPacket = ca_pcm_be32(desc + 20);
+      memcpy(&pContainer->sampleRate, &sampleRateBits, sizeof(double));
+      pContainer->channels = ca_pcm_be32(desc + 24);
+      pContainer->bitsPerSample = ca_pcm_be32(desc + 28);
+      pContainer->bytesPerSample = pContainer->channels == 0 ? 0 : bytesPerPacket / pContainer->channels;
+      pContainer->isFloat = (flags & PCM_CAF_FLAG_IS_FLOAT) != 0;
+      pContainer->isBigEndian = (flags & PCM_CAF_FLAG_IS_LITTLE_ENDIAN) == 0;
+      pContainer->isSigned8 = CA_TRUE;
+      if (memcmp(desc + 8, "lpcm", 4) != 0 || framesPerPacket != 1)
+      {
+        return ca_result_unsupported_format;
+      }
+
+      pContainer->hasFormat = CA_TRUE;
+      result = ca_pcm_reader_skip(pReader, chunkSize - sizeof(desc));
+    }
+    else if (memcmp(header, "chan", 4) == 0)
+    {
+      result = ca_pcm_parse_caf_chan(pReader, pContainer, chunkSize);
+    }
+    else if (memcmp(header, "data", 4) == 0)
+    {
+      ca_uint8 editCount[4];
+      result = ca_pcm_reader_read(pReader, editCount, sizeof(editCount));
+      if (result != ca_result_success)
+      {
+        return result;
+      }
+
+      // A size of -1 means the data runs to the end of the file.
+      pContainer->hasData = CA_TRUE;
+      pContainer->dataOffset = pReader->position;
+      pContainer->dataSize = chunkSize == PCM_UNKNOWN_SIZE ? PCM_UNKNOWN_SIZE : chunkSize - sizeof(editCount);
+      if (pContainer->hasFormat || chunkSize == PCM_UNKNOWN_SIZE)
+      {
+        return ca_result_success;
+      }
+      result = ca_pcm_reader_skip(pReader, pContainer->dataSize);
+    }
+    else
+    {
+      result = ca_pcm_reader_skip(pReader, chunkSize);
+    }
+
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (pContainer->hasFormat && pContainer->hasData)
+    {
+      return ca_result_success;
+    }
+  }
+
+  return ca_result_unsupported_format;
+}
+
+// MARK: Container
+
+static ca_result ca_pcm_parse_container(ca_pcm_reader *pReader, ca_pcm_container *pContainer)
+{
+  ca_uint8 header[12];
+  ca_result result = ca_pcm_reader_read(pReader, header, 8);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The CAF file header is 8 bytes and is followed by the desc chunk.
+  if (memcmp(header, "caff", 4) == 0)
+  {
+    return ca_pcm_be16(header + 4) == 1 ? ca_pcm_parse_caf(pReader, pContainer) : ca_result_unsupported_format;
+  }
+
+  result = ca_pcm_reader_read(pReader, header + 8, 4);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  if (memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0)
+  {
+    return ca_pcm_parse_riff(pReader, pContainer, CA_FALSE);
+  }
+
+  if ((memcmp(header, "RF64", 4) == 0 || memcmp(header, "BW64", 4) == 0) && memcmp(header + 8, "WAVE", 4) == 0)
+  {
+    return ca_pcm_parse_riff(pReader, pContainer, CA_TRUE);
+  }
+
+  if (memcmp(header, "FORM", 4) == 0 && (memcmp(header + 8, "AIFF", 4) == 0 || memcmp(header + 8, "AIFC", 4) == 0))
+  {
+    return ca_pcm_parse_aiff(pReader, pContainer, header[11] == 'C');
+  }
+
+  if (memcmp(header, w64RiffGuid, sizeof(header)) == 0)
+  {
+    // The rest of the riff GUID, the file size and the wave GUID.
+    ca_uint8 rest[28];
+    result = ca_pcm_reader_read(pReader, rest, sizeof(rest));
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    if (memcmp(rest, w64RiffGuid + sizeof(header), 4) != 0 || memcmp(rest + 12, w64WaveGuid, 16) != 0)
+    {
+      return ca_result_unsupported_format;
+    }
+    return ca_pcm_parse_w64(pReader, pContainer);
+  }
+
+  return ca_result_unsupported_format;
+}
+
+static ca_sample_format ca_pcm_get_sample_format(const ca_pcm_container *pContainer)
+{
+  if (pContainer->isFloat)
+  {
+    return pContainer->bytesPerSample == 4 ? ca_sample_format_f32 : ca_sample_format_unknown;
+  }
+
+  if (pContainer->bitsPerSample == 0 || pContainer->bitsPerSample > pContainer->bytesPerSample * 8)
+  {
+    return ca_sample_format_unknown;
+  }
+
+  switch (pContainer->bytesPerSample)
+  {
+  case 1:
+    return ca_sample_format_u8;
+  case 2:
+    return ca_sample_format_s16;
+  case 3:
+    return ca_sample_format_s24;
+  case 4:
+    return ca_sample_format_s32;
+  default:
+    return ca_sample_format_unknown;
+  }
+}
+
+// MARK: Decoder
+
+ca_result ca_pcm_decoder_init(ca_pcm_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (pSeekProc == NULL)
+  {
+    return ca_result_unsupported_format;
+  }
+
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)calloc(1, sizeof(ca_pcm_decoder_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pData->readFunc = pReadProc;
+  pData->seekFunc = pSeekProc;
+  pData->tellFunc = pTellProc;
+  pData->decodedFunc = pDecodedProc;
+  pDecoder->config = config;
+  pDecoder->pUserData = pUserData;
+  pDecoder->pData = pData;
+
+  ca_pcm_reader reader = {
+      .pDecoder = pDecoder,
+      .position = 0,
+  };
+  ca_pcm_container container = {
+      .dataSize = PCM_UNKNOWN_SIZE,
+      .frameCount = PCM_UNKNOWN_SIZE,
+  };
+  ca_result result = ca_pcm_parse_container(&reader, &container);
+  ca_sample_format sampleFormat = ca_pcm_get_sample_format(&container);
+
+  // Written so that a NaN rate from a CAF or AIFF header fails too.
+  if (result == ca_result_success && (sampleFormat == ca_sample_format_unknown || container.channels == 0 || !(container.sampleRate >= 1 && container.sampleRate <= 0xFFFFFFFF)))
+  {
+    result = ca_result_unsupported_format;
+  }
+
+  if (result == ca_result_success && reader.position != container.dataOffset && pSeekProc((ca_int64)container.dataOffset, ca_seek_origin_start, pUserData) != ca_seek_result_success)
+  {
+    result = ca_result_seek_failed;
+  }
+
+  if (result != ca_result_success)
+  {
+    free(pData);
+    pDecoder->pData = NULL;
+    return result;
+  }
+
+  pData->bytesPerSample = container.bytesPerSample;
+  pData->bytesPerFrame = container.bytesPerSample * container.channels;
+  pData->isBigEndian = container.isBigEndian && container.bytesPerSample > 1;
+  pData->isSigned8 = container.isSigned8 && sampleFormat == ca_sample_format_u8;
+  pData->dataOffset = container.dataOffset;
+  pData->hasChannelMap = container.hasChannelMap;
+  memcpy(pData->channelMap, container.channelMap, sizeof(pData->channelMap));
+  pData->format.channels = container.channels;
+  pData->format.sample_rate = (ca_uint32)(container.sampleRate + 0.5);
+  pData->format.sample_foramt = sampleFormat;
+  pData->format.apple.format_id = 0;
+
+  // Seeking and the end of stream are computed from the data size, so the length has to be known up front when possible.
+  ca_uint64 dataSize = container.dataSize;
+  ca_uint64 position = 0;
+  ca_uint64 length = 0;
+  if (dataSize == PCM_UNKNOWN_SIZE && pTellProc != NULL && pTellProc(&position, &length, pUserData) == ca_tell_result_success && length > pData->dataOffset)
+  {
+    dataSize = length - pData->dataOffset;
+  }
+
+  pData->isLengthKnown = dataSize != PCM_UNKNOWN_SIZE;
+  pData->format.length = pData->isLengthKnown ? dataSize / pData->bytesPerFrame : 0;
+  if (pData->isLengthKnown && container.frameCount != PCM_UNKNOWN_SIZE)
+  {
+    pData->format.length = ca_min(pData->format.length, container.frameCount);
+  }
+
+  pData->bufferFrameCount = (ca_uint32)ca_max(1, PCM_DECODE_SIZE / pData->bytesPerFrame);
+  pData->pBuffer = malloc((size_t)pData->bufferFrameCount * pData->bytesPerFrame);
+  if (pData->pBuffer == NULL)
+  {
+    free(pData);
+    pDecoder->pData = NULL;
+    return ca_result_out_of_memory;
+  }
+
+  return ca_result_success;
+}
+
+ca_result ca_pcm_decoder_get_format(ca_pcm_decoder *pDecoder, ca_audio_format *pFormat)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  *pFormat = pData->format;
+  return ca_result_success;
+}
+
+ca_result ca_pcm_decoder_get_channel_map(ca_pcm_decoder *pDecoder, ca_channel *pChannelMap)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  if (pData->hasChannelMap)
+  {
+    memcpy(pChannelMap, pData->channelMap, pData->format.channels);
+  }
+  else
+  {
+    ca_get_standard_channel_map(pChannelMap, pData->format.channels);
+  }
+  return ca_result_success;
+}
+
+ca_result ca_pcm_decoder_decode_next(ca_pcm_decoder *pDecoder)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  if (pData->isEOF)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint64 frameCount = pData->bufferFrameCount;
+  if (pData->isLengthKnown)
+  {
+    frameCount = ca_min(frameCount, pData->format.length - ca_min(pData->cursor, pData->format.length));
+  }
+
+  ca_uint32 bytesToRead = (ca_uint32)frameCount * pData->bytesPerFrame;
+  ca_uint32 totalRead = 0;
+  ca_bool isAtEnd = frameCount == 0;
+  while (totalRead < bytesToRead)
+  {
+    ca_uint32 bytesRead = 0;
+    ca_read_result result = pData->readFunc((ca_uint8 *)pData->pBuffer + totalRead, bytesToRead - totalRead, &bytesRead, pDecoder->pUserData);
+    totalRead += bytesRead;
+    if (result == ca_read_result_failed)
+    {
+      return ca_result_read_failed;
+    }
+
+    if (result == ca_read_result_at_end || bytesRead == 0)
+    {
+      isAtEnd = CA_TRUE;
+      break;
+    }
+  }
+
+  // A trailing partial frame is dropped.
+  ca_uint32 framesRead = totalRead / pData->bytesPerFrame;
+  pData->cursor += framesRead;
+  pData->isEOF = isAtEnd || (pData->isLengthKnown && pData->cursor >= pData->format.length);
+  if (framesRead == 0)
+  {
+    return ca_result_success;
+  }
+
+  ca_uint64 sampleCount = (ca_uint64)framesRead * pData->format.channels;
+  if (pData->isBigEndian)
+  {
+    ca_swap_pcm_bytes(pData->pBuffer, pData->bytesPerSample, sampleCount);
+  }
+  else if (pData->isSigned8)
+  {
+    ca_uint8 *pSamples = (ca_uint8 *)pData->pBuffer;
+    for (ca_uint64 i = 0; i < sampleCount; i++)
+    {
+      pSamples[i] ^= 0x80;
+    }
+  }
+
+  pData->decodedFunc(framesRead, pData->pBuffer, pDecoder->pUserData);
+  return ca_result_success;
+}
+
+ca_result ca_pcm_decoder_seek(ca_pcm_decoder *pDecoder, ca_uint64 frameIndex)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  if (pData->isLengthKnown)
+  {
+    frameIndex = ca_min(frameIndex, pData->format.length);
+  }
+
+  ca_uint64 byteOffset = pData->dataOffset + frameIndex * pData->bytesPerFrame;
+  if (pData->seekFunc((ca_int64)byteOffset, ca_seek_origin_start, pDecoder->pUserData) != ca_seek_result_success)
+  {
+    return ca_result_seek_failed;
+  }
+
+  pData->cursor = frameIndex;
+  pData->isEOF = pData->isLengthKnown && frameIndex >= pData->format.length;
+  return ca_result_success;
+}
+
+ca_result ca_pcm_decoder_get_eof(ca_pcm_decoder *pDecoder, ca_bool *pIsEOF)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  *pIsEOF = pData->isEOF;
+  return ca_result_success;
+}
+
+ca_uint64 ca_pcm_decoder_get_size_in_bytes(ca_pcm_decoder *pDecoder)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  return sizeof(ca_pcm_decoder_data) + (ca_uint64)pData->bufferFrameCount * pData->bytesPerFrame;
+}
+
+ca_result ca_pcm_decoder_uninit(ca_pcm_decoder *pDecoder)
+{
+  ca_pcm_decoder_data *pData = (ca_pcm_decoder_data *)pDecoder->pData;
+  free(pData->pBuffer);
+  free(pData);
+  pDecoder->pData = NULL;
+  return ca_result_success;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ca_channel_mixer.h"
+#include "ca_decoder.h"
+
+// Reads uncompressed PCM from RIFF/RF64/W64 WAV, AIFF/AIFC and CAF without the platform decoders.
+typedef struct
+{
+  ca_decoder_config config;
+  void *pUserData;
+  void *pData;
+} ca_pcm_decoder;
+
+// Returns ca_result_unsupported_format when the stream is not a PCM container this decoder understands.
+// The stream position is undefined afterwards, so the caller has to seek back before trying another backend.
+ca_result ca_pcm_decoder_init(ca_pcm_decoder *pDecoder, ca_decoder_config config, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
+
+ca_result ca_pcm_decoder_get_format(ca_pcm_decoder *pDecoder, ca_audio_format *pFormat);
+
+// Fills one position per channel from the WAV channel mask or the CAF channel layout, or the standard map when the file has none.
+ca_result ca_pcm_decoder_get_channel_map(ca_pcm_decoder *pDecoder, ca_channel *pChannelMap);
+
+ca_result ca_pcm_decoder_decode_next(ca_pcm_decoder *pDecoder);
+
+ca_result ca_pcm_decoder_seek(ca_pcm_decoder *pDecoder, ca_uint64 frameIndex);
+
+ca_result ca_pcm_decoder_get_eof(ca_pcm_decoder *pDecoder, ca_bool *pIsEOF);
+
+// Returns the bytes of the buffers the decoder allocated.
+ca_uint64 ca_pcm_decoder_get_size_in_bytes(ca_pcm_decoder *pDecoder);
+
+ca_result ca_pcm_decoder_uninit(ca_pcm_decoder *pDecoder);
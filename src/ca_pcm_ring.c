@@ -0,0 +1,309 @@
+#include "ca_pcm_ring.h"
+#include "ca_convert.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if __APPLE__
+#include <mach/mach.h>
+#define PCM_RING_MIRROR_MACH 1
+#elif __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(SYS_memfd_create)
+#define PCM_RING_MIRROR_MEMFD 1
+#endif
+#endif
+
+// Frame sizes sharing few factors with the page size need many pages before a whole number of frames fits.
+// Past this many pages the ring is not mapped twice, so the rounding cannot grow a small ring by megabytes.
+#define PCM_RING_MAX_QUANTUM_PAGES 64
+
+typedef struct
+{
+  // Two consecutive copies of the ring, either the same pages mapped twice or a plain buffer mirrored on commit.
+  ca_uint8 *pBuffer;
+  size_t size;
+
+  // Frames written and read since the last reset. The producer owns writePosition and the consumer owns readPosition.
+  _Atomic ca_uint64 writePosition;
+  _Atomic ca_uint64 readPosition;
+} ca_pcm_ring_data;
+
+// MARK: Mapping
+
+#if PCM_RING_MIRROR_MEMFD
+static ca_uint8 *ca_pcm_ring_map(size_t size)
+{
+  int fd = (int)syscall(SYS_memfd_create, "ca_pcm_ring", 0);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  // The whole range is reserved first so nothing else can be mapped between the two halves.
+  ca_uint8 *pBuffer = NULL;
+  void *pReserved = ftruncate(fd, (off_t)size) == 0 ? mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+  if (pReserved != MAP_FAILED)
+  {
+    pBuffer = (ca_uint8 *)pReserved;
+    if (mmap(pBuffer, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(pBuffer + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      munmap(pBuffer, size * 2);
+      pBuffer = NULL;
+    }
+  }
+
+  close(fd);
+  return pBuffer;
+}
+
+static void ca_pcm_ring_unmap(ca_uint8 *pBuffer, size_t size)
+{
+  munmap(pBuffer, size * 2);
+}
+#elif PCM_RING_MIRROR_MACH
+static ca_uint8 *ca_pcm_ring_map(size_t size)
+{
+  vm_address_t address = 0;
+  if (vm_allocate(mach_task_self(), &address, size * 2, VM_FLAGS_ANYWHERE) != KERN_SUCCESS)
+  {
+    return NULL;
+  }
+
+  // The second half is replaced by a shared view of the first.
+  vm_address_t mirrorAddress = address + size;
+  vm_prot_t currentProtection;
+  vm_prot_t maxProtection;
+  kern_return_t kr = vm_remap(mach_task_self(), &mirrorAddress, size, 0, VM_FLAGS_FIXED | VM_FLAGS_OVERWRITE, mach_task_self(), address, FALSE, &currentProtection, &maxProtection, VM_INHERIT_DEFAULT);
+  if (kr != KERN_SUCCESS || mirrorAddress != address + size)
+  {
+    vm_deallocate(mach_task_self(), address, size * 2);
+    return NULL;
+  }
+
+  return (ca_uint8 *)address;
+}
+
+static void ca_pcm_ring_unmap(ca_uint8 *pBuffer, size_t size)
+{
+  vm_deallocate(mach_task_self(), (vm_address_t)pBuffer, size * 2);
+}
+#else
+static ca_uint8 *ca_pcm_ring_map(size_t size)
+{
+  (void)size;
+  return NULL;
+}
+
+static void ca_pcm_ring_unmap(ca_uint8 *pBuffer, size_t size)
+{
+  (void)pBuffer;
+  (void)size;
+}
+#endif
+
+// MARK: Ring
+
+// The positions are loaded one after the other, so either side can move in between when another thread asks.
+static ca_uint32 ca_pcm_ring_get_buffered(ca_pcm_ring *pRing, ca_pcm_ring_data *pData)
+{
+  ca_uint64 readPosition = atomic_load_explicit(&pData->readPosition, memory_order_acquire);
+  ca_uint64 writePosition = atomic_load_explicit(&pData->writePosition, memory_order_acquire);
+  return writePosition > readPosition ? (ca_uint32)ca_min(writePosition - readPosition, (ca_uint64)pRing->capacity) : 0;
+}
+
+ca_result ca_pcm_ring_init(ca_pcm_ring *pRing, ca_sample_format format, ca_uint32 channels, ca_uint32 capacity)
+{
+  ca_uint32 bytesPerFrame = ca_get_bytes_per_sample(format) * channels;
+  if (bytesPerFrame == 0 || capacity == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)calloc(1, sizeof(ca_pcm_ring_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  // The mapped size has to be a multiple of both the page size and the frame size.
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t quantum = pageSize;
+  while (quantum % bytesPerFrame != 0 && quantum < pageSize * PCM_RING_MAX_QUANTUM_PAGES)
+  {
+    quantum += pageSize;
+  }
+
+  size_t mappedSize = ((size_t)capacity * bytesPerFrame + quantum - 1) / quantum * quantum;
+  ca_bool canMap = quantum % bytesPerFrame == 0 && mappedSize / bytesPerFrame <= 0xFFFFFFFF;
+  pData->pBuffer = canMap ? ca_pcm_ring_map(mappedSize) : NULL;
+  pRing->isMirrored = pData->pBuffer != NULL;
+  if (pRing->isMirrored)
+  {
+    pData->size = mappedSize;
+  }
+  else
+  {
+    pData->size = (size_t)capacity * bytesPerFrame;
+    pData->pBuffer = (ca_uint8 *)malloc(pData->size * 2);
+    if (pData->pBuffer == NULL)
+    {
+      free(pData);
+      return ca_result_out_of_memory;
+    }
+  }
+
+  atomic_init(&pData->writePosition, 0);
+  atomic_init(&pData->readPosition, 0);
+  pRing->format = format;
+  pRing->channels = channels;
+  pRing->bytesPerFrame = bytesPerFrame;
+  pRing->capacity = (ca_uint32)(pData->size / bytesPerFrame);
+  pRing->pData = pData;
+  return ca_result_success;
+}
+
+ca_result ca_pcm_ring_acquire_write(ca_pcm_ring *pRing, ca_uint32 *pFrameCount, void **ppBuffer)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return ca_result_not_initialized;
+  }
+
+  ca_uint64 writePosition = atomic_load_explicit(&pData->writePosition, memory_order_relaxed);
+  ca_uint64 readPosition = atomic_load_explicit(&pData->readPosition, memory_order_acquire);
+  ca_uint32 writable = pRing->capacity - (ca_uint32)(writePosition - readPosition);
+  *pFrameCount = ca_min(*pFrameCount, writable);
+  *ppBuffer = pData->pBuffer + (size_t)(writePosition % pRing->capacity) * pRing->bytesPerFrame;
+  return ca_result_success;
+}
+
+ca_result ca_pcm_ring_commit_write(ca_pcm_ring *pRing, ca_uint32 frameCount)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return ca_result_not_initialized;
+  }
+
+  ca_uint64 writePosition = atomic_load_explicit(&pData->writePosition, memory_order_relaxed);
+  ca_uint64 readPosition = atomic_load_explicit(&pData->readPosition, memory_order_acquire);
+  if (frameCount > pRing->capacity - (ca_uint32)(writePosition - readPosition))
+  {
+    return ca_result_invalid_args;
+  }
+
+  // Without the double mapping, the frames written to one copy are mirrored to the other one.
+  if (!pRing->isMirrored && frameCount > 0)
+  {
+    size_t start = (size_t)(writePosition % pRing->capacity) * pRing->bytesPerFrame;
+    size_t end = start + (size_t)frameCount * pRing->bytesPerFrame;
+    if (start < pData->size)
+    {
+      size_t firstEnd = ca_min(end, pData->size);
+      memcpy(pData->pBuffer + pData->size + start, pData->pBuffer + start, firstEnd - start);
+    }
+
+    if (end > pData->size)
+    {
+      size_t secondStart = ca_max(start, pData->size);
+      memcpy(pData->pBuffer + secondStart - pData->size, pData->pBuffer + secondStart, end - secondStart);
+    }
+  }
+
+  atomic_store_explicit(&pData->writePosition, writePosition + frameCount, memory_order_release);
+  return ca_result_success;
+}
+
+ca_result ca_pcm_ring_acquire_read(ca_pcm_ring *pRing, ca_uint32 *pFrameCount, void **ppBuffer)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return ca_result_not_initialized;
+  }
+
+  ca_uint64 readPosition = atomic_load_explicit(&pData->readPosition, memory_order_relaxed);
+  ca_uint64 writePosition = atomic_load_explicit(&pData->writePosition, memory_order_acquire);
+  ca_uint32 readable = (ca_uint32)(writePosition - readPosition);
+  *pFrameCount = ca_min(*pFrameCount, readable);
+  *ppBuffer = pData->pBuffer + (size_t)(readPosition % pRing->capacity) * pRing->bytesPerFrame;
+  return ca_result_success;
+}
+
+ca_result ca_pcm_ring_commit_read(ca_pcm_ring *pRing, ca_uint32 frameCount)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return ca_result_not_initialized;
+  }
+
+  ca_uint64 readPosition = atomic_load_explicit(&pData->readPosition, memory_order_relaxed);
+  ca_uint64 writePosition = atomic_load_explicit(&pData->writePosition, memory_order_acquire);
+  if (frameCount > writePosition - readPosition)
+  {
+    return ca_result_invalid_args;
+  }
+
+  atomic_store_explicit(&pData->readPosition, readPosition + frameCount, memory_order_release);
+  return ca_result_success;
+}
+
+ca_uint32 ca_pcm_ring_get_readable(ca_pcm_ring *pRing)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return 0;
+  }
+
+  return ca_pcm_ring_get_buffered(pRing, pData);
+}
+
+ca_uint32 ca_pcm_ring_get_writable(ca_pcm_ring *pRing)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return 0;
+  }
+
+  return pRing->capacity - ca_pcm_ring_get_buffered(pRing, pData);
+}
+
+void ca_pcm_ring_reset(ca_pcm_ring *pRing)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  atomic_store_explicit(&pData->writePosition, 0, memory_order_release);
+  atomic_store_explicit(&pData->readPosition, 0, memory_order_release);
+}
+
+void ca_pcm_ring_uninit(ca_pcm_ring *pRing)
+{
+  ca_pcm_ring_data *pData = (ca_pcm_ring_data *)pRing->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  if (pRing->isMirrored)
+  {
+    ca_pcm_ring_unmap(pData->pBuffer, pData->size);
+  }
+  else
+  {
+    free(pData->pBuffer);
+  }
+  free(pData);
+  pRing->pData = NULL;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// A single producer, single consumer ring of PCM frames whose readable and writable regions are always contiguous.
+// The buffer pages are mapped twice back to back, so a region crossing the end continues into the second mapping.
+// Where double mapping is not available, or a frame size needs too many pages to fit whole frames, commits copy the written frames into a second plain buffer instead.
+typedef struct
+{
+  ca_sample_format format;
+  ca_uint32 channels;
+  ca_uint32 bytesPerFrame;
+
+  // May be larger than requested since the mapped size is rounded up to whole pages.
+  ca_uint32 capacity;
+  ca_bool isMirrored;
+  void *pData;
+} ca_pcm_ring;
+
+FFI_PLUGIN_EXPORT ca_result ca_pcm_ring_init(ca_pcm_ring *pRing, ca_sample_format format, ca_uint32 channels, ca_uint32 capacity);
+
+// Returns the writable region in ppBuffer. pFrameCount requests a frame count and receives the contiguous frames available, which can be less.
+// Only the producer thread may call the write functions.
+FFI_PLUGIN_EXPORT ca_result ca_pcm_ring_acquire_write(ca_pcm_ring *pRing, ca_uint32 *pFrameCount, void **ppBuffer);
+
+// Publishes frameCount frames written to the acquired region.
+FFI_PLUGIN_EXPORT ca_result ca_pcm_ring_commit_write(ca_pcm_ring *pRing, ca_uint32 frameCount);
+
+// Returns the readable region in ppBuffer. pFrameCount requests a frame count and receives the contiguous frames available, which can be less.
+// Only the consumer thread may call the read functions.
+FFI_PLUGIN_EXPORT ca_result ca_pcm_ring_acquire_read(ca_pcm_ring *pRing, ca_uint32 *pFrameCount, void **ppBuffer);
+
+// Releases frameCount frames of the acquired region to the producer.
+FFI_PLUGIN_EXPORT ca_result ca_pcm_ring_commit_read(ca_pcm_ring *pRing, ca_uint32 frameCount);
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_pcm_ring_get_readable(ca_pcm_ring *pRing);
+
+FFI_PLUGIN_EXPORT ca_uint32 ca_pcm_ring_get_writable(ca_pcm_ring *pRing);
+
+// Drops every buffered frame. Neither side may use the ring meanwhile.
+FFI_PLUGIN_EXPORT void ca_pcm_ring_reset(ca_pcm_ring *pRing);
+
+FFI_PLUGIN_EXPORT void ca_pcm_ring_uninit(ca_pcm_ring *pRing);
@@ -0,0 +1,509 @@
+#include "ca_playlist.h"
+#include "ca_budget.h"
+#include "ca_convert.h"
+#include "ca_thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ca_playlist_data;
+
+typedef struct
+{
+  struct ca_playlist_data *pPlaylist;
+  ca_uint32 index;
+  ca_decoder_read_proc pReadProc;
+  ca_decoder_seek_proc pSeekProc;
+  ca_decoder_tell_proc pTellProc;
+  void *pUserData;
+
+  // isReady, isRefused and result are written by the worker under the playlist lock. The playing thread uses the rest once isReady is set.
+  // isRefused is set instead of isReady when the process budget had no room for the decoder, and the track is opened again later.
+  ca_bool isScheduled;
+  ca_bool isReady;
+  ca_bool isRefused;
+  ca_result result;
+  ca_bool isOpened;
+  ca_decoder decoder;
+
+  // Set when the track was closed ahead of time. The source is left where the prefetch stopped reading and is rewound before the track opens again.
+  ca_bool isRewindNeeded;
+
+  // Frames decoded ahead of time, delivered before the decoder is used by the playing thread.
+  ca_bool isCapturing;
+  ca_result captureResult;
+  ca_uint8 *pFrames;
+  ca_uint32 frameCount;
+  ca_uint32 frameCapacity;
+  ca_uint32 bytesPerFrame;
+  ca_uint64 reservedBytes;
+} ca_playlist_track;
+
+typedef struct ca_playlist_data
+{
+  ca_playlist_config config;
+  ca_playlist_decoded_proc pDecodedProc;
+  void *pUserData;
+
+  // One worker opens tracks in playing order.
+  ca_thread_pool pool;
+  pthread_mutex_t lock;
+  pthread_cond_t readyCond;
+  ca_bool isCancelled;
+
+  // Played tracks are released and leave NULL entries.
+  ca_playlist_track **ppTracks;
+  ca_uint32 trackCount;
+  ca_uint32 trackCapacity;
+  ca_uint32 currentIndex;
+
+  // Bytes of prefetched frames held by tracks which have not played them yet, also reserved from the process budget under the lock.
+  ca_uint64 usedBytes;
+  ca_budget_account account;
+
+  // Set by a critical trim until the current track ends. Only the current track is opened meanwhile.
+  ca_bool isPrefetchPaused;
+} ca_playlist_data;
+
+// MARK: Track
+
+static ca_read_result ca_playlist_on_read(void *pBufferIn, ca_uint32 bytesToRead, ca_uint32 *pBytesRead, void *pUserData)
+{
+  ca_playlist_track *pTrack = (ca_playlist_track *)pUserData;
+  return pTrack->pReadProc(pBufferIn, bytesToRead, pBytesRead, pTrack->pUserData);
+}
+
+static ca_seek_result ca_playlist_on_seek(ca_int64 byteOffset, ca_seek_origin origin, void *pUserData)
+{
+  ca_playlist_track *pTrack = (ca_playlist_track *)pUserData;
+  return pTrack->pSeekProc(byteOffset, origin, pTrack->pUserData);
+}
+
+static ca_tell_result ca_playlist_on_tell(ca_uint64 *pPosition, ca_uint64 *pLength, void *pUserData)
+{
+  ca_playlist_track *pTrack = (ca_playlist_track *)pUserData;
+  return pTrack->pTellProc(pPosition, pLength, pTrack->pUserData);
+}
+
+// Frames are kept while the track is prefetched and passed to the host once it plays.
+static void ca_playlist_on_decoded(ca_uint32 frameCount, void *pBuffer, void *pUserData)
+{
+  ca_playlist_track *pTrack = (ca_playlist_track *)pUserData;
+  if (!pTrack->isCapturing)
+  {
+    pTrack->pPlaylist->pDecodedProc(pTrack->index, frameCount, pBuffer, pTrack->pPlaylist->pUserData);
+    return;
+  }
+
+  if (pTrack->captureResult != ca_result_success)
+  {
+    return;
+  }
+
+  // The budgeted decode stops at the capacity. It only delivers more when the capacity is smaller than what one source frame resamples to,
+  // and the extra bytes are reserved like the rest. Without them the prefetch fails instead of leaving a gap.
+  if (pTrack->frameCount + frameCount > pTrack->frameCapacity)
+  {
+    ca_playlist_data *pData = pTrack->pPlaylist;
+    ca_uint64 extraBytes = (ca_uint64)(pTrack->frameCount + frameCount - pTrack->frameCapacity) * pTrack->bytesPerFrame;
+    pthread_mutex_lock(&pData->lock);
+    ca_bool isReserved = ca_budget_reserve(&pData->account, extraBytes);
+    if (isReserved)
+    {
+      pData->usedBytes += extraBytes;
+      pTrack->reservedBytes += extraBytes;
+    }
+    pthread_mutex_unlock(&pData->lock);
+
+    ca_uint8 *pFrames = isReserved ? (ca_uint8 *)realloc(pTrack->pFrames, (size_t)pTrack->reservedBytes) : NULL;
+    if (pFrames == NULL)
+    {
+      pTrack->captureResult = ca_result_out_of_memory;
+      return;
+    }
+    pTrack->pFrames = pFrames;
+    pTrack->frameCapacity = pTrack->frameCount + frameCount;
+  }
+
+  memcpy(pTrack->pFrames + (size_t)pTrack->frameCount * pTrack->bytesPerFrame, pBuffer, (size_t)frameCount * pTrack->bytesPerFrame);
+  pTrack->frameCount += frameCount;
+}
+
+// Opens the decoder and decodes the first frames as far as the memory budget allows. Runs on the worker.
+static ca_result ca_playlist_open_track(ca_playlist_data *pData, ca_playlist_track *pTrack)
+{
+  if (pTrack->isRewindNeeded)
+  {
+    if (pTrack->pSeekProc(0, ca_seek_origin_start, pTrack->pUserData) != ca_seek_result_success)
+    {
+      return ca_result_seek_failed;
+    }
+    pTrack->isRewindNeeded = CA_FALSE;
+  }
+
+  ca_result result = ca_decoder_init(&pTrack->decoder, pData->config.decoderConfig, ca_playlist_on_read, ca_playlist_on_seek, pTrack->pTellProc == NULL ? NULL : ca_playlist_on_tell, ca_playlist_on_decoded, pTrack);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+  pTrack->isOpened = CA_TRUE;
+
+  ca_audio_format format;
+  result = ca_decoder_get_format(&pTrack->decoder, &format);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  pTrack->bytesPerFrame = ca_get_bytes_per_sample(format.sample_foramt) * format.channels;
+  ca_uint64 frameCount = (ca_uint64)format.sample_rate * pData->config.prefetchMillis / 1000;
+  pthread_mutex_lock(&pData->lock);
+  ca_uint64 availableBytes = pData->config.prefetchSizeInBytes - ca_min(pData->usedBytes, pData->config.prefetchSizeInBytes);
+  availableBytes = ca_min(availableBytes, ca_budget_get_available());
+  frameCount = ca_min(frameCount, availableBytes / ca_max(pTrack->bytesPerFrame, 1u));
+  if (!ca_budget_reserve(&pData->account, frameCount * pTrack->bytesPerFrame))
+  {
+    frameCount = 0;
+  }
+  pTrack->reservedBytes = frameCount * pTrack->bytesPerFrame;
+  pData->usedBytes += pTrack->reservedBytes;
+  pthread_mutex_unlock(&pData->lock);
+
+  if (frameCount == 0)
+  {
+    return ca_result_success;
+  }
+
+  pTrack->pFrames = (ca_uint8 *)malloc((size_t)pTrack->reservedBytes);
+  if (pTrack->pFrames == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pTrack->frameCapacity = (ca_uint32)frameCount;
+  pTrack->isCapturing = CA_TRUE;
+  pTrack->captureResult = ca_result_success;
+  result = ca_decoder_decode_budget(&pTrack->decoder, (ca_uint32)frameCount, 0);
+  pTrack->isCapturing = CA_FALSE;
+  return result != ca_result_success ? result : pTrack->captureResult;
+}
+
+static void ca_playlist_open_job(void *pJobData)
+{
+  ca_playlist_track *pTrack = (ca_playlist_track *)pJobData;
+  ca_playlist_data *pData = pTrack->pPlaylist;
+
+  pthread_mutex_lock(&pData->lock);
+  ca_bool isCancelled = pData->isCancelled;
+  pthread_mutex_unlock(&pData->lock);
+
+  ca_result result = isCancelled ? ca_result_unknown_failed : ca_playlist_open_track(pData, pTrack);
+
+  pthread_mutex_lock(&pData->lock);
+  if (result == ca_result_budget_exceeded)
+  {
+    pTrack->isScheduled = CA_FALSE;
+    pTrack->isRefused = CA_TRUE;
+  }
+  else
+  {
+    pTrack->result = result;
+    pTrack->isReady = CA_TRUE;
+  }
+  pthread_cond_broadcast(&pData->readyCond);
+  pthread_mutex_unlock(&pData->lock);
+}
+
+// Hands the prefetched frames to the host and returns their bytes to the budget.
+static void ca_playlist_release_frames(ca_playlist_data *pData, ca_playlist_track *pTrack)
+{
+  free(pTrack->pFrames);
+  pTrack->pFrames = NULL;
+  pTrack->frameCount = 0;
+
+  pthread_mutex_lock(&pData->lock);
+  pData->usedBytes -= pTrack->reservedBytes;
+  ca_budget_release(&pData->account, pTrack->reservedBytes);
+  pthread_mutex_unlock(&pData->lock);
+  pTrack->reservedBytes = 0;
+}
+
+static void ca_playlist_free_track(ca_playlist_data *pData, ca_playlist_track *pTrack)
+{
+  if (pTrack->isOpened)
+  {
+    ca_decoder_uninit(&pTrack->decoder);
+  }
+  ca_playlist_release_frames(pData, pTrack);
+  free(pTrack);
+}
+
+// Called with the lock held. Opens the current track and the prefetchDepth tracks after it.
+// Tracks after the current one wait while prefetching is paused or the process budget has no room for another decoder.
+static void ca_playlist_schedule(ca_playlist_data *pData)
+{
+  ca_uint64 endIndex = ca_min((ca_uint64)pData->currentIndex + pData->config.prefetchDepth + 1, (ca_uint64)pData->trackCount);
+  for (ca_uint32 i = pData->currentIndex; i < endIndex; i++)
+  {
+    ca_playlist_track *pTrack = pData->ppTracks[i];
+    if (pTrack->isScheduled)
+    {
+      continue;
+    }
+
+    if (i > pData->currentIndex && (pData->isPrefetchPaused || !ca_budget_has_room()))
+    {
+      break;
+    }
+
+    pTrack->isScheduled = CA_TRUE;
+    pTrack->isRefused = CA_FALSE;
+    ca_result result = ca_thread_pool_submit(&pData->pool, ca_playlist_open_job, pTrack);
+    if (result != ca_result_success)
+    {
+      pTrack->result = result;
+      pTrack->isReady = CA_TRUE;
+    }
+  }
+}
+
+// Releases the current track and moves on to the next one.
+static void ca_playlist_advance(ca_playlist_data *pData, ca_playlist_track *pTrack)
+{
+  ca_playlist_free_track(pData, pTrack);
+  pthread_mutex_lock(&pData->lock);
+  pData->ppTracks[pData->currentIndex] = NULL;
+  pData->currentIndex++;
+  pData->isPrefetchPaused = CA_FALSE;
+  pthread_mutex_unlock(&pData->lock);
+}
+
+// Closes the tracks opened ahead of the current one so they are opened again later. Tracks the worker still opens are left alone.
+static void ca_playlist_close_ahead(ca_playlist_data *pData)
+{
+  pthread_mutex_lock(&pData->lock);
+  pData->isPrefetchPaused = CA_TRUE;
+  ca_uint32 startIndex = pData->currentIndex + 1;
+  ca_uint32 endIndex = pData->trackCount;
+  pthread_mutex_unlock(&pData->lock);
+
+  for (ca_uint32 i = startIndex; i < endIndex; i++)
+  {
+    pthread_mutex_lock(&pData->lock);
+    ca_playlist_track *pTrack = pData->ppTracks[i];
+    ca_bool isClosable = pTrack->isReady && pTrack->result == ca_result_success;
+    pthread_mutex_unlock(&pData->lock);
+    if (!isClosable)
+    {
+      continue;
+    }
+
+    ca_decoder_uninit(&pTrack->decoder);
+    pTrack->isOpened = CA_FALSE;
+    pTrack->isRewindNeeded = CA_TRUE;
+    ca_playlist_release_frames(pData, pTrack);
+
+    pthread_mutex_lock(&pData->lock);
+    pTrack->isScheduled = CA_FALSE;
+    pTrack->isReady = CA_FALSE;
+    pthread_mutex_unlock(&pData->lock);
+  }
+}
+
+// MARK: API
+
+FFI_PLUGIN_EXPORT ca_playlist_config ca_playlist_config_init()
+{
+  ca_playlist_config config = {
+    .decoderConfig = ca_decoder_config_init(),
+    .prefetchDepth = 1,
+    .prefetchMillis = 300,
+    .prefetchSizeInBytes = 4 * 1024 * 1024,
+  };
+  return config;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_init(ca_playlist *pPlaylist, ca_playlist_config config, ca_playlist_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (config.decoderConfig.pDecodedPlanarProc != NULL || config.decoderConfig.pDecodedChunkProc != NULL || pDecodedProc == NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_playlist_data *pData = (ca_playlist_data *)calloc(1, sizeof(ca_playlist_data));
+  if (pData == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  ca_result result = ca_thread_pool_init(&pData->pool, 1);
+  if (result != ca_result_success)
+  {
+    free(pData);
+    return result;
+  }
+
+  pthread_mutex_init(&pData->lock, NULL);
+  pthread_cond_init(&pData->readyCond, NULL);
+  pData->config = config;
+  pData->pDecodedProc = pDecodedProc;
+  pData->pUserData = pUserData;
+  pPlaylist->pData = pData;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_append(ca_playlist *pPlaylist, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pSourceUserData, ca_uint32 *pTrackIndex)
+{
+  ca_playlist_data *pData = (ca_playlist_data *)pPlaylist->pData;
+  ca_playlist_track *pTrack = (ca_playlist_track *)calloc(1, sizeof(ca_playlist_track));
+  if (pTrack == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pTrack->pPlaylist = pData;
+  pTrack->pReadProc = pReadProc;
+  pTrack->pSeekProc = pSeekProc;
+  pTrack->pTellProc = pTellProc;
+  pTrack->pUserData = pSourceUserData;
+
+  pthread_mutex_lock(&pData->lock);
+  if (pData->trackCount == pData->trackCapacity)
+  {
+    ca_uint32 capacity = ca_max(pData->trackCapacity * 2, 8u);
+    ca_playlist_track **ppTracks = (ca_playlist_track **)realloc(pData->ppTracks, sizeof(ca_playlist_track *) * capacity);
+    if (ppTracks == NULL)
+    {
+      pthread_mutex_unlock(&pData->lock);
+      free(pTrack);
+      return ca_result_out_of_memory;
+    }
+    pData->ppTracks = ppTracks;
+    pData->trackCapacity = capacity;
+  }
+
+  pTrack->index = pData->trackCount;
+  pData->ppTracks[pData->trackCount++] = pTrack;
+  ca_playlist_schedule(pData);
+  pthread_mutex_unlock(&pData->lock);
+
+  if (pTrackIndex != NULL)
+  {
+    *pTrackIndex = pTrack->index;
+  }
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_decode_next(ca_playlist *pPlaylist)
+{
+  ca_playlist_data *pData = (ca_playlist_data *)pPlaylist->pData;
+  ca_trim_level level;
+  if (ca_budget_poll_trim(&pData->account, &level) && level == ca_trim_level_critical)
+  {
+    ca_playlist_close_ahead(pData);
+  }
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pData->lock);
+    if (pData->currentIndex == pData->trackCount)
+    {
+      pthread_mutex_unlock(&pData->lock);
+      return ca_result_success;
+    }
+
+    ca_playlist_schedule(pData);
+    ca_playlist_track *pTrack = pData->ppTracks[pData->currentIndex];
+    while (!pTrack->isReady && !pTrack->isRefused)
+    {
+      pthread_cond_wait(&pData->readyCond, &pData->lock);
+    }
+
+    // The track stays current and is opened again by the next call.
+    if (pTrack->isRefused)
+    {
+      pTrack->isRefused = CA_FALSE;
+      pthread_mutex_unlock(&pData->lock);
+      return ca_result_budget_exceeded;
+    }
+    pthread_mutex_unlock(&pData->lock);
+
+    if (pTrack->result != ca_result_success)
+    {
+      ca_result result = pTrack->result;
+      ca_playlist_advance(pData, pTrack);
+      return result;
+    }
+
+    if (pTrack->frameCount > 0)
+    {
+      pData->pDecodedProc(pTrack->index, pTrack->frameCount, pTrack->pFrames, pData->pUserData);
+      ca_playlist_release_frames(pData, pTrack);
+      return ca_result_success;
+    }
+
+    ca_bool isEOF = CA_FALSE;
+    ca_result result = ca_decoder_get_eof(&pTrack->decoder, &isEOF);
+    if (result == ca_result_success && !isEOF)
+    {
+      result = ca_decoder_decode_next(&pTrack->decoder);
+      if (result == ca_result_success)
+      {
+        return result;
+      }
+    }
+
+    // The next track starts in this call, so the host sees no empty call at the boundary.
+    ca_playlist_advance(pData, pTrack);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+  }
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_get_current_track(ca_playlist *pPlaylist, ca_uint32 *pTrackIndex)
+{
+  ca_playlist_data *pData = (ca_playlist_data *)pPlaylist->pData;
+  pthread_mutex_lock(&pData->lock);
+  *pTrackIndex = pData->currentIndex;
+  pthread_mutex_unlock(&pData->lock);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_get_eof(ca_playlist *pPlaylist, ca_bool *pIsEOF)
+{
+  ca_playlist_data *pData = (ca_playlist_data *)pPlaylist->pData;
+  pthread_mutex_lock(&pData->lock);
+  *pIsEOF = pData->currentIndex == pData->trackCount;
+  pthread_mutex_unlock(&pData->lock);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_uninit(ca_playlist *pPlaylist)
+{
+  ca_playlist_data *pData = (ca_playlist_data *)pPlaylist->pData;
+  if (pData == NULL)
+  {
+    return ca_result_success;
+  }
+
+  // Queued opens give up, and the running one finishes before the tracks are released.
+  pthread_mutex_lock(&pData->lock);
+  pData->isCancelled = CA_TRUE;
+  pthread_mutex_unlock(&pData->lock);
+  ca_thread_pool_uninit(&pData->pool);
+
+  for (ca_uint32 i = pData->currentIndex; i < pData->trackCount; i++)
+  {
+    ca_playlist_free_track(pData, pData->ppTracks[i]);
+  }
+
+  ca_budget_close(&pData->account);
+  free(pData->ppTracks);
+  pthread_cond_destroy(&pData->readyCond);
+  pthread_mutex_destroy(&pData->lock);
+  free(pData);
+  pPlaylist->pData = NULL;
+  return ca_result_success;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ca_decoder.h"
+
+// Receives the frames of the track at trackIndex, in the order tracks were appended.
+typedef void (*ca_playlist_decoded_proc)(ca_uint32 trackIndex, ca_uint32 frameCount, void *pBuffer, void *pUserData);
+
+typedef struct
+{
+  // Used for every track. Planar and chunk output are not supported. Fix the output format to get the same one from every track.
+  ca_decoder_config decoderConfig;
+
+  // Tracks after the current one opened ahead of time.
+  ca_uint32 prefetchDepth;
+
+  // Output decoded ahead of time for each opened track, and the bytes all tracks may hold together before they play.
+  ca_uint32 prefetchMillis;
+  ca_uint64 prefetchSizeInBytes;
+} ca_playlist_config;
+
+// Plays tracks back to back. The next tracks are opened and their first frames decoded on a background thread,
+// so the boundary costs no more than copying those frames.
+typedef struct
+{
+  void *pData;
+} ca_playlist;
+
+FFI_PLUGIN_EXPORT ca_playlist_config ca_playlist_config_init();
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_init(ca_playlist *pPlaylist, ca_playlist_config config, ca_playlist_decoded_proc pDecodedProc, void *pUserData);
+
+// Adds a track at the end. The source procs receive pSourceUserData and are called on the background thread until the track plays.
+// pTrackIndex can be NULL.
+FFI_PLUGIN_EXPORT ca_result ca_playlist_append(ca_playlist *pPlaylist, ca_decoder_read_proc pReadProc, ca_decoder_seek_proc pSeekProc, ca_decoder_tell_proc pTellProc, void *pSourceUserData, ca_uint32 *pTrackIndex);
+
+// Delivers the next frames of the current track. At its end the next track starts in the same call, waiting for it to open if it is not ready yet.
+// A track which fails to open or decode returns its error once and is skipped.
+// A track refused by the process budget of ca_budget.h returns ca_result_budget_exceeded instead and stays current, so a later call tries it again.
+FFI_PLUGIN_EXPORT ca_result ca_playlist_decode_next(ca_playlist *pPlaylist);
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_get_current_track(ca_playlist *pPlaylist, ca_uint32 *pTrackIndex);
+
+// Set once every appended track has played.
+FFI_PLUGIN_EXPORT ca_result ca_playlist_get_eof(ca_playlist *pPlaylist, ca_bool *pIsEOF);
+
+FFI_PLUGIN_EXPORT ca_result ca_playlist_uninit(ca_playlist *pPlaylist);
@@ -0,0 +1,575 @@
+#include "ca_resampler.h"
+#include "ca_cpu.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CA_SUPPORT_SSE2
+#include <immintrin.h>
+#endif
+
+#if CA_SUPPORT_NEON
+#include <arm_neon.h>
+#endif
+
+#define RESAMPLER_BLOCK_FRAMES 1024
+#define RESAMPLER_MAX_EXACT_PHASES 1024
+#define RESAMPLER_INTERPOLATED_PHASES 256
+#define RESAMPLER_MAX_DOWNSAMPLE_FACTOR 8
+#define RESAMPLER_PI 3.14159265358979323846
+
+// Every tap count is a multiple of 8 so the SIMD kernels need no tail handling.
+typedef float (*ca_resampler_dot_proc)(const float *pCoefficients, const float *pSamples, ca_uint32 taps);
+
+typedef struct
+{
+  ca_uint32 taps;
+  double beta;
+  double rolloff;
+} ca_resampler_preset;
+
+static const ca_resampler_preset resamplerPresets[] = {
+    {16, 6.0, 0.85},
+    {32, 8.0, 0.91},
+    {64, 10.0, 0.945},
+    {128, 12.0, 0.965},
+};
+
+// MARK: Dot product kernels
+
+static float ca_resampler_dot_scalar(const float *pCoefficients, const float *pSamples, ca_uint32 taps)
+{
+  float sum = 0;
+  for (ca_uint32 i = 0; i < taps; i++)
+  {
+    sum += pCoefficients[i] * pSamples[i];
+  }
+  return sum;
+}
+
+#if CA_SUPPORT_SSE2
+CA_TARGET_SSE2 static float ca_resampler_dot_sse2(const float *pCoefficients, const float *pSamples, ca_uint32 taps)
+{
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  for (ca_uint32 i = 0; i < taps; i += 8)
+  {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(pCoefficients + i), _mm_loadu_ps(pSamples + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(pCoefficients + i + 4), _mm_loadu_ps(pSamples + i + 4)));
+  }
+
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+#endif
+
+#if CA_SUPPORT_AVX2
+CA_TARGET_AVX2 static float ca_resampler_dot_avx2(const float *pCoefficients, const float *pSamples, ca_uint32 taps)
+{
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  ca_uint32 i = 0;
+  for (; i + 16 <= taps; i += 16)
+  {
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(pCoefficients + i), _mm256_loadu_ps(pSamples + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(pCoefficients + i + 8), _mm256_loadu_ps(pSamples + i + 8)));
+  }
+
+  if (i < taps)
+  {
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(pCoefficients + i), _mm256_loadu_ps(pSamples + i)));
+  }
+
+  __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  return _mm_cvtss_f32(half);
+}
+#endif
+
+#if CA_SUPPORT_NEON
+static float ca_resampler_dot_neon(const float *pCoefficients, const float *pSamples, ca_uint32 taps)
+{
+  float32x4_t sum0 = vdupq_n_f32(0);
+  float32x4_t sum1 = vdupq_n_f32(0);
+  for (ca_uint32 i = 0; i < taps; i += 8)
+  {
+    sum0 = vfmaq_f32(sum0, vld1q_f32(pCoefficients + i), vld1q_f32(pSamples + i));
+    sum1 = vfmaq_f32(sum1, vld1q_f32(pCoefficients + i + 4), vld1q_f32(pSamples + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(sum0, sum1));
+}
+#endif
+
+static pthread_once_t dotProcOnce = PTHREAD_ONCE_INIT;
+static ca_resampler_dot_proc simdDotProc = ca_resampler_dot_scalar;
+
+static void ca_resampler_init_dot_proc()
+{
+  ca_uint32 features = ca_get_cpu_features();
+
+#if CA_SUPPORT_SSE2
+  if (features & ca_cpu_feature_sse2)
+  {
+    simdDotProc = ca_resampler_dot_sse2;
+  }
+#endif
+
+#if CA_SUPPORT_AVX2
+  if (features & ca_cpu_feature_avx2)
+  {
+    simdDotProc = ca_resampler_dot_avx2;
+  }
+#endif
+
+#if CA_SUPPORT_NEON
+  if (features & ca_cpu_feature_neon)
+  {
+    simdDotProc = ca_resampler_dot_neon;
+  }
+#endif
+
+  (void)features;
+}
+
+// MARK: Filter design
+
+static ca_uint32 ca_resampler_gcd(ca_uint32 a, ca_uint32 b)
+{
+  while (b != 0)
+  {
+    ca_uint32 t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static double ca_resampler_bessel_i0(double x)
+{
+  double sum = 1;
+  double term = 1;
+  for (int k = 1; k < 50; k++)
+  {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+    {
+      break;
+    }
+  }
+  return sum;
+}
+
+static ca_uint32 ca_resampler_get_taps(ca_resampler_config config, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut)
+{
+  ca_uint32 taps = resamplerPresets[config.quality].taps;
+  if (sampleRateIn > sampleRateOut)
+  {
+    // The transition band shrinks with the output rate, so the filter gets longer in input frames.
+    ca_uint32 factor = (sampleRateIn + sampleRateOut / 2) / sampleRateOut;
+    taps *= ca_min(factor, (ca_uint32)RESAMPLER_MAX_DOWNSAMPLE_FACTOR);
+  }
+  return taps;
+}
+
+static float ca_resampler_get_cutoff(ca_resampler_config config, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut)
+{
+  double cutoff = 0.5 * resamplerPresets[config.quality].rolloff;
+  if (sampleRateIn > sampleRateOut)
+  {
+    cutoff = cutoff * sampleRateOut / sampleRateIn;
+  }
+  return (float)cutoff;
+}
+
+// Fills one row of taps for an output frame which is fraction frames after the center tap.
+static void ca_resampler_design_row(float *pRow, ca_uint32 taps, double cutoff, double beta, double fraction)
+{
+  double halfLength = taps / 2.0;
+  double sum = 0;
+  double row[RESAMPLER_MAX_DOWNSAMPLE_FACTOR * 128];
+  for (ca_uint32 k = 0; k < taps; k++)
+  {
+    double distance = (double)k - (taps / 2 - 1) - fraction;
+    double x = 2 * cutoff * distance;
+    double sinc = fabs(x) < 1e-12 ? 1.0 : sin(RESAMPLER_PI * x) / (RESAMPLER_PI * x);
+    double ratio = distance / halfLength;
+    double window = ratio * ratio >= 1 ? 0 : ca_resampler_bessel_i0(beta * sqrt(1 - ratio * ratio)) / ca_resampler_bessel_i0(beta);
+    row[k] = 2 * cutoff * sinc * window;
+    sum += row[k];
+  }
+
+  // Normalizing every row keeps the DC gain at exactly 1 for all phases.
+  for (ca_uint32 k = 0; k < taps; k++)
+  {
+    pRow[k] = (float)(row[k] / sum);
+  }
+}
+
+static ca_result ca_resampler_build_table(ca_resampler *pResampler, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut)
+{
+  ca_uint32 divisor = ca_resampler_gcd(sampleRateIn, sampleRateOut);
+  ca_uint32 phaseCount = sampleRateOut / divisor;
+  ca_bool isInterpolated = phaseCount > RESAMPLER_MAX_EXACT_PHASES;
+  ca_uint32 taps = ca_resampler_get_taps(pResampler->config, sampleRateIn, sampleRateOut);
+  float cutoff = ca_resampler_get_cutoff(pResampler->config, sampleRateIn, sampleRateOut);
+
+  // Small ratio changes on an interpolated table, such as clock drift correction, reuse the table.
+  ca_bool isReusable = pResampler->pTable != NULL && isInterpolated && pResampler->isInterpolated && taps == pResampler->taps && fabsf(cutoff - pResampler->cutoff) <= pResampler->cutoff * 0.005f;
+  if (!isReusable)
+  {
+    ca_uint32 rows = isInterpolated ? RESAMPLER_INTERPOLATED_PHASES + 1 : phaseCount;
+    float *pTable = (float *)malloc(sizeof(float) * rows * taps);
+    float *pCoefficients = (float *)realloc(pResampler->pCoefficients, sizeof(float) * taps);
+    if (pTable == NULL || pCoefficients == NULL)
+    {
+      free(pTable);
+      pResampler->pCoefficients = pCoefficients;
+      return ca_result_out_of_memory;
+    }
+
+    double beta = resamplerPresets[pResampler->config.quality].beta;
+    for (ca_uint32 row = 0; row < rows; row++)
+    {
+      double fraction = isInterpolated ? (double)row / RESAMPLER_INTERPOLATED_PHASES : (double)row / phaseCount;
+      ca_resampler_design_row(pTable + (size_t)row * taps, taps, cutoff, beta, fraction);
+    }
+
+    free(pResampler->pTable);
+    pResampler->pTable = pTable;
+    pResampler->pCoefficients = pCoefficients;
+    pResampler->tableRows = rows;
+    pResampler->taps = taps;
+    pResampler->cutoff = cutoff;
+  }
+
+  // Keeps the fractional position when the phase resolution changes.
+  ca_uint64 newPhaseCount = isInterpolated ? ((ca_uint64)1 << 32) : phaseCount;
+  if (pResampler->phaseCount != 0 && pResampler->phaseCount != newPhaseCount)
+  {
+    pResampler->phase = (ca_uint64)((double)pResampler->phase / pResampler->phaseCount * newPhaseCount);
+  }
+
+  pResampler->isInterpolated = isInterpolated;
+  pResampler->phaseCount = newPhaseCount;
+  pResampler->step = isInterpolated ? (ca_uint64)((double)sampleRateIn / sampleRateOut * newPhaseCount + 0.5) : sampleRateIn / divisor;
+  pResampler->config.sampleRateIn = sampleRateIn;
+  pResampler->config.sampleRateOut = sampleRateOut;
+  return ca_result_success;
+}
+
+// MARK: Buffer
+
+static ca_uint32 ca_resampler_get_history(ca_resampler *pResampler)
+{
+  return pResampler->taps / 2 - 1;
+}
+
+static ca_result ca_resampler_reserve_buffer(ca_resampler *pResampler)
+{
+  ca_uint32 history = ca_resampler_get_history(pResampler);
+  ca_uint32 capacity = pResampler->taps + RESAMPLER_BLOCK_FRAMES;
+  ca_uint32 available = 0;
+  if (pResampler->pBuffer != NULL)
+  {
+    available = pResampler->bufferFrames > pResampler->center ? pResampler->bufferFrames - pResampler->center : 0;
+    if (pResampler->bufferCapacity >= capacity && pResampler->center >= history)
+    {
+      return ca_result_success;
+    }
+
+    capacity = ca_max(capacity, history + available);
+  }
+
+  ca_uint32 channels = pResampler->config.channels;
+  float *pBuffer = (float *)calloc((size_t)capacity * channels, sizeof(float));
+  if (pBuffer == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  // Moves the frames around the center into the new buffer so the position is kept.
+  if (pResampler->pBuffer != NULL)
+  {
+    ca_uint32 oldHistory = ca_min(pResampler->center, history);
+    for (ca_uint32 channel = 0; channel < channels; channel++)
+    {
+      const float *pOld = pResampler->pBuffer + (size_t)channel * pResampler->bufferCapacity;
+      float *pNew = pBuffer + (size_t)channel * capacity;
+      memcpy(pNew + history - oldHistory, pOld + pResampler->center - oldHistory, sizeof(float) * (oldHistory + available));
+    }
+
+    pResampler->bufferStartFrame += (ca_int64)pResampler->center - history;
+  }
+
+  free(pResampler->pBuffer);
+  pResampler->pBuffer = pBuffer;
+  pResampler->bufferCapacity = capacity;
+  pResampler->bufferFrames = history + available;
+  pResampler->center = history;
+  return ca_result_success;
+}
+
+// Drops the frames which are no longer reachable by the first tap.
+static void ca_resampler_compact(ca_resampler *pResampler)
+{
+  ca_uint32 history = ca_resampler_get_history(pResampler);
+  if (pResampler->center <= history)
+  {
+    return;
+  }
+
+  ca_uint32 dropped = ca_min(pResampler->center - history, pResampler->bufferFrames);
+  ca_uint32 remaining = pResampler->bufferFrames - dropped;
+  for (ca_uint32 channel = 0; channel < pResampler->config.channels; channel++)
+  {
+    float *pChannel = pResampler->pBuffer + (size_t)channel * pResampler->bufferCapacity;
+    memmove(pChannel, pChannel + dropped, sizeof(float) * remaining);
+  }
+
+  pResampler->bufferFrames = remaining;
+  pResampler->center -= dropped;
+  pResampler->bufferStartFrame += dropped;
+}
+
+static ca_uint32 ca_resampler_fill(ca_resampler *pResampler, const float *pFramesIn, ca_uint64 frameCount)
+{
+  ca_uint32 channels = pResampler->config.channels;
+  ca_uint32 count = (ca_uint32)ca_min(frameCount, (ca_uint64)(pResampler->bufferCapacity - pResampler->bufferFrames));
+  for (ca_uint32 channel = 0; channel < channels; channel++)
+  {
+    float *pChannel = pResampler->pBuffer + (size_t)channel * pResampler->bufferCapacity + pResampler->bufferFrames;
+    if (pFramesIn == NULL)
+    {
+      memset(pChannel, 0, sizeof(float) * count);
+      continue;
+    }
+
+    for (ca_uint32 i = 0; i < count; i++)
+    {
+      pChannel[i] = pFramesIn[(size_t)i * channels + channel];
+    }
+  }
+
+  pResampler->bufferFrames += count;
+  return count;
+}
+
+// MARK: Processing
+
+static const float *ca_resampler_get_coefficients(ca_resampler *pResampler)
+{
+  ca_uint32 taps = pResampler->taps;
+  if (!pResampler->isInterpolated)
+  {
+    return pResampler->pTable + (size_t)pResampler->phase * taps;
+  }
+
+  ca_uint64 position = pResampler->phase * RESAMPLER_INTERPOLATED_PHASES;
+  ca_uint32 row = (ca_uint32)(position >> 32);
+  float fraction = (float)(position & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+  const float *pRow0 = pResampler->pTable + (size_t)row * taps;
+  const float *pRow1 = pRow0 + taps;
+  for (ca_uint32 k = 0; k < taps; k++)
+  {
+    pResampler->pCoefficients[k] = pRow0[k] + (pRow1[k] - pRow0[k]) * fraction;
+  }
+  return pResampler->pCoefficients;
+}
+
+// Produces frames while the filter has all of its taps. isFlushing limits the output to the real input frames.
+static ca_uint64 ca_resampler_produce(ca_resampler *pResampler, float *pFramesOut, ca_uint64 frameCount, ca_bool isFlushing)
+{
+  ca_resampler_dot_proc pDot = (ca_resampler_dot_proc)pResampler->pDotProc;
+  ca_uint32 channels = pResampler->config.channels;
+  ca_uint32 history = ca_resampler_get_history(pResampler);
+  ca_uint32 lookahead = pResampler->taps / 2;
+
+  ca_uint64 produced = 0;
+  while (produced < frameCount && pResampler->center + lookahead < pResampler->bufferFrames)
+  {
+    if (isFlushing && pResampler->bufferStartFrame + (ca_int64)pResampler->center >= (ca_int64)pResampler->inputFrameCount)
+    {
+      break;
+    }
+
+    const float *pCoefficients = ca_resampler_get_coefficients(pResampler);
+    float *pFrame = pFramesOut + produced * channels;
+    for (ca_uint32 channel = 0; channel < channels; channel++)
+    {
+      const float *pSamples = pResampler->pBuffer + (size_t)channel * pResampler->bufferCapacity + pResampler->center - history;
+      pFrame[channel] = pDot(pCoefficients, pSamples, pResampler->taps);
+    }
+
+    pResampler->phase += pResampler->step;
+    pResampler->center += (ca_uint32)(pResampler->phase / pResampler->phaseCount);
+    pResampler->phase %= pResampler->phaseCount;
+    produced++;
+  }
+
+  return produced;
+}
+
+FFI_PLUGIN_EXPORT ca_resampler_config ca_resampler_config_init(ca_uint32 channels, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut)
+{
+  ca_resampler_config config = {
+      .channels = channels,
+      .sampleRateIn = sampleRateIn,
+      .sampleRateOut = sampleRateOut,
+      .quality = ca_resampler_quality_medium,
+      .isSimdDisabled = CA_FALSE,
+  };
+  return config;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_resampler_init(ca_resampler *pResampler, ca_resampler_config config)
+{
+  if (config.channels == 0 || config.sampleRateIn == 0 || config.sampleRateOut == 0 || config.quality > ca_resampler_quality_best)
+  {
+    return ca_result_invalid_args;
+  }
+
+  memset(pResampler, 0, sizeof(ca_resampler));
+  pResampler->config = config;
+
+  if (config.isSimdDisabled)
+  {
+    pResampler->pDotProc = (const void *)ca_resampler_dot_scalar;
+  }
+  else
+  {
+    pthread_once(&dotProcOnce, ca_resampler_init_dot_proc);
+    pResampler->pDotProc = (const void *)simdDotProc;
+  }
+
+  ca_result result = ca_resampler_build_table(pResampler, config.sampleRateIn, config.sampleRateOut);
+  if (result == ca_result_success)
+  {
+    result = ca_resampler_reserve_buffer(pResampler);
+  }
+
+  if (result != ca_result_success)
+  {
+    ca_resampler_uninit(pResampler);
+    return result;
+  }
+
+  ca_resampler_reset(pResampler);
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_resampler_set_rate(ca_resampler *pResampler, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut)
+{
+  if (sampleRateIn == 0 || sampleRateOut == 0)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_result result = ca_resampler_build_table(pResampler, sampleRateIn, sampleRateOut);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  return ca_resampler_reserve_buffer(pResampler);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_resampler_process(ca_resampler *pResampler, const float *pFramesIn, ca_uint64 *pFrameCountIn, float *pFramesOut, ca_uint64 *pFrameCountOut)
+{
+  ca_bool isFlushing = pFramesIn == NULL;
+  ca_uint64 frameCountIn = isFlushing ? 0 : *pFrameCountIn;
+  ca_uint64 frameCountOut = *pFrameCountOut;
+  ca_uint32 channels = pResampler->config.channels;
+
+  ca_uint64 consumed = 0;
+  ca_uint64 produced = 0;
+  for (;;)
+  {
+    produced += ca_resampler_produce(pResampler, pFramesOut + produced * channels, frameCountOut - produced, isFlushing);
+    if (produced == frameCountOut)
+    {
+      break;
+    }
+
+    // Flushing feeds silence until every real input frame has been the center once.
+    ca_bool isFlushed = pResampler->bufferStartFrame + (ca_int64)pResampler->center >= (ca_int64)pResampler->inputFrameCount;
+    if ((!isFlushing && consumed == frameCountIn) || (isFlushing && isFlushed))
+    {
+      break;
+    }
+
+    ca_resampler_compact(pResampler);
+    if (isFlushing)
+    {
+      ca_resampler_fill(pResampler, NULL, pResampler->bufferCapacity);
+    }
+    else
+    {
+      ca_uint32 filled = ca_resampler_fill(pResampler, pFramesIn + consumed * channels, frameCountIn - consumed);
+      consumed += filled;
+      pResampler->inputFrameCount += filled;
+    }
+  }
+
+  if (!isFlushing)
+  {
+    *pFrameCountIn = consumed;
+  }
+  else if (pFrameCountIn != NULL)
+  {
+    *pFrameCountIn = 0;
+  }
+
+  *pFrameCountOut = produced;
+  return ca_result_success;
+}
+
+FFI_PLUGIN_EXPORT ca_uint64 ca_resampler_get_expected_output_frame_count(ca_resampler *pResampler, ca_uint64 inputFrameCount)
+{
+  ca_uint64 buffered = pResampler->bufferFrames > pResampler->center ? pResampler->bufferFrames - pResampler->center : 0;
+  double frames = ((double)(buffered + inputFrameCount) * pResampler->phaseCount - pResampler->phase) / pResampler->step;
+  return frames <= 0 ? 1 : (ca_uint64)ceil(frames) + 1;
+}
+
+FFI_PLUGIN_EXPORT ca_uint64 ca_resampler_get_max_input_frame_count(ca_resampler *pResampler, ca_uint64 outputFrameCount)
+{
+  // An output frame is produced once the input reaches its center plus the lookahead, so frame outputFrameCount must stay short of that.
+  // The step is split into its whole and fractional parts so the product fits in 64 bits.
+  outputFrameCount = ca_min(outputFrameCount, (ca_uint64)0xFFFFFFFF);
+  ca_uint64 whole = pResampler->step / pResampler->phaseCount;
+  ca_uint64 fraction = pResampler->step % pResampler->phaseCount;
+  ca_uint64 center = pResampler->center + outputFrameCount * whole + (pResampler->phase + outputFrameCount * fraction) / pResampler->phaseCount;
+  ca_uint64 required = center + pResampler->taps / 2;
+  return required > pResampler->bufferFrames ? required - pResampler->bufferFrames : 0;
+}
+
+FFI_PLUGIN_EXPORT void ca_resampler_reset(ca_resampler *pResampler)
+{
+  // The first output frame is centered on the first input frame, so the history starts as silence.
+  ca_uint32 history = ca_resampler_get_history(pResampler);
+  for (ca_uint32 channel = 0; channel < pResampler->config.channels; channel++)
+  {
+    memset(pResampler->pBuffer + (size_t)channel * pResampler->bufferCapacity, 0, sizeof(float) * history);
+  }
+
+  pResampler->bufferFrames = history;
+  pResampler->center = history;
+  pResampler->bufferStartFrame = -(ca_int64)history;
+  pResampler->inputFrameCount = 0;
+  pResampler->phase = 0;
+}
+
+FFI_PLUGIN_EXPORT void ca_resampler_uninit(ca_resampler *pResampler)
+{
+  free(pResampler->pTable);
+  free(pResampler->pCoefficients);
+  free(pResampler->pBuffer);
+  pResampler->pTable = NULL;
+  pResampler->pCoefficients = NULL;
+  pResampler->pBuffer = NULL;
+}
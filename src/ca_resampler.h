@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// Quality presets of the windowed-sinc filter. Higher presets use more taps and a sharper cutoff.
+typedef enum
+{
+  ca_resampler_quality_low = 0,
+  ca_resampler_quality_medium = 1,
+  ca_resampler_quality_high = 2,
+  ca_resampler_quality_best = 3,
+} ca_resampler_quality;
+
+typedef struct
+{
+  ca_uint32 channels;
+  ca_uint32 sampleRateIn;
+  ca_uint32 sampleRateOut;
+  ca_resampler_quality quality;
+
+  // Forces the scalar dot product kernel.
+  ca_bool isSimdDisabled;
+} ca_resampler_config;
+
+typedef struct
+{
+  ca_resampler_config config;
+
+  // Filter table. Rational ratios use one row per phase. Other ratios interpolate between rows.
+  float *pTable;
+  ca_uint32 tableRows;
+  ca_uint32 taps;
+  float cutoff;
+  ca_bool isInterpolated;
+  float *pCoefficients;
+
+  // The fractional read position is phase / phaseCount. Each output frame advances it by step.
+  ca_uint64 phase;
+  ca_uint64 phaseCount;
+  ca_uint64 step;
+
+  // Planar input history. center is the buffer index of the frame at or before the read position.
+  float *pBuffer;
+  ca_uint32 bufferCapacity;
+  ca_uint32 bufferFrames;
+  ca_uint32 center;
+  ca_int64 bufferStartFrame;
+  ca_uint64 inputFrameCount;
+
+  const void *pDotProc;
+} ca_resampler;
+
+FFI_PLUGIN_EXPORT ca_resampler_config ca_resampler_config_init(ca_uint32 channels, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut);
+
+FFI_PLUGIN_EXPORT ca_result ca_resampler_init(ca_resampler *pResampler, ca_resampler_config config);
+
+// Changes the ratio without dropping the buffered input. Can be called between process calls.
+FFI_PLUGIN_EXPORT ca_result ca_resampler_set_rate(ca_resampler *pResampler, ca_uint32 sampleRateIn, ca_uint32 sampleRateOut);
+
+// Resamples interleaved f32 frames. On return pFrameCountIn and pFrameCountOut hold the frames consumed and produced.
+// Passing NULL as pFramesIn flushes the frames held back by the filter delay.
+FFI_PLUGIN_EXPORT ca_result ca_resampler_process(ca_resampler *pResampler, const float *pFramesIn, ca_uint64 *pFrameCountIn, float *pFramesOut, ca_uint64 *pFrameCountOut);
+
+// Returns an upper bound of the frames produced from inputFrameCount more input frames.
+FFI_PLUGIN_EXPORT ca_uint64 ca_resampler_get_expected_output_frame_count(ca_resampler *pResampler, ca_uint64 inputFrameCount);
+
+// Returns the most input frames the next process call can take without producing more than outputFrameCount frames.
+FFI_PLUGIN_EXPORT ca_uint64 ca_resampler_get_max_input_frame_count(ca_resampler *pResampler, ca_uint64 outputFrameCount);
+
+// Drops the buffered input, e.g. after a seek.
+FFI_PLUGIN_EXPORT void ca_resampler_reset(ca_resampler *pResampler);
+
+FFI_PLUGIN_EXPORT void ca_resampler_uninit(ca_resampler *pResampler);
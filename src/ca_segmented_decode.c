@@ -0,0 +1,380 @@
+#include "ca_segmented_decode.h"
+#include "ca_convert.h"
+#include "ca_cpu.h"
+#include "ca_thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENTED_DECODE_SEGMENT_FRAME_COUNT (256 * 1024)
+#define SEGMENTED_DECODE_SEGMENTS_PER_THREAD 2
+#define SEGMENTED_DECODE_UNKNOWN_POSITION (~(ca_uint64)0)
+
+struct ca_segmented_decode_state;
+
+// The output frames [start, end) of the stream. The last segment ends at the end of the stream.
+typedef struct
+{
+  struct ca_segmented_decode_state *pState;
+  ca_uint64 start;
+  ca_uint64 end;
+
+  // Output frame of the next decoded frame.
+  ca_uint64 position;
+
+  ca_uint8 *pFrames;
+  ca_uint64 frameCount;
+  ca_uint64 frameCapacity;
+
+  ca_bool isDone;
+  ca_result result;
+} ca_segmented_decode_segment;
+
+// A decoder reused by the segments decoded on a worker thread. It reads the shared source from its own position.
+typedef struct
+{
+  struct ca_segmented_decode_state *pState;
+  ca_decoder decoder;
+  ca_bool isInitialized;
+  ca_bool isBusy;
+  ca_uint64 position;
+  ca_segmented_decode_segment *pSegment;
+} ca_segmented_decode_worker;
+
+typedef struct ca_segmented_decode_state
+{
+  ca_source source;
+  ca_decoder_config decoderConfig;
+  ca_uint32 bytesPerFrame;
+
+  // Serializes the source procs. sourcePosition is where the source was left by the last worker.
+  pthread_mutex_t sourceLock;
+  ca_uint64 sourcePosition;
+
+  // Guards the workers' isBusy flags, the segments' isDone flags and isCancelled.
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  ca_bool isCancelled;
+
+  // workerCount + 1 workers, one for each pool thread and one for the thread waiting for the pool.
+  ca_segmented_decode_worker *pWorkers;
+  ca_uint32 workerCount;
+} ca_segmented_decode_state;
+
+// MARK: Source
+
+static ca_read_result ca_segmented_decode_on_read(void *pBufferIn, ca_uint32 bytesToRead, ca_uint32 *pBytesRead, void *pUserData)
+{
+  ca_segmented_decode_worker *pWorker = (ca_segmented_decode_worker *)pUserData;
+  ca_segmented_decode_state *pState = pWorker->pState;
+  ca_read_result result = ca_read_result_failed;
+  *pBytesRead = 0;
+
+  pthread_mutex_lock(&pState->sourceLock);
+  if (pState->sourcePosition == pWorker->position || pState->source.pSeekProc == NULL || pState->source.pSeekProc((ca_int64)pWorker->position, ca_seek_origin_start, pState->source.pUserData) == ca_seek_result_success)
+  {
+    result = pState->source.pReadProc(pBufferIn, bytesToRead, pBytesRead, pState->source.pUserData);
+    pWorker->position += *pBytesRead;
+  }
+  pState->sourcePosition = result == ca_read_result_failed ? SEGMENTED_DECODE_UNKNOWN_POSITION : pWorker->position;
+  pthread_mutex_unlock(&pState->sourceLock);
+  return result;
+}
+
+static ca_seek_result ca_segmented_decode_on_seek(ca_int64 byteOffset, ca_seek_origin origin, void *pUserData)
+{
+  ca_segmented_decode_worker *pWorker = (ca_segmented_decode_worker *)pUserData;
+  ca_segmented_decode_state *pState = pWorker->pState;
+  ca_int64 position = origin == ca_seek_origin_current ? (ca_int64)pWorker->position + byteOffset : byteOffset;
+  if (position < 0)
+  {
+    return ca_seek_result_failed;
+  }
+
+  pthread_mutex_lock(&pState->sourceLock);
+  ca_seek_result result = pState->source.pSeekProc(position, ca_seek_origin_start, pState->source.pUserData);
+  if (result == ca_seek_result_success)
+  {
+    pWorker->position = (ca_uint64)position;
+  }
+  pState->sourcePosition = result == ca_seek_result_success ? pWorker->position : SEGMENTED_DECODE_UNKNOWN_POSITION;
+  pthread_mutex_unlock(&pState->sourceLock);
+  return result;
+}
+
+static ca_tell_result ca_segmented_decode_on_tell(ca_uint64 *pPosition, ca_uint64 *pLength, void *pUserData)
+{
+  ca_segmented_decode_worker *pWorker = (ca_segmented_decode_worker *)pUserData;
+  ca_segmented_decode_state *pState = pWorker->pState;
+
+  ca_uint64 position = 0;
+  pthread_mutex_lock(&pState->sourceLock);
+  ca_tell_result result = pState->source.pTellProc(&position, pLength, pState->source.pUserData);
+  pthread_mutex_unlock(&pState->sourceLock);
+  *pPosition = pWorker->position;
+  return result;
+}
+
+// MARK: Segments
+
+// Keeps the decoded frames which fall into the segment.
+static void ca_segmented_decode_on_decoded(ca_uint32 frameCount, void *pBuffer, void *pUserData)
+{
+  ca_segmented_decode_worker *pWorker = (ca_segmented_decode_worker *)pUserData;
+  ca_segmented_decode_segment *pSegment = pWorker->pSegment;
+  if (pSegment == NULL)
+  {
+    return;
+  }
+
+  ca_uint64 position = pSegment->position;
+  pSegment->position += frameCount;
+  ca_uint64 start = ca_max(position, pSegment->start);
+  ca_uint64 end = ca_min(pSegment->position, pSegment->end);
+  if (start >= end || pSegment->result != ca_result_success)
+  {
+    return;
+  }
+
+  ca_uint32 bytesPerFrame = pSegment->pState->bytesPerFrame;
+  if (pSegment->frameCount + (end - start) > pSegment->frameCapacity)
+  {
+    ca_uint64 capacity = ca_max(pSegment->frameCapacity * 2, pSegment->frameCount + (end - start));
+    ca_uint8 *pFrames = (ca_uint8 *)realloc(pSegment->pFrames, (size_t)capacity * bytesPerFrame);
+    if (pFrames == NULL)
+    {
+      pSegment->result = ca_result_out_of_memory;
+      return;
+    }
+    pSegment->pFrames = pFrames;
+    pSegment->frameCapacity = capacity;
+  }
+
+  memcpy(pSegment->pFrames + (size_t)pSegment->frameCount * bytesPerFrame, (const ca_uint8 *)pBuffer + (size_t)(start - position) * bytesPerFrame, (size_t)(end - start) * bytesPerFrame);
+  pSegment->frameCount += end - start;
+}
+
+static ca_result ca_segmented_decode_worker_init(ca_segmented_decode_worker *pWorker)
+{
+  ca_segmented_decode_state *pState = pWorker->pState;
+  ca_source source = pState->source;
+  pWorker->position = 0;
+  ca_result result = ca_decoder_init(&pWorker->decoder, pState->decoderConfig, ca_segmented_decode_on_read, source.pSeekProc == NULL ? NULL : ca_segmented_decode_on_seek, source.pTellProc == NULL ? NULL : ca_segmented_decode_on_tell, ca_segmented_decode_on_decoded, pWorker);
+  pWorker->isInitialized = result == ca_result_success;
+  return result;
+}
+
+static ca_bool ca_segmented_decode_is_cancelled(ca_segmented_decode_state *pState)
+{
+  pthread_mutex_lock(&pState->lock);
+  ca_bool isCancelled = pState->isCancelled;
+  pthread_mutex_unlock(&pState->lock);
+  return isCancelled;
+}
+
+// Decodes a segment on a free worker's decoder.
+// Only sample-exact streams are split, so the seek restores the decoder state and nothing before the segment is decoded.
+static void ca_segmented_decode_segment_job(void *pJobData)
+{
+  ca_segmented_decode_segment *pSegment = (ca_segmented_decode_segment *)pJobData;
+  ca_segmented_decode_state *pState = pSegment->pState;
+
+  // At most the pool threads and the thread waiting for the pool run jobs, so one worker is always free.
+  ca_segmented_decode_worker *pWorker = NULL;
+  pthread_mutex_lock(&pState->lock);
+  for (ca_uint32 i = 0; pWorker == NULL; i++)
+  {
+    pWorker = pState->pWorkers[i].isBusy ? NULL : &pState->pWorkers[i];
+  }
+  pWorker->isBusy = CA_TRUE;
+  pthread_mutex_unlock(&pState->lock);
+
+  ca_result result = pWorker->isInitialized ? ca_result_success : ca_segmented_decode_worker_init(pWorker);
+  if (result == ca_result_success)
+  {
+    pSegment->position = pSegment->start;
+    result = ca_decoder_seek(&pWorker->decoder, pSegment->position);
+  }
+
+  pWorker->pSegment = pSegment;
+  ca_bool isEOF = CA_FALSE;
+  while (result == ca_result_success && pSegment->result == ca_result_success && !isEOF && pSegment->position < pSegment->end && !ca_segmented_decode_is_cancelled(pState))
+  {
+    result = ca_decoder_decode_next(&pWorker->decoder);
+    if (result == ca_result_success)
+    {
+      result = ca_decoder_get_eof(&pWorker->decoder, &isEOF);
+    }
+  }
+  pWorker->pSegment = NULL;
+
+  pthread_mutex_lock(&pState->lock);
+  pSegment->result = pSegment->result == ca_result_success ? result : pSegment->result;
+  pSegment->isDone = CA_TRUE;
+  pWorker->isBusy = CA_FALSE;
+  pthread_cond_broadcast(&pState->cond);
+  pthread_mutex_unlock(&pState->lock);
+}
+
+// MARK: Decode
+
+FFI_PLUGIN_EXPORT ca_segmented_decode_config ca_segmented_decode_config_init()
+{
+  ca_segmented_decode_config config = {
+      .decoderConfig = ca_decoder_config_init(),
+      .threadCount = 0,
+      .segmentFrameCount = SEGMENTED_DECODE_SEGMENT_FRAME_COUNT,
+  };
+  return config;
+}
+
+static void ca_segmented_decode_state_uninit(ca_segmented_decode_state *pState)
+{
+  for (ca_uint32 i = 0; i <= pState->workerCount; i++)
+  {
+    if (pState->pWorkers[i].isInitialized)
+    {
+      ca_decoder_uninit(&pState->pWorkers[i].decoder);
+    }
+  }
+
+  pthread_cond_destroy(&pState->cond);
+  pthread_mutex_destroy(&pState->lock);
+  pthread_mutex_destroy(&pState->sourceLock);
+  free(pState->pWorkers);
+}
+
+// Decodes the segments on the pool, keeping a bounded number of them in flight, and delivers them in order.
+static ca_result ca_segmented_decode_run(ca_segmented_decode_state *pState, ca_thread_pool *pPool, ca_segmented_decode_segment *pSegments, ca_uint32 segmentCount, ca_uint32 segmentFrameCount, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  ca_uint32 window = pState->workerCount * SEGMENTED_DECODE_SEGMENTS_PER_THREAD;
+  ca_uint32 submitCount = 0;
+  ca_result result = ca_result_success;
+  for (ca_uint32 i = 0; i < segmentCount && result == ca_result_success; i++)
+  {
+    for (; submitCount < segmentCount && submitCount < i + window && result == ca_result_success; submitCount++)
+    {
+      result = ca_thread_pool_submit(pPool, ca_segmented_decode_segment_job, &pSegments[submitCount]);
+    }
+
+    ca_segmented_decode_segment *pSegment = &pSegments[i];
+    pthread_mutex_lock(&pState->lock);
+    while (!pSegment->isDone && i < submitCount)
+    {
+      pthread_cond_wait(&pState->cond, &pState->lock);
+    }
+    pthread_mutex_unlock(&pState->lock);
+
+    result = result != ca_result_success ? result : pSegment->result;
+    for (ca_uint64 offset = 0; offset < pSegment->frameCount && result == ca_result_success; offset += segmentFrameCount)
+    {
+      ca_uint32 frameCount = (ca_uint32)ca_min(pSegment->frameCount - offset, (ca_uint64)segmentFrameCount);
+      pDecodedProc(frameCount, pSegment->pFrames + (size_t)offset * pState->bytesPerFrame, pUserData);
+    }
+
+    free(pSegment->pFrames);
+    pSegment->pFrames = NULL;
+  }
+
+  // The segments still in flight stop at their next packet.
+  pthread_mutex_lock(&pState->lock);
+  pState->isCancelled = CA_TRUE;
+  pthread_mutex_unlock(&pState->lock);
+  ca_thread_pool_wait(pPool);
+  return result;
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_segmented_decode(ca_source source, ca_segmented_decode_config config, ca_decoder_decoded_proc pDecodedProc, void *pUserData)
+{
+  if (source.pReadProc == NULL || pDecodedProc == NULL || config.decoderConfig.pDecodedPlanarProc != NULL || config.decoderConfig.pDecodedChunkProc != NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_segmented_decode_state state;
+  memset(&state, 0, sizeof(state));
+  state.source = source;
+  state.decoderConfig = config.decoderConfig;
+  state.sourcePosition = SEGMENTED_DECODE_UNKNOWN_POSITION;
+  state.workerCount = config.threadCount == 0 ? ca_get_cpu_count() : config.threadCount;
+  state.pWorkers = (ca_segmented_decode_worker *)calloc(state.workerCount + 1, sizeof(ca_segmented_decode_worker));
+  if (state.pWorkers == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pthread_mutex_init(&state.sourceLock, NULL);
+  pthread_mutex_init(&state.lock, NULL);
+  pthread_cond_init(&state.cond, NULL);
+  for (ca_uint32 i = 0; i <= state.workerCount; i++)
+  {
+    state.pWorkers[i].pState = &state;
+  }
+
+  // The segments are the parallelism, so each decoder runs on a single thread.
+  state.decoderConfig.decodeThreadCount = 1;
+
+  // MP3 seeks into far segments would otherwise jump with the seek table and land a few frames off.
+  state.decoderConfig.isSeekTableDisabled = CA_TRUE;
+
+  // The first worker's decoder tells the output format and length.
+  ca_audio_format format;
+  ca_bool isSampleExact = CA_FALSE;
+  ca_result result = ca_segmented_decode_worker_init(&state.pWorkers[0]);
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_get_format(&state.pWorkers[0].decoder, &format);
+  }
+  if (result == ca_result_success)
+  {
+    result = ca_decoder_get_is_sample_exact(&state.pWorkers[0].decoder, &isSampleExact);
+  }
+
+  state.bytesPerFrame = result == ca_result_success ? ca_get_bytes_per_sample(format.sample_foramt) * format.channels : 0;
+  if (result == ca_result_success && state.bytesPerFrame == 0)
+  {
+    result = ca_result_unsupported_format;
+  }
+
+  if (result != ca_result_success)
+  {
+    ca_segmented_decode_state_uninit(&state);
+    return result;
+  }
+
+  // Platform codecs do not seek sample exact, and resampler phases and dither noise depend on every frame before them, so those outputs cannot be stitched exactly.
+  ca_uint32 segmentFrameCount = config.segmentFrameCount == 0 ? SEGMENTED_DECODE_SEGMENT_FRAME_COUNT : config.segmentFrameCount;
+  ca_bool isSegmentable = isSampleExact && source.pSeekProc != NULL && format.length != 0 && config.decoderConfig.outputSampleRate == 0 && config.decoderConfig.ditherMode == ca_dither_mode_none;
+  ca_uint32 segmentCount = isSegmentable ? (ca_uint32)ca_max((format.length + segmentFrameCount - 1) / segmentFrameCount, 1) : 1;
+  ca_segmented_decode_segment *pSegments = (ca_segmented_decode_segment *)calloc(segmentCount, sizeof(ca_segmented_decode_segment));
+  if (pSegments == NULL)
+  {
+    ca_segmented_decode_state_uninit(&state);
+    return ca_result_out_of_memory;
+  }
+
+  // The last segment runs to the end of the stream in case the length is short.
+  for (ca_uint32 i = 0; i < segmentCount; i++)
+  {
+    pSegments[i].pState = &state;
+    pSegments[i].start = (ca_uint64)i * segmentFrameCount;
+    pSegments[i].end = i + 1 < segmentCount ? pSegments[i].start + segmentFrameCount : SEGMENTED_DECODE_UNKNOWN_POSITION;
+    pSegments[i].result = ca_result_success;
+  }
+
+  ca_thread_pool pool;
+  result = ca_thread_pool_init(&pool, isSegmentable ? state.workerCount : 1);
+  if (result == ca_result_success)
+  {
+    result = ca_segmented_decode_run(&state, &pool, pSegments, segmentCount, segmentFrameCount, pDecodedProc, pUserData);
+    ca_thread_pool_uninit(&pool);
+  }
+
+  for (ca_uint32 i = 0; i < segmentCount; i++)
+  {
+    free(pSegments[i].pFrames);
+  }
+  free(pSegments);
+  ca_segmented_decode_state_uninit(&state);
+  return result;
+}
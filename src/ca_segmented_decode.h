@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ca_io.h"
+
+typedef struct
+{
+  // pDecodedPlanarProc and pDecodedChunkProc are not supported.
+  ca_decoder_config decoderConfig;
+
+  // Segments decoded at the same time. Zero uses one thread per CPU core.
+  ca_uint32 threadCount;
+
+  // Output frames of each segment. Zero uses the default.
+  ca_uint32 segmentFrameCount;
+} ca_segmented_decode_config;
+
+FFI_PLUGIN_EXPORT ca_segmented_decode_config ca_segmented_decode_config_init();
+
+// Decodes the whole source into pDecodedProc, which is called in order on the calling thread.
+// The source is split into segments at seek points, and each segment is decoded by its own decoder on a worker thread.
+// The output matches a sequential decode sample for sample. Only the streams read natively are split, see ca_decoder_get_is_sample_exact.
+// Streams decoded by the platform codecs, sources without a seek proc or a known length, and resampled or dithered outputs are decoded as one segment.
+// The source procs must be callable from any thread. Calls to them are serialized.
+FFI_PLUGIN_EXPORT ca_result ca_segmented_decode(ca_source source, ca_segmented_decode_config config, ca_decoder_decoded_proc pDecodedProc, void *pUserData);
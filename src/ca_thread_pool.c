@@ -0,0 +1,193 @@
+#include "ca_thread_pool.h"
+#include "ca_cpu.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct ca_thread_pool_job
+{
+  ca_thread_pool_job_proc pJobProc;
+  void *pJobData;
+  struct ca_thread_pool_job *pNext;
+} ca_thread_pool_job;
+
+typedef struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t jobCond;
+  pthread_cond_t idleCond;
+  ca_thread_pool_job *pHead;
+  ca_thread_pool_job *pTail;
+  ca_uint32 pendingCount;
+  ca_bool isStopping;
+  ca_uint32 threadCount;
+  pthread_t *pThreads;
+} ca_thread_pool_data;
+
+// Pops the next job. Must be called with the mutex held.
+static ca_thread_pool_job *ca_thread_pool_pop(ca_thread_pool_data *pData)
+{
+  ca_thread_pool_job *pJob = pData->pHead;
+  if (pJob != NULL)
+  {
+    pData->pHead = pJob->pNext;
+    if (pData->pHead == NULL)
+    {
+      pData->pTail = NULL;
+    }
+  }
+  return pJob;
+}
+
+// Runs the job without the mutex and marks it as finished.
+static void ca_thread_pool_run(ca_thread_pool_data *pData, ca_thread_pool_job *pJob)
+{
+  pthread_mutex_unlock(&pData->mutex);
+  pJob->pJobProc(pJob->pJobData);
+  free(pJob);
+  pthread_mutex_lock(&pData->mutex);
+
+  pData->pendingCount--;
+  if (pData->pendingCount == 0)
+  {
+    pthread_cond_broadcast(&pData->idleCond);
+  }
+}
+
+static void *ca_thread_pool_worker(void *pUserData)
+{
+  ca_thread_pool_data *pData = (ca_thread_pool_data *)pUserData;
+  pthread_mutex_lock(&pData->mutex);
+  for (;;)
+  {
+    ca_thread_pool_job *pJob = ca_thread_pool_pop(pData);
+    if (pJob != NULL)
+    {
+      ca_thread_pool_run(pData, pJob);
+      continue;
+    }
+
+    if (pData->isStopping)
+    {
+      break;
+    }
+    pthread_cond_wait(&pData->jobCond, &pData->mutex);
+  }
+  pthread_mutex_unlock(&pData->mutex);
+  return NULL;
+}
+
+ca_result ca_thread_pool_init(ca_thread_pool *pPool, ca_uint32 threadCount)
+{
+  if (threadCount == 0)
+  {
+    threadCount = ca_get_cpu_count();
+  }
+
+  ca_thread_pool_data *pData = (ca_thread_pool_data *)calloc(1, sizeof(ca_thread_pool_data));
+  pthread_t *pThreads = (pthread_t *)calloc(threadCount, sizeof(pthread_t));
+  if (pData == NULL || pThreads == NULL)
+  {
+    free(pData);
+    free(pThreads);
+    return ca_result_out_of_memory;
+  }
+
+  pthread_mutex_init(&pData->mutex, NULL);
+  pthread_cond_init(&pData->jobCond, NULL);
+  pthread_cond_init(&pData->idleCond, NULL);
+  pData->pThreads = pThreads;
+  pPool->pData = pData;
+
+  for (ca_uint32 i = 0; i < threadCount; i++)
+  {
+    if (pthread_create(&pThreads[i], NULL, ca_thread_pool_worker, pData) != 0)
+    {
+      break;
+    }
+    pData->threadCount++;
+  }
+
+  if (pData->threadCount == 0)
+  {
+    ca_thread_pool_uninit(pPool);
+    return ca_result_unknown_failed;
+  }
+
+  pPool->threadCount = pData->threadCount;
+  return ca_result_success;
+}
+
+ca_result ca_thread_pool_submit(ca_thread_pool *pPool, ca_thread_pool_job_proc pJobProc, void *pJobData)
+{
+  ca_thread_pool_data *pData = (ca_thread_pool_data *)pPool->pData;
+  ca_thread_pool_job *pJob = (ca_thread_pool_job *)malloc(sizeof(ca_thread_pool_job));
+  if (pJob == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pJob->pJobProc = pJobProc;
+  pJob->pJobData = pJobData;
+  pJob->pNext = NULL;
+
+  pthread_mutex_lock(&pData->mutex);
+  if (pData->pTail == NULL)
+  {
+    pData->pHead = pJob;
+  }
+  else
+  {
+    pData->pTail->pNext = pJob;
+  }
+  pData->pTail = pJob;
+  pData->pendingCount++;
+  pthread_cond_signal(&pData->jobCond);
+  pthread_mutex_unlock(&pData->mutex);
+  return ca_result_success;
+}
+
+void ca_thread_pool_wait(ca_thread_pool *pPool)
+{
+  ca_thread_pool_data *pData = (ca_thread_pool_data *)pPool->pData;
+  pthread_mutex_lock(&pData->mutex);
+  while (pData->pendingCount > 0)
+  {
+    ca_thread_pool_job *pJob = ca_thread_pool_pop(pData);
+    if (pJob != NULL)
+    {
+      ca_thread_pool_run(pData, pJob);
+    }
+    else
+    {
+      pthread_cond_wait(&pData->idleCond, &pData->mutex);
+    }
+  }
+  pthread_mutex_unlock(&pData->mutex);
+}
+
+void ca_thread_pool_uninit(ca_thread_pool *pPool)
+{
+  ca_thread_pool_data *pData = (ca_thread_pool_data *)pPool->pData;
+  if (pData == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pData->mutex);
+  pData->isStopping = CA_TRUE;
+  pthread_cond_broadcast(&pData->jobCond);
+  pthread_mutex_unlock(&pData->mutex);
+
+  for (ca_uint32 i = 0; i < pData->threadCount; i++)
+  {
+    pthread_join(pData->pThreads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pData->idleCond);
+  pthread_cond_destroy(&pData->jobCond);
+  pthread_mutex_destroy(&pData->mutex);
+  free(pData->pThreads);
+  free(pData);
+  pPool->pData = NULL;
+  pPool->threadCount = 0;
+}
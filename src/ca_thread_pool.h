@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ca_defs.h"
+
+typedef void (*ca_thread_pool_job_proc)(void *pJobData);
+
+// A fixed set of worker threads running jobs in submission order.
+typedef struct
+{
+  ca_uint32 threadCount;
+  void *pData;
+} ca_thread_pool;
+
+// Starts threadCount workers. Zero uses one worker per CPU core.
+ca_result ca_thread_pool_init(ca_thread_pool *pPool, ca_uint32 threadCount);
+
+ca_result ca_thread_pool_submit(ca_thread_pool *pPool, ca_thread_pool_job_proc pJobProc, void *pJobData);
+
+// Blocks until every submitted job has finished. The calling thread runs queued jobs while it waits.
+void ca_thread_pool_wait(ca_thread_pool *pPool);
+
+// Finishes the queued jobs and joins the workers.
+void ca_thread_pool_uninit(ca_thread_pool *pPool);
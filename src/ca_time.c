@@ -0,0 +1,9 @@
+#include "ca_time.h"
+#include <time.h>
+
+FFI_PLUGIN_EXPORT ca_uint64 ca_get_time_micros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ca_uint64)ts.tv_sec * 1000000 + (ca_uint64)ts.tv_nsec / 1000;
+}
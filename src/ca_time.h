@@ -0,0 +1,6 @@
+#pragma once
+
+#include "ca_defs.h"
+
+// Returns microseconds of a monotonic clock, for measuring intervals only.
+FFI_PLUGIN_EXPORT ca_uint64 ca_get_time_micros();
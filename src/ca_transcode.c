@@ -0,0 +1,441 @@
+#include "ca_transcode.h"
+#include "ca_convert.h"
+#include "ca_miniaudio.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRANSCODE_CHUNK_FRAME_COUNT 4096
+#define TRANSCODE_QUEUE_LENGTH 8
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  ca_uint32 slotCount;
+  ca_uint32 slotCapacity;
+  ca_uint8 *pSlots;
+  ca_uint32 *pSlotFrameCounts;
+
+  ca_uint32 readIndex;
+  ca_uint32 writeIndex;
+  ca_uint32 count;
+
+  ca_bool isClosed;
+  ca_bool isCancelled;
+} ca_transcode_queue;
+
+typedef struct
+{
+  ca_source source;
+  ca_sink sink;
+  ca_transcode_config config;
+
+  ca_decoder decoder;
+  ma_encoder encoder;
+
+  ca_uint32 bytesPerFrame;
+  ca_uint64 totalFrames;
+
+  ca_transcode_queue decodedQueue;
+
+  // The slot which is being filled by the decoded callback.
+  void *pDecodingSlot;
+  ca_uint32 decodingSlotFrames;
+
+  pthread_mutex_t resultLock;
+  ca_result result;
+} ca_transcode_pipeline;
+
+static ca_result ca_transcode_queue_init(ca_transcode_queue *pQueue, ca_uint32 slotCount, ca_uint32 slotCapacity)
+{
+  pQueue->pSlots = malloc((size_t)slotCount * slotCapacity);
+  pQueue->pSlotFrameCounts = malloc(sizeof(ca_uint32) * slotCount);
+  if (pQueue->pSlots == NULL || pQueue->pSlotFrameCounts == NULL)
+  {
+    free(pQueue->pSlots);
+    free(pQueue->pSlotFrameCounts);
+    return ca_result_out_of_memory;
+  }
+
+  pthread_mutex_init(&pQueue->lock, NULL);
+  pthread_cond_init(&pQueue->cond, NULL);
+  pQueue->slotCount = slotCount;
+  pQueue->slotCapacity = slotCapacity;
+  pQueue->readIndex = 0;
+  pQueue->writeIndex = 0;
+  pQueue->count = 0;
+  pQueue->isClosed = CA_FALSE;
+  pQueue->isCancelled = CA_FALSE;
+  return ca_result_success;
+}
+
+static void ca_transcode_queue_uninit(ca_transcode_queue *pQueue)
+{
+  pthread_cond_destroy(&pQueue->cond);
+  pthread_mutex_destroy(&pQueue->lock);
+  free(pQueue->pSlots);
+  free(pQueue->pSlotFrameCounts);
+}
+
+// Blocks until a slot is writable. Returns NULL when the queue was cancelled.
+static void *ca_transcode_queue_acquire_write(ca_transcode_queue *pQueue)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  while (pQueue->count == pQueue->slotCount && !pQueue->isCancelled)
+  {
+    pthread_cond_wait(&pQueue->cond, &pQueue->lock);
+  }
+
+  void *pSlot = pQueue->isCancelled ? NULL : pQueue->pSlots + (size_t)pQueue->writeIndex * pQueue->slotCapacity;
+  pthread_mutex_unlock(&pQueue->lock);
+  return pSlot;
+}
+
+static void ca_transcode_queue_commit_write(ca_transcode_queue *pQueue, ca_uint32 frameCount)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  pQueue->pSlotFrameCounts[pQueue->writeIndex] = frameCount;
+  pQueue->writeIndex = (pQueue->writeIndex + 1) % pQueue->slotCount;
+  pQueue->count++;
+  pthread_cond_broadcast(&pQueue->cond);
+  pthread_mutex_unlock(&pQueue->lock);
+}
+
+// Blocks until a slot is readable. Returns NULL when the queue was drained after closing or was cancelled.
+static void *ca_transcode_queue_acquire_read(ca_transcode_queue *pQueue, ca_uint32 *pFrameCount)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  while (pQueue->count == 0 && !pQueue->isClosed && !pQueue->isCancelled)
+  {
+    pthread_cond_wait(&pQueue->cond, &pQueue->lock);
+  }
+
+  void *pSlot = NULL;
+  if (pQueue->count > 0 && !pQueue->isCancelled)
+  {
+    pSlot = pQueue->pSlots + (size_t)pQueue->readIndex * pQueue->slotCapacity;
+    *pFrameCount = pQueue->pSlotFrameCounts[pQueue->readIndex];
+  }
+  pthread_mutex_unlock(&pQueue->lock);
+  return pSlot;
+}
+
+static void ca_transcode_queue_release_read(ca_transcode_queue *pQueue)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  pQueue->readIndex = (pQueue->readIndex + 1) % pQueue->slotCount;
+  pQueue->count--;
+  pthread_cond_broadcast(&pQueue->cond);
+  pthread_mutex_unlock(&pQueue->lock);
+}
+
+static void ca_transcode_queue_close(ca_transcode_queue *pQueue, ca_bool cancel)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  pQueue->isClosed = CA_TRUE;
+  pQueue->isCancelled = pQueue->isCancelled || cancel;
+  pthread_cond_broadcast(&pQueue->cond);
+  pthread_mutex_unlock(&pQueue->lock);
+}
+
+static ca_bool ca_transcode_queue_is_cancelled(ca_transcode_queue *pQueue)
+{
+  pthread_mutex_lock(&pQueue->lock);
+  ca_bool isCancelled = pQueue->isCancelled;
+  pthread_mutex_unlock(&pQueue->lock);
+  return isCancelled;
+}
+
+static void ca_transcode_fail(ca_transcode_pipeline *pPipeline, ca_result result)
+{
+  pthread_mutex_lock(&pPipeline->resultLock);
+  if (pPipeline->result == ca_result_success)
+  {
+    pPipeline->result = result;
+  }
+  pthread_mutex_unlock(&pPipeline->resultLock);
+
+  ca_transcode_queue_close(&pPipeline->decodedQueue, CA_TRUE);
+}
+
+static ca_read_result ca_transcode_source_read(void *pBufferIn, ca_uint32 bytesToRead, ca_uint32 *pBytesRead, void *pUserData)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pUserData;
+  return pPipeline->source.pReadProc(pBufferIn, bytesToRead, pBytesRead, pPipeline->source.pUserData);
+}
+
+static ca_seek_result ca_transcode_source_seek(ca_int64 byteOffset, ca_seek_origin origin, void *pUserData)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pUserData;
+  if (pPipeline->source.pSeekProc == NULL)
+  {
+    return ca_seek_result_unsupported;
+  }
+
+  return pPipeline->source.pSeekProc(byteOffset, origin, pPipeline->source.pUserData);
+}
+
+static ca_tell_result ca_transcode_source_tell(ca_uint64 *pPosition, ca_uint64 *pLength, void *pUserData)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pUserData;
+  return pPipeline->source.pTellProc(pPosition, pLength, pPipeline->source.pUserData);
+}
+
+// Runs on the decode thread. Packs the frames converted by the decoder's output stage into the decoded queue.
+static void ca_transcode_decoded(ca_uint32 frameCount, void *pBuffer, void *pUserData)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pUserData;
+  ca_uint32 chunkFrameCount = pPipeline->config.chunkFrameCount;
+  const ca_uint8 *pFrames = (const ca_uint8 *)pBuffer;
+
+  while (frameCount > 0)
+  {
+    if (pPipeline->pDecodingSlot == NULL)
+    {
+      pPipeline->pDecodingSlot = ca_transcode_queue_acquire_write(&pPipeline->decodedQueue);
+      pPipeline->decodingSlotFrames = 0;
+      if (pPipeline->pDecodingSlot == NULL)
+      {
+        return;
+      }
+    }
+
+    ca_uint32 framesToCopy = ca_min(frameCount, chunkFrameCount - pPipeline->decodingSlotFrames);
+    memcpy((ca_uint8 *)pPipeline->pDecodingSlot + (size_t)pPipeline->decodingSlotFrames * pPipeline->bytesPerFrame, pFrames, (size_t)framesToCopy * pPipeline->bytesPerFrame);
+    pPipeline->decodingSlotFrames += framesToCopy;
+    pFrames += (size_t)framesToCopy * pPipeline->bytesPerFrame;
+    frameCount -= framesToCopy;
+
+    if (pPipeline->decodingSlotFrames == chunkFrameCount)
+    {
+      ca_transcode_queue_commit_write(&pPipeline->decodedQueue, pPipeline->decodingSlotFrames);
+      pPipeline->pDecodingSlot = NULL;
+    }
+  }
+}
+
+static void *ca_transcode_decode_thread(void *pUserData)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pUserData;
+
+  ca_bool isEOF = CA_FALSE;
+  while (!isEOF)
+  {
+    ca_result result = ca_decoder_decode_next(&pPipeline->decoder);
+    if (result == ca_result_success)
+    {
+      result = ca_decoder_get_eof(&pPipeline->decoder, &isEOF);
+    }
+
+    if (result != ca_result_success)
+    {
+      ca_transcode_fail(pPipeline, result);
+      return NULL;
+    }
+
+    if (ca_transcode_queue_is_cancelled(&pPipeline->decodedQueue))
+    {
+      return NULL;
+    }
+  }
+
+  if (pPipeline->pDecodingSlot != NULL && pPipeline->decodingSlotFrames > 0)
+  {
+    ca_transcode_queue_commit_write(&pPipeline->decodedQueue, pPipeline->decodingSlotFrames);
+    pPipeline->pDecodingSlot = NULL;
+  }
+
+  ca_transcode_queue_close(&pPipeline->decodedQueue, CA_FALSE);
+  return NULL;
+}
+
+static ma_result ca_transcode_encoder_write(ma_encoder *pEncoder, const void *pBufferIn, size_t bytesToWrite, size_t *pBytesWritten)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pEncoder->pUserData;
+
+  ca_uint32 bytesWritten = 0;
+  ca_write_result writeResult = pPipeline->sink.pWriteProc(pBufferIn, (ca_uint32)bytesToWrite, &bytesWritten, pPipeline->sink.pUserData);
+  *pBytesWritten = bytesWritten;
+  return writeResult == ca_write_result_success ? MA_SUCCESS : MA_ERROR;
+}
+
+static ma_result ca_transcode_encoder_seek(ma_encoder *pEncoder, ma_int64 offset, ma_seek_origin origin)
+{
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)pEncoder->pUserData;
+
+  ca_seek_origin caOrigin;
+  switch (origin)
+  {
+  case ma_seek_origin_start:
+    caOrigin = ca_seek_origin_start;
+    break;
+  case ma_seek_origin_current:
+    caOrigin = ca_seek_origin_current;
+    break;
+  default:
+    return MA_NOT_IMPLEMENTED;
+  }
+
+  ca_seek_result seekResult = pPipeline->sink.pSeekProc(offset, caOrigin, pPipeline->sink.pUserData);
+  return seekResult == ca_seek_result_success ? MA_SUCCESS : MA_ERROR;
+}
+
+FFI_PLUGIN_EXPORT ca_transcode_config ca_transcode_config_init()
+{
+  ca_transcode_config config = {
+      .decoderConfig = ca_decoder_config_init(),
+      .sampleFormat = ca_sample_format_unknown,
+      .channels = 0,
+      .sampleRate = 0,
+      .chunkFrameCount = TRANSCODE_CHUNK_FRAME_COUNT,
+      .queueLength = TRANSCODE_QUEUE_LENGTH,
+      .pProgressProc = NULL,
+      .pProgressUserData = NULL,
+  };
+
+  // Offline transcoding favors throughput, so FLAC sources are decoded on every core.
+  config.decoderConfig.decodeThreadCount = 0;
+  return config;
+}
+
+static ca_result ca_transcode_pipeline_init(ca_transcode_pipeline *pPipeline)
+{
+  ca_transcode_config *pConfig = &pPipeline->config;
+
+  // The decoder's output stage converts the sample format, mixes the channels and resamples, so the decoded frames are encoded as they are.
+  ca_decoder_config decoderConfig = pConfig->decoderConfig;
+  if (decoderConfig.outputSampleFormat == ca_sample_format_unknown)
+  {
+    decoderConfig.outputSampleFormat = pConfig->sampleFormat;
+  }
+
+  if (decoderConfig.outputChannels == 0)
+  {
+    decoderConfig.outputChannels = pConfig->channels;
+  }
+
+  if (decoderConfig.outputSampleRate == 0)
+  {
+    decoderConfig.outputSampleRate = pConfig->sampleRate;
+  }
+
+  ca_result result = ca_decoder_init(&pPipeline->decoder, decoderConfig, ca_transcode_source_read, pPipeline->source.pSeekProc == NULL ? NULL : ca_transcode_source_seek, pPipeline->source.pTellProc == NULL ? NULL : ca_transcode_source_tell, ca_transcode_decoded, pPipeline);
+  if (result != ca_result_success)
+  {
+    return result;
+  }
+
+  // The format is the one the decoder delivers.
+  ca_audio_format format;
+  result = ca_decoder_get_format(&pPipeline->decoder, &format);
+  if (result != ca_result_success)
+  {
+    ca_decoder_uninit(&pPipeline->decoder);
+    return result;
+  }
+
+  pPipeline->bytesPerFrame = ca_get_bytes_per_sample(format.sample_foramt) * format.channels;
+  pPipeline->totalFrames = format.length;
+  if (pPipeline->bytesPerFrame == 0)
+  {
+    ca_decoder_uninit(&pPipeline->decoder);
+    return ca_result_unsupported_format;
+  }
+
+  // ma_format and ca_sample_format share the same values.
+  ma_encoder_config encoderConfig = ma_encoder_config_init(ma_encoding_format_wav, (ma_format)format.sample_foramt, format.channels, format.sample_rate);
+  if (ma_encoder_init(ca_transcode_encoder_write, ca_transcode_encoder_seek, pPipeline, &encoderConfig, &pPipeline->encoder) != MA_SUCCESS)
+  {
+    ca_decoder_uninit(&pPipeline->decoder);
+    return ca_result_write_failed;
+  }
+
+  result = ca_transcode_queue_init(&pPipeline->decodedQueue, pConfig->queueLength, pConfig->chunkFrameCount * pPipeline->bytesPerFrame);
+  if (result != ca_result_success)
+  {
+    ma_encoder_uninit(&pPipeline->encoder);
+    ca_decoder_uninit(&pPipeline->decoder);
+    return result;
+  }
+
+  pthread_mutex_init(&pPipeline->resultLock, NULL);
+  pPipeline->result = ca_result_success;
+  pPipeline->pDecodingSlot = NULL;
+  pPipeline->decodingSlotFrames = 0;
+  return ca_result_success;
+}
+
+static void ca_transcode_pipeline_uninit(ca_transcode_pipeline *pPipeline)
+{
+  pthread_mutex_destroy(&pPipeline->resultLock);
+  ca_transcode_queue_uninit(&pPipeline->decodedQueue);
+  ma_encoder_uninit(&pPipeline->encoder);
+  ca_decoder_uninit(&pPipeline->decoder);
+}
+
+FFI_PLUGIN_EXPORT ca_result ca_transcode(ca_source source, ca_sink sink, ca_transcode_config config)
+{
+  if (source.pReadProc == NULL || sink.pWriteProc == NULL || sink.pSeekProc == NULL || config.chunkFrameCount == 0 || config.queueLength == 0 || config.decoderConfig.pDecodedPlanarProc != NULL || config.decoderConfig.pDecodedChunkProc != NULL)
+  {
+    return ca_result_invalid_args;
+  }
+
+  ca_transcode_pipeline *pPipeline = (ca_transcode_pipeline *)malloc(sizeof(ca_transcode_pipeline));
+  if (pPipeline == NULL)
+  {
+    return ca_result_out_of_memory;
+  }
+
+  pPipeline->source = source;
+  pPipeline->sink = sink;
+  pPipeline->config = config;
+
+  ca_result result = ca_transcode_pipeline_init(pPipeline);
+  if (result != ca_result_success)
+  {
+    free(pPipeline);
+    return result;
+  }
+
+  pthread_t decodeThread;
+  ca_bool isDecodeThreadStarted = pthread_create(&decodeThread, NULL, ca_transcode_decode_thread, pPipeline) == 0;
+  if (!isDecodeThreadStarted)
+  {
+    ca_transcode_fail(pPipeline, ca_result_unknown_failed);
+  }
+
+  // The calling thread runs the encode stage, so the sink and the progress proc never cross threads.
+  ca_uint64 framesWritten = 0;
+  ca_uint32 frameCount;
+  void *pSlot;
+  while ((pSlot = ca_transcode_queue_acquire_read(&pPipeline->decodedQueue, &frameCount)) != NULL)
+  {
+    ma_uint64 framesEncoded = 0;
+    ma_result maResult = ma_encoder_write_pcm_frames(&pPipeline->encoder, pSlot, frameCount, &framesEncoded);
+    ca_transcode_queue_release_read(&pPipeline->decodedQueue);
+    if (maResult != MA_SUCCESS || framesEncoded != frameCount)
+    {
+      ca_transcode_fail(pPipeline, ca_result_write_failed);
+      break;
+    }
+
+    framesWritten += framesEncoded;
+    if (config.pProgressProc != NULL)
+    {
+      config.pProgressProc(framesWritten, ca_max(pPipeline->totalFrames, framesWritten), config.pProgressUserData);
+    }
+  }
+
+  if (isDecodeThreadStarted)
+  {
+    pthread_join(decodeThread, NULL);
+  }
+
+  result = pPipeline->result;
+  ca_transcode_pipeline_uninit(pPipeline);
+  free(pPipeline);
+
+  return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ca_io.h"
+
+// Called on the thread which called ca_transcode.
+typedef void (*ca_transcode_progress_proc)(ca_uint64 framesWritten, ca_uint64 totalFrames, void *pUserData);
+
+typedef struct
+{
+  // Planar and chunk output are not supported.
+  ca_decoder_config decoderConfig;
+
+  // Output format of the encoded file, converted by the decoder's output stage. Zero or unknown keeps the decoded format.
+  // The output fields of decoderConfig take precedence when set.
+  ca_sample_format sampleFormat;
+  ca_uint32 channels;
+  ca_uint32 sampleRate;
+
+  // Size of the bounded queue between the decode and encode stages.
+  ca_uint32 chunkFrameCount;
+  ca_uint32 queueLength;
+
+  ca_transcode_progress_proc pProgressProc;
+  void *pProgressUserData;
+} ca_transcode_config;
+
+FFI_PLUGIN_EXPORT ca_transcode_config ca_transcode_config_init();
+
+// Decodes the source and encodes it into the sink as a WAV file.
+// The decode stage runs on its own thread, so the source procs must be callable from any thread. The source tell proc is optional.
+// The sink procs and the progress proc are called on the calling thread.
+FFI_PLUGIN_EXPORT ca_result ca_transcode(ca_source source, ca_sink sink, ca_transcode_config config);
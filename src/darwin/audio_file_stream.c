@@ -1,8 +1,11 @@
 #include "audio_file_stream.h"
 #include "../ca_decoder.h"
+#include "../ca_arena.h"
 #include <AudioToolbox/AudioFileStream.h>
 #include <AudioToolbox/AudioConverter.h>
+#include <AudioToolbox/AudioFormat.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define MAX_HEADER_SIZE 1024 * 1024
 #define DECODE_SIZE 1024
@@ -31,6 +34,12 @@ typedef struct
   ca_bool isAudioConverterReady;
   AudioConverterRef pAudioConverter;
 
+  // Buffers of one packet batch, released when the next batch arrives. Sized from the formats once the converter is created.
+  ca_arena scratch;
+  UInt32 maxOutputPacketSize;
+  UInt32 bufferOutSize;
+  UInt32 maxDecodeSize;
+
   struct
   {
     AudioBuffer buffer;
@@ -166,6 +175,40 @@ static void audio_file_stream_property_listener(void *inClientData, AudioFileStr
   }
 }
 
+// Sizes the scratch arena for the largest batch the parsing buffer produces, so steady decoding allocates nothing.
+static ca_result audio_file_stream_scratch_init(audio_file_stream *pStream)
+{
+  audio_file_stream_data *pData = (audio_file_stream_data *)pStream->pData;
+
+  size_t scratchSize = pData->parsingBufferSize;
+  if (pData->inputFormat.mFormatID == kAudioFormatLinearPCM)
+  {
+    scratchSize += (size_t)pData->parsingBufferSize / ca_max(pData->inputFormat.mBytesPerFrame, (UInt32)1) * pData->outputFormat.mBytesPerFrame;
+  }
+  else
+  {
+    ca_result result = get_converter_property(pStream, kAudioConverterPropertyMaximumOutputPacketSize, sizeof(UInt32), &pData->maxOutputPacketSize);
+    if (result != ca_result_success)
+    {
+      return result;
+    }
+
+    UInt32 minBufferSize = 0;
+    result = get_converter_property(pStream, kAudioConverterPropertyMinimumOutputBufferSize, sizeof(UInt32), &minBufferSize);
+    if (result != ca_result_success && result != kAudioConverterErr_PropertyNotSupported)
+    {
+      return result;
+    }
+
+    pData->bufferOutSize = ca_max(pData->maxOutputPacketSize * pData->outputFormat.mBytesPerPacket, minBufferSize);
+    pData->maxDecodeSize = pData->maxOutputPacketSize * pData->outputFormat.mBytesPerPacket * PACKET_AGGREGATION_COUNT;
+    scratchSize += (size_t)pData->bufferOutSize + pData->maxDecodeSize;
+  }
+
+  // Each allocation is rounded up to the arena alignment.
+  return ca_arena_init(&pData->scratch, scratchSize + 3 * 16);
+}
+
 static void audio_file_stream_packets(void *inClientData, UInt32 inNumberBytes, UInt32 inNumberPackets, const void *inInputData, AudioStreamPacketDescription *inPacketDescriptions)
 {
   audio_file_stream *pStream = (audio_file_stream *)inClientData;
@@ -205,14 +248,27 @@ static void audio_file_stream_packets(void *inClientData, UInt32 inNumberBytes,
       result = osstatus_to_result(AudioConverterSetProperty(pData->pAudioConverter, kAudioConverterDecompressionMagicCookie, pData->magicCookie.size, pData->magicCookie.pData));
       if (result != ca_result_success)
       {
+        AudioConverterDispose(pData->pAudioConverter);
         return;
       }
     }
 
+    result = audio_file_stream_scratch_init(pStream);
+    if (result != ca_result_success)
+    {
+      AudioConverterDispose(pData->pAudioConverter);
+      return;
+    }
+
     pData->isAudioConverterReady = CA_TRUE;
   }
 
-  void *pBufferIn = malloc(inNumberBytes);
+  ca_arena_reset(&pData->scratch);
+  void *pBufferIn = ca_arena_alloc(&pData->scratch, inNumberBytes);
+  if (pBufferIn == NULL)
+  {
+    return;
+  }
   memcpy(pBufferIn, inInputData, inNumberBytes);
 
   // MEMO: PCM(WAVE)形式で AudioConverterFillComplexBuffer 処理を呼び出すとクラッキングノイズのようなものが混ざるため、 AudioConverterConvertBuffer を使用する
@@ -220,14 +276,17 @@ static void audio_file_stream_packets(void *inClientData, UInt32 inNumberBytes,
   {
     UInt32 frameCount = inNumberBytes / pData->inputFormat.mBytesPerFrame;
     UInt32 bufferOutSize = pData->outputFormat.mBytesPerFrame * frameCount;
-    void *pBufferOut = malloc(bufferOutSize);
+    void *pBufferOut = ca_arena_alloc(&pData->scratch, bufferOutSize);
+    if (pBufferOut == NULL)
+    {
+      return;
+    }
+
     result = osstatus_to_result(AudioConverterConvertBuffer(pData->pAudioConverter, inNumberBytes, pBufferIn, &bufferOutSize, pBufferOut));
     if (result == ca_result_success)
     {
       pData->decodedFunc(bufferOutSize / pData->outputFormat.mBytesPerFrame, pBufferOut, pStream->pUserData);
     }
-
-    free(pBufferOut);
   }
   else
   {
@@ -239,31 +298,22 @@ static void audio_file_stream_packets(void *inClientData, UInt32 inNumberBytes,
       pData->input.packetDescriptions = inPacketDescriptions;
     }
 
-    UInt32 maxOutputPacketSize;
-    result = get_converter_property(pStream, kAudioConverterPropertyMaximumOutputPacketSize, sizeof(UInt32), &maxOutputPacketSize);
-    if (result != ca_result_success)
+    UInt32 maxOutputPacketSize = pData->maxOutputPacketSize;
+    UInt32 bufferOutSize = pData->bufferOutSize;
+    UInt32 maxDecodeSize = pData->maxDecodeSize;
+    void *pBufferOut = ca_arena_alloc(&pData->scratch, bufferOutSize);
+    void *pDecodedOut = ca_arena_alloc(&pData->scratch, maxDecodeSize);
+    if (pBufferOut == NULL || pDecodedOut == NULL)
     {
       return;
     }
 
-    UInt32 minBufferSize = 0;
-    result = get_converter_property(pStream, kAudioConverterPropertyMinimumOutputBufferSize, sizeof(UInt32), &minBufferSize);
-    if (result != ca_result_success && result != kAudioConverterErr_PropertyNotSupported)
-    {
-      return;
-    }
-
-    UInt32 bufferOutSize = ca_max(maxOutputPacketSize * pData->outputFormat.mBytesPerPacket, minBufferSize);
-    void *pBufferOut = malloc(bufferOutSize);
-
     AudioBufferList outBufferList;
     outBufferList.mNumberBuffers = 1;
     outBufferList.mBuffers[0].mDataByteSize = bufferOutSize;
     outBufferList.mBuffers[0].mNumberChannels = pData->outputFormat.mChannelsPerFrame;
     outBufferList.mBuffers[0].mData = pBufferOut;
 
-    UInt32 maxDecodeSize = maxOutputPacketSize * pData->outputFormat.mBytesPerPacket * PACKET_AGGREGATION_COUNT;
-    void *pDecodedOut = malloc(maxDecodeSize);
     UInt32 decodedSize = 0;
 
     while (CA_TRUE)
@@ -291,12 +341,7 @@ static void audio_file_stream_packets(void *inClientData, UInt32 inNumberBytes,
     {
       pData->decodedFunc(decodedSize / pData->outputFormat.mBytesPerFrame, pDecodedOut, pStream->pUserData);
     }
-
-    free(pBufferOut);
-    free(pDecodedOut);
   }
-
-  free(pBufferIn);
 }
 
 static ca_result audio_file_stream_parse_bytes(audio_file_stream *pStream, ca_uint32 *pBytesRead)
@@ -388,8 +433,6 @@ ca_result audio_file_stream_init(audio_file_stream *pStream, ca_decoder_config c
   pStream->pData = pData;
   pStream->pUserData = pUserData;
 
-  pData->pStreamId = malloc(sizeof(AudioFileStreamID));
-  pData->pAudioConverter = malloc(sizeof(AudioConverterRef));
   pData->readFunc = pReadProc;
   pData->seekFunc = pSeekProc;
   pData->tellFunc = pTellProc;
@@ -453,6 +496,85 @@ ca_result audio_file_stream_get_format(audio_file_stream *pStream, audio_file_st
   return result;
 }
 
+// Returns the layout of the decoded frames, which the converter knows best once it exists. Tagged layouts are expanded into channel descriptions.
+static AudioChannelLayout *audio_file_stream_copy_channel_layout(audio_file_stream *pStream)
+{
+  audio_file_stream_data *pData = (audio_file_stream_data *)pStream->pData;
+  UInt32 size = 0;
+  AudioChannelLayout *pLayout = NULL;
+  if (pData->isAudioConverterReady && AudioConverterGetPropertyInfo(pData->pAudioConverter, kAudioConverterOutputChannelLayout, &size, NULL) == noErr && size >= sizeof(AudioChannelLayout))
+  {
+    pLayout = (AudioChannelLayout *)malloc(size);
+    if (pLayout != NULL && AudioConverterGetProperty(pData->pAudioConverter, kAudioConverterOutputChannelLayout, &size, pLayout) != noErr)
+    {
+      free(pLayout);
+      pLayout = NULL;
+    }
+  }
+
+  if (pLayout == NULL && AudioFileStreamGetPropertyInfo(pData->pStreamId, kAudioFileStreamProperty_ChannelLayout, &size, NULL) == noErr && size >= sizeof(AudioChannelLayout))
+  {
+    pLayout = (AudioChannelLayout *)malloc(size);
+    if (pLayout != NULL && AudioFileStreamGetProperty(pData->pStreamId, kAudioFileStreamProperty_ChannelLayout, &size, pLayout) != noErr)
+    {
+      free(pLayout);
+      pLayout = NULL;
+    }
+  }
+
+  if (pLayout == NULL || pLayout->mChannelLayoutTag == kAudioChannelLayoutTag_UseChannelDescriptions || pLayout->mChannelLayoutTag == kAudioChannelLayoutTag_UseChannelBitmap)
+  {
+    return pLayout;
+  }
+
+  AudioChannelLayoutTag tag = pLayout->mChannelLayoutTag;
+  free(pLayout);
+  if (AudioFormatGetPropertyInfo(kAudioFormatProperty_ChannelLayoutForTag, sizeof(tag), &tag, &size) != noErr || size < sizeof(AudioChannelLayout))
+  {
+    return NULL;
+  }
+
+  pLayout = (AudioChannelLayout *)malloc(size);
+  if (pLayout != NULL && AudioFormatGetProperty(kAudioFormatProperty_ChannelLayoutForTag, sizeof(tag), &tag, &size, pLayout) != noErr)
+  {
+    free(pLayout);
+    pLayout = NULL;
+  }
+  return pLayout;
+}
+
+ca_result audio_file_stream_get_channel_map(audio_file_stream *pStream, ca_uint32 channels, ca_channel *pChannelMap)
+{
+  ca_get_standard_channel_map(pChannelMap, channels);
+  AudioChannelLayout *pLayout = audio_file_stream_copy_channel_layout(pStream);
+  if (pLayout == NULL)
+  {
+    return ca_result_success;
+  }
+
+  ca_channel channelMap[CA_MAX_CHANNELS];
+  ca_bool isMapped = CA_FALSE;
+  if (pLayout->mChannelLayoutTag == kAudioChannelLayoutTag_UseChannelBitmap)
+  {
+    isMapped = ca_channel_map_from_mask(channelMap, channels, pLayout->mChannelBitmap);
+  }
+  else if (pLayout->mNumberChannelDescriptions == channels)
+  {
+    for (ca_uint32 i = 0; i < channels; i++)
+    {
+      channelMap[i] = ca_channel_from_apple_label(pLayout->mChannelDescriptions[i].mChannelLabel);
+    }
+    isMapped = ca_channel_map_is_positioned(channelMap, channels);
+  }
+
+  if (isMapped)
+  {
+    memcpy(pChannelMap, channelMap, channels);
+  }
+  free(pLayout);
+  return ca_result_success;
+}
+
 ca_result audio_file_stream_decode_next(audio_file_stream *pStream)
 {
   ca_uint32 bytesRead = DECODE_SIZE;
@@ -503,6 +625,14 @@ ca_result audio_file_stream_seek(audio_file_stream *pStream, ca_uint64 frameInde
   return ca_result_success;
 }
 
+ca_result audio_file_stream_seek_sync(audio_file_stream *pStream, ca_uint64 frameIndex, ca_uint64 *pFrameIndex)
+{
+  audio_file_stream_data *pData = (audio_file_stream_data *)pStream->pData;
+  ca_uint64 framesPerPacket = ca_max((ca_uint64)pData->inputFormat.mFramesPerPacket, (ca_uint64)1);
+  *pFrameIndex = frameIndex / framesPerPacket * framesPerPacket;
+  return audio_file_stream_seek(pStream, frameIndex);
+}
+
 ca_result audio_file_stream_get_eof(audio_file_stream *pStream, ca_bool *pIsEOF)
 {
   audio_file_stream_data *pData = (audio_file_stream_data *)pStream->pData;
@@ -544,6 +674,7 @@ ca_result audio_file_stream_uninit(audio_file_stream *pStream)
   if (pData->isAudioConverterReady)
   {
     result = osstatus_to_result(AudioConverterDispose(pData->pAudioConverter));
+    ca_arena_uninit(&pData->scratch);
   }
 
   free(pData);
@@ -1,4 +1,5 @@
 #pragma once
+#include "../ca_channel_mixer.h"
 #include "../ca_decoder.h"
 
 typedef struct
@@ -21,10 +22,16 @@ ca_result audio_file_stream_init(audio_file_stream *pStream, ca_decoder_config c
 
 ca_result audio_file_stream_get_format(audio_file_stream *pStream, audio_file_stream_format *pFormat);
 
+// Fills one position per channel from the channel layout of the decoded frames, or the standard map when the stream has none.
+ca_result audio_file_stream_get_channel_map(audio_file_stream *pStream, ca_uint32 channels, ca_channel *pChannelMap);
+
 ca_result audio_file_stream_decode_next(audio_file_stream *pStream);
 
 ca_result audio_file_stream_seek(audio_file_stream *pStream, ca_uint64 frameIndex);
 
+// AudioFileStream seeks by packet, so this is the same seek. pFrameIndex receives the first frame of the packet decoded next.
+ca_result audio_file_stream_seek_sync(audio_file_stream *pStream, ca_uint64 frameIndex, ca_uint64 *pFrameIndex);
+
 ca_result audio_file_stream_get_eof(audio_file_stream *pStream, ca_bool *pIsEOF);
 
 ca_result audio_file_stream_uninit(audio_file_stream *pStream);